@@ -0,0 +1,322 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+/* By default, the library allocates memory with malloc(), but an
+ * application may substitute its own allocator with sql_set_allocator()
+ * before any connections have been established. The allocator is used for
+ * the objects which the library owns (connections, statements, fields and
+ * their bookkeeping, the statement cache and compiled format strings), and
+ * by SQLite, but not by the PostgreSQL or MySQL client libraries, nor for
+ * buffers which are handed over to the caller.
+ *
+ * Statements and fields are allocated from per-connection slabs, so that
+ * once a connection has warmed up, executing a query doesn't need to call
+ * the allocator at all for them. Objects are only allocated by the thread
+ * using the connection, but may be returned by any thread (for example,
+ * when a consumer releases an Arrow stream), so they are returned to a
+ * lock-free list which the allocating thread takes over in its entirety
+ * once its own free list is exhausted. A slab can be destroyed while
+ * objects allocated from it are still in use, in which case it is freed
+ * once the last of them has been returned: the slab holds a reference on
+ * itself, as does each outstanding object, and whichever thread releases
+ * the last reference frees it.
+ */
+
+/* Number of objects in each block allocated by a slab */
+#define SQL_SLAB_BLOCK_COUNT           16
+
+/* Alignment of objects allocated from a slab */
+#define SQL_SLAB_ALIGN                 16
+
+typedef struct sql_slab_block_struct SQL_SLAB_BLOCK;
+
+struct sql_slab_block_struct
+{
+	SQL_SLAB_BLOCK *next;
+};
+
+struct sql_slab_struct
+{
+	size_t size;
+	SQL_SLAB_BLOCK *blocks;
+	/* Only used by the allocating thread */
+	void *free;
+	/* Objects which have been returned, by any thread */
+	void *returned;
+	size_t refs;
+};
+
+static void sql_slab_release_(SQL_SLAB *slab);
+
+static pthread_mutex_t sql_allocator_lock = PTHREAD_MUTEX_INITIALIZER;
+static SQL_ALLOCATOR sql_allocator;
+static int sql_allocator_inuse;
+
+/* Replace the memory allocation functions used by the library; must be
+ * invoked before the library first allocates memory, which it may do
+ * before any connections are established (for example, in
+ * sql_logger_start()). Passing NULL restores the default allocator.
+ */
+int
+sql_set_allocator(const SQL_ALLOCATOR *allocator)
+{
+	pthread_mutex_lock(&sql_allocator_lock);
+	if(sql_allocator_inuse)
+	{
+		pthread_mutex_unlock(&sql_allocator_lock);
+		sql_set_error_("HY010", "The allocator cannot be changed once memory has been allocated");
+		errno = EBUSY;
+		return -1;
+	}
+	if(allocator && (!allocator->allocate || !allocator->reallocate || !allocator->deallocate))
+	{
+		pthread_mutex_unlock(&sql_allocator_lock);
+		sql_set_error_("HY009", "An allocator must provide all of its functions");
+		errno = EINVAL;
+		return -1;
+	}
+	if(allocator)
+	{
+		sql_allocator = *allocator;
+	}
+	else
+	{
+		memset(&sql_allocator, 0, sizeof(SQL_ALLOCATOR));
+	}
+	pthread_mutex_unlock(&sql_allocator_lock);
+	return 0;
+}
+
+/* Prevent the allocator from being changed; invoked before a connection
+ * is created, and by the first allocation the library makes, so that
+ * memory is never released through a different allocator from the one
+ * which allocated it. Returns 1 if a custom allocator is in effect.
+ */
+int
+sql_allocator_lock_(void)
+{
+	int r;
+
+	pthread_mutex_lock(&sql_allocator_lock);
+	__atomic_store_n(&sql_allocator_inuse, 1, __ATOMIC_RELEASE);
+	r = (sql_allocator.allocate != NULL);
+	pthread_mutex_unlock(&sql_allocator_lock);
+	return r;
+}
+
+void *
+sql_malloc_(size_t size)
+{
+	if(!__atomic_load_n(&sql_allocator_inuse, __ATOMIC_ACQUIRE))
+	{
+		sql_allocator_lock_();
+	}
+	if(sql_allocator.allocate)
+	{
+		return sql_allocator.allocate(size, sql_allocator.data);
+	}
+	return malloc(size);
+}
+
+void *
+sql_calloc_(size_t nmemb, size_t size)
+{
+	void *p;
+
+	if(!__atomic_load_n(&sql_allocator_inuse, __ATOMIC_ACQUIRE))
+	{
+		sql_allocator_lock_();
+	}
+	if(!sql_allocator.allocate)
+	{
+		return calloc(nmemb, size);
+	}
+	if(size && nmemb > (size_t) -1 / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	p = sql_allocator.allocate(nmemb * size, sql_allocator.data);
+	if(p)
+	{
+		memset(p, 0, nmemb * size);
+	}
+	return p;
+}
+
+void *
+sql_realloc_(void *ptr, size_t size)
+{
+	if(!__atomic_load_n(&sql_allocator_inuse, __ATOMIC_ACQUIRE))
+	{
+		sql_allocator_lock_();
+	}
+	if(sql_allocator.reallocate)
+	{
+		return sql_allocator.reallocate(ptr, size, sql_allocator.data);
+	}
+	return realloc(ptr, size);
+}
+
+void
+sql_free_(void *ptr)
+{
+	if(!ptr)
+	{
+		return;
+	}
+	if(sql_allocator.deallocate)
+	{
+		sql_allocator.deallocate(ptr, sql_allocator.data);
+		return;
+	}
+	free(ptr);
+}
+
+char *
+sql_strdup_(const char *str)
+{
+	char *p;
+	size_t len;
+
+	len = strlen(str) + 1;
+	p = (char *) sql_malloc_(len);
+	if(p)
+	{
+		memcpy(p, str, len);
+	}
+	return p;
+}
+
+/* Create a slab of objects of a particular size */
+SQL_SLAB *
+sql_slab_create_(size_t size)
+{
+	SQL_SLAB *slab;
+
+	slab = (SQL_SLAB *) sql_calloc_(1, sizeof(SQL_SLAB));
+	if(!slab)
+	{
+		return NULL;
+	}
+	if(size < sizeof(void *))
+	{
+		size = sizeof(void *);
+	}
+	slab->size = ((size + SQL_SLAB_ALIGN - 1) / SQL_SLAB_ALIGN) * SQL_SLAB_ALIGN;
+	slab->refs = 1;
+	return slab;
+}
+
+/* Destroy a slab, or arrange for it to be destroyed once all of the
+ * objects allocated from it have been freed
+ */
+void
+sql_slab_destroy_(SQL_SLAB *slab)
+{
+	if(!slab)
+	{
+		return;
+	}
+	if(!__atomic_sub_fetch(&(slab->refs), 1, __ATOMIC_ACQ_REL))
+	{
+		sql_slab_release_(slab);
+	}
+}
+
+/* Allocate a zero-filled object from a slab */
+void *
+sql_slab_alloc_(SQL_SLAB *slab)
+{
+	SQL_SLAB_BLOCK *block;
+	char *p;
+	size_t c;
+
+	if(!slab->free)
+	{
+		slab->free = __atomic_exchange_n(&(slab->returned), NULL, __ATOMIC_ACQUIRE);
+	}
+	if(!slab->free)
+	{
+		block = (SQL_SLAB_BLOCK *) sql_malloc_(SQL_SLAB_ALIGN + slab->size * SQL_SLAB_BLOCK_COUNT);
+		if(!block)
+		{
+			return NULL;
+		}
+		block->next = slab->blocks;
+		slab->blocks = block;
+		/* Thread the new objects onto the free list */
+		p = (char *) block + SQL_SLAB_ALIGN;
+		for(c = 0; c < SQL_SLAB_BLOCK_COUNT; c++)
+		{
+			*((void **) (void *) p) = slab->free;
+			slab->free = p;
+			p += slab->size;
+		}
+	}
+	p = (char *) slab->free;
+	slab->free = *((void **) (void *) p);
+	__atomic_add_fetch(&(slab->refs), 1, __ATOMIC_RELAXED);
+	memset(p, 0, slab->size);
+	return p;
+}
+
+/* Return an object to the slab it was allocated from; may be invoked by
+ * any thread
+ */
+void
+sql_slab_free_(SQL_SLAB *slab, void *ptr)
+{
+	void *head;
+
+	if(!ptr)
+	{
+		return;
+	}
+	head = __atomic_load_n(&(slab->returned), __ATOMIC_RELAXED);
+	do
+	{
+		*((void **) ptr) = head;
+	}
+	while(!__atomic_compare_exchange_n(&(slab->returned), &head, ptr, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	if(!__atomic_sub_fetch(&(slab->refs), 1, __ATOMIC_ACQ_REL))
+	{
+		sql_slab_release_(slab);
+	}
+}
+
+static void
+sql_slab_release_(SQL_SLAB *slab)
+{
+	SQL_SLAB_BLOCK *block;
+
+	while(slab->blocks)
+	{
+		block = slab->blocks;
+		slab->blocks = block->next;
+		sql_free_(block);
+	}
+	sql_free_(slab);
+}
@@ -0,0 +1,394 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+#include "libsql-arrow.h"
+
+/* Result-sets are exported as a stream of struct arrays, one child array
+ * per column, built from batches fetched with sql_stmt_fetch_batch(). The
+ * buffers of each batch are handed over to the Arrow arrays rather than
+ * being copied: integers become int64 ("l"), reals float64 ("g"), blobs
+ * large binary ("Z") and everything else large UTF-8 strings ("U").
+ * Booleans are stored as int64 in a batch, and so are packed into a bitmap
+ * to become Arrow booleans ("b").
+ */
+
+typedef struct
+{
+	SQL_STATEMENT *stmt;
+	size_t batch_rows;
+	SQL_BATCH batch;
+	unsigned int ncolumns;
+	char **names;
+	SQL_FIELD_TYPE *types;
+	char error[512];
+} SQL_ARROW_STREAM;
+
+/* The buffers owned by an exported column array */
+typedef struct
+{
+	const void *buffers[3];
+	void *owned[3];
+} SQL_ARROW_BUFFERS;
+
+static int sql_arrow_get_schema_(struct ArrowArrayStream *restrict stream, struct ArrowSchema *restrict out);
+static int sql_arrow_get_next_(struct ArrowArrayStream *restrict stream, struct ArrowArray *restrict out);
+static const char *sql_arrow_get_last_error_(struct ArrowArrayStream *stream);
+static void sql_arrow_release_stream_(struct ArrowArrayStream *stream);
+static void sql_arrow_release_schema_(struct ArrowSchema *schema);
+static void sql_arrow_release_array_(struct ArrowArray *array);
+static void sql_arrow_release_column_(struct ArrowArray *array);
+static int sql_arrow_column_(SQL_BATCH *restrict batch, unsigned int col, struct ArrowArray *restrict out);
+static const char *sql_arrow_format_(SQL_FIELD_TYPE type);
+
+int
+sql_stmt_export_arrow(SQL_STATEMENT *restrict stmt, size_t batch_rows, struct ArrowSchema *restrict schema, struct ArrowArrayStream *restrict stream)
+{
+	SQL_ARROW_STREAM *p;
+	SQL_FIELD *field;
+	SQL *sql;
+	const char *name;
+	unsigned int c;
+
+	sql = stmt->api->connection(stmt);
+	memset(stream, 0, sizeof(struct ArrowArrayStream));
+	p = (SQL_ARROW_STREAM *) calloc(1, sizeof(SQL_ARROW_STREAM));
+	if(!p)
+	{
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		return -1;
+	}
+	stmt->api->addref(stmt);
+	p->stmt = stmt;
+	p->batch_rows = batch_rows ? batch_rows : SQL_ARROW_BATCH_ROWS;
+	stream->get_schema = sql_arrow_get_schema_;
+	stream->get_next = sql_arrow_get_next_;
+	stream->get_last_error = sql_arrow_get_last_error_;
+	stream->release = sql_arrow_release_stream_;
+	stream->private_data = p;
+	/* The column types are fixed by the first batch, which is fetched up
+	 * front so that the schema reflects them
+	 */
+	if(sql_stmt_fetch_batch(stmt, p->batch_rows, &(p->batch)) < 0)
+	{
+		stream->release(stream);
+		return -1;
+	}
+	p->ncolumns = stmt->api->columns(stmt);
+	p->names = (char **) calloc(p->ncolumns + 1, sizeof(char *));
+	p->types = (SQL_FIELD_TYPE *) calloc(p->ncolumns + 1, sizeof(SQL_FIELD_TYPE));
+	if(!p->names || !p->types)
+	{
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		stream->release(stream);
+		return -1;
+	}
+	for(c = 0; c < p->ncolumns; c++)
+	{
+		p->types[c] = p->batch.columns[c].type;
+		field = stmt->api->field(stmt, c);
+		name = field ? field->api->name(field) : NULL;
+		p->names[c] = strdup(name ? name : "");
+		if(field)
+		{
+			field->api->release(field);
+		}
+		if(!p->names[c])
+		{
+			sql->api->set_error(sql, "58000", "Memory allocation error");
+			stream->release(stream);
+			return -1;
+		}
+	}
+	if(schema && sql_arrow_get_schema_(stream, schema))
+	{
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		stream->release(stream);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+sql_arrow_get_schema_(struct ArrowArrayStream *restrict stream, struct ArrowSchema *restrict out)
+{
+	SQL_ARROW_STREAM *p;
+	struct ArrowSchema *children;
+	unsigned int c;
+	size_t len;
+	char *names;
+
+	p = (SQL_ARROW_STREAM *) stream->private_data;
+	memset(out, 0, sizeof(struct ArrowSchema));
+	/* The schema may outlive the stream, and so its private data is a
+	 * single allocation holding the child pointers, followed by the
+	 * children themselves, followed by copies of the column names
+	 */
+	len = (p->ncolumns + 1) * (sizeof(struct ArrowSchema *) + sizeof(struct ArrowSchema));
+	for(c = 0; c < p->ncolumns; c++)
+	{
+		len += strlen(p->names[c]) + 1;
+	}
+	out->private_data = calloc(1, len);
+	if(!out->private_data)
+	{
+		strcpy(p->error, "Memory allocation error");
+		return ENOMEM;
+	}
+	out->format = "+s";
+	out->name = "";
+	out->n_children = p->ncolumns;
+	out->children = (struct ArrowSchema **) out->private_data;
+	out->release = sql_arrow_release_schema_;
+	children = (struct ArrowSchema *) &(out->children[p->ncolumns + 1]);
+	names = (char *) &(children[p->ncolumns + 1]);
+	for(c = 0; c < p->ncolumns; c++)
+	{
+		strcpy(names, p->names[c]);
+		children[c].format = sql_arrow_format_(p->types[c]);
+		children[c].name = names;
+		names = strchr(names, 0) + 1;
+		children[c].flags = ARROW_FLAG_NULLABLE;
+		children[c].release = sql_arrow_release_schema_;
+		out->children[c] = &(children[c]);
+	}
+	return 0;
+}
+
+static int
+sql_arrow_get_next_(struct ArrowArrayStream *restrict stream, struct ArrowArray *restrict out)
+{
+	SQL_ARROW_STREAM *p;
+	struct ArrowArray *children;
+	SQL *sql;
+	unsigned int c;
+
+	p = (SQL_ARROW_STREAM *) stream->private_data;
+	memset(out, 0, sizeof(struct ArrowArray));
+	if(!p->batch.rows)
+	{
+		/* The previous batch has been exported; fetch the next one */
+		if(sql_stmt_fetch_batch(p->stmt, p->batch_rows, &(p->batch)) < 0)
+		{
+			sql = p->stmt->api->connection(p->stmt);
+			strncpy(p->error, sql->api->error(sql), sizeof(p->error) - 1);
+			return EIO;
+		}
+		if(!p->batch.rows)
+		{
+			/* End of stream */
+			return 0;
+		}
+	}
+	out->private_data = calloc(p->ncolumns + 1, sizeof(struct ArrowArray *) + sizeof(struct ArrowArray));
+	out->buffers = (const void **) calloc(1, sizeof(void *));
+	if(!out->private_data || !out->buffers)
+	{
+		free(out->private_data);
+		free(out->buffers);
+		strcpy(p->error, "Memory allocation error");
+		return ENOMEM;
+	}
+	out->length = p->batch.rows;
+	out->n_buffers = 1;
+	out->n_children = p->ncolumns;
+	out->children = (struct ArrowArray **) out->private_data;
+	out->release = sql_arrow_release_array_;
+	children = (struct ArrowArray *) &(out->children[p->ncolumns + 1]);
+	for(c = 0; c < p->ncolumns; c++)
+	{
+		out->children[c] = &(children[c]);
+		if(sql_arrow_column_(&(p->batch), c, &(children[c])))
+		{
+			/* Some of the batch's buffers have been taken, so it can't
+			 * be exported again
+			 */
+			p->batch.rows = 0;
+			out->release(out);
+			strcpy(p->error, "Memory allocation error");
+			return ENOMEM;
+		}
+	}
+	p->batch.rows = 0;
+	return 0;
+}
+
+static const char *
+sql_arrow_get_last_error_(struct ArrowArrayStream *stream)
+{
+	SQL_ARROW_STREAM *p;
+
+	p = (SQL_ARROW_STREAM *) stream->private_data;
+	return p->error[0] ? p->error : NULL;
+}
+
+static void
+sql_arrow_release_stream_(struct ArrowArrayStream *stream)
+{
+	SQL_ARROW_STREAM *p;
+	unsigned int c;
+
+	p = (SQL_ARROW_STREAM *) stream->private_data;
+	if(p->names)
+	{
+		for(c = 0; c < p->ncolumns; c++)
+		{
+			free(p->names[c]);
+		}
+		free(p->names);
+	}
+	free(p->types);
+	sql_batch_free(&(p->batch));
+	sql_stmt_destroy(p->stmt);
+	free(p);
+	stream->release = NULL;
+}
+
+static void
+sql_arrow_release_schema_(struct ArrowSchema *schema)
+{
+	/* Children are released along with their parent */
+	free(schema->private_data);
+	schema->release = NULL;
+}
+
+static void
+sql_arrow_release_array_(struct ArrowArray *array)
+{
+	int64_t c;
+
+	for(c = 0; c < array->n_children; c++)
+	{
+		if(array->children[c]->release)
+		{
+			array->children[c]->release(array->children[c]);
+		}
+	}
+	free(array->private_data);
+	free(array->buffers);
+	array->release = NULL;
+}
+
+static void
+sql_arrow_release_column_(struct ArrowArray *array)
+{
+	SQL_ARROW_BUFFERS *buffers;
+
+	buffers = (SQL_ARROW_BUFFERS *) array->private_data;
+	free(buffers->owned[0]);
+	free(buffers->owned[1]);
+	free(buffers->owned[2]);
+	free(buffers);
+	array->release = NULL;
+}
+
+/* Populate a child array by taking over the buffers of a batch column */
+static int
+sql_arrow_column_(SQL_BATCH *restrict batch, unsigned int col, struct ArrowArray *restrict out)
+{
+	SQL_BATCH_COLUMN *column;
+	SQL_ARROW_BUFFERS *buffers;
+	uint8_t *bits;
+	size_t r;
+
+	column = &(batch->columns[col]);
+	buffers = (SQL_ARROW_BUFFERS *) calloc(1, sizeof(SQL_ARROW_BUFFERS));
+	if(!buffers)
+	{
+		return -1;
+	}
+	out->length = batch->rows;
+	out->null_count = column->nulls;
+	out->n_buffers = 2;
+	out->buffers = buffers->buffers;
+	out->private_data = buffers;
+	out->release = sql_arrow_release_column_;
+	buffers->owned[0] = column->validity;
+	column->validity = NULL;
+	switch(column->type)
+	{
+	case SQL_TYPE_INTEGER:
+		buffers->owned[1] = column->ints;
+		column->ints = NULL;
+		break;
+	case SQL_TYPE_REAL:
+		buffers->owned[1] = column->reals;
+		column->reals = NULL;
+		break;
+	case SQL_TYPE_BOOLEAN:
+		bits = (uint8_t *) calloc((batch->rows / 8) + 1, 1);
+		if(!bits)
+		{
+			return -1;
+		}
+		for(r = 0; r < batch->rows; r++)
+		{
+			if(column->ints[r])
+			{
+				bits[r / 8] |= (1 << (r % 8));
+			}
+		}
+		buffers->owned[1] = bits;
+		break;
+	default:
+		out->n_buffers = 3;
+		buffers->owned[1] = column->offsets;
+		column->offsets = NULL;
+		if(!column->data)
+		{
+			/* The data buffer must be present even if it's empty */
+			column->data = (char *) malloc(1);
+			if(!column->data)
+			{
+				return -1;
+			}
+		}
+		buffers->owned[2] = column->data;
+		column->data = NULL;
+		column->dataalloc = 0;
+		column->datalen = 0;
+		break;
+	}
+	buffers->buffers[0] = buffers->owned[0];
+	buffers->buffers[1] = buffers->owned[1];
+	buffers->buffers[2] = buffers->owned[2];
+	return 0;
+}
+
+static const char *
+sql_arrow_format_(SQL_FIELD_TYPE type)
+{
+	switch(type)
+	{
+	case SQL_TYPE_INTEGER:
+		return "l";
+	case SQL_TYPE_REAL:
+		return "g";
+	case SQL_TYPE_BOOLEAN:
+		return "b";
+	case SQL_TYPE_BLOB:
+		return "Z";
+	default:
+		return "U";
+	}
+}
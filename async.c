@@ -0,0 +1,68 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+/* Asynchronous queries allow an application to issue a query and carry on
+ * with other work (typically servicing an event loop) while it executes.
+ * Only one asynchronous query may be outstanding on a connection at a time,
+ * and the connection must not otherwise be used until its result has been
+ * collected with sql_result().
+ */
+
+/* Begin executing a query, returning without waiting for it to complete */
+int
+sql_query_async(SQL *restrict sql, const char *restrict query)
+{
+	return sql->api->query_async(sql, query);
+}
+
+/* Check whether the outstanding asynchronous query has completed, without
+ * blocking; returns 1 if the result is ready, 0 if the query is still
+ * executing, or -1 on error
+ */
+int
+sql_poll(SQL *sql)
+{
+	return sql->api->poll(sql);
+}
+
+/* Obtain the result of the outstanding asynchronous query, blocking until
+ * it has completed if necessary; the result-set must be freed with
+ * sql_stmt_destroy()
+ */
+SQL_STATEMENT *
+sql_result(SQL *sql)
+{
+	return sql->api->result(sql);
+}
+
+/* Obtain a file descriptor which becomes readable when sql_poll() should
+ * be invoked, suitable for use with poll(), select() or epoll; returns -1
+ * if one is not available
+ */
+int
+sql_socket(SQL *sql)
+{
+	return sql->api->socket(sql);
+}
@@ -0,0 +1,270 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+/* Batches hold a number of rows of a result-set in column-major form:
+ * integer and boolean columns are stored as arrays of int64_t, real
+ * columns as arrays of double, blobs as their raw bytes, and everything
+ * else as text, with the values of each column stored contiguously in a
+ * single buffer and
+ * delimited by an array of (rows + 1) offsets. Each column has a validity
+ * bitmap, in which the bit for a row (least-significant bit first) is set
+ * if the value is not NULL.
+ *
+ * Engines populate batches natively, without going through the statement
+ * API for each value.
+ */
+
+static int sql_batch_columns_(SQL_STATEMENT *restrict stmt, SQL_BATCH *restrict batch, unsigned int ncolumns);
+static int sql_batch_prepare_(SQL_BATCH_COLUMN *column, size_t capacity);
+
+/* Fetch up to max_rows rows, beginning with the current row, into a batch,
+ * which must be zero-filled before it is first used and can be re-used by
+ * subsequent calls for the same statement. The column types are determined
+ * by the first call. Returns the number of rows fetched, which is zero once
+ * there are no more rows, or -1 on error.
+ */
+int
+sql_stmt_fetch_batch(SQL_STATEMENT *restrict stmt, size_t max_rows, SQL_BATCH *restrict batch)
+{
+	SQL *sql;
+	SQL_TRACE_STATE state;
+	unsigned int c, ncolumns;
+	int r;
+
+	sql = stmt->api->connection(stmt);
+	ncolumns = stmt->api->columns(stmt);
+	if(batch->ncolumns != ncolumns && sql_batch_columns_(stmt, batch, ncolumns))
+	{
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		return -1;
+	}
+	if(max_rows > batch->capacity)
+	{
+		batch->capacity = max_rows;
+	}
+	batch->rows = 0;
+	for(c = 0; c < ncolumns; c++)
+	{
+		if(sql_batch_prepare_(&(batch->columns[c]), batch->capacity))
+		{
+			sql->api->set_error(sql, "58000", "Memory allocation error");
+			return -1;
+		}
+	}
+	if(!max_rows || stmt->api->eof(stmt))
+	{
+		return 0;
+	}
+	/* Batches are reported individually, after any rows which have already
+	 * been fetched with sql_stmt_next()
+	 */
+	sql_trace_fetched_(stmt, 0);
+	sql_trace_start_(sql, &state, SQL_STATS_FETCH, stmt->api->statement(stmt));
+	state.fingerprint = stmt->fingerprint;
+	r = stmt->api->fetch_batch(stmt, max_rows, batch);
+	sql_trace_finish_(sql, &state, (r < 0 ? -1 : 0), 0);
+	return r;
+}
+
+/* Free the buffers used by a batch */
+void
+sql_batch_free(SQL_BATCH *batch)
+{
+	unsigned int c;
+
+	for(c = 0; c < batch->ncolumns; c++)
+	{
+		free(batch->columns[c].validity);
+		free(batch->columns[c].ints);
+		free(batch->columns[c].reals);
+		free(batch->columns[c].offsets);
+		free(batch->columns[c].data);
+	}
+	free(batch->columns);
+	memset(batch, 0, sizeof(SQL_BATCH));
+}
+
+/* Store the value of a column in the current row of a batch; integer and
+ * real values are converted from text if the engine can't supply them
+ * natively. The value must be nul-terminated, although the terminator
+ * is not counted in len. Returns -1 if memory could not be allocated.
+ */
+int
+sql_batch_text_(SQL_BATCH *restrict batch, unsigned int col, const char *restrict value, size_t len)
+{
+	SQL_BATCH_COLUMN *column;
+	size_t alloc;
+	char *p;
+
+	column = &(batch->columns[col]);
+	switch(column->type)
+	{
+	case SQL_TYPE_INTEGER:
+		sql_batch_int64_(batch, col, strtoll(value, NULL, 10));
+		return 0;
+	case SQL_TYPE_BOOLEAN:
+		sql_batch_int64_(batch, col, sql_parse_boolean_(value));
+		return 0;
+	case SQL_TYPE_REAL:
+		sql_batch_real_(batch, col, strtod(value, NULL));
+		return 0;
+	default:
+		break;
+	}
+	if(!column->data || column->datalen + len > column->dataalloc)
+	{
+		alloc = (column->data && column->dataalloc) ? column->dataalloc : 4096;
+		while(alloc < column->datalen + len)
+		{
+			alloc *= 2;
+		}
+		p = (char *) realloc(column->data, alloc);
+		if(!p)
+		{
+			return -1;
+		}
+		column->data = p;
+		column->dataalloc = alloc;
+	}
+	memcpy(&(column->data[column->datalen]), value, len);
+	column->datalen += len;
+	column->offsets[batch->rows + 1] = column->datalen;
+	column->validity[batch->rows / 8] |= (1 << (batch->rows % 8));
+	return 0;
+}
+
+void
+sql_batch_int64_(SQL_BATCH *batch, unsigned int col, int64_t value)
+{
+	batch->columns[col].ints[batch->rows] = value;
+	batch->columns[col].validity[batch->rows / 8] |= (1 << (batch->rows % 8));
+}
+
+void
+sql_batch_real_(SQL_BATCH *batch, unsigned int col, double value)
+{
+	batch->columns[col].reals[batch->rows] = value;
+	batch->columns[col].validity[batch->rows / 8] |= (1 << (batch->rows % 8));
+}
+
+void
+sql_batch_null_(SQL_BATCH *batch, unsigned int col)
+{
+	SQL_BATCH_COLUMN *column;
+
+	column = &(batch->columns[col]);
+	switch(column->type)
+	{
+	case SQL_TYPE_INTEGER:
+	case SQL_TYPE_BOOLEAN:
+		column->ints[batch->rows] = 0;
+		break;
+	case SQL_TYPE_REAL:
+		column->reals[batch->rows] = 0;
+		break;
+	default:
+		column->offsets[batch->rows + 1] = column->datalen;
+		break;
+	}
+	column->nulls++;
+}
+
+/* Set up the columns of a batch for a statement's result-set */
+static int
+sql_batch_columns_(SQL_STATEMENT *restrict stmt, SQL_BATCH *restrict batch, unsigned int ncolumns)
+{
+	SQL_FIELD *field;
+	unsigned int c;
+
+	sql_batch_free(batch);
+	batch->columns = (SQL_BATCH_COLUMN *) calloc(ncolumns + 1, sizeof(SQL_BATCH_COLUMN));
+	if(!batch->columns)
+	{
+		return -1;
+	}
+	batch->ncolumns = ncolumns;
+	for(c = 0; c < ncolumns; c++)
+	{
+		field = stmt->api->field(stmt, c);
+		if(field)
+		{
+			batch->columns[c].type = field->api->type(field);
+			field->api->release(field);
+		}
+	}
+	return 0;
+}
+
+/* Ensure that the buffers for a column can hold capacity rows, and empty
+ * them; the buffers may have been taken by the caller since the last
+ * batch was fetched, in which case they will be NULL
+ */
+static int
+sql_batch_prepare_(SQL_BATCH_COLUMN *column, size_t capacity)
+{
+	uint8_t *validity;
+	int64_t *ints;
+	double *reals;
+
+	validity = (uint8_t *) realloc(column->validity, (capacity / 8) + 1);
+	if(!validity)
+	{
+		return -1;
+	}
+	column->validity = validity;
+	memset(column->validity, 0, (capacity / 8) + 1);
+	column->nulls = 0;
+	switch(column->type)
+	{
+	case SQL_TYPE_INTEGER:
+	case SQL_TYPE_BOOLEAN:
+		ints = (int64_t *) realloc(column->ints, sizeof(int64_t) * (capacity + 1));
+		if(!ints)
+		{
+			return -1;
+		}
+		column->ints = ints;
+		break;
+	case SQL_TYPE_REAL:
+		reals = (double *) realloc(column->reals, sizeof(double) * (capacity + 1));
+		if(!reals)
+		{
+			return -1;
+		}
+		column->reals = reals;
+		break;
+	default:
+		ints = (int64_t *) realloc(column->offsets, sizeof(int64_t) * (capacity + 1));
+		if(!ints)
+		{
+			return -1;
+		}
+		column->offsets = ints;
+		column->offsets[0] = 0;
+		column->datalen = 0;
+		break;
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+/* Insert rows into a table as efficiently as the engine allows: the
+ * callback is invoked repeatedly to supply the values of each row, and
+ * returns 1 if it has supplied one, 0 when there are no more rows, or -1
+ * to abort the load. Unless a transaction is already in progress, the rows
+ * are inserted atomically.
+ *
+ * Returns the number of rows inserted, or -1 on error.
+ */
+long long
+sql_bulk_insert(SQL *restrict sql, const char *restrict table, const char *const *restrict columns, SQL_BULK_ROW fn, void *restrict userdata)
+{
+	SQL_TRACE_STATE state;
+	size_t ncolumns;
+	long long r;
+
+	for(ncolumns = 0; columns[ncolumns]; ncolumns++);
+	if(!ncolumns)
+	{
+		sql->api->set_error(sql, "07002", "At least one column must be specified for a bulk insert");
+		return -1;
+	}
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, NULL);
+	r = sql->api->bulk_insert(sql, table, columns, ncolumns, fn, userdata);
+	sql_trace_finish_(sql, &state, (r < 0 ? -1 : 0), (r < 0 ? 0 : r));
+	return r;
+}
+
+/* Construct the list of columns to be inserted into, for engines which
+ * issue INSERT or COPY statements
+ */
+char *
+sql_bulk_columns_(const char *const *columns, size_t ncolumns)
+{
+	size_t c, len;
+	char *buf, *p;
+
+	len = 1;
+	for(c = 0; c < ncolumns; c++)
+	{
+		len += strlen(columns[c]) + 2;
+	}
+	buf = (char *) malloc(len);
+	if(!buf)
+	{
+		return NULL;
+	}
+	p = buf;
+	for(c = 0; c < ncolumns; c++)
+	{
+		if(c)
+		{
+			*p = ',';
+			p++;
+			*p = ' ';
+			p++;
+		}
+		strcpy(p, columns[c]);
+		p = strchr(p, 0);
+	}
+	*p = 0;
+	return buf;
+}
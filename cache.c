@@ -0,0 +1,487 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+/* Each connection can have a bounded, least-recently-used cache of prepared
+ * statements keyed by statement text, which is consulted by sql_query() and
+ * sql_execute(). It is disabled by default, because each new text costs
+ * an additional round-trip to prepare it. Only single data-manipulation
+ * statements are prepared, and the engine can veto preparing new ones,
+ * as PostgreSQL does inside a transaction. Cached statements are owned by
+ * the cache: a cached statement which is handed out to a caller has an
+ * additional reference, and cannot be handed out again (or evicted) until
+ * that reference has been released.
+ */
+
+struct sql_cache_entry_struct
+{
+	SQL_CACHE_ENTRY *prev;
+	SQL_CACHE_ENTRY *next;
+	SQL_CACHE_ENTRY *hnext;
+	unsigned long hash;
+	char *text;
+	SQL_STATEMENT *stmt;
+};
+
+struct sql_cache_struct
+{
+	size_t limit;
+	size_t count;
+	size_t nbuckets;
+	SQL_CACHE_ENTRY **buckets;
+	/* Most-recently used entry is at the head */
+	SQL_CACHE_ENTRY *head;
+	SQL_CACHE_ENTRY *tail;
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+};
+
+static unsigned long sql_cache_hash_(const char *str);
+static int sql_cache_preparable_(const char *statement);
+static void sql_cache_unlink_(SQL_CACHE *restrict cache, SQL_CACHE_ENTRY *restrict entry);
+static void sql_cache_evict_(SQL_CACHE *restrict cache, SQL_CACHE_ENTRY *restrict entry);
+static int sql_cache_resize_(SQL_CACHE *cache, size_t limit);
+
+/* Set the maximum number of prepared statements cached on a connection;
+ * a limit of zero disables the cache
+ */
+int
+sql_set_cache_size(SQL *sql, size_t limit)
+{
+	SQL_CACHE *cache;
+
+	if(!sql->cache)
+	{
+		if(!limit)
+		{
+			return 0;
+		}
+		cache = sql_cache_create_(limit);
+		if(!cache)
+		{
+			return -1;
+		}
+		sql->cache = cache;
+		return 0;
+	}
+	return sql_cache_resize_(sql->cache, limit);
+}
+
+/* Obtain statistics about the statement cache */
+int
+sql_cache_stats(SQL *restrict sql, SQL_CACHE_STATS *restrict stats)
+{
+	memset(stats, 0, sizeof(SQL_CACHE_STATS));
+	if(!sql->cache)
+	{
+		return 0;
+	}
+	stats->size = sql->cache->count;
+	stats->limit = sql->cache->limit;
+	stats->hits = sql->cache->hits;
+	stats->misses = sql->cache->misses;
+	stats->evictions = sql->cache->evictions;
+	return 0;
+}
+
+SQL_CACHE *
+sql_cache_create_(size_t limit)
+{
+	SQL_CACHE *cache;
+
+	cache = (SQL_CACHE *) sql_calloc_(1, sizeof(SQL_CACHE));
+	if(!cache)
+	{
+		return NULL;
+	}
+	/* Keep the load factor of the hash table at or below 0.5 */
+	cache->nbuckets = 16;
+	while(cache->nbuckets < limit * 2)
+	{
+		cache->nbuckets *= 2;
+	}
+	cache->buckets = (SQL_CACHE_ENTRY **) sql_calloc_(cache->nbuckets, sizeof(SQL_CACHE_ENTRY *));
+	if(!cache->buckets)
+	{
+		sql_free_(cache);
+		return NULL;
+	}
+	cache->limit = limit;
+	return cache;
+}
+
+/* Release all of the cached statements; must be invoked by an engine
+ * before the underlying connection is closed
+ */
+void
+sql_cache_destroy_(SQL_CACHE *cache)
+{
+	if(!cache)
+	{
+		return;
+	}
+	while(cache->tail)
+	{
+		sql_cache_evict_(cache, cache->tail);
+	}
+	sql_free_(cache->buckets);
+	sql_free_(cache);
+}
+
+/* Obtain a prepared statement for the specified text, either from the
+ * cache or by preparing (and caching) a new one. Returns NULL if the
+ * cache is disabled or the statement could not be prepared.
+ */
+SQL_STATEMENT *
+sql_cache_statement_(SQL *restrict sql, const char *restrict statement)
+{
+	SQL_CACHE *cache;
+	SQL_CACHE_ENTRY *entry, *p;
+	SQL_STATEMENT *stmt;
+	unsigned long hash;
+
+	cache = sql->cache;
+	if(!cache->limit)
+	{
+		return NULL;
+	}
+	hash = sql_cache_hash_(statement);
+	for(entry = cache->buckets[hash & (cache->nbuckets - 1)]; entry; entry = entry->hnext)
+	{
+		if(entry->hash == hash && !strcmp(entry->text, statement))
+		{
+			break;
+		}
+	}
+	if(entry && entry->stmt->refcount == 1)
+	{
+		cache->hits++;
+		if(entry != cache->head)
+		{
+			sql_cache_unlink_(cache, entry);
+			entry->next = cache->head;
+			cache->head->prev = entry;
+			cache->head = entry;
+		}
+		entry->stmt->api->addref(entry->stmt);
+		return entry->stmt;
+	}
+	cache->misses++;
+	/* A text which has been prepared before is known to be preparable, but
+	 * new ones must be vetted first
+	 */
+	if(!entry && (!sql_cache_preparable_(statement) || !sql->api->cacheable(sql, statement)))
+	{
+		return NULL;
+	}
+	stmt = sql->api->statement(sql, statement);
+	if(!stmt || entry)
+	{
+		/* Either the statement couldn't be prepared, or the cached copy is
+		 * still in use; in the latter case, hand out an uncached one
+		 */
+		return stmt;
+	}
+	if(cache->count >= cache->limit)
+	{
+		/* Find the least-recently used statement which isn't in use */
+		for(p = cache->tail; p; p = p->prev)
+		{
+			if(p->stmt->refcount == 1)
+			{
+				break;
+			}
+		}
+		if(!p)
+		{
+			return stmt;
+		}
+		sql_cache_evict_(cache, p);
+		cache->evictions++;
+	}
+	entry = (SQL_CACHE_ENTRY *) sql_calloc_(1, sizeof(SQL_CACHE_ENTRY));
+	if(!entry)
+	{
+		return stmt;
+	}
+	entry->text = sql_strdup_(statement);
+	if(!entry->text)
+	{
+		sql_free_(entry);
+		return stmt;
+	}
+	entry->hash = hash;
+	entry->stmt = stmt;
+	entry->hnext = cache->buckets[hash & (cache->nbuckets - 1)];
+	cache->buckets[hash & (cache->nbuckets - 1)] = entry;
+	entry->next = cache->head;
+	if(cache->head)
+	{
+		cache->head->prev = entry;
+	}
+	cache->head = entry;
+	if(!cache->tail)
+	{
+		cache->tail = entry;
+	}
+	cache->count++;
+	stmt->cached = 1;
+	stmt->api->addref(stmt);
+	return stmt;
+}
+
+/* Remove a statement from the cache, typically because it failed to
+ * execute and so should be prepared afresh next time
+ */
+void
+sql_cache_discard_(SQL *restrict sql, SQL_STATEMENT *restrict stmt)
+{
+	SQL_CACHE_ENTRY *entry;
+
+	if(!stmt->cached)
+	{
+		return;
+	}
+	for(entry = sql->cache->head; entry; entry = entry->next)
+	{
+		if(entry->stmt == stmt)
+		{
+			sql_cache_evict_(sql->cache, entry);
+			return;
+		}
+	}
+}
+
+/* FNV-1a */
+static unsigned long
+sql_cache_hash_(const char *str)
+{
+	unsigned long hash;
+
+	hash = 2166136261UL;
+	for(; *str; str++)
+	{
+		hash ^= (unsigned char) *str;
+		hash *= 16777619UL;
+	}
+	return hash;
+}
+
+/* Determine whether a statement text is worth preparing: it must be a
+ * single data-manipulation statement, because those are the ones which
+ * every engine can prepare, and a multiple-statement string can't be
+ * prepared at all
+ */
+static int
+sql_cache_preparable_(const char *statement)
+{
+	static const char *const verbs[] = {
+		"SELECT", "INSERT", "UPDATE", "DELETE", "REPLACE", "WITH", "VALUES", NULL
+	};
+	const char *p, *tag;
+	size_t c, len, taglen;
+	char quote;
+
+	p = statement;
+	while(isspace((unsigned char) *p) || *p == '(')
+	{
+		p++;
+	}
+	for(c = 0; verbs[c]; c++)
+	{
+		len = strlen(verbs[c]);
+		if(!strncasecmp(p, verbs[c], len) && !isalnum((unsigned char) p[len]) && p[len] != '_')
+		{
+			break;
+		}
+	}
+	if(!verbs[c])
+	{
+		return 0;
+	}
+	for(; *p; p++)
+	{
+		switch(*p)
+		{
+		case '\'':
+		case '"':
+		case '`':
+			/* Doubled quotes are handled as two adjacent literals */
+			quote = *p;
+			for(p++; *p && *p != quote; p++)
+			{
+				if(*p == '\\' && quote != '"' && p[1])
+				{
+					p++;
+				}
+			}
+			if(!*p)
+			{
+				return 0;
+			}
+			break;
+		case '-':
+			if(p[1] == '-')
+			{
+				p += strcspn(p, "\n");
+				if(!*p)
+				{
+					return 1;
+				}
+			}
+			break;
+		case '/':
+			if(p[1] == '*')
+			{
+				p = strstr(p + 2, "*/");
+				if(!p)
+				{
+					return 0;
+				}
+				p++;
+			}
+			break;
+		case '$':
+			/* A PostgreSQL dollar-quoted string, $tag$...$tag$ */
+			if(p > statement && (isalnum((unsigned char) p[-1]) || p[-1] == '_'))
+			{
+				break;
+			}
+			tag = p;
+			for(p++; isalpha((unsigned char) *p) || *p == '_'; p++)
+			{
+			}
+			if(*p != '$')
+			{
+				p = tag;
+				break;
+			}
+			taglen = p - tag + 1;
+			for(p++; *p && strncmp(p, tag, taglen); p++)
+			{
+			}
+			if(!*p)
+			{
+				return 0;
+			}
+			p += taglen - 1;
+			break;
+		case ';':
+			/* Only whitespace may follow the terminator */
+			for(p++; isspace((unsigned char) *p); p++)
+			{
+			}
+			return !*p;
+		}
+	}
+	return 1;
+}
+
+/* Remove an entry from the LRU list */
+static void
+sql_cache_unlink_(SQL_CACHE *restrict cache, SQL_CACHE_ENTRY *restrict entry)
+{
+	if(entry->prev)
+	{
+		entry->prev->next = entry->next;
+	}
+	else
+	{
+		cache->head = entry->next;
+	}
+	if(entry->next)
+	{
+		entry->next->prev = entry->prev;
+	}
+	else
+	{
+		cache->tail = entry->prev;
+	}
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+/* Remove an entry from the cache altogether, releasing its statement */
+static void
+sql_cache_evict_(SQL_CACHE *restrict cache, SQL_CACHE_ENTRY *restrict entry)
+{
+	SQL_CACHE_ENTRY **pp;
+
+	for(pp = &(cache->buckets[entry->hash & (cache->nbuckets - 1)]); *pp; pp = &((*pp)->hnext))
+	{
+		if(*pp == entry)
+		{
+			*pp = entry->hnext;
+			break;
+		}
+	}
+	sql_cache_unlink_(cache, entry);
+	/* If the statement is still in use, it becomes an ordinary statement
+	 * which will be freed when the caller destroys it
+	 */
+	entry->stmt->cached = 0;
+	entry->stmt->api->release(entry->stmt);
+	sql_free_(entry->text);
+	sql_free_(entry);
+	cache->count--;
+}
+
+/* Change the maximum size of the cache, evicting entries as needed */
+static int
+sql_cache_resize_(SQL_CACHE *cache, size_t limit)
+{
+	SQL_CACHE_ENTRY **buckets, *entry;
+	size_t nbuckets;
+
+	while(cache->count > limit && cache->tail)
+	{
+		sql_cache_evict_(cache, cache->tail);
+		cache->evictions++;
+	}
+	cache->limit = limit;
+	nbuckets = 16;
+	while(nbuckets < limit * 2)
+	{
+		nbuckets *= 2;
+	}
+	if(nbuckets <= cache->nbuckets)
+	{
+		return 0;
+	}
+	buckets = (SQL_CACHE_ENTRY **) sql_calloc_(nbuckets, sizeof(SQL_CACHE_ENTRY *));
+	if(!buckets)
+	{
+		return -1;
+	}
+	for(entry = cache->head; entry; entry = entry->next)
+	{
+		entry->hnext = buckets[entry->hash & (nbuckets - 1)];
+		buckets[entry->hash & (nbuckets - 1)] = entry;
+	}
+	sql_free_(cache->buckets);
+	cache->buckets = buckets;
+	cache->nbuckets = nbuckets;
+	return 0;
+}
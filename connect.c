@@ -45,25 +45,74 @@ sql_connect_uri(URI *uri)
 {
 	SQL_ENGINE *engine;
 	SQL *conn;
+	unsigned long long start;
+	size_t limit;
+	char buf[32];
 	
 	engine = sql_engine_(uri);
 	if(!engine)
 	{		
 		return NULL;
 	}
+	sql_allocator_lock_();
+	start = sql_stats_timer_();
 	conn = engine->api->create(engine);
 	if(!conn)
 	{
+		sql_stats_op_(NULL, SQL_STATS_CONNECT, start);
 		sql_set_error_("53000", "The client engine failed to create a connection object");
 		return NULL;
 	}
+	sql_stats_attach_(conn);
 	if(conn->api->connect(conn, uri))
 	{
-		/* Save error state */
+		/* Save error state; the failed attempt is still counted in the
+		 * process-wide statistics, when the connection is freed
+		 */
+		sql_stats_op_(conn, SQL_STATS_CONNECT, start);
 		sql_set_error_(conn->api->sqlstate(conn), conn->api->error(conn));
 		conn->api->release(conn);
 		return NULL;
 	}
+	sql_stats_op_(conn, SQL_STATS_CONNECT, start);
+	sql_logger_attach_(conn);
+	/* ?stmtcache=N enables a prepared statement cache of N statements */
+	limit = SQL_DEFAULT_CACHE_SIZE;
+	if(sql_uri_param_(uri, "stmtcache", buf, sizeof(buf)) < sizeof(buf))
+	{
+		limit = strtoul(buf, NULL, 10);
+	}
+	/* ?binary=1 requests results in binary form where supported */
+	if(sql_uri_flag_(uri, "binary"))
+	{
+		conn->flags |= SQL_FLAG_BINARY;
+	}
+	/* ?stream=1 retrieves the rows of result-sets incrementally */
+	if(sql_uri_flag_(uri, "stream"))
+	{
+		conn->flags |= SQL_FLAG_STREAM;
+	}
+	/* ?pipeline=1 pipelines transactions where supported */
+	if(sql_uri_flag_(uri, "pipeline"))
+	{
+		conn->flags |= SQL_FLAG_PIPELINE;
+	}
+	/* ?buffered=1 reads SQLite result-sets into memory */
+	if(sql_uri_flag_(uri, "buffered"))
+	{
+		conn->flags |= SQL_FLAG_BUFFERED;
+	}
+	/* ?autoparam=1 turns format strings into prepared statements */
+	if(sql_uri_flag_(uri, "autoparam"))
+	{
+		conn->flags |= SQL_FLAG_AUTOPARAM;
+	}
+	if(sql_set_cache_size(conn, limit))
+	{
+		sql_set_error_("58000", "Memory allocation error");
+		conn->api->release(conn);
+		return NULL;
+	}
 	return conn;
 }
 
@@ -108,17 +157,22 @@ sql_escape(SQL *restrict sql, const unsigned char *restrict from, size_t length,
 	return sql->api->escape(sql, from, length, buf, buflen);
 }
 
-/* Set the query-logging function */
+/* Set the query-logging function; the engine always invokes the logger
+ * (see logger.c), which calls this either directly or from the background
+ * thread
+ */
 int
 sql_set_querylog(SQL *sql, SQL_LOG_QUERY fn)
 {
-	return sql->api->set_querylog(sql, fn);
+	sql->logquery = fn;
+	return 0;
 }
 
 int
 sql_set_errorlog(SQL *sql, SQL_LOG_ERROR fn)
 {
-	return sql->api->set_errorlog(sql, fn);
+	sql->logerror = fn;
+	return 0;
 }
 
 int
@@ -127,6 +181,20 @@ sql_set_noticelog(SQL *sql, SQL_LOG_NOTICE fn)
 	return sql->api->set_noticelog(sql, fn);
 }
 
+/* Set the connection flags; engines ignore flags which they don't support */
+int
+sql_set_flags(SQL *sql, unsigned int flags)
+{
+	sql->flags = flags;
+	return 0;
+}
+
+unsigned int
+sql_flags(SQL *sql)
+{
+	return sql->flags;
+}
+
 /* Return information about the connection */
 SQL_LANG
 sql_lang(SQL *sql)
@@ -139,3 +207,81 @@ sql_variant(SQL *sql)
 {
 	return sql->api->variant(sql);
 }
+
+/* Obtain the value of a parameter from the query string of a connection
+ * URI; returns the length of the value (which may be greater than or equal
+ * to buflen if it was truncated), or (size_t) -1 if it is not present
+ */
+size_t
+sql_uri_param_(URI *restrict uri, const char *restrict name, char *restrict buf, size_t buflen)
+{
+	URI_INFO *info;
+	const char *p, *end, *value;
+	size_t namelen, len;
+
+	info = uri_info(uri);
+	if(!info)
+	{
+		return (size_t) -1;
+	}
+	namelen = strlen(name);
+	len = (size_t) -1;
+	for(p = info->query; p && *p; p = end)
+	{
+		end = p + strcspn(p, "&;");
+		value = memchr(p, '=', end - p);
+		if(!value)
+		{
+			value = end;
+		}
+		if((size_t) (value - p) == namelen && !strncmp(p, name, namelen))
+		{
+			if(value < end)
+			{
+				value++;
+			}
+			len = end - value;
+			if(buf && buflen)
+			{
+				if(len < buflen)
+				{
+					memcpy(buf, value, len);
+					buf[len] = 0;
+				}
+				else
+				{
+					memcpy(buf, value, buflen - 1);
+					buf[buflen - 1] = 0;
+				}
+			}
+			break;
+		}
+		if(*end)
+		{
+			end++;
+		}
+	}
+	uri_info_destroy(info);
+	return len;
+}
+
+/* Return nonzero if a boolean parameter in a connection URI is present
+ * and set to a true value ("1", "yes", "true" or "on"), or has no value
+ */
+int
+sql_uri_flag_(URI *restrict uri, const char *restrict name)
+{
+	char buf[8];
+	size_t len;
+
+	len = sql_uri_param_(uri, name, buf, sizeof(buf));
+	if(len == (size_t) -1 || len >= sizeof(buf))
+	{
+		return 0;
+	}
+	if(!len || !strcmp(buf, "1") || !strcasecmp(buf, "yes") || !strcasecmp(buf, "true") || !strcasecmp(buf, "on"))
+	{
+		return 1;
+	}
+	return 0;
+}
@@ -135,6 +135,18 @@ sql_def_trylock_(SQL *me)
 	return pthread_mutex_trylock(&(me->lock));
 }
 
+/* Any statement may be prepared for the statement cache, because one which
+ * can't be will simply be executed instead
+ */
+int
+sql_def_cacheable_(SQL *restrict me, const char *restrict statement)
+{
+	(void) me;
+	(void) statement;
+
+	return 1;
+}
+
 
 int
 sql_statement_def_queryinterface_(SQL_STATEMENT *restrict me, uuid_t *restrict uuid, void *restrict *restrict out)
@@ -157,6 +169,92 @@ sql_statement_def_addref_(SQL_STATEMENT *me)
 	return me->refcount;
 }
 
+/* Default implementations of the native value accessors, for engines
+ * (or result-sets) which only provide values as text
+ */
+int64_t
+sql_statement_def_int64_(SQL_STATEMENT *me, unsigned int col)
+{
+	const char *s;
+
+	s = (const char *) me->api->valueptr(me, col);
+	if(!s)
+	{
+		return 0;
+	}
+	return (int64_t) strtoll(s, NULL, 10);
+}
+
+double
+sql_statement_def_real_(SQL_STATEMENT *me, unsigned int col)
+{
+	const char *s;
+
+	s = (const char *) me->api->valueptr(me, col);
+	if(!s)
+	{
+		return 0;
+	}
+	return strtod(s, NULL);
+}
+
+int
+sql_statement_def_boolean_(SQL_STATEMENT *me, unsigned int col)
+{
+	const char *s;
+
+	s = (const char *) me->api->valueptr(me, col);
+	if(!s)
+	{
+		return 0;
+	}
+	return sql_parse_boolean_(s);
+}
+
+/* Interpret a textual boolean value */
+int
+sql_parse_boolean_(const char *s)
+{
+	switch(*s)
+	{
+	case 't':
+	case 'T':
+	case 'y':
+	case 'Y':
+		return 1;
+	case 'o':
+	case 'O':
+		/* "on" or "off" */
+		return (s[1] == 'n' || s[1] == 'N');
+	}
+	return (strtod(s, NULL) != 0);
+}
+
+const unsigned char *
+sql_statement_def_blob_(SQL_STATEMENT *restrict me, unsigned int col, size_t *restrict len)
+{
+	const unsigned char *p;
+
+	p = me->api->valueptr(me, col);
+	if(len)
+	{
+		*len = (p ? me->api->valuelen(me, col) - 1 : 0);
+	}
+	return p;
+}
+
+/* Statement counters are not supported by default */
+int
+sql_statement_def_scanstatus_(SQL_STATEMENT *restrict me, SQL_STMT_STATUS *restrict status)
+{
+	SQL *sql;
+
+	memset(status, 0, sizeof(SQL_STMT_STATUS));
+	sql = me->api->connection(me);
+	sql->api->set_error(sql, "0A000", "Statement counters are not supported by this engine");
+	return -1;
+}
+
 int
 sql_field_def_queryinterface_(SQL_FIELD *restrict me, uuid_t *restrict uuid, void *restrict *restrict out)
 {
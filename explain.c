@@ -0,0 +1,1008 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+/* sql_explain() obtains the plan of a query in whichever form the engine
+ * provides it, and translates it into a tree of SQL_PLAN_NODEs:
+ *
+ *   SQLite      EXPLAIN QUERY PLAN, one step per row, with parent ids in
+ *               versions which have them; sql_explain_analyze() executes
+ *               the query and attaches the statement's scan counters
+ *   PostgreSQL  EXPLAIN (FORMAT JSON[, ANALYZE]), one step per "Plan"
+ *   MySQL       EXPLAIN FORMAT=JSON, one step per query block, operation
+ *               and table
+ *
+ * The EXPLAIN statements are executed directly by the engine, bypassing
+ * the statement cache, tracing and fingerprinting.
+ */
+
+typedef enum
+{
+	SQL_JSON_NULL,
+	SQL_JSON_BOOL,
+	SQL_JSON_NUMBER,
+	SQL_JSON_STRING,
+	SQL_JSON_ARRAY,
+	SQL_JSON_OBJECT
+} SQL_JSON_TYPE;
+
+typedef struct sql_json_struct SQL_JSON;
+
+/* A JSON value; the elements of an array or the members of an object are
+ * a list beginning at child, and each member has a name
+ */
+struct sql_json_struct
+{
+	SQL_JSON_TYPE type;
+	char *name;
+	char *str;
+	double num;
+	SQL_JSON *child;
+	SQL_JSON *next;
+};
+
+static int sql_explain_(SQL *restrict sql, const char *restrict query, int analyze, SQL_PLAN *restrict plan);
+static SQL_STATEMENT *sql_explain_query_(SQL *restrict sql, const char *restrict prefix, const char *restrict query);
+static int sql_explain_sqlite_(SQL *restrict sql, const char *restrict query, int analyze, SQL_PLAN *restrict plan);
+static void sql_explain_sqlite_detail_(SQL_PLAN_NODE *node);
+static int sql_explain_sqlite_analyze_(SQL *restrict sql, const char *restrict query, SQL_PLAN *restrict plan);
+static int sql_explain_json_(SQL *restrict sql, const char *restrict query, int analyze, SQL_PLAN *restrict plan);
+static int sql_explain_pg_(SQL_PLAN *restrict plan, SQL_PLAN_NODE *restrict parent, const SQL_JSON *restrict obj);
+static int sql_explain_mysql_(SQL_PLAN *restrict plan, SQL_PLAN_NODE *restrict parent, const SQL_JSON *restrict json);
+static SQL_PLAN_NODE *sql_explain_node_(SQL_PLAN *restrict plan, SQL_PLAN_NODE *restrict parent, const char *restrict detail);
+static int sql_explain_set_(char **restrict dest, const char *restrict src);
+static SQL_PLAN_NODE *sql_explain_walk_(SQL_PLAN_NODE *node);
+static void sql_explain_free_(SQL_PLAN_NODE *node);
+static int sql_explain_explainable_(const char *query);
+static SQL_JSON *sql_json_parse_(const char **p);
+static int sql_json_string_(const char **restrict p, char **restrict out);
+static void sql_json_free_(SQL_JSON *json);
+static const SQL_JSON *sql_json_member_(const SQL_JSON *restrict obj, const char *restrict name);
+static const char *sql_json_str_(const SQL_JSON *restrict obj, const char *restrict name);
+static double sql_json_num_(const SQL_JSON *restrict obj, const char *restrict name);
+
+/* Obtain the plan of a query */
+int
+sql_explain(SQL *restrict sql, const char *restrict query, SQL_PLAN *restrict plan)
+{
+	return sql_explain_(sql, query, 0, plan);
+}
+
+/* Execute a query, obtaining its plan along with measurements of each
+ * step where the engine provides them
+ */
+int
+sql_explain_analyze(SQL *restrict sql, const char *restrict query, SQL_PLAN *restrict plan)
+{
+	return sql_explain_(sql, query, 1, plan);
+}
+
+/* Free the resources used by a plan */
+void
+sql_plan_free(SQL_PLAN *plan)
+{
+	sql_explain_free_(plan->root);
+	sql_free_(plan->text);
+	plan->root = NULL;
+	plan->text = NULL;
+}
+
+/* Configure automatic EXPLAIN of slow queries */
+int
+sql_set_autoexplain(SQL *restrict sql, const SQL_AUTOEXPLAIN *restrict autoexplain)
+{
+	if(autoexplain)
+	{
+		memcpy(&(sql->autoexplain), autoexplain, sizeof(SQL_AUTOEXPLAIN));
+	}
+	else
+	{
+		memset(&(sql->autoexplain), 0, sizeof(SQL_AUTOEXPLAIN));
+	}
+	return 0;
+}
+
+/* Invoked on completion of a query which took nsec to execute, if
+ * automatic EXPLAIN is enabled on the connection; statements other than
+ * queries and DML, and queries whose results may still be in the process
+ * of being received, are skipped
+ */
+void
+sql_explain_auto_(SQL *restrict sql, const char *restrict query, unsigned long long nsec)
+{
+	SQL_PLAN plan;
+
+	if(nsec < sql->autoexplain.threshold || (sql->flags & (SQL_FLAG_STREAM|SQL_FLAG_PIPELINE)) ||
+	   !sql_explain_explainable_(query))
+	{
+		return;
+	}
+	if(sql_explain(sql, query, &plan))
+	{
+		return;
+	}
+	sql->autoexplain.fn(sql, query, nsec, &plan, sql->autoexplain.userdata);
+	sql_plan_free(&plan);
+}
+
+static int
+sql_explain_(SQL *restrict sql, const char *restrict query, int analyze, SQL_PLAN *restrict plan)
+{
+	int r;
+
+	memset(plan, 0, sizeof(SQL_PLAN));
+	switch(sql->api->variant(sql))
+	{
+	case SQL_VARIANT_SQLITE:
+		r = sql_explain_sqlite_(sql, query, analyze, plan);
+		break;
+	case SQL_VARIANT_POSTGRES:
+	case SQL_VARIANT_MYSQL:
+		r = sql_explain_json_(sql, query, analyze, plan);
+		break;
+	default:
+		sql->api->set_error(sql, "0A000", "EXPLAIN is not supported by this engine");
+		r = -1;
+	}
+	if(r)
+	{
+		sql_plan_free(plan);
+	}
+	return r;
+}
+
+/* Execute an EXPLAIN statement consisting of prefix followed by query,
+ * without a prepared statement
+ */
+static SQL_STATEMENT *
+sql_explain_query_(SQL *restrict sql, const char *restrict prefix, const char *restrict query)
+{
+	SQL_STATEMENT *rs;
+	char *text;
+	void *data;
+	size_t len;
+	int r;
+
+	len = strlen(prefix);
+	text = (char *) sql_malloc_(len + strlen(query) + 1);
+	if(!text)
+	{
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		return NULL;
+	}
+	strcpy(text, prefix);
+	strcpy(&(text[len]), query);
+	rs = sql->api->statement(sql, NULL);
+	if(!rs)
+	{
+		sql_free_(text);
+		return NULL;
+	}
+	data = NULL;
+	r = sql->api->execute(sql, text, &data);
+	sql_free_(text);
+	if(r || rs->api->set_results(rs, data))
+	{
+		rs->api->release(rs);
+		return NULL;
+	}
+	return rs;
+}
+
+static int
+sql_explain_sqlite_(SQL *restrict sql, const char *restrict query, int analyze, SQL_PLAN *restrict plan)
+{
+	SQL_STATEMENT *rs;
+	SQL_PLAN_NODE *node, *parent;
+	SQL_FIELD *field;
+	struct
+	{
+		int64_t id;
+		SQL_PLAN_NODE *node;
+	} *ids, *p;
+	size_t nids, idalloc, len, textlen, c;
+	const char *detail;
+	int tree;
+	int64_t pid;
+	char *t;
+
+	rs = sql_explain_query_(sql, "EXPLAIN QUERY PLAN ", query);
+	if(!rs)
+	{
+		return -1;
+	}
+	/* SQLite 3.24 and later report each step's id and that of its parent,
+	 * while earlier versions report a flat list
+	 */
+	tree = 0;
+	if(rs->api->columns(rs) >= 4)
+	{
+		field = rs->api->field(rs, 0);
+		if(field)
+		{
+			tree = !strcmp(field->api->name(field), "id");
+			field->api->release(field);
+		}
+	}
+	ids = NULL;
+	nids = 0;
+	idalloc = 0;
+	textlen = 0;
+	for(; !rs->api->eof(rs); rs->api->next(rs))
+	{
+		detail = (const char *) rs->api->valueptr(rs, 3);
+		if(!detail)
+		{
+			detail = "";
+		}
+		parent = NULL;
+		if(tree)
+		{
+			pid = rs->api->int64(rs, 1);
+			for(c = 0; c < nids; c++)
+			{
+				if(ids[c].id == pid)
+				{
+					parent = ids[c].node;
+					break;
+				}
+			}
+		}
+		node = sql_explain_node_(plan, parent, detail);
+		if(!node)
+		{
+			break;
+		}
+		sql_explain_sqlite_detail_(node);
+		if(tree)
+		{
+			if(nids >= idalloc)
+			{
+				p = sql_realloc_(ids, (idalloc + 16) * sizeof(*ids));
+				if(!p)
+				{
+					break;
+				}
+				ids = p;
+				idalloc += 16;
+			}
+			ids[nids].id = rs->api->int64(rs, 0);
+			ids[nids].node = node;
+			nids++;
+		}
+		/* The text of the plan is one line per step */
+		len = strlen(detail);
+		t = (char *) sql_realloc_(plan->text, textlen + len + 2);
+		if(!t)
+		{
+			break;
+		}
+		plan->text = t;
+		memcpy(&(t[textlen]), detail, len);
+		textlen += len;
+		t[textlen] = '\n';
+		textlen++;
+		t[textlen] = 0;
+	}
+	sql_free_(ids);
+	if(!rs->api->eof(rs))
+	{
+		rs->api->release(rs);
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		return -1;
+	}
+	rs->api->release(rs);
+	if(analyze)
+	{
+		return sql_explain_sqlite_analyze_(sql, query, plan);
+	}
+	return 0;
+}
+
+/* Interpret the description of a step, such as "SCAN TABLE t" or "SEARCH
+ * t USING INDEX i (a=?)"
+ */
+static void
+sql_explain_sqlite_detail_(SQL_PLAN_NODE *node)
+{
+	const char *p, *s;
+	char *name;
+	int scan;
+
+	p = node->detail;
+	if(!strncmp(p, "SCAN ", 5))
+	{
+		scan = 1;
+		p += 5;
+	}
+	else if(!strncmp(p, "SEARCH ", 7))
+	{
+		scan = 0;
+		p += 7;
+	}
+	else
+	{
+		return;
+	}
+	if(!strncmp(p, "TABLE ", 6))
+	{
+		p += 6;
+	}
+	if(!strncmp(p, "CONSTANT ROW", 12) || !strncmp(p, "SUBQUERY ", 9) || *p == '(')
+	{
+		return;
+	}
+	for(s = p; *s && *s != ' '; s++);
+	name = (char *) sql_malloc_(s - p + 1);
+	if(!name)
+	{
+		return;
+	}
+	memcpy(name, p, s - p);
+	name[s - p] = 0;
+	node->relation = name;
+	p = strstr(s, " INDEX ");
+	if(p)
+	{
+		p += 7;
+		for(s = p; *s && *s != ' '; s++);
+		name = (char *) sql_malloc_(s - p + 1);
+		if(name)
+		{
+			memcpy(name, p, s - p);
+			name[s - p] = 0;
+			node->index = name;
+		}
+	}
+	node->fullscan = (scan && !strstr(node->detail, " USING "));
+}
+
+/* Execute the query and attach the counters of each of its loops to the
+ * step with the same description
+ */
+static int
+sql_explain_sqlite_analyze_(SQL *restrict sql, const char *restrict query, SQL_PLAN *restrict plan)
+{
+	SQL_STATEMENT *stmt;
+	SQL_STMT_STATUS status;
+	SQL_PLAN_NODE *node;
+	unsigned long long start, nsec;
+	unsigned int c;
+
+	stmt = sql->api->statement(sql, query);
+	if(!stmt)
+	{
+		return -1;
+	}
+	start = sql_stats_now_();
+	if(stmt->api->execute(stmt, 0, NULL))
+	{
+		stmt->api->release(stmt);
+		return -1;
+	}
+	while(!stmt->api->eof(stmt))
+	{
+		if(stmt->api->next(stmt) < 0)
+		{
+			stmt->api->release(stmt);
+			return -1;
+		}
+	}
+	nsec = sql_stats_now_() - start;
+	if(stmt->api->scanstatus(stmt, &status))
+	{
+		stmt->api->release(stmt);
+		return -1;
+	}
+	for(c = 0; c < status.nscans; c++)
+	{
+		if(!status.scans[c].explain)
+		{
+			continue;
+		}
+		for(node = plan->root; node; node = sql_explain_walk_(node))
+		{
+			if(node->actual_rows < 0 && !strcmp(node->detail, status.scans[c].explain))
+			{
+				node->actual_rows = status.scans[c].visits;
+				node->est_rows = status.scans[c].estimate;
+				break;
+			}
+		}
+	}
+	/* SQLite doesn't time individual steps, so only the top-level step of
+	 * a single-step plan can be timed
+	 */
+	if(plan->root && !plan->root->next && !plan->root->child)
+	{
+		plan->root->actual_msec = nsec / 1000000.0;
+	}
+	stmt->api->release(stmt);
+	return 0;
+}
+
+/* PostgreSQL and MySQL both describe plans in JSON */
+static int
+sql_explain_json_(SQL *restrict sql, const char *restrict query, int analyze, SQL_PLAN *restrict plan)
+{
+	SQL_STATEMENT *rs;
+	SQL_JSON *json;
+	const SQL_JSON *p, *item;
+	const char *text;
+	int pg, r;
+
+	pg = (sql->api->variant(sql) == SQL_VARIANT_POSTGRES);
+	if(analyze && !pg)
+	{
+		sql->api->set_error(sql, "0A000", "EXPLAIN ANALYZE is not supported by this engine");
+		return -1;
+	}
+	if(pg)
+	{
+		rs = sql_explain_query_(sql, (analyze ? "EXPLAIN (FORMAT JSON, ANALYZE) " : "EXPLAIN (FORMAT JSON) "), query);
+	}
+	else
+	{
+		rs = sql_explain_query_(sql, "EXPLAIN FORMAT=JSON ", query);
+	}
+	if(!rs)
+	{
+		return -1;
+	}
+	text = (rs->api->eof(rs) ? NULL : (const char *) rs->api->valueptr(rs, 0));
+	if(!text || sql_explain_set_(&(plan->text), text))
+	{
+		rs->api->release(rs);
+		sql->api->set_error(sql, "58000", "The plan could not be obtained");
+		return -1;
+	}
+	rs->api->release(rs);
+	text = plan->text;
+	json = sql_json_parse_(&text);
+	if(!json)
+	{
+		sql->api->set_error(sql, "58000", "The plan could not be parsed");
+		return -1;
+	}
+	r = 0;
+	if(pg)
+	{
+		/* An array of objects, each with a "Plan" */
+		for(p = (json->type == SQL_JSON_ARRAY ? json->child : NULL); p && !r; p = p->next)
+		{
+			if((item = sql_json_member_(p, "Plan")))
+			{
+				r = sql_explain_pg_(plan, NULL, item);
+			}
+		}
+	}
+	else
+	{
+		r = sql_explain_mysql_(plan, NULL, json);
+	}
+	sql_json_free_(json);
+	if(r)
+	{
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+	}
+	return r;
+}
+
+static int
+sql_explain_pg_(SQL_PLAN *restrict plan, SQL_PLAN_NODE *restrict parent, const SQL_JSON *restrict obj)
+{
+	SQL_PLAN_NODE *node;
+	const SQL_JSON *p;
+	const char *type, *rel, *idx;
+	char *detail;
+	double loops;
+
+	type = sql_json_str_(obj, "Node Type");
+	rel = sql_json_str_(obj, "Relation Name");
+	idx = sql_json_str_(obj, "Index Name");
+	if(!type)
+	{
+		type = "";
+	}
+	detail = (char *) sql_malloc_(strlen(type) + (rel ? strlen(rel) + 4 : 0) + (idx ? strlen(idx) + 7 : 0) + 1);
+	if(!detail)
+	{
+		return -1;
+	}
+	strcpy(detail, type);
+	if(idx)
+	{
+		strcat(detail, " using ");
+		strcat(detail, idx);
+	}
+	if(rel)
+	{
+		strcat(detail, " on ");
+		strcat(detail, rel);
+	}
+	node = sql_explain_node_(plan, parent, detail);
+	sql_free_(detail);
+	if(!node || (rel && sql_explain_set_(&(node->relation), rel)) || (idx && sql_explain_set_(&(node->index), idx)))
+	{
+		return -1;
+	}
+	node->fullscan = !strcmp(type, "Seq Scan");
+	node->est_rows = sql_json_num_(obj, "Plan Rows");
+	node->est_cost = sql_json_num_(obj, "Total Cost");
+	if(sql_json_member_(obj, "Actual Rows"))
+	{
+		/* Actual values are averages per loop */
+		loops = sql_json_num_(obj, "Actual Loops");
+		if(loops < 1)
+		{
+			loops = 1;
+		}
+		node->actual_rows = sql_json_num_(obj, "Actual Rows") * loops;
+		node->actual_msec = sql_json_num_(obj, "Actual Total Time") * loops;
+	}
+	p = sql_json_member_(obj, "Plans");
+	for(p = (p ? p->child : NULL); p; p = p->next)
+	{
+		if(sql_explain_pg_(plan, node, p))
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* MySQL's plans nest tables within query blocks and operations such as
+ * "ordering_operation", which become steps; other objects and arrays
+ * (such as "nested_loop") are looked inside of
+ */
+static int
+sql_explain_mysql_(SQL_PLAN *restrict plan, SQL_PLAN_NODE *restrict parent, const SQL_JSON *restrict json)
+{
+	SQL_PLAN_NODE *node;
+	const SQL_JSON *p, *cost;
+	const char *type, *table, *key;
+	char *detail;
+	size_t len;
+
+	for(p = json->child; p; p = p->next)
+	{
+		if(p->type != SQL_JSON_OBJECT && p->type != SQL_JSON_ARRAY)
+		{
+			continue;
+		}
+		node = parent;
+		len = (p->name ? strlen(p->name) : 0);
+		if(p->name && p->type == SQL_JSON_OBJECT && !strcmp(p->name, "table"))
+		{
+			type = sql_json_str_(p, "access_type");
+			table = sql_json_str_(p, "table_name");
+			key = sql_json_str_(p, "key");
+			if(!type)
+			{
+				type = "";
+			}
+			detail = (char *) sql_malloc_(strlen(type) + (table ? strlen(table) + 4 : 0) + (key ? strlen(key) + 7 : 0) + 1);
+			if(!detail)
+			{
+				return -1;
+			}
+			strcpy(detail, type);
+			if(key)
+			{
+				strcat(detail, " using ");
+				strcat(detail, key);
+			}
+			if(table)
+			{
+				strcat(detail, " on ");
+				strcat(detail, table);
+			}
+			node = sql_explain_node_(plan, parent, detail);
+			sql_free_(detail);
+			if(!node || (table && sql_explain_set_(&(node->relation), table)) || (key && sql_explain_set_(&(node->index), key)))
+			{
+				return -1;
+			}
+			node->fullscan = !strcmp(type, "ALL");
+			node->est_rows = sql_json_num_(p, "rows_examined_per_scan");
+			cost = sql_json_member_(p, "cost_info");
+			node->est_cost = (cost ? sql_json_num_(cost, "prefix_cost") : -1);
+		}
+		else if(p->name && p->type == SQL_JSON_OBJECT &&
+				(!strcmp(p->name, "query_block") || !strcmp(p->name, "duplicates_removal") ||
+				 !strcmp(p->name, "union_result") || (len > 10 && !strcmp(&(p->name[len - 10]), "_operation"))))
+		{
+			node = sql_explain_node_(plan, parent, p->name);
+			if(!node)
+			{
+				return -1;
+			}
+			cost = sql_json_member_(p, "cost_info");
+			node->est_cost = (cost ? sql_json_num_(cost, "query_cost") : -1);
+		}
+		if(sql_explain_mysql_(plan, node, p))
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Append a new step to the children of parent, or to the top level of the
+ * plan if it is NULL
+ */
+static SQL_PLAN_NODE *
+sql_explain_node_(SQL_PLAN *restrict plan, SQL_PLAN_NODE *restrict parent, const char *restrict detail)
+{
+	SQL_PLAN_NODE *node, **pp;
+
+	node = (SQL_PLAN_NODE *) sql_calloc_(1, sizeof(SQL_PLAN_NODE));
+	if(!node)
+	{
+		return NULL;
+	}
+	if(sql_explain_set_(&(node->detail), detail))
+	{
+		sql_free_(node);
+		return NULL;
+	}
+	node->est_rows = -1;
+	node->est_cost = -1;
+	node->actual_rows = -1;
+	node->actual_msec = -1;
+	node->parent = parent;
+	for(pp = (parent ? &(parent->child) : &(plan->root)); *pp; pp = &((*pp)->next));
+	*pp = node;
+	return node;
+}
+
+static int
+sql_explain_set_(char **restrict dest, const char *restrict src)
+{
+	*dest = sql_strdup_(src);
+	return (*dest ? 0 : -1);
+}
+
+/* Return the step following node in a depth-first traversal of a plan */
+static SQL_PLAN_NODE *
+sql_explain_walk_(SQL_PLAN_NODE *node)
+{
+	if(node->child)
+	{
+		return node->child;
+	}
+	for(; node; node = node->parent)
+	{
+		if(node->next)
+		{
+			return node->next;
+		}
+	}
+	return NULL;
+}
+
+/* Free a list of steps, along with their children */
+static void
+sql_explain_free_(SQL_PLAN_NODE *node)
+{
+	SQL_PLAN_NODE *next;
+
+	for(; node; node = next)
+	{
+		next = node->next;
+		sql_explain_free_(node->child);
+		sql_free_(node->detail);
+		sql_free_(node->relation);
+		sql_free_(node->index);
+		sql_free_(node);
+	}
+}
+
+/* Only queries and DML statements can be explained */
+static int
+sql_explain_explainable_(const char *query)
+{
+	static const char *const verbs[] = { "SELECT", "INSERT", "UPDATE", "DELETE", "REPLACE", "WITH", NULL };
+	size_t c, len;
+
+	while(isspace((unsigned char) *query) || *query == '(')
+	{
+		query++;
+	}
+	for(c = 0; verbs[c]; c++)
+	{
+		len = strlen(verbs[c]);
+		if(!strncasecmp(query, verbs[c], len) && !isalnum((unsigned char) query[len]) && query[len] != '_')
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* A minimal JSON parser, sufficient for EXPLAIN output */
+static SQL_JSON *
+sql_json_parse_(const char **p)
+{
+	SQL_JSON *json, *child, **pp;
+	const char *s;
+	char *name;
+	int close;
+
+	for(s = *p; isspace((unsigned char) *s); s++);
+	json = (SQL_JSON *) sql_calloc_(1, sizeof(SQL_JSON));
+	if(!json)
+	{
+		return NULL;
+	}
+	if(*s == '{' || *s == '[')
+	{
+		json->type = (*s == '{' ? SQL_JSON_OBJECT : SQL_JSON_ARRAY);
+		close = (*s == '{' ? '}' : ']');
+		pp = &(json->child);
+		for(s++; ; s++)
+		{
+			for(; isspace((unsigned char) *s); s++);
+			if(*s == close && !json->child)
+			{
+				break;
+			}
+			name = NULL;
+			if(json->type == SQL_JSON_OBJECT)
+			{
+				if(sql_json_string_(&s, &name))
+				{
+					sql_json_free_(json);
+					return NULL;
+				}
+				for(; isspace((unsigned char) *s); s++);
+				if(*s != ':')
+				{
+					sql_free_(name);
+					sql_json_free_(json);
+					return NULL;
+				}
+				s++;
+			}
+			child = sql_json_parse_(&s);
+			if(!child)
+			{
+				sql_free_(name);
+				sql_json_free_(json);
+				return NULL;
+			}
+			child->name = name;
+			*pp = child;
+			pp = &(child->next);
+			for(; isspace((unsigned char) *s); s++);
+			if(*s == close)
+			{
+				break;
+			}
+			if(*s != ',')
+			{
+				sql_json_free_(json);
+				return NULL;
+			}
+		}
+		*p = s + 1;
+		return json;
+	}
+	if(*s == '"')
+	{
+		json->type = SQL_JSON_STRING;
+		if(sql_json_string_(&s, &(json->str)))
+		{
+			sql_free_(json);
+			return NULL;
+		}
+		*p = s;
+		return json;
+	}
+	if(!strncmp(s, "true", 4) || !strncmp(s, "false", 5))
+	{
+		json->type = SQL_JSON_BOOL;
+		json->num = (*s == 't');
+		*p = s + (*s == 't' ? 4 : 5);
+		return json;
+	}
+	if(!strncmp(s, "null", 4))
+	{
+		json->type = SQL_JSON_NULL;
+		*p = s + 4;
+		return json;
+	}
+	json->type = SQL_JSON_NUMBER;
+	json->num = strtod(s, &name);
+	if(name == s)
+	{
+		sql_free_(json);
+		return NULL;
+	}
+	*p = name;
+	return json;
+}
+
+/* Parse a string, advancing *p past its closing quote */
+static int
+sql_json_string_(const char **restrict p, char **restrict out)
+{
+	const char *s;
+	char *buf, *d;
+	unsigned long ch;
+
+	s = *p;
+	if(*s != '"')
+	{
+		return -1;
+	}
+	s++;
+	buf = (char *) sql_malloc_(strlen(s) + 1);
+	if(!buf)
+	{
+		return -1;
+	}
+	for(d = buf; *s && *s != '"'; s++)
+	{
+		if(*s != '\\')
+		{
+			*d = *s;
+			d++;
+			continue;
+		}
+		s++;
+		switch(*s)
+		{
+		case 'b':
+			*d = '\b';
+			break;
+		case 'f':
+			*d = '\f';
+			break;
+		case 'n':
+			*d = '\n';
+			break;
+		case 'r':
+			*d = '\r';
+			break;
+		case 't':
+			*d = '\t';
+			break;
+		case 'u':
+			/* Characters outside of the BMP (in surrogate pairs) are not
+			 * expected, and are replaced
+			 */
+			if(!isxdigit((unsigned char) s[1]) || !isxdigit((unsigned char) s[2]) ||
+			   !isxdigit((unsigned char) s[3]) || !isxdigit((unsigned char) s[4]))
+			{
+				sql_free_(buf);
+				return -1;
+			}
+			ch = 0;
+			sscanf(s + 1, "%4lx", &ch);
+			s += 4;
+			if(ch >= 0xd800 && ch < 0xe000)
+			{
+				ch = '?';
+			}
+			if(ch < 0x80)
+			{
+				*d = (char) ch;
+			}
+			else if(ch < 0x800)
+			{
+				*d = (char) (0xc0 | (ch >> 6));
+				d++;
+				*d = (char) (0x80 | (ch & 0x3f));
+			}
+			else
+			{
+				*d = (char) (0xe0 | (ch >> 12));
+				d++;
+				*d = (char) (0x80 | ((ch >> 6) & 0x3f));
+				d++;
+				*d = (char) (0x80 | (ch & 0x3f));
+			}
+			break;
+		case 0:
+			sql_free_(buf);
+			return -1;
+		default:
+			*d = *s;
+		}
+		d++;
+	}
+	if(*s != '"')
+	{
+		sql_free_(buf);
+		return -1;
+	}
+	*d = 0;
+	*p = s + 1;
+	*out = buf;
+	return 0;
+}
+
+static void
+sql_json_free_(SQL_JSON *json)
+{
+	SQL_JSON *child, *next;
+
+	for(child = json->child; child; child = next)
+	{
+		next = child->next;
+		sql_json_free_(child);
+	}
+	sql_free_(json->name);
+	sql_free_(json->str);
+	sql_free_(json);
+}
+
+static const SQL_JSON *
+sql_json_member_(const SQL_JSON *restrict obj, const char *restrict name)
+{
+	const SQL_JSON *p;
+
+	if(obj->type != SQL_JSON_OBJECT)
+	{
+		return NULL;
+	}
+	for(p = obj->child; p; p = p->next)
+	{
+		if(!strcmp(p->name, name))
+		{
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static const char *
+sql_json_str_(const SQL_JSON *restrict obj, const char *restrict name)
+{
+	const SQL_JSON *p;
+
+	p = sql_json_member_(obj, name);
+	return (p && p->type == SQL_JSON_STRING ? p->str : NULL);
+}
+
+/* Obtain a numeric member, which MySQL sometimes provides as a string;
+ * returns -1 if it is not present
+ */
+static double
+sql_json_num_(const SQL_JSON *restrict obj, const char *restrict name)
+{
+	const SQL_JSON *p;
+
+	p = sql_json_member_(obj, name);
+	if(p && p->type == SQL_JSON_NUMBER)
+	{
+		return p->num;
+	}
+	if(p && p->type == SQL_JSON_STRING)
+	{
+		return strtod(p->str, NULL);
+	}
+	return -1;
+}
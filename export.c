@@ -0,0 +1,275 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+#include <unistd.h>
+
+/* Output is accumulated into a fixed-size buffer which is passed to the
+ * sink whenever it fills, so that exporting uses a constant amount of
+ * memory regardless of the size of the result-set
+ */
+#define SQL_EXPORT_BUFLEN              65536
+
+struct sql_export_buffer_struct
+{
+	SQL *sql;
+	const SQL_EXPORT_SINK *sink;
+	SQL_EXPORT_FORMAT format;
+	int failed;
+	size_t len;
+	char buf[SQL_EXPORT_BUFLEN];
+};
+
+static int sql_export_flush_(SQL_EXPORT_BUFFER *buf);
+static int sql_export_csv_(SQL_EXPORT_BUFFER *restrict buf, const char *restrict value, size_t len);
+static int sql_export_tsv_(SQL_EXPORT_BUFFER *restrict buf, const char *restrict value, size_t len);
+
+/* Execute a query and write its results to a sink in the specified format,
+ * returning the number of rows written, or -1 on error.
+ *
+ * In CSV format, NULL is written as an empty unquoted field and an empty
+ * string as "". In TSV format, tabs, newlines, carriage returns and
+ * backslashes are escaped with a backslash and NULL is written as \N. Both
+ * match the corresponding PostgreSQL COPY formats. Binary output is
+ * PostgreSQL's binary COPY format, and is only supported by PostgreSQL.
+ */
+long long
+sql_export(SQL *restrict sql, const char *restrict query, SQL_EXPORT_FORMAT format, const SQL_EXPORT_SINK *restrict sink)
+{
+	SQL_EXPORT_BUFFER *buf;
+	SQL_TRACE_STATE state;
+	long long r;
+
+	buf = (SQL_EXPORT_BUFFER *) malloc(sizeof(SQL_EXPORT_BUFFER));
+	if(!buf)
+	{
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		return -1;
+	}
+	buf->sql = sql;
+	buf->sink = sink;
+	buf->format = format;
+	buf->failed = 0;
+	buf->len = 0;
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, query);
+	state.literal = 1;
+	r = sql->api->export(sql, query, format, buf);
+	if(r >= 0 && sql_export_flush_(buf))
+	{
+		r = -1;
+	}
+	sql_trace_finish_(sql, &state, (r < 0 ? -1 : 0), 0);
+	free(buf);
+	return r;
+}
+
+/* Write pre-formatted data to the sink */
+int
+sql_export_data_(SQL_EXPORT_BUFFER *restrict buf, const void *restrict data, size_t len)
+{
+	const char *p;
+	size_t n;
+
+	if(buf->failed)
+	{
+		return -1;
+	}
+	p = (const char *) data;
+	while(len)
+	{
+		if(buf->len == SQL_EXPORT_BUFLEN && sql_export_flush_(buf))
+		{
+			return -1;
+		}
+		n = SQL_EXPORT_BUFLEN - buf->len;
+		if(n > len)
+		{
+			n = len;
+		}
+		memcpy(&(buf->buf[buf->len]), p, n);
+		buf->len += n;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Write a single value, which is NULL for an SQL NULL; values must be
+ * written in column order, and each row terminated with sql_export_eol_()
+ */
+int
+sql_export_value_(SQL_EXPORT_BUFFER *restrict buf, unsigned int col, const char *restrict value, size_t len)
+{
+	char sep;
+
+	if(col)
+	{
+		sep = (buf->format == SQL_EXPORT_CSV ? ',' : '\t');
+		if(sql_export_data_(buf, &sep, 1))
+		{
+			return -1;
+		}
+	}
+	if(buf->format == SQL_EXPORT_CSV)
+	{
+		return sql_export_csv_(buf, value, len);
+	}
+	return sql_export_tsv_(buf, value, len);
+}
+
+/* Terminate a row */
+int
+sql_export_eol_(SQL_EXPORT_BUFFER *buf)
+{
+	return sql_export_data_(buf, "\n", 1);
+}
+
+/* Pass the contents of the buffer to the sink */
+static int
+sql_export_flush_(SQL_EXPORT_BUFFER *buf)
+{
+	const char *p;
+	size_t len;
+	ssize_t n;
+
+	if(buf->failed)
+	{
+		return -1;
+	}
+	if(!buf->len)
+	{
+		return 0;
+	}
+	if(buf->sink->write)
+	{
+		if(buf->sink->write(buf->sink->userdata, buf->buf, buf->len))
+		{
+			buf->failed = 1;
+			buf->sql->api->set_error(buf->sql, "58030", "Failed to write exported data");
+			return -1;
+		}
+		buf->len = 0;
+		return 0;
+	}
+	p = buf->buf;
+	len = buf->len;
+	while(len)
+	{
+		n = write(buf->sink->fd, p, len);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			buf->failed = 1;
+			buf->sql->api->set_error(buf->sql, "58030", strerror(errno));
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	buf->len = 0;
+	return 0;
+}
+
+static int
+sql_export_csv_(SQL_EXPORT_BUFFER *restrict buf, const char *restrict value, size_t len)
+{
+	const char *p, *s, *e;
+
+	if(!value)
+	{
+		return 0;
+	}
+	/* Values are only quoted if they need to be */
+	e = value + len;
+	for(p = value; p < e; p++)
+	{
+		if(*p == ',' || *p == '"' || *p == '\n' || *p == '\r')
+		{
+			break;
+		}
+	}
+	if(len && p == e)
+	{
+		return sql_export_data_(buf, value, len);
+	}
+	if(sql_export_data_(buf, "\"", 1))
+	{
+		return -1;
+	}
+	for(s = value; (p = memchr(s, '"', e - s)); s = p + 1)
+	{
+		if(sql_export_data_(buf, s, p - s + 1) || sql_export_data_(buf, "\"", 1))
+		{
+			return -1;
+		}
+	}
+	if(sql_export_data_(buf, s, e - s))
+	{
+		return -1;
+	}
+	return sql_export_data_(buf, "\"", 1);
+}
+
+static int
+sql_export_tsv_(SQL_EXPORT_BUFFER *restrict buf, const char *restrict value, size_t len)
+{
+	const char *p, *s, *e;
+	char esc[2];
+
+	if(!value)
+	{
+		return sql_export_data_(buf, "\\N", 2);
+	}
+	e = value + len;
+	esc[0] = '\\';
+	for(s = p = value; p < e; p++)
+	{
+		switch(*p)
+		{
+		case '\\':
+			esc[1] = '\\';
+			break;
+		case '\t':
+			esc[1] = 't';
+			break;
+		case '\n':
+			esc[1] = 'n';
+			break;
+		case '\r':
+			esc[1] = 'r';
+			break;
+		default:
+			continue;
+		}
+		if(sql_export_data_(buf, s, p - s) || sql_export_data_(buf, esc, 2))
+		{
+			return -1;
+		}
+		s = p + 1;
+	}
+	return sql_export_data_(buf, s, e - s);
+}
@@ -43,3 +43,9 @@ sql_field_width(SQL_FIELD *field)
 {
 	return field->api->width(field);
 }
+
+SQL_FIELD_TYPE
+sql_field_type(SQL_FIELD *field)
+{
+	return field->api->type(field);
+}
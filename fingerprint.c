@@ -0,0 +1,490 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+/* A query's fingerprint is a hash of its normalised text, in which
+ * literals, placeholders and printf-style conversions are replaced by ?,
+ * comments are removed, whitespace is collapsed, and lists consisting only
+ * of values (such as the contents of IN (...) or of each row of a
+ * multi-row VALUES clause) are collapsed to (...). Queries which differ
+ * only in the values they contain, whether inlined by sql_queryf() or
+ * bound as parameters, therefore share a fingerprint.
+ *
+ * Once sql_fingerprint_set_limit() has been invoked, each query executed by
+ * any connection in the process is aggregated by fingerprint into a
+ * bounded table; when it is full, the entry with the fewest calls is
+ * evicted to make room for a new one.
+ */
+
+/* Normalised text up to this length is built on the stack */
+#define SQL_FINGERPRINT_STACK           1024
+
+typedef struct sql_fingerprint_entry_struct SQL_FINGERPRINT_ENTRY;
+
+struct sql_fingerprint_entry_struct
+{
+	SQL_FINGERPRINT_ENTRY *hnext;
+	SQL_FINGERPRINT_STATS stats;
+};
+
+static pthread_mutex_t sql_fingerprint_lock_ = PTHREAD_MUTEX_INITIALIZER;
+static size_t sql_fingerprint_limit_;
+static size_t sql_fingerprint_count_;
+static size_t sql_fingerprint_nbuckets_;
+static SQL_FINGERPRINT_ENTRY **sql_fingerprint_buckets_;
+static SQL_FINGERPRINT_ENTRY *sql_fingerprint_entries_;
+
+static size_t sql_fingerprint_normalise_(const char *restrict query, char *restrict buf);
+static unsigned long long sql_fingerprint_hash_(const char *str);
+static int sql_fingerprint_word_(int c);
+static int sql_fingerprint_compare_(const void *a, const void *b);
+
+/* Set the maximum number of fingerprints whose statistics are retained,
+ * discarding any existing statistics; a limit of zero disables them
+ */
+int
+sql_fingerprint_set_limit(size_t limit)
+{
+	SQL_FINGERPRINT_ENTRY **buckets, *entries;
+	size_t nbuckets;
+
+	buckets = NULL;
+	entries = NULL;
+	nbuckets = 0;
+	if(limit)
+	{
+		/* Keep the load factor of the hash table at or below 0.5 */
+		nbuckets = 16;
+		while(nbuckets < limit * 2)
+		{
+			nbuckets *= 2;
+		}
+		buckets = (SQL_FINGERPRINT_ENTRY **) sql_calloc_(nbuckets, sizeof(SQL_FINGERPRINT_ENTRY *));
+		entries = (SQL_FINGERPRINT_ENTRY *) sql_calloc_(limit, sizeof(SQL_FINGERPRINT_ENTRY));
+		if(!buckets || !entries)
+		{
+			sql_free_(buckets);
+			sql_free_(entries);
+			return -1;
+		}
+	}
+	pthread_mutex_lock(&sql_fingerprint_lock_);
+	sql_free_(sql_fingerprint_buckets_);
+	sql_free_(sql_fingerprint_entries_);
+	sql_fingerprint_buckets_ = buckets;
+	sql_fingerprint_entries_ = entries;
+	sql_fingerprint_nbuckets_ = nbuckets;
+	sql_fingerprint_count_ = 0;
+	__atomic_store_n(&sql_fingerprint_limit_, limit, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&sql_fingerprint_lock_);
+	return 0;
+}
+
+/* Discard the statistics gathered so far */
+int
+sql_fingerprint_reset(void)
+{
+	pthread_mutex_lock(&sql_fingerprint_lock_);
+	if(sql_fingerprint_limit_)
+	{
+		memset(sql_fingerprint_buckets_, 0, sql_fingerprint_nbuckets_ * sizeof(SQL_FINGERPRINT_ENTRY *));
+		memset(sql_fingerprint_entries_, 0, sql_fingerprint_limit_ * sizeof(SQL_FINGERPRINT_ENTRY));
+	}
+	sql_fingerprint_count_ = 0;
+	pthread_mutex_unlock(&sql_fingerprint_lock_);
+	return 0;
+}
+
+/* Obtain the statistics for up to max fingerprints, in descending order of
+ * total time spent executing them; returns the number of entries stored,
+ * or (size_t) -1 on error
+ */
+size_t
+sql_fingerprint_top(SQL_FINGERPRINT_STATS *stats, size_t max)
+{
+	SQL_FINGERPRINT_STATS *all;
+	size_t c, count;
+
+	pthread_mutex_lock(&sql_fingerprint_lock_);
+	count = sql_fingerprint_count_;
+	if(!count || !max)
+	{
+		pthread_mutex_unlock(&sql_fingerprint_lock_);
+		return 0;
+	}
+	all = (SQL_FINGERPRINT_STATS *) sql_malloc_(count * sizeof(SQL_FINGERPRINT_STATS));
+	if(!all)
+	{
+		pthread_mutex_unlock(&sql_fingerprint_lock_);
+		return (size_t) -1;
+	}
+	for(c = 0; c < count; c++)
+	{
+		all[c] = sql_fingerprint_entries_[c].stats;
+	}
+	pthread_mutex_unlock(&sql_fingerprint_lock_);
+	qsort(all, count, sizeof(SQL_FINGERPRINT_STATS), sql_fingerprint_compare_);
+	if(count > max)
+	{
+		count = max;
+	}
+	memcpy(stats, all, count * sizeof(SQL_FINGERPRINT_STATS));
+	sql_free_(all);
+	return count;
+}
+
+/* Compute the fingerprint of a query, storing as much of its normalised
+ * text as will fit in buf if it is not NULL
+ */
+unsigned long long
+sql_fingerprint(const char *restrict query, char *restrict buf, size_t buflen)
+{
+	char sbuf[SQL_FINGERPRINT_STACK], *text;
+	unsigned long long hash;
+	size_t len;
+
+	len = strlen(query);
+	text = sbuf;
+	if(len * 2 + 1 > sizeof(sbuf))
+	{
+		text = (char *) sql_malloc_(len * 2 + 1);
+		if(!text)
+		{
+			return 0;
+		}
+	}
+	len = sql_fingerprint_normalise_(query, text);
+	hash = sql_fingerprint_hash_(text);
+	if(buf && buflen)
+	{
+		if(len >= buflen)
+		{
+			len = buflen - 1;
+		}
+		memcpy(buf, text, len);
+		buf[len] = 0;
+	}
+	if(text != sbuf)
+	{
+		sql_free_(text);
+	}
+	return hash;
+}
+
+/* Returns nonzero if fingerprint statistics are enabled */
+int
+sql_fingerprint_enabled_(void)
+{
+	return __atomic_load_n(&sql_fingerprint_limit_, __ATOMIC_RELAXED) != 0;
+}
+
+/* Record an operation against a fingerprint; the execution of a query
+ * (op SQL_STATS_QUERY) creates an entry for it if needed, with query
+ * normalised to provide its text, while fetches only update the totals of
+ * an existing entry
+ */
+void
+sql_fingerprint_record_(unsigned long long fingerprint, const char *restrict query, SQL_STATS_OP op, unsigned long long nsec, unsigned long long rows, int status)
+{
+	SQL_FINGERPRINT_ENTRY *entry, **pp;
+	size_t c, bucket;
+
+	pthread_mutex_lock(&sql_fingerprint_lock_);
+	if(!sql_fingerprint_limit_)
+	{
+		/* Disabled since the caller checked */
+		pthread_mutex_unlock(&sql_fingerprint_lock_);
+		return;
+	}
+	bucket = fingerprint & (sql_fingerprint_nbuckets_ - 1);
+	for(entry = sql_fingerprint_buckets_[bucket]; entry; entry = entry->hnext)
+	{
+		if(entry->stats.fingerprint == fingerprint)
+		{
+			break;
+		}
+	}
+	if(!entry)
+	{
+		if(op != SQL_STATS_QUERY)
+		{
+			pthread_mutex_unlock(&sql_fingerprint_lock_);
+			return;
+		}
+		if(sql_fingerprint_count_ < sql_fingerprint_limit_)
+		{
+			entry = &(sql_fingerprint_entries_[sql_fingerprint_count_]);
+			sql_fingerprint_count_++;
+		}
+		else
+		{
+			/* Evict the least-called entry */
+			entry = sql_fingerprint_entries_;
+			for(c = 1; c < sql_fingerprint_count_; c++)
+			{
+				if(sql_fingerprint_entries_[c].stats.calls < entry->stats.calls)
+				{
+					entry = &(sql_fingerprint_entries_[c]);
+				}
+			}
+			for(pp = &(sql_fingerprint_buckets_[entry->stats.fingerprint & (sql_fingerprint_nbuckets_ - 1)]); *pp; pp = &((*pp)->hnext))
+			{
+				if(*pp == entry)
+				{
+					*pp = entry->hnext;
+					break;
+				}
+			}
+		}
+		memset(entry, 0, sizeof(SQL_FINGERPRINT_ENTRY));
+		entry->stats.fingerprint = fingerprint;
+		if(query)
+		{
+			sql_fingerprint(query, entry->stats.query, sizeof(entry->stats.query));
+		}
+		entry->hnext = sql_fingerprint_buckets_[bucket];
+		sql_fingerprint_buckets_[bucket] = entry;
+	}
+	if(op == SQL_STATS_QUERY)
+	{
+		entry->stats.calls++;
+		if(nsec > entry->stats.max_nsec)
+		{
+			entry->stats.max_nsec = nsec;
+		}
+	}
+	if(status)
+	{
+		entry->stats.errors++;
+	}
+	entry->stats.total_nsec += nsec;
+	entry->stats.rows += rows;
+	pthread_mutex_unlock(&sql_fingerprint_lock_);
+}
+
+/* Normalise a query into buf, which must be at least twice the length of
+ * the query plus one byte, returning the length of the normalised text
+ */
+static size_t
+sql_fingerprint_normalise_(const char *restrict query, char *restrict buf)
+{
+	const char *p, *s;
+	char *out, *q;
+	int space, close;
+
+	out = buf;
+	space = 0;
+	for(p = query; *p;)
+	{
+		if(isspace((unsigned char) *p))
+		{
+			space = 1;
+			p++;
+			continue;
+		}
+		if(p[0] == '-' && p[1] == '-')
+		{
+			for(; *p && *p != '\n'; p++);
+			space = 1;
+			continue;
+		}
+		if(p[0] == '/' && p[1] == '*')
+		{
+			for(p += 2; *p && !(p[0] == '*' && p[1] == '/'); p++);
+			p += (*p ? 2 : 0);
+			space = 1;
+			continue;
+		}
+		/* Whitespace is retained only where it separates two tokens, and
+		 * always follows a comma
+		 */
+		if(space && out > buf && out[-1] != '(' && *p != ',' && *p != ')')
+		{
+			*out = ' ';
+			out++;
+		}
+		space = 0;
+		if(*p == '\'')
+		{
+			/* A string literal */
+			for(p++; *p; p++)
+			{
+				if(*p == '\\' && p[1])
+				{
+					p++;
+				}
+				else if(*p == '\'')
+				{
+					if(p[1] != '\'')
+					{
+						break;
+					}
+					p++;
+				}
+			}
+			p += (*p ? 1 : 0);
+			*out = '?';
+			out++;
+			continue;
+		}
+		if(*p == '"' || *p == '`' || *p == '[')
+		{
+			/* A quoted identifier */
+			close = (*p == '[' ? ']' : *p);
+			s = strchr(p + 1, close);
+			s = (s ? s + 1 : strchr(p, 0));
+			memcpy(out, p, s - p);
+			out += s - p;
+			p = s;
+			continue;
+		}
+		if(isdigit((unsigned char) *p) || (*p == '.' && isdigit((unsigned char) p[1])))
+		{
+			/* A numeric literal */
+			for(; isalnum((unsigned char) *p) || *p == '.' || *p == '_'; p++)
+			{
+				if((*p == 'e' || *p == 'E') && (p[1] == '+' || p[1] == '-'))
+				{
+					p++;
+				}
+			}
+			*out = '?';
+			out++;
+			continue;
+		}
+		if(isalpha((unsigned char) *p) || *p == '_')
+		{
+			/* A keyword or identifier */
+			for(; sql_fingerprint_word_(*p); p++, out++)
+			{
+				*out = *p;
+			}
+			continue;
+		}
+		if(*p == '?' || (*p == '$' && isdigit((unsigned char) p[1])) ||
+		   (*p == ':' && (isalpha((unsigned char) p[1]) || p[1] == '_')))
+		{
+			/* A placeholder */
+			for(p++; sql_fingerprint_word_(*p); p++);
+			*out = '?';
+			out++;
+			continue;
+		}
+		if(*p == '%')
+		{
+			/* A printf-style conversion, as passed to sql_queryf() */
+			for(s = p + 1; *s && strchr("-+#0123456789.hlLjzt", *s); s++);
+			if(*s && strchr("diouxXeEfFgGcsQqp", *s))
+			{
+				p = s + 1;
+				*out = '?';
+				out++;
+				continue;
+			}
+			if(p[1] == '%')
+			{
+				p++;
+			}
+		}
+		*out = *p;
+		out++;
+		if(*p == ',')
+		{
+			space = 1;
+		}
+		p++;
+		if(out[-1] != ')')
+		{
+			continue;
+		}
+		/* Collapse a parenthesised list of values to (...) */
+		for(q = out - 2; q > buf && *q == '?'; q -= 3)
+		{
+			if(q[-1] == '(')
+			{
+				break;
+			}
+			if(q - buf < 3 || q[-1] != ' ' || q[-2] != ',')
+			{
+				q = buf;
+				break;
+			}
+		}
+		if(q > buf && *q == '?' && q[-1] == '(')
+		{
+			out = q - 1;
+			memcpy(out, "(...)", 5);
+			out += 5;
+			/* ...and adjacent lists of values, such as the rows of a
+			 * multi-row INSERT, to a single one
+			 */
+			if(out - buf >= 12 && !memcmp(out - 12, "(...), (...)", 12))
+			{
+				out -= 7;
+			}
+		}
+	}
+	*out = 0;
+	return out - buf;
+}
+
+/* FNV-1a */
+static unsigned long long
+sql_fingerprint_hash_(const char *str)
+{
+	unsigned long long hash;
+
+	hash = 14695981039346656037ULL;
+	for(; *str; str++)
+	{
+		hash ^= (unsigned char) *str;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static int
+sql_fingerprint_word_(int c)
+{
+	return isalnum((unsigned char) c) || c == '_' || c == '$';
+}
+
+/* Order by descending total time */
+static int
+sql_fingerprint_compare_(const void *a, const void *b)
+{
+	const SQL_FINGERPRINT_STATS *sa, *sb;
+
+	sa = (const SQL_FINGERPRINT_STATS *) a;
+	sb = (const SQL_FINGERPRINT_STATS *) b;
+	if(sa->total_nsec > sb->total_nsec)
+	{
+		return -1;
+	}
+	if(sa->total_nsec < sb->total_nsec)
+	{
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,1114 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include "p_libsql.h"
+
+/* Format strings passed to sql_queryf() and sql_executef() are compiled
+ * into a list of operations, which is cached by the connection so that a
+ * format string used repeatedly is only parsed once. Cached formats are
+ * keyed by the address of the format string, and checked against a copy
+ * of its text in case the storage has been re-used.
+ *
+ * Queries are built in a single pass into an output buffer retained by the
+ * connection between calls, with %q and %Q arguments escaped directly into
+ * it. The conversions are those of printf(), except that %q interpolates a
+ * string escaped for use within a quoted literal, and %Q does the same but
+ * adds the quotes. Both produce an unquoted NULL if the argument is NULL.
+ * A malformed conversion is copied to the output without its leading %,
+ * while a length modifier applied to %s, %q or %Q causes formatting to
+ * fail.
+ *
+ * If SQL_FLAG_AUTOPARAM is set, the cached entry for a format string also
+ * holds a prepared statement created from it by sql_template_create_(),
+ * so that sql_queryf() and sql_executef() can bind their arguments as
+ * parameters instead of interpolating them. Format strings which can't be
+ * expressed this way (for example, because they use %s, or a conversion
+ * within a quoted literal) are remembered and formatted as text, as are
+ * those whose statements fail to execute where the same query formatted
+ * as text succeeds. A query whose statement can't be prepared or executed
+ * is always retried as text.
+ */
+
+#define SQL_FORMAT_CACHE_SIZE          64
+
+/* Output buffers larger than this aren't retained between calls */
+#define SQL_FORMAT_RETAIN              1048576
+
+/* Widths and precisions are clamped to this value */
+#define SQL_FORMAT_MAXWIDTH            0x3fff
+
+/* Values of the width and precision of an operation */
+#define SQL_FORMAT_NONE                -1
+#define SQL_FORMAT_STAR                -2
+
+typedef enum
+{
+	SQL_FMT_LITERAL,
+	SQL_FMT_INT,
+	SQL_FMT_UINT,
+	SQL_FMT_PRINTF,
+	SQL_FMT_STRING,
+	SQL_FMT_QUOTE,
+	SQL_FMT_COUNT
+} SQL_FORMAT_OPCODE;
+
+typedef enum
+{
+	SQL_FMT_ARG_INT,
+	SQL_FMT_ARG_SHORT,
+	SQL_FMT_ARG_LONG,
+	SQL_FMT_ARG_LLONG,
+	SQL_FMT_ARG_SIZE,
+	SQL_FMT_ARG_PTRDIFF,
+	SQL_FMT_ARG_DOUBLE,
+	SQL_FMT_ARG_LDOUBLE,
+	SQL_FMT_ARG_STRING,
+	SQL_FMT_ARG_POINTER
+} SQL_FORMAT_ARG;
+
+typedef struct sql_format_op_struct SQL_FORMAT_OP;
+typedef struct sql_format_struct SQL_FORMAT;
+typedef struct sql_format_buffer_struct SQL_FORMAT_BUFFER;
+
+struct sql_format_op_struct
+{
+	SQL_FORMAT_OPCODE op;
+	SQL_FORMAT_ARG arg;
+	/* Literal text, relative to the start of the format string */
+	size_t off;
+	size_t len;
+	int width;
+	int prec;
+	/* 1 for %q, 2 for %Q */
+	int quote;
+	/* Whether the specification passed to snprintf() has a precision */
+	int hasprec;
+	/* The specification passed to snprintf(), which always takes the width
+	 * (and precision, if present) as arguments; empty if not required
+	 */
+	char spec[16];
+};
+
+struct sql_format_struct
+{
+	const char *key;
+	char *text;
+	/* The automatically-parameterised statement, if any */
+	SQL_STATEMENT *stmt;
+	int noparam;
+	/* Set if the format contains a conversion which can't be performed */
+	int invalid;
+	size_t nops;
+	size_t opsalloc;
+	SQL_FORMAT_OP *ops;
+};
+
+struct sql_format_buffer_struct
+{
+	char *buf;
+	size_t len;
+	size_t alloc;
+};
+
+struct sql_formatter_struct
+{
+	SQL_FORMAT_BUFFER out;
+	int busy;
+	SQL_FORMAT *formats[SQL_FORMAT_CACHE_SIZE];
+};
+
+static SQL_FORMAT *sql_format_lookup_(SQL_FORMATTER *restrict f, const char *restrict format);
+static SQL_FORMAT *sql_format_compile_(const char *format);
+static void sql_format_destroy_(SQL_FORMAT *fmt);
+static SQL_FORMAT_OP *sql_format_add_(SQL_FORMAT *fmt);
+static int sql_format_literal_(SQL_FORMAT *fmt, size_t off, size_t len);
+static int sql_format_spec_(SQL_FORMAT_OP *restrict op, const char *restrict *restrict src);
+static int sql_format_getint_(const char *restrict *restrict src);
+static int sql_format_run_(SQL *restrict sql, const SQL_FORMAT *restrict fmt, SQL_FORMAT_BUFFER *restrict out, va_list ap);
+static int sql_format_printf_(SQL_FORMAT_BUFFER *restrict out, const SQL_FORMAT_OP *restrict op, int width, int prec, va_list *ap);
+static int sql_format_quote_(SQL *restrict sql, SQL_FORMAT_BUFFER *restrict out, const SQL_FORMAT_OP *restrict op, int width, int prec, const char *restrict str);
+static int sql_format_reserve_(SQL_FORMAT_BUFFER *out, size_t len);
+
+/* Format a query, returning a buffer which must be passed to
+ * sql_format_release_() once the query has been executed
+ */
+char *
+sql_format_query_(SQL *restrict sql, const char *restrict format, va_list ap)
+{
+	SQL_FORMATTER *f;
+	SQL_FORMAT *fmt;
+	SQL_FORMAT_BUFFER tmp;
+
+	f = sql->formatter;
+	if(!f)
+	{
+		f = (SQL_FORMATTER *) sql_calloc_(1, sizeof(SQL_FORMATTER));
+		if(!f)
+		{
+			sql->api->set_error(sql, "58000", "Memory allocation error");
+			return NULL;
+		}
+		sql->formatter = f;
+	}
+	fmt = sql_format_lookup_(f, format);
+	if(!fmt)
+	{
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		return NULL;
+	}
+	if(f->busy)
+	{
+		/* A query is being formatted while a previous one is still in
+		 * use (for example, from within a logging callback), so it can't
+		 * use the connection's buffer
+		 */
+		memset(&tmp, 0, sizeof(tmp));
+		if(sql_format_run_(sql, fmt, &tmp, ap))
+		{
+			sql_free_(tmp.buf);
+			return NULL;
+		}
+		return tmp.buf;
+	}
+	f->out.len = 0;
+	if(sql_format_run_(sql, fmt, &(f->out), ap))
+	{
+		return NULL;
+	}
+	f->busy = 1;
+	return f->out.buf;
+}
+
+/* Release a query returned by sql_format_query_() */
+void
+sql_format_release_(SQL *restrict sql, char *restrict query)
+{
+	SQL_FORMATTER *f;
+
+	f = sql->formatter;
+	if(!f || query != f->out.buf)
+	{
+		sql_free_(query);
+		return;
+	}
+	f->busy = 0;
+	if(f->out.alloc > SQL_FORMAT_RETAIN)
+	{
+		sql_free_(f->out.buf);
+		memset(&(f->out), 0, sizeof(f->out));
+	}
+}
+
+/* Obtain the prepared statement for a format string, preparing it if it
+ * hasn't been already; returns NULL if the format string can't be turned
+ * into a prepared statement, or the cached one is already in use, in which
+ * case the query should be formatted as text instead. As with the statement
+ * cache, the caller receives an additional reference to the statement.
+ */
+SQL_STATEMENT *
+sql_format_statement_(SQL *restrict sql, const char *restrict format)
+{
+	SQL_FORMATTER *f;
+	SQL_FORMAT *fmt;
+	SQL_TEMPLATE *tmpl;
+	SQL_STATEMENT *stmt;
+
+	f = sql->formatter;
+	if(!f)
+	{
+		f = (SQL_FORMATTER *) sql_calloc_(1, sizeof(SQL_FORMATTER));
+		if(!f)
+		{
+			return NULL;
+		}
+		sql->formatter = f;
+	}
+	fmt = sql_format_lookup_(f, format);
+	if(!fmt || fmt->noparam)
+	{
+		return NULL;
+	}
+	if(fmt->stmt)
+	{
+		if(fmt->stmt->refcount != 1)
+		{
+			return NULL;
+		}
+		fmt->stmt->api->addref(fmt->stmt);
+		return fmt->stmt;
+	}
+	tmpl = sql_template_create_(sql, format);
+	if(!tmpl)
+	{
+		if(errno == ENOTSUP)
+		{
+			fmt->noparam = 1;
+		}
+		return NULL;
+	}
+	/* If the statement can't be prepared, formatting it as text will
+	 * report the error
+	 */
+	stmt = sql->api->statement(sql, tmpl->native);
+	if(!stmt)
+	{
+		sql_template_destroy_(tmpl);
+		return NULL;
+	}
+	stmt->tmpl = tmpl;
+	stmt->cached = 1;
+	fmt->stmt = stmt;
+	stmt->api->addref(stmt);
+	return stmt;
+}
+
+/* Discard a prepared statement obtained from sql_format_statement_(),
+ * typically because it failed to execute, so that it will be prepared
+ * afresh next time
+ */
+void
+sql_format_discard_(SQL *restrict sql, SQL_STATEMENT *restrict stmt)
+{
+	SQL_FORMAT *fmt;
+	size_t c;
+
+	if(!sql->formatter)
+	{
+		return;
+	}
+	for(c = 0; c < SQL_FORMAT_CACHE_SIZE; c++)
+	{
+		fmt = sql->formatter->formats[c];
+		if(fmt && fmt->stmt == stmt)
+		{
+			fmt->stmt = NULL;
+			stmt->cached = 0;
+			stmt->api->release(stmt);
+			return;
+		}
+	}
+}
+
+/* Record that a format string should always be formatted as text, because
+ * its prepared statement failed where the query formatted as text did not
+ */
+void
+sql_format_noparam_(SQL *restrict sql, const char *restrict format)
+{
+	SQL_FORMAT *fmt;
+
+	if(!sql->formatter)
+	{
+		return;
+	}
+	fmt = sql_format_lookup_(sql->formatter, format);
+	if(fmt)
+	{
+		fmt->noparam = 1;
+	}
+}
+
+/* Free the formatting state of a connection; invoked by engines when a
+ * connection is freed
+ */
+void
+sql_formatter_destroy_(SQL_FORMATTER *f)
+{
+	size_t c;
+
+	if(!f)
+	{
+		return;
+	}
+	for(c = 0; c < SQL_FORMAT_CACHE_SIZE; c++)
+	{
+		sql_format_destroy_(f->formats[c]);
+	}
+	sql_free_(f->out.buf);
+	sql_free_(f);
+}
+
+/* Obtain the compiled form of a format string, compiling it if it isn't
+ * already cached
+ */
+static SQL_FORMAT *
+sql_format_lookup_(SQL_FORMATTER *restrict f, const char *restrict format)
+{
+	SQL_FORMAT *fmt;
+	size_t slot;
+
+	slot = ((uintptr_t) format >> 3) % SQL_FORMAT_CACHE_SIZE;
+	fmt = f->formats[slot];
+	if(fmt && fmt->key == format && !strcmp(fmt->text, format))
+	{
+		return fmt;
+	}
+	fmt = sql_format_compile_(format);
+	if(!fmt)
+	{
+		return NULL;
+	}
+	sql_format_destroy_(f->formats[slot]);
+	f->formats[slot] = fmt;
+	return fmt;
+}
+
+static SQL_FORMAT *
+sql_format_compile_(const char *format)
+{
+	SQL_FORMAT *fmt;
+	SQL_FORMAT_OP op, *p;
+	const char *s, *start;
+	size_t len;
+	int r;
+
+	fmt = (SQL_FORMAT *) sql_calloc_(1, sizeof(SQL_FORMAT));
+	if(!fmt)
+	{
+		return NULL;
+	}
+	fmt->key = format;
+	fmt->text = sql_strdup_(format);
+	if(!fmt->text)
+	{
+		sql_free_(fmt);
+		return NULL;
+	}
+	s = fmt->text;
+	while(*s)
+	{
+		if(*s != '%')
+		{
+			len = strcspn(s, "%");
+			if(sql_format_literal_(fmt, s - fmt->text, len))
+			{
+				break;
+			}
+			s += len;
+			continue;
+		}
+		start = s;
+		s++;
+		if(*s == '%')
+		{
+			/* The second % of %% is a literal */
+			if(sql_format_literal_(fmt, s - fmt->text, 1))
+			{
+				break;
+			}
+			s++;
+			continue;
+		}
+		r = sql_format_spec_(&op, &s);
+		if(r > 0)
+		{
+			fmt->invalid = 1;
+			continue;
+		}
+		if(r)
+		{
+			/* Malformed: the text following the % is output as-is */
+			s = start + 1;
+			continue;
+		}
+		p = sql_format_add_(fmt);
+		if(!p)
+		{
+			break;
+		}
+		*p = op;
+	}
+	if(*s)
+	{
+		sql_format_destroy_(fmt);
+		return NULL;
+	}
+	return fmt;
+}
+
+static void
+sql_format_destroy_(SQL_FORMAT *fmt)
+{
+	if(!fmt)
+	{
+		return;
+	}
+	if(fmt->stmt)
+	{
+		/* If the statement is still in use, it will be freed when the
+		 * caller destroys it
+		 */
+		fmt->stmt->cached = 0;
+		fmt->stmt->api->release(fmt->stmt);
+	}
+	sql_free_(fmt->ops);
+	sql_free_(fmt->text);
+	sql_free_(fmt);
+}
+
+static SQL_FORMAT_OP *
+sql_format_add_(SQL_FORMAT *fmt)
+{
+	SQL_FORMAT_OP *p;
+	size_t n;
+
+	if(fmt->nops == fmt->opsalloc)
+	{
+		n = (fmt->opsalloc ? fmt->opsalloc * 2 : 8);
+		p = (SQL_FORMAT_OP *) sql_realloc_(fmt->ops, n * sizeof(SQL_FORMAT_OP));
+		if(!p)
+		{
+			return NULL;
+		}
+		fmt->ops = p;
+		fmt->opsalloc = n;
+	}
+	p = &(fmt->ops[fmt->nops]);
+	fmt->nops++;
+	memset(p, 0, sizeof(SQL_FORMAT_OP));
+	return p;
+}
+
+/* Add literal text, extending the previous operation if it is a literal
+ * immediately preceding this one
+ */
+static int
+sql_format_literal_(SQL_FORMAT *fmt, size_t off, size_t len)
+{
+	SQL_FORMAT_OP *p;
+
+	if(fmt->nops)
+	{
+		p = &(fmt->ops[fmt->nops - 1]);
+		if(p->op == SQL_FMT_LITERAL && p->off + p->len == off)
+		{
+			p->len += len;
+			return 0;
+		}
+	}
+	p = sql_format_add_(fmt);
+	if(!p)
+	{
+		return -1;
+	}
+	p->op = SQL_FMT_LITERAL;
+	p->off = off;
+	p->len = len;
+	return 0;
+}
+
+/* Parse a conversion specification, %[flags][width][.prec][modifier]type,
+ * where *src points to the character following the %; returns -1 if the
+ * specification is malformed, or 1 if it is well-formed but can't be
+ * performed
+ */
+static int
+sql_format_spec_(SQL_FORMAT_OP *restrict op, const char *restrict *restrict src)
+{
+	const char *s;
+	char flags[8], mod[3], *p;
+	int modifier, simple;
+	char type;
+
+	memset(op, 0, sizeof(SQL_FORMAT_OP));
+	s = *src;
+	p = flags;
+	while(*s && strchr("+- #0", *s))
+	{
+		if(!memchr(flags, *s, p - flags) && p - flags < 5)
+		{
+			*p = *s;
+			p++;
+		}
+		s++;
+	}
+	*p = 0;
+	op->width = SQL_FORMAT_NONE;
+	if(*s == '*')
+	{
+		op->width = SQL_FORMAT_STAR;
+		s++;
+	}
+	else if(isdigit((unsigned char) *s))
+	{
+		op->width = sql_format_getint_(&s);
+	}
+	op->prec = SQL_FORMAT_NONE;
+	if(*s == '.')
+	{
+		s++;
+		if(*s == '*')
+		{
+			op->prec = SQL_FORMAT_STAR;
+			s++;
+		}
+		else if(isdigit((unsigned char) *s))
+		{
+			op->prec = sql_format_getint_(&s);
+		}
+		else
+		{
+			return -1;
+		}
+	}
+	modifier = 0;
+	mod[0] = 0;
+	switch(*s)
+	{
+	case 'h':
+	case 'l':
+	case 'L':
+	case 'z':
+	case 't':
+		modifier = *s;
+		s++;
+		if(modifier == 'l' && *s == 'l')
+		{
+			modifier = 'L';
+			s++;
+		}
+		break;
+	}
+	type = *s;
+	if(!type || !strchr("diouxXfegEGcsqQpn", type))
+	{
+		return -1;
+	}
+	s++;
+	simple = (!flags[0] && op->width == SQL_FORMAT_NONE);
+	op->hasprec = 1;
+	switch(type)
+	{
+	case 'd':
+	case 'i':
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+		switch(modifier)
+		{
+		case 0:
+			op->arg = SQL_FMT_ARG_INT;
+			break;
+		case 'h':
+			op->arg = SQL_FMT_ARG_SHORT;
+			strcpy(mod, "h");
+			break;
+		case 'l':
+			op->arg = SQL_FMT_ARG_LONG;
+			strcpy(mod, "l");
+			break;
+		case 'L':
+			op->arg = SQL_FMT_ARG_LLONG;
+			strcpy(mod, "ll");
+			break;
+		case 'z':
+			op->arg = SQL_FMT_ARG_SIZE;
+			strcpy(mod, "z");
+			break;
+		case 't':
+			op->arg = SQL_FMT_ARG_PTRDIFF;
+			strcpy(mod, "t");
+			break;
+		}
+		if(simple && op->prec == SQL_FORMAT_NONE && (type == 'd' || type == 'i'))
+		{
+			op->op = SQL_FMT_INT;
+		}
+		else if(simple && op->prec == SQL_FORMAT_NONE && type == 'u')
+		{
+			op->op = SQL_FMT_UINT;
+		}
+		else
+		{
+			op->op = SQL_FMT_PRINTF;
+		}
+		break;
+	case 'c':
+		if(modifier)
+		{
+			return -1;
+		}
+		op->op = SQL_FMT_PRINTF;
+		op->arg = SQL_FMT_ARG_INT;
+		op->hasprec = 0;
+		break;
+	case 'e':
+	case 'f':
+	case 'g':
+	case 'E':
+	case 'G':
+		if(modifier == 'L')
+		{
+			op->arg = SQL_FMT_ARG_LDOUBLE;
+			strcpy(mod, "L");
+		}
+		else if(!modifier || modifier == 'l')
+		{
+			op->arg = SQL_FMT_ARG_DOUBLE;
+		}
+		else
+		{
+			return -1;
+		}
+		op->op = SQL_FMT_PRINTF;
+		break;
+	case 's':
+	case 'q':
+	case 'Q':
+		if(modifier)
+		{
+			*src = s;
+			return 1;
+		}
+		op->arg = SQL_FMT_ARG_STRING;
+		if(type == 's')
+		{
+			op->op = (simple ? SQL_FMT_STRING : SQL_FMT_PRINTF);
+		}
+		else
+		{
+			op->op = SQL_FMT_QUOTE;
+			op->quote = (type == 'Q' ? 2 : 1);
+		}
+		type = 's';
+		break;
+	case 'p':
+		if(modifier)
+		{
+			return -1;
+		}
+		op->op = SQL_FMT_PRINTF;
+		op->arg = SQL_FMT_ARG_POINTER;
+		op->hasprec = 0;
+		break;
+	case 'n':
+		if(modifier)
+		{
+			return -1;
+		}
+		op->op = SQL_FMT_COUNT;
+		break;
+	}
+	if(op->op == SQL_FMT_PRINTF || (op->op == SQL_FMT_QUOTE && !simple))
+	{
+		snprintf(op->spec, sizeof(op->spec), "%%%s*%s%s%c", flags, (op->hasprec ? ".*" : ""), mod, type);
+	}
+	*src = s;
+	return 0;
+}
+
+static int
+sql_format_getint_(const char *restrict *restrict src)
+{
+	int i;
+
+	i = 0;
+	while(isdigit((unsigned char) **src))
+	{
+		if(i <= SQL_FORMAT_MAXWIDTH)
+		{
+			i = (i * 10) + (**src - '0');
+		}
+		(*src)++;
+	}
+	return (i > SQL_FORMAT_MAXWIDTH ? SQL_FORMAT_MAXWIDTH : i);
+}
+
+/* Execute a compiled format, appending the result to a buffer */
+static int
+sql_format_run_(SQL *restrict sql, const SQL_FORMAT *restrict fmt, SQL_FORMAT_BUFFER *restrict out, va_list ap)
+{
+	const SQL_FORMAT_OP *op;
+	unsigned long long uval;
+	long long ival;
+	const char *str;
+	char digits[24], *p;
+	size_t c, len;
+	int width, prec, neg, *ip;
+	va_list args;
+
+	if(fmt->invalid)
+	{
+		sql->api->set_error(sql, "0A000", "The format string contains an unsupported conversion");
+		return -1;
+	}
+	if(sql_format_reserve_(out, 0))
+	{
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		return -1;
+	}
+	/* A copy of the list is made so that it can be passed by reference */
+	va_copy(args, ap);
+	for(c = 0; c < fmt->nops; c++)
+	{
+		op = &(fmt->ops[c]);
+		width = (op->width == SQL_FORMAT_STAR ? va_arg(args, int) : op->width);
+		prec = (op->prec == SQL_FORMAT_STAR ? va_arg(args, int) : op->prec);
+		if(op->width == SQL_FORMAT_NONE)
+		{
+			width = 0;
+		}
+		if(width > SQL_FORMAT_MAXWIDTH || width < -SQL_FORMAT_MAXWIDTH)
+		{
+			width = (width < 0 ? -SQL_FORMAT_MAXWIDTH : SQL_FORMAT_MAXWIDTH);
+		}
+		if(prec > SQL_FORMAT_MAXWIDTH)
+		{
+			prec = SQL_FORMAT_MAXWIDTH;
+		}
+		switch(op->op)
+		{
+		case SQL_FMT_LITERAL:
+			if(sql_format_reserve_(out, op->len))
+			{
+				break;
+			}
+			memcpy(&(out->buf[out->len]), &(fmt->text[op->off]), op->len);
+			out->len += op->len;
+			continue;
+		case SQL_FMT_INT:
+		case SQL_FMT_UINT:
+			ival = 0;
+			uval = 0;
+			switch(op->arg)
+			{
+			case SQL_FMT_ARG_INT:
+				ival = va_arg(args, int);
+				uval = (unsigned int) ival;
+				break;
+			case SQL_FMT_ARG_SHORT:
+				ival = va_arg(args, int);
+				uval = (unsigned short) ival;
+				ival = (short) ival;
+				break;
+			case SQL_FMT_ARG_LONG:
+				ival = va_arg(args, long);
+				uval = (unsigned long) ival;
+				break;
+			case SQL_FMT_ARG_LLONG:
+				ival = va_arg(args, long long);
+				uval = (unsigned long long) ival;
+				break;
+			case SQL_FMT_ARG_SIZE:
+				uval = va_arg(args, size_t);
+				ival = (long long) uval;
+				break;
+			case SQL_FMT_ARG_PTRDIFF:
+				ival = va_arg(args, ptrdiff_t);
+				uval = (size_t) ival;
+				break;
+			default:
+				break;
+			}
+			neg = 0;
+			if(op->op == SQL_FMT_INT && ival < 0)
+			{
+				neg = 1;
+				uval = 0ULL - (unsigned long long) ival;
+			}
+			else if(op->op == SQL_FMT_INT)
+			{
+				uval = (unsigned long long) ival;
+			}
+			p = &(digits[sizeof(digits)]);
+			do
+			{
+				p--;
+				*p = '0' + (uval % 10);
+				uval /= 10;
+			}
+			while(uval);
+			if(neg)
+			{
+				p--;
+				*p = '-';
+			}
+			len = &(digits[sizeof(digits)]) - p;
+			if(sql_format_reserve_(out, len))
+			{
+				break;
+			}
+			memcpy(&(out->buf[out->len]), p, len);
+			out->len += len;
+			continue;
+		case SQL_FMT_PRINTF:
+			if(sql_format_printf_(out, op, width, prec, &args))
+			{
+				break;
+			}
+			continue;
+		case SQL_FMT_STRING:
+			str = va_arg(args, const char *);
+			if(!str)
+			{
+				str = "(null)";
+			}
+			len = (prec >= 0 ? strnlen(str, prec) : strlen(str));
+			if(sql_format_reserve_(out, len))
+			{
+				break;
+			}
+			memcpy(&(out->buf[out->len]), str, len);
+			out->len += len;
+			continue;
+		case SQL_FMT_QUOTE:
+			str = va_arg(args, const char *);
+			if(sql_format_quote_(sql, out, op, width, prec, str))
+			{
+				break;
+			}
+			continue;
+		case SQL_FMT_COUNT:
+			ip = va_arg(args, int *);
+			if(!ip)
+			{
+				va_end(args);
+				sql->api->set_error(sql, "HY009", "Invalid use of null pointer");
+				return -1;
+			}
+			*ip = (int) out->len;
+			continue;
+		}
+		va_end(args);
+		sql->api->set_error(sql, "58000", "Memory allocation error");
+		return -1;
+	}
+	va_end(args);
+	out->buf[out->len] = 0;
+	return 0;
+}
+
+/* Format a single value using snprintf(); ap is passed by reference so
+ * that the caller's list is advanced past the argument
+ */
+static int
+sql_format_printf_(SQL_FORMAT_BUFFER *restrict out, const SQL_FORMAT_OP *restrict op, int width, int prec, va_list *ap)
+{
+	union
+	{
+		int i;
+		long l;
+		long long ll;
+		size_t z;
+		ptrdiff_t t;
+		double d;
+		long double ld;
+		const char *s;
+		void *p;
+	} v;
+	size_t avail;
+	int n, pass;
+
+	switch(op->arg)
+	{
+	case SQL_FMT_ARG_INT:
+	case SQL_FMT_ARG_SHORT:
+		v.i = va_arg(*ap, int);
+		break;
+	case SQL_FMT_ARG_LONG:
+		v.l = va_arg(*ap, long);
+		break;
+	case SQL_FMT_ARG_LLONG:
+		v.ll = va_arg(*ap, long long);
+		break;
+	case SQL_FMT_ARG_SIZE:
+		v.z = va_arg(*ap, size_t);
+		break;
+	case SQL_FMT_ARG_PTRDIFF:
+		v.t = va_arg(*ap, ptrdiff_t);
+		break;
+	case SQL_FMT_ARG_DOUBLE:
+		v.d = va_arg(*ap, double);
+		break;
+	case SQL_FMT_ARG_LDOUBLE:
+		v.ld = va_arg(*ap, long double);
+		break;
+	case SQL_FMT_ARG_STRING:
+		v.s = va_arg(*ap, const char *);
+		if(!v.s)
+		{
+			v.s = "(null)";
+		}
+		break;
+	case SQL_FMT_ARG_POINTER:
+		v.p = va_arg(*ap, void *);
+		break;
+	}
+	/* Try formatting into the space available, and if it isn't enough,
+	 * make enough available and try again
+	 */
+	for(pass = 0; pass < 2; pass++)
+	{
+		avail = out->alloc - out->len;
+#define SQL_FORMAT_PRINTF_(value) \
+	(op->hasprec ? snprintf(&(out->buf[out->len]), avail, op->spec, width, prec, value) : \
+		snprintf(&(out->buf[out->len]), avail, op->spec, width, value))
+		switch(op->arg)
+		{
+		case SQL_FMT_ARG_INT:
+		case SQL_FMT_ARG_SHORT:
+			n = SQL_FORMAT_PRINTF_(v.i);
+			break;
+		case SQL_FMT_ARG_LONG:
+			n = SQL_FORMAT_PRINTF_(v.l);
+			break;
+		case SQL_FMT_ARG_LLONG:
+			n = SQL_FORMAT_PRINTF_(v.ll);
+			break;
+		case SQL_FMT_ARG_SIZE:
+			n = SQL_FORMAT_PRINTF_(v.z);
+			break;
+		case SQL_FMT_ARG_PTRDIFF:
+			n = SQL_FORMAT_PRINTF_(v.t);
+			break;
+		case SQL_FMT_ARG_DOUBLE:
+			n = SQL_FORMAT_PRINTF_(v.d);
+			break;
+		case SQL_FMT_ARG_LDOUBLE:
+			n = SQL_FORMAT_PRINTF_(v.ld);
+			break;
+		case SQL_FMT_ARG_STRING:
+			n = SQL_FORMAT_PRINTF_(v.s);
+			break;
+		case SQL_FMT_ARG_POINTER:
+			n = SQL_FORMAT_PRINTF_(v.p);
+			break;
+		default:
+			n = -1;
+			break;
+		}
+#undef SQL_FORMAT_PRINTF_
+		if(n < 0)
+		{
+			return -1;
+		}
+		if((size_t) n < avail)
+		{
+			out->len += n;
+			return 0;
+		}
+		if(sql_format_reserve_(out, n))
+		{
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/* Escape a string directly into the output buffer, optionally adding
+ * quotes; if a width or flags were specified, the string is padded first
+ * by formatting it into the free space at the end of the buffer
+ */
+static int
+sql_format_quote_(SQL *restrict sql, SQL_FORMAT_BUFFER *restrict out, const SQL_FORMAT_OP *restrict op, int width, int prec, const char *restrict str)
+{
+	const char *src;
+	size_t slen, elen, start;
+	int n;
+
+	if(!str)
+	{
+		if(sql_format_reserve_(out, 4))
+		{
+			return -1;
+		}
+		memcpy(&(out->buf[out->len]), "NULL", 4);
+		out->len += 4;
+		return 0;
+	}
+	start = out->len;
+	if(op->spec[0])
+	{
+		n = snprintf(NULL, 0, op->spec, width, prec, str);
+		if(n < 0 || sql_format_reserve_(out, (n * 3) + 3))
+		{
+			return -1;
+		}
+		snprintf(&(out->buf[start]), n + 1, op->spec, width, prec, str);
+		slen = n;
+		src = &(out->buf[start]);
+		out->len += slen;
+	}
+	else
+	{
+		slen = (prec >= 0 ? strnlen(str, prec) : strlen(str));
+		if(sql_format_reserve_(out, (slen * 2) + 3))
+		{
+			return -1;
+		}
+		src = str;
+	}
+	if(op->quote == 2)
+	{
+		out->buf[out->len] = '\'';
+		out->len++;
+	}
+	elen = sql->api->escape(sql, (const unsigned char *) src, slen, &(out->buf[out->len]), (slen * 2) + 1);
+	if(elen == (size_t) -1 || !elen || elen > (slen * 2) + 1)
+	{
+		return -1;
+	}
+	out->len += elen - 1;
+	if(op->quote == 2)
+	{
+		out->buf[out->len] = '\'';
+		out->len++;
+	}
+	if(op->spec[0])
+	{
+		/* Move the escaped string over the unescaped one */
+		memmove(&(out->buf[start]), &(out->buf[start + slen]), out->len - start - slen);
+		out->len -= slen;
+	}
+	return 0;
+}
+
+/* Ensure that there is space for len more bytes, plus a terminating NUL */
+static int
+sql_format_reserve_(SQL_FORMAT_BUFFER *out, size_t len)
+{
+	char *p;
+	size_t needed;
+
+	needed = out->len + len + 1;
+	if(needed <= out->alloc)
+	{
+		return 0;
+	}
+	if(needed < out->alloc * 2)
+	{
+		needed = out->alloc * 2;
+	}
+	if(needed < 256)
+	{
+		needed = 256;
+	}
+	p = (char *) sql_realloc_(out->buf, needed);
+	if(!p)
+	{
+		return -1;
+	}
+	out->buf = p;
+	out->alloc = needed;
+	return 0;
+}
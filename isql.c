@@ -40,6 +40,8 @@
 	 
 #define QUERY_BLOCK                    128
 #define PQUERY_BLOCK                   4
+#define FINGERPRINT_LIMIT              256
+#define FINGERPRINT_TOP                20
 	 
 struct query_struct
 {
@@ -512,6 +514,37 @@ parse_query(const char *buf)
 	return query_state;
 }
 
+static int
+show_fingerprints(void)
+{
+	SQL_FINGERPRINT_STATS *stats;
+	size_t count, c;
+
+	stats = (SQL_FINGERPRINT_STATS *) calloc(FINGERPRINT_TOP, sizeof(SQL_FINGERPRINT_STATS));
+	if(!stats)
+	{
+		fprintf(stderr, "%s: failed to allocate memory for query statistics\n", short_program_name);
+		return -1;
+	}
+	count = sql_fingerprint_top(stats, FINGERPRINT_TOP);
+	if(count == (size_t) -1)
+	{
+		fprintf(stderr, "%s: failed to obtain query statistics\n", short_program_name);
+		free(stats);
+		return -1;
+	}
+	printf("%16s %8s %12s %12s %10s %6s  %s\n", "fingerprint", "calls", "total ms", "max ms", "rows", "errors", "query");
+	for(c = 0; c < count; c++)
+	{
+		printf("%016llx %8llu %12.3f %12.3f %10llu %6llu  %s\n",
+			stats[c].fingerprint, stats[c].calls,
+			stats[c].total_nsec / 1000000.0, stats[c].max_nsec / 1000000.0,
+			stats[c].rows, stats[c].errors, stats[c].query);
+	}
+	free(stats);
+	return 0;
+}
+
 static int
 exec_builtin(SQL *conn, History *hist, char *query)
 {
@@ -561,6 +594,10 @@ exec_builtin(SQL *conn, History *hist, char *query)
 		sql_conn = conn;
 		return 0;
 	}
+	if(!strncmp(query, "\\f", 2))
+	{
+		return show_fingerprints();
+	}
 	printf("[42000] Unknown command '%s'\n", query);
 	return -1;
 }
@@ -640,6 +677,7 @@ main(int argc, char **argv)
 	int num, state;
 	
 	check_args(argc, argv);
+	sql_fingerprint_set_limit(FINGERPRINT_LIMIT);
 	if(connect_uri)
 	{		
 		sql_conn = sql_connect_uri(connect_uri);
@@ -656,6 +694,7 @@ main(int argc, char **argv)
 		"Type:  \\c URI to establish a new connection\n"
 		"       \\g or ; to execute query\n"
 		"       \\G to execute the query showing results in long format\n"
+		"       \\f to show statistics for the most expensive queries\n"
 		"       \\q to end the SQL session\n"
 		"\n"
 		);
@@ -0,0 +1,100 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ * Copyright 2012-2013 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef LIBSQL_ARROW_H_
+# define LIBSQL_ARROW_H_                1
+
+# include <stdint.h>
+# include <libsql.h>
+
+/* The Apache Arrow C data and stream interfaces; these definitions are
+ * ABI-stable and may be provided by other headers, hence the guards.
+ * See https://arrow.apache.org/docs/format/CDataInterface.html
+ */
+
+# ifndef ARROW_C_DATA_INTERFACE
+#  define ARROW_C_DATA_INTERFACE
+
+#  define ARROW_FLAG_DICTIONARY_ORDERED 1
+#  define ARROW_FLAG_NULLABLE           2
+#  define ARROW_FLAG_MAP_KEYS_SORTED    4
+
+struct ArrowSchema
+{
+	const char *format;
+	const char *name;
+	const char *metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema **children;
+	struct ArrowSchema *dictionary;
+	void (*release)(struct ArrowSchema *);
+	void *private_data;
+};
+
+struct ArrowArray
+{
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void **buffers;
+	struct ArrowArray **children;
+	struct ArrowArray *dictionary;
+	void (*release)(struct ArrowArray *);
+	void *private_data;
+};
+
+# endif /*!ARROW_C_DATA_INTERFACE*/
+
+# ifndef ARROW_C_STREAM_INTERFACE
+#  define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream
+{
+	int (*get_schema)(struct ArrowArrayStream *, struct ArrowSchema *out);
+	int (*get_next)(struct ArrowArrayStream *, struct ArrowArray *out);
+	const char *(*get_last_error)(struct ArrowArrayStream *);
+	void (*release)(struct ArrowArrayStream *);
+	void *private_data;
+};
+
+# endif /*!ARROW_C_STREAM_INTERFACE*/
+
+/* Default number of rows in each record batch */
+# define SQL_ARROW_BATCH_ROWS           65536
+
+# if defined(__cplusplus)
+extern "C" {
+# endif
+
+	/* Export a result-set as a stream of Arrow record batches, each of up
+	 * to batch_rows rows (or SQL_ARROW_BATCH_ROWS if zero). The stream holds
+	 * a reference to the statement until it is released.
+	 */
+	int sql_stmt_export_arrow(SQL_STATEMENT *restrict statement, size_t batch_rows, struct ArrowSchema *restrict schema, struct ArrowArrayStream *restrict stream);
+
+# if defined(__cplusplus)
+}
+# endif
+
+#endif /*!LIBSQL_ARROW_H_*/
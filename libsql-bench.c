@@ -0,0 +1,596 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "libsql.h"
+
+#ifndef EXIT_SUCCESS
+# define EXIT_SUCCESS                  0
+#endif
+
+#ifndef EXIT_FAILURE
+# define EXIT_FAILURE                  1
+#endif
+
+/* Microbenchmarks for the library's hot paths. Each benchmark is run for
+ * an increasing number of iterations until it takes at least the target
+ * time, and the results are written to standard output as JSON so that
+ * they can be compared between builds.
+ *
+ * Allocations are counted by installing an allocator with
+ * sql_set_allocator(), and so include SQLite's, but not those made by the
+ * PostgreSQL or MySQL client libraries.
+ */
+
+#define DEFAULT_URI                    "sqlite::memory:"
+#define DEFAULT_TARGET_MSEC            250
+#define BENCH_ROWS                     1000
+#define BENCH_MAX_ITERATIONS           1000000000ULL
+
+typedef struct bench_struct BENCH;
+
+struct bench_struct
+{
+	SQL *sql;
+	URI *uri;
+	SQL_STATEMENT *rs;
+	/* Accumulated while the timer is running */
+	unsigned long long nsec;
+	unsigned long long allocs;
+	unsigned long long bytes;
+	/* Values when the timer was last started */
+	unsigned long long start;
+	unsigned long long start_allocs;
+	unsigned long long start_bytes;
+};
+
+struct bench_def_struct
+{
+	const char *name;
+	int (*fn)(BENCH *bench, unsigned long long n);
+};
+
+static const char *short_program_name;
+static URI *connect_uri;
+static const char *filter;
+static unsigned long long target_nsec = DEFAULT_TARGET_MSEC * 1000000ULL;
+static unsigned long long alloc_count, alloc_bytes;
+
+static int bench_connect(BENCH *bench, unsigned long long n);
+static int bench_query(BENCH *bench, unsigned long long n);
+static int bench_queryf(BENCH *bench, unsigned long long n);
+static int bench_escape(BENCH *bench, unsigned long long n);
+static int bench_perform(BENCH *bench, unsigned long long n);
+static int bench_fetch_next(BENCH *bench, unsigned long long n);
+static int bench_fetch_value(BENCH *bench, unsigned long long n);
+static int bench_fetch_str(BENCH *bench, unsigned long long n);
+static int bench_fetch_long(BENCH *bench, unsigned long long n);
+
+static const struct bench_def_struct benchmarks[] = {
+	{ "connect", bench_connect },
+	{ "query", bench_query },
+	{ "queryf", bench_queryf },
+	{ "escape", bench_escape },
+	{ "perform", bench_perform },
+	{ "fetch_next", bench_fetch_next },
+	{ "fetch_value", bench_fetch_value },
+	{ "fetch_str", bench_fetch_str },
+	{ "fetch_long", bench_fetch_long },
+	{ NULL, NULL }
+};
+
+static void *
+count_allocate(size_t size, void *data)
+{
+	(void) data;
+
+	__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+static void *
+count_reallocate(void *ptr, size_t size, void *data)
+{
+	(void) data;
+
+	__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+	return realloc(ptr, size);
+}
+
+static void
+count_deallocate(void *ptr, void *data)
+{
+	(void) data;
+
+	free(ptr);
+}
+
+static unsigned long long
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bench_start(BENCH *bench)
+{
+	bench->start_allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+	bench->start_bytes = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED);
+	bench->start = now();
+}
+
+static void
+bench_stop(BENCH *bench)
+{
+	bench->nsec += now() - bench->start;
+	bench->allocs += __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - bench->start_allocs;
+	bench->bytes += __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED) - bench->start_bytes;
+}
+
+static void
+bench_error(const char *what, SQL *sql)
+{
+	fprintf(stderr, "%s: %s: [%s] %s\n", short_program_name, what, sql_sqlstate(sql), sql_error(sql));
+}
+
+/* Establish and close a connection */
+static int
+bench_connect(BENCH *bench, unsigned long long n)
+{
+	SQL *sql;
+
+	for(; n; n--)
+	{
+		sql = sql_connect_uri(bench->uri);
+		if(!sql)
+		{
+			bench_error("connect", NULL);
+			return -1;
+		}
+		sql_disconnect(sql);
+	}
+	return 0;
+}
+
+/* Execute a literal single-row query; the baseline for queryf */
+static int
+bench_query(BENCH *bench, unsigned long long n)
+{
+	SQL_STATEMENT *rs;
+
+	for(; n; n--)
+	{
+		rs = sql_query(bench->sql, "SELECT 'O''Brien', 'bench', 42");
+		if(!rs)
+		{
+			bench_error("query", bench->sql);
+			return -1;
+		}
+		sql_stmt_destroy(rs);
+	}
+	return 0;
+}
+
+/* Execute the same query built from a format string with %q and %Q */
+static int
+bench_queryf(BENCH *bench, unsigned long long n)
+{
+	SQL_STATEMENT *rs;
+
+	for(; n; n--)
+	{
+		rs = sql_queryf(bench->sql, "SELECT '%q', %Q, %d", "O'Brien", "bench", 42);
+		if(!rs)
+		{
+			bench_error("queryf", bench->sql);
+			return -1;
+		}
+		sql_stmt_destroy(rs);
+	}
+	return 0;
+}
+
+static int
+bench_escape(BENCH *bench, unsigned long long n)
+{
+	static const char str[] = "It's a 'quoted' string with a \\ backslash, of moderate length";
+	char buf[sizeof(str) * 2 + 1];
+
+	for(; n; n--)
+	{
+		if(!sql_escape(bench->sql, (const unsigned char *) str, sizeof(str) - 1, buf, sizeof(buf)))
+		{
+			bench_error("escape", bench->sql);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+perform_txn(SQL *restrict sql, void *restrict userdata)
+{
+	(void) sql;
+	(void) userdata;
+
+	return SQL_TXN_COMMIT;
+}
+
+/* The overhead of an empty sql_perform() transaction */
+static int
+bench_perform(BENCH *bench, unsigned long long n)
+{
+	for(; n; n--)
+	{
+		if(sql_perform(bench->sql, perform_txn, NULL, -1, SQL_TXN_DEFAULT))
+		{
+			bench_error("perform", bench->sql);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Position bench->rs on a row of the fixture table, re-executing the query
+ * (with the timer stopped) once the rows have been exhausted
+ */
+static int
+fetch_row(BENCH *bench)
+{
+	if(bench->rs && !sql_stmt_eof(bench->rs))
+	{
+		return 0;
+	}
+	bench_stop(bench);
+	if(bench->rs)
+	{
+		sql_stmt_destroy(bench->rs);
+	}
+	bench->rs = sql_query(bench->sql, "SELECT \"id\", \"name\", \"score\" FROM \"libsql_bench\"");
+	bench_start(bench);
+	if(!bench->rs)
+	{
+		bench_error("query", bench->sql);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+bench_fetch_next(BENCH *bench, unsigned long long n)
+{
+	for(; n; n--)
+	{
+		if(fetch_row(bench))
+		{
+			return -1;
+		}
+		sql_stmt_next(bench->rs);
+	}
+	return 0;
+}
+
+static int
+bench_fetch_value(BENCH *bench, unsigned long long n)
+{
+	char buf[64];
+	unsigned int c;
+
+	for(; n; n--)
+	{
+		if(fetch_row(bench))
+		{
+			return -1;
+		}
+		for(c = 0; c < 3; c++)
+		{
+			sql_stmt_value(bench->rs, c, buf, sizeof(buf));
+		}
+		sql_stmt_next(bench->rs);
+	}
+	return 0;
+}
+
+static int
+bench_fetch_str(BENCH *bench, unsigned long long n)
+{
+	unsigned int c;
+
+	for(; n; n--)
+	{
+		if(fetch_row(bench))
+		{
+			return -1;
+		}
+		for(c = 0; c < 3; c++)
+		{
+			sql_stmt_str(bench->rs, c);
+		}
+		sql_stmt_next(bench->rs);
+	}
+	return 0;
+}
+
+static int
+bench_fetch_long(BENCH *bench, unsigned long long n)
+{
+	for(; n; n--)
+	{
+		if(fetch_row(bench))
+		{
+			return -1;
+		}
+		sql_stmt_long(bench->rs, 0);
+		sql_stmt_next(bench->rs);
+	}
+	return 0;
+}
+
+/* Create and populate the (temporary) table read by the fetch benchmarks */
+static int
+create_fixture(SQL *sql)
+{
+	int c;
+
+	if(sql_execute(sql, "CREATE TEMPORARY TABLE \"libsql_bench\" (\"id\" INTEGER, \"name\" VARCHAR(64), \"score\" DOUBLE PRECISION)"))
+	{
+		bench_error("create table", sql);
+		return -1;
+	}
+	if(sql_begin(sql, SQL_TXN_DEFAULT))
+	{
+		bench_error("begin", sql);
+		return -1;
+	}
+	for(c = 0; c < BENCH_ROWS; c++)
+	{
+		if(sql_executef(sql, "INSERT INTO \"libsql_bench\" (\"id\", \"name\", \"score\") VALUES (%d, 'row %d', %f)", c, c, c * 1.5))
+		{
+			bench_error("insert", sql);
+			sql_rollback(sql);
+			return -1;
+		}
+	}
+	if(sql_commit(sql))
+	{
+		bench_error("commit", sql);
+		return -1;
+	}
+	return 0;
+}
+
+/* Run a benchmark for increasing numbers of iterations until it takes at
+ * least the target time, then write its results
+ */
+static int
+run_benchmark(BENCH *bench, const struct bench_def_struct *def, int first)
+{
+	unsigned long long n, next;
+
+	n = 1;
+	for(;;)
+	{
+		bench->nsec = 0;
+		bench->allocs = 0;
+		bench->bytes = 0;
+		bench_start(bench);
+		if(def->fn(bench, n))
+		{
+			return -1;
+		}
+		bench_stop(bench);
+		if(bench->nsec >= target_nsec || n >= BENCH_MAX_ITERATIONS)
+		{
+			break;
+		}
+		/* Aim for 20% over the target, growing by at most 100x each time */
+		if(bench->nsec)
+		{
+			next = (unsigned long long) ((double) n * target_nsec * 1.2 / bench->nsec);
+		}
+		else
+		{
+			next = n * 100;
+		}
+		if(next > n * 100)
+		{
+			next = n * 100;
+		}
+		if(next <= n)
+		{
+			next = n + 1;
+		}
+		if(next > BENCH_MAX_ITERATIONS)
+		{
+			next = BENCH_MAX_ITERATIONS;
+		}
+		n = next;
+	}
+	printf("%s\n    { \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"allocs_per_op\": %.2f, \"bytes_per_op\": %.2f }",
+		   (first ? "" : ","), def->name, n,
+		   (double) bench->nsec / n, (double) bench->allocs / n, (double) bench->bytes / n);
+	fflush(stdout);
+	return 0;
+}
+
+static const char *
+variant_name(SQL *sql)
+{
+	switch(sql_variant(sql))
+	{
+	case SQL_VARIANT_MYSQL:
+		return "mysql";
+	case SQL_VARIANT_POSTGRES:
+		return "postgres";
+	case SQL_VARIANT_SQLITE:
+		return "sqlite";
+	}
+	return "unknown";
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: %s [-t MSEC] [-f NAME] [URI]\n"
+			"  -t MSEC   run each benchmark for at least MSEC milliseconds (default %d)\n"
+			"  -f NAME   only run benchmarks whose names contain NAME\n"
+			"  URI       connect to URI (default %s)\n",
+			short_program_name, DEFAULT_TARGET_MSEC, DEFAULT_URI);
+}
+
+static int
+check_args(int argc, char **argv)
+{
+	const char *str;
+	char *t;
+	int c;
+	URI *here;
+
+	t = strrchr(argv[0], '/');
+	if(t)
+	{
+		short_program_name = t + 1;
+	}
+	else
+	{
+		short_program_name = argv[0];
+	}
+	while((c = getopt(argc, argv, "hf:t:")) != -1)
+	{
+		switch(c)
+		{
+			case 'h':
+				usage();
+				exit(EXIT_SUCCESS);
+			case 'f':
+				filter = optarg;
+				break;
+			case 't':
+				target_nsec = strtoull(optarg, &t, 10) * 1000000ULL;
+				if(*t || !target_nsec)
+				{
+					return -1;
+				}
+				break;
+			default:
+				return -1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if(argc > 1)
+	{
+		return -1;
+	}
+	str = (argc == 1 ? argv[0] : DEFAULT_URI);
+	here = uri_create_cwd();
+	if(!here)
+	{
+		fprintf(stderr, "%s: failed to obtain URI for current working directory\n", short_program_name);
+	}
+	connect_uri = uri_create_str(str, here);
+	uri_destroy(here);
+	if(!connect_uri)
+	{
+		fprintf(stderr, "%s: failed to parse URI <%s>\n", short_program_name, str);
+		return -1;
+	}
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	SQL_ALLOCATOR allocator;
+	BENCH bench;
+	const struct bench_def_struct *def;
+	int first, status;
+
+	if(check_args(argc, argv))
+	{
+		usage();
+		exit(EXIT_FAILURE);
+	}
+	allocator.allocate = count_allocate;
+	allocator.reallocate = count_reallocate;
+	allocator.deallocate = count_deallocate;
+	allocator.data = NULL;
+	if(sql_set_allocator(&allocator))
+	{
+		bench_error("set allocator", NULL);
+		exit(EXIT_FAILURE);
+	}
+	memset(&bench, 0, sizeof(BENCH));
+	bench.uri = connect_uri;
+	bench.sql = sql_connect_uri(connect_uri);
+	if(!bench.sql)
+	{
+		bench_error("connect", NULL);
+		exit(EXIT_FAILURE);
+	}
+	if(create_fixture(bench.sql))
+	{
+		sql_disconnect(bench.sql);
+		exit(EXIT_FAILURE);
+	}
+	printf("{\n  \"engine\": \"%s\",\n  \"rows\": %d,\n  \"target_ms\": %llu,\n  \"benchmarks\": [",
+		   variant_name(bench.sql), BENCH_ROWS, target_nsec / 1000000ULL);
+	status = EXIT_SUCCESS;
+	first = 1;
+	for(def = benchmarks; def->name; def++)
+	{
+		if(filter && !strstr(def->name, filter))
+		{
+			continue;
+		}
+		if(run_benchmark(&bench, def, first))
+		{
+			status = EXIT_FAILURE;
+			break;
+		}
+		first = 0;
+		if(bench.rs)
+		{
+			sql_stmt_destroy(bench.rs);
+			bench.rs = NULL;
+		}
+	}
+	printf("\n  ]\n}\n");
+	if(bench.rs)
+	{
+		sql_stmt_destroy(bench.rs);
+	}
+	sql_disconnect(bench.sql);
+	uri_destroy(connect_uri);
+	return status;
+}
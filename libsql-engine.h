@@ -22,6 +22,7 @@
 #ifndef LIBSQL_ENGINE_H_
 # define LIBSQL_ENGINE_H_               1
 
+# include <pthread.h>
 # include <libsql.h>
 # include <uuid/uuid.h>
 
@@ -38,6 +39,85 @@ typedef struct sql_api_struct SQL_API;
 typedef struct sql_statement_api_struct SQL_STATEMENT_API;
 typedef struct sql_field_api_struct SQL_FIELD_API;
 
+typedef struct sql_cache_struct SQL_CACHE;
+typedef struct sql_cache_entry_struct SQL_CACHE_ENTRY;
+typedef struct sql_param_struct SQL_PARAM;
+typedef struct sql_template_struct SQL_TEMPLATE;
+typedef struct sql_export_buffer_struct SQL_EXPORT_BUFFER;
+typedef struct sql_pool_entry_struct SQL_POOL_ENTRY;
+typedef struct sql_formatter_struct SQL_FORMATTER;
+typedef struct sql_slab_struct SQL_SLAB;
+typedef struct sql_stats_block_struct SQL_STATS_BLOCK;
+
+/* Types of bound parameter values */
+typedef enum
+{
+	SQL_PARAM_NULL,
+	SQL_PARAM_INT,
+	SQL_PARAM_UINT,
+	SQL_PARAM_DOUBLE,
+	SQL_PARAM_TEXT
+} SQL_PARAM_TYPE;
+
+/* Types of the arguments consumed by a compiled statement template */
+typedef enum
+{
+	SQL_ARG_INT,
+	SQL_ARG_UINT,
+	SQL_ARG_SHORT,
+	SQL_ARG_USHORT,
+	SQL_ARG_LONG,
+	SQL_ARG_ULONG,
+	SQL_ARG_LLONG,
+	SQL_ARG_ULLONG,
+	SQL_ARG_SIZE,
+	SQL_ARG_PTRDIFF,
+	SQL_ARG_DOUBLE,
+	SQL_ARG_LDOUBLE,
+	SQL_ARG_STRING
+} SQL_ARG_TYPE;
+
+/* A single parameter value passed to an engine for binding */
+struct sql_param_struct
+{
+	SQL_PARAM_TYPE type;
+	long long ival;
+	unsigned long long uval;
+	double dval;
+	const char *sval;
+	size_t slen;
+};
+
+/* A printf-style statement compiled into native placeholder syntax */
+struct sql_template_struct
+{
+	char *native;
+	unsigned int nparams;
+	SQL_ARG_TYPE *args;
+	SQL_PARAM *params;
+};
+
+/* The live statistics counters of a connection, which are only updated
+ * by the thread using it, but may be read by any; error codes are packed
+ * into the integer keys of an open-addressed table. Blocks are linked into
+ * a list of live connections by sql_stats_attach_().
+ */
+struct sql_stats_block_struct
+{
+	SQL_STATS_BLOCK *prev;
+	SQL_STATS_BLOCK *next;
+	int attached;
+	SQL_STATS_HISTOGRAM ops[SQL_STATS_OPS];
+	unsigned long long wait_nsec;
+	unsigned long long rows;
+	unsigned long long bytes;
+	unsigned long long errors;
+	unsigned long long retries;
+	unsigned long long deadlocks;
+	unsigned long long errkeys[SQL_STATS_SQLSTATES];
+	unsigned long long errcounts[SQL_STATS_SQLSTATES];
+};
+
 /* API implemented by SQL engine plug-ins */
 struct sql_engine_api_struct
 {
@@ -76,6 +156,19 @@ struct sql_api_struct
 	SQL_VARIANT (*variant)(SQL *variant);
 	int (*set_userdata)(SQL *restrict me, void *restrict userdata);
 	void *(*userdata)(SQL *me);
+	void (*set_error)(SQL *restrict me, const char *restrict sqlstate, const char *restrict message);
+	int (*execute_batch)(SQL *restrict me, const char *const *restrict statements, size_t count, unsigned long long *restrict affected);
+	int (*execute_script)(SQL *restrict me, const char *restrict script, unsigned long long *restrict affected, size_t naffected);
+	long long (*bulk_insert)(SQL *restrict me, const char *restrict table, const char *const *restrict columns, size_t ncolumns, SQL_BULK_ROW fn, void *restrict userdata);
+	long long (*export)(SQL *restrict me, const char *restrict query, SQL_EXPORT_FORMAT format, SQL_EXPORT_BUFFER *restrict buf);
+	long long (*query_foreach)(SQL *restrict me, const char *restrict query, SQL_ROW_FN fn, void *restrict userdata);
+	int (*ping)(SQL *me);
+	int (*query_async)(SQL *restrict me, const char *restrict query);
+	int (*poll)(SQL *me);
+	SQL_STATEMENT *(*result)(SQL *me);
+	int (*socket)(SQL *me);
+	int (*cacheable)(SQL *restrict me, const char *restrict statement);
+	unsigned long long (*affected)(SQL *me);
 };
 
 /* API provided on statements */
@@ -100,6 +193,15 @@ struct sql_statement_api_struct
 	unsigned long long (*cur)(SQL_STATEMENT *me);
 	int (*rewind)(SQL_STATEMENT *me);
 	int (*seek)(SQL_STATEMENT *me, unsigned long long ofs);
+	int (*execute)(SQL_STATEMENT *restrict me, unsigned int nparams, const SQL_PARAM *restrict params);
+	int (*reset)(SQL_STATEMENT *me);
+	int64_t (*int64)(SQL_STATEMENT *me, unsigned int col);
+	double (*real)(SQL_STATEMENT *me, unsigned int col);
+	int (*boolean)(SQL_STATEMENT *me, unsigned int col);
+	const unsigned char *(*blob)(SQL_STATEMENT *restrict me, unsigned int col, size_t *restrict len);
+	int (*fetch_batch)(SQL_STATEMENT *restrict me, size_t max_rows, SQL_BATCH *restrict batch);
+	int (*row)(SQL_STATEMENT *restrict me, SQL_CELL *restrict cells, unsigned int ncols);
+	int (*scanstatus)(SQL_STATEMENT *restrict me, SQL_STMT_STATUS *restrict status);
 };
 
 /* API provided on fields */
@@ -110,6 +212,7 @@ struct sql_field_api_struct
 	unsigned long (*release)(SQL_FIELD *me);
 	const char *(*name)(SQL_FIELD *me);
 	size_t (*width)(SQL_FIELD *me);
+	SQL_FIELD_TYPE (*type)(SQL_FIELD *me);
 };
 
 #define SQL_ENGINE_COMMON_MEMBERS \
@@ -119,36 +222,59 @@ struct sql_field_api_struct
 #define SQL_COMMON_MEMBERS \
 	SQL_API *api; \
 	unsigned long refcount; \
-	pthread_mutex_t lock;
+	pthread_mutex_t lock; \
+	SQL_CACHE *cache; \
+	unsigned int flags; \
+	SQL_POOL_ENTRY *pooled; \
+	SQL_FORMATTER *formatter; \
+	SQL_SLAB *stmtslab; \
+	SQL_SLAB *fieldslab; \
+	SQL_STATS_BLOCK stats; \
+	SQL_TRACE tracer; \
+	SQL_LOG_QUERY logquery; \
+	SQL_LOG_ERROR logerror; \
+	SQL_AUTOEXPLAIN autoexplain;
 
 #define SQL_STATEMENT_COMMON_MEMBERS \
 	SQL_STATEMENT_API *api; \
-	unsigned long refcount;
+	unsigned long refcount; \
+	SQL_TEMPLATE *tmpl; \
+	int cached; \
+	SQL_SLAB *slab; \
+	unsigned long long fingerprint; \
+	int fetching; \
+	unsigned long long fetched; \
+	unsigned long long fetch_start;
 
 #define SQL_FIELD_COMMON_MEMBERS \
 	SQL_FIELD_API *api; \
-	unsigned long refcount;
+	unsigned long refcount; \
+	SQL_SLAB *slab;
 
 # if !defined(SQL_STRUCT_DEFINED)
 
+/* Engine-specific members follow the common ones, so code outside of
+ * the engines can safely make use of the common members
+ */
+
 struct sql_engine_struct
 {
-	SQL_ENGINE_API *api;
+	SQL_ENGINE_COMMON_MEMBERS
 };
 
 struct sql_struct
 {
-	SQL_API *api;
+	SQL_COMMON_MEMBERS
 };
 
 struct sql_statement_struct
 {
-	SQL_STATEMENT_API *api;
+	SQL_STATEMENT_COMMON_MEMBERS
 };
 
 struct sql_field_struct
 {
-	SQL_FIELD_API *api;
+	SQL_FIELD_COMMON_MEMBERS
 };
 # endif /*!SQL_STRUCT_DEFINED*/
 
@@ -161,9 +287,67 @@ unsigned long sql_def_addref_(SQL *me);
 int sql_def_lock_(SQL *me);
 int sql_def_unlock_(SQL *me);
 int sql_def_trylock_(SQL *me);
+int sql_def_cacheable_(SQL *restrict me, const char *restrict statement);
 
 int sql_statement_def_queryinterface_(SQL_STATEMENT *restrict me, uuid_t *restrict uuid, void *restrict *restrict out);
 unsigned long sql_statement_def_addref_(SQL_STATEMENT *me);
+int64_t sql_statement_def_int64_(SQL_STATEMENT *me, unsigned int col);
+double sql_statement_def_real_(SQL_STATEMENT *me, unsigned int col);
+int sql_statement_def_boolean_(SQL_STATEMENT *me, unsigned int col);
+const unsigned char *sql_statement_def_blob_(SQL_STATEMENT *restrict me, unsigned int col, size_t *restrict len);
+int sql_statement_def_scanstatus_(SQL_STATEMENT *restrict me, SQL_STMT_STATUS *restrict status);
+
+size_t sql_uri_param_(URI *restrict uri, const char *restrict name, char *restrict buf, size_t buflen);
+int sql_uri_flag_(URI *restrict uri, const char *restrict name);
+
+char *sql_batch_join_(const char *const *statements, size_t count);
+char *sql_bulk_columns_(const char *const *columns, size_t ncolumns);
+
+int sql_export_data_(SQL_EXPORT_BUFFER *restrict buf, const void *restrict data, size_t len);
+int sql_export_value_(SQL_EXPORT_BUFFER *restrict buf, unsigned int col, const char *restrict value, size_t len);
+int sql_export_eol_(SQL_EXPORT_BUFFER *buf);
+
+int sql_parse_boolean_(const char *s);
+
+int sql_batch_text_(SQL_BATCH *restrict batch, unsigned int col, const char *restrict value, size_t len);
+void sql_batch_int64_(SQL_BATCH *batch, unsigned int col, int64_t value);
+void sql_batch_real_(SQL_BATCH *batch, unsigned int col, double value);
+void sql_batch_null_(SQL_BATCH *batch, unsigned int col);
+
+SQL_CACHE *sql_cache_create_(size_t limit);
+void sql_cache_destroy_(SQL_CACHE *cache);
+SQL_STATEMENT *sql_cache_statement_(SQL *restrict sql, const char *restrict statement);
+void sql_cache_discard_(SQL *restrict sql, SQL_STATEMENT *restrict stmt);
+
+void sql_formatter_destroy_(SQL_FORMATTER *f);
+
+int sql_allocator_lock_(void);
+void *sql_malloc_(size_t size);
+void *sql_calloc_(size_t nmemb, size_t size);
+void *sql_realloc_(void *ptr, size_t size);
+void sql_free_(void *ptr);
+char *sql_strdup_(const char *str);
+
+SQL_SLAB *sql_slab_create_(size_t size);
+void sql_slab_destroy_(SQL_SLAB *slab);
+void *sql_slab_alloc_(SQL_SLAB *slab);
+void sql_slab_free_(SQL_SLAB *slab, void *ptr);
+
+unsigned long long sql_stats_now_(void);
+unsigned long long sql_stats_timer_(void);
+void sql_stats_attach_(SQL *sql);
+void sql_stats_detach_(SQL *sql);
+unsigned long long sql_stats_op_(SQL *sql, SQL_STATS_OP op, unsigned long long start);
+void sql_stats_wait_(SQL *sql, unsigned long long start);
+void sql_stats_rows_(SQL *sql, unsigned long long rows, unsigned long long bytes);
+void sql_stats_error_(SQL *restrict sql, const char *restrict sqlstate);
+void sql_stats_retry_(SQL *sql, int deadlocked);
+
+void sql_logger_detach_(SQL *sql);
+
+SQL_TEMPLATE *sql_template_create_(SQL *restrict sql, const char *restrict format);
+void sql_template_destroy_(SQL_TEMPLATE *tmpl);
+int sql_template_bind_(SQL_TEMPLATE *tmpl, va_list ap);
 
 int sql_field_def_queryinterface_(SQL_FIELD *restrict me, uuid_t *restrict uuid, void *restrict *restrict out);
 unsigned long sql_field_def_addref_(SQL_FIELD *me);
@@ -23,16 +23,22 @@
 # define LIBSQL_H_                      1
 
 # include <stdarg.h>
+# include <stdint.h>
 # include <liburi.h>
 
 typedef struct sql_struct SQL;
 typedef struct sql_statement_struct SQL_STATEMENT;
 typedef struct sql_field_struct SQL_FIELD; 
+typedef struct sql_pool_struct SQL_POOL;
 typedef int (*SQL_PERFORM_TXN)(SQL *restrict, void *restrict userdata);
 typedef int (*SQL_PERFORM_MIGRATE)(SQL *restrict sql, const char *identifier, int newversion, void *restrict userdata);
 typedef int (*SQL_LOG_QUERY)(SQL *restrict sql, const char *query);
 typedef int (*SQL_LOG_ERROR)(SQL *restrict sql, const char *sqlstate, const char *message);
 typedef int (*SQL_LOG_NOTICE)(SQL *restrict sql, const char *notice);
+typedef int (*SQL_BULK_ROW)(SQL *restrict sql, const char **restrict values, void *restrict userdata);
+typedef int (*SQL_EXPORT_WRITE)(void *restrict userdata, const void *restrict data, size_t len);
+typedef struct sql_cell_struct SQL_CELL;
+typedef int (*SQL_ROW_FN)(SQL *restrict sql, const SQL_CELL *restrict cells, unsigned int ncols, void *restrict userdata);
 
 /* Return values for SQL_PERFORM_TXN */
 # define SQL_TXN_COMMIT                 1
@@ -62,6 +68,319 @@ typedef enum
 	SQL_VARIANT_SQLITE
 } SQL_VARIANT;
 
+/* Connection flags (see sql_set_flags()) */
+# define SQL_FLAG_BINARY                0x0001
+# define SQL_FLAG_STREAM                0x0002
+/* Pipeline the statements of sql_perform() transactions where supported */
+# define SQL_FLAG_PIPELINE              0x0004
+/* Execute sql_queryf() and sql_executef() as prepared statements */
+# define SQL_FLAG_AUTOPARAM             0x0008
+/* Read whole SQLite result-sets into memory, so that they can be rewound
+ * and seeked as MySQL and PostgreSQL result-sets can
+ */
+# define SQL_FLAG_BUFFERED              0x0010
+
+/* Native column types */
+typedef enum
+{
+	SQL_TYPE_UNKNOWN,
+	SQL_TYPE_INTEGER,
+	SQL_TYPE_REAL,
+	SQL_TYPE_NUMERIC,
+	SQL_TYPE_BOOLEAN,
+	SQL_TYPE_TEXT,
+	SQL_TYPE_BLOB,
+	SQL_TYPE_TIMESTAMP,
+	SQL_TYPE_UUID
+} SQL_FIELD_TYPE;
+
+/* sql_export() output formats */
+typedef enum
+{
+	SQL_EXPORT_CSV,
+	SQL_EXPORT_TSV,
+	SQL_EXPORT_BINARY
+} SQL_EXPORT_FORMAT;
+
+/* Destination for sql_export(): if write is NULL, output is written to
+ * fd; otherwise write is invoked with userdata, returning 0 on success
+ */
+typedef struct
+{
+	int fd;
+	SQL_EXPORT_WRITE write;
+	void *userdata;
+} SQL_EXPORT_SINK;
+
+/* The value of a column in the current row (see sql_stmt_row()); ptr is
+ * nul-terminated, and remains valid until the statement moves to another
+ * row
+ */
+struct sql_cell_struct
+{
+	const char *ptr;
+	size_t len;
+	int null;
+};
+
+/* A column of a batch of rows (see sql_stmt_fetch_batch()): integer and
+ * boolean values are stored in ints, real values in reals, and all others
+ * in data (as raw bytes for blobs, or text otherwise), with the value for
+ * row n located between offsets[n] and offsets[n + 1]. The bit for row n
+ * in validity (least-significant bit first) is set if the value is not
+ * NULL. A caller may take ownership of any of the buffers by setting the
+ * pointer to NULL (and dataalloc to zero, in the case of data).
+ */
+typedef struct
+{
+	SQL_FIELD_TYPE type;
+	uint8_t *validity;
+	size_t nulls;
+	int64_t *ints;
+	double *reals;
+	int64_t *offsets;
+	char *data;
+	size_t datalen;
+	size_t dataalloc;
+} SQL_BATCH_COLUMN;
+
+typedef struct
+{
+	size_t rows;
+	size_t capacity;
+	unsigned int ncolumns;
+	SQL_BATCH_COLUMN *columns;
+} SQL_BATCH;
+
+/* Prepared statement cache statistics */
+typedef struct
+{
+	size_t size;
+	size_t limit;
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+} SQL_CACHE_STATS;
+
+/* Connection pool statistics; times are in microseconds */
+typedef struct
+{
+	size_t size;
+	size_t idle;
+	size_t min;
+	size_t max;
+	size_t in_use;
+	size_t peak;
+	unsigned long long gets;
+	unsigned long long waits;
+	unsigned long long timeouts;
+	unsigned long long created;
+	unsigned long long destroyed;
+	unsigned long long failed;
+	unsigned long long wait_usec;
+	unsigned long long max_wait_usec;
+} SQL_POOL_STATS;
+
+/* Operations whose latency is recorded in SQL_STATS */
+typedef enum
+{
+	SQL_STATS_CONNECT,
+	SQL_STATS_QUERY,
+	SQL_STATS_FETCH,
+	SQL_STATS_BEGIN,
+	SQL_STATS_COMMIT,
+	SQL_STATS_ROLLBACK
+} SQL_STATS_OP;
+
+# define SQL_STATS_OPS                  6
+# define SQL_STATS_BUCKETS              24
+# define SQL_STATS_SQLSTATES            32
+
+/* A latency histogram: bucket n counts the operations which completed in
+ * less than 2^n microseconds, except for the last, which counts the rest
+ */
+typedef struct
+{
+	unsigned long long count;
+	unsigned long long nsec;
+	unsigned long long buckets[SQL_STATS_BUCKETS];
+} SQL_STATS_HISTOGRAM;
+
+/* Performance statistics for a connection, or for the whole process; times
+ * are in nanoseconds. wait_nsec is the time spent waiting for the server
+ * (or, for SQLite, the database engine), and bytes is the size of the
+ * result data received from it. Errors are counted by SQLSTATE until
+ * all of the slots have been used, after which new codes are counted only
+ * in the total.
+ */
+typedef struct
+{
+	SQL_STATS_HISTOGRAM ops[SQL_STATS_OPS];
+	unsigned long long wait_nsec;
+	unsigned long long rows;
+	unsigned long long bytes;
+	unsigned long long errors;
+	unsigned long long retries;
+	unsigned long long deadlocks;
+	struct
+	{
+		char sqlstate[6];
+		unsigned long long count;
+	} sqlstates[SQL_STATS_SQLSTATES];
+} SQL_STATS;
+
+/* An operation traced by sql_set_tracer(): query is the statement text (or
+ * the format string, for sql_queryf() and friends), or NULL if there isn't
+ * one. start is a monotonic timestamp in nanoseconds; the remaining members
+ * are only set for finish events. rows and bytes are those received from
+ * the server during the operation, affected is zero where the engine does
+ * not report it, and sqlstate is only set if status is nonzero.
+ *
+ * Rows fetched with sql_stmt_next() are reported by a single finish event
+ * (without a start event) once the last row has been fetched or the
+ * result-set is discarded; its duration runs from the end of the query,
+ * and rows is the number of rows fetched.
+ */
+typedef struct
+{
+	SQL_STATS_OP op;
+	const char *query;
+	unsigned long long start;
+	unsigned long long nsec;
+	unsigned long long rows;
+	unsigned long long affected;
+	unsigned long long bytes;
+	int status;
+	const char *sqlstate;
+} SQL_TRACE_EVENT;
+
+typedef void (*SQL_TRACE_FN)(SQL *restrict sql, const SQL_TRACE_EVENT *restrict event, void *restrict userdata);
+
+/* Tracing callbacks, either of which may be NULL; finish is only invoked
+ * for operations which took at least threshold nanoseconds
+ */
+typedef struct
+{
+	SQL_TRACE_FN start;
+	SQL_TRACE_FN finish;
+	void *userdata;
+	unsigned long long threshold;
+} SQL_TRACE;
+
+/* Aggregate statistics for queries sharing a fingerprint (see
+ * sql_fingerprint()); query is the normalised text, truncated if necessary
+ */
+# define SQL_FINGERPRINT_TEXT           256
+
+typedef struct
+{
+	unsigned long long fingerprint;
+	char query[SQL_FINGERPRINT_TEXT];
+	unsigned long long calls;
+	unsigned long long errors;
+	unsigned long long rows;
+	unsigned long long total_nsec;
+	unsigned long long max_nsec;
+} SQL_FINGERPRINT_STATS;
+
+/* A step of a query plan (see sql_explain()); relation and index are the
+ * table and index it reads, if any, and fullscan is nonzero if it reads the
+ * whole of a table. Estimates are -1 if the engine doesn't provide them,
+ * and measurements are -1 unless the plan was obtained with
+ * sql_explain_analyze().
+ */
+typedef struct sql_plan_node_struct SQL_PLAN_NODE;
+
+struct sql_plan_node_struct
+{
+	SQL_PLAN_NODE *parent;
+	SQL_PLAN_NODE *child;
+	SQL_PLAN_NODE *next;
+	char *detail;
+	char *relation;
+	char *index;
+	int fullscan;
+	double est_rows;
+	double est_cost;
+	double actual_rows;
+	double actual_msec;
+};
+
+/* A query plan: root is the first of the top-level steps, and text is the
+ * plan as the engine reported it
+ */
+typedef struct
+{
+	SQL_PLAN_NODE *root;
+	char *text;
+} SQL_PLAN;
+
+/* Configuration of automatic EXPLAIN (see sql_set_autoexplain()) */
+typedef void (*SQL_EXPLAIN_FN)(SQL *restrict sql, const char *restrict query, unsigned long long nsec, const SQL_PLAN *restrict plan, void *restrict userdata);
+
+typedef struct
+{
+	SQL_EXPLAIN_FN fn;
+	void *userdata;
+	unsigned long long threshold;
+} SQL_AUTOEXPLAIN;
+
+/* Execution counters of a prepared statement (see sql_stmt_scanstatus());
+ * each of the scans is a loop of the statement's plan, whose name and
+ * explain strings remain valid until the statement is destroyed
+ */
+# define SQL_STMT_SCANS                 16
+
+typedef struct
+{
+	const char *name;
+	const char *explain;
+	unsigned long long loops;
+	unsigned long long visits;
+	double estimate;
+} SQL_SCAN_STATUS;
+
+typedef struct
+{
+	unsigned long long fullscan_steps;
+	unsigned long long sorts;
+	unsigned long long autoindexes;
+	unsigned long long vm_steps;
+	unsigned int nscans;
+	SQL_SCAN_STATUS scans[SQL_STMT_SCANS];
+} SQL_STMT_STATUS;
+
+/* Configuration of the asynchronous logger (see sql_logger_start()); a
+ * zero capacity selects the default, and a sample of N logs one in every N
+ * queries (errors are always logged). If path is not NULL, records are
+ * appended to that file instead of being passed to each connection's
+ * query and error logging callbacks.
+ */
+typedef struct
+{
+	size_t capacity;
+	unsigned int sample;
+	const char *path;
+} SQL_LOGGER;
+
+typedef struct
+{
+	unsigned long long logged;
+	unsigned long long sampled;
+	unsigned long long dropped;
+} SQL_LOGGER_STATS;
+
+/* Memory allocation functions, which must be thread-safe; data is passed
+ * to each of them
+ */
+typedef struct
+{
+	void *(*allocate)(size_t size, void *data);
+	void *(*reallocate)(void *ptr, size_t size, void *data);
+	void (*deallocate)(void *ptr, void *data);
+	void *data;
+} SQL_ALLOCATOR;
+
 # if (!defined(__STDC_VERSION__) || __STDC_VERSION__ < 199901L) && !defined(restrict)
 #  define restrict
 # endif
@@ -76,6 +395,21 @@ extern "C" {
 	int sql_scheme_exists(const char *urischeme);
 	int sql_scheme_foreach(int (*fn)(const char *scheme, void *userdata), void *userdata);
 
+	/* Replace the memory allocator used by the library (including SQLite);
+	 * must be invoked before any other function which may allocate memory,
+	 * including sql_connect() and sql_logger_start()
+	 */
+	int sql_set_allocator(const SQL_ALLOCATOR *allocator);
+
+	/* Connection pools */
+	SQL_POOL *sql_pool_create(const char *uri, size_t min, size_t max);
+	int sql_pool_destroy(SQL_POOL *pool);
+	SQL *sql_pool_get(SQL_POOL *pool, int timeout);
+	int sql_pool_put(SQL_POOL *pool, SQL *sql);
+	int sql_pool_set_idle_timeout(SQL_POOL *pool, unsigned int seconds);
+	int sql_pool_set_affinity(SQL_POOL *pool, int enable);
+	int sql_pool_stats(SQL_POOL *restrict pool, SQL_POOL_STATS *restrict stats);
+
 	int sql_set_userdata(SQL *restrict sql, void *restrict data);
 	void *sql_userdata(SQL *sql);
 
@@ -90,9 +424,78 @@ extern "C" {
 	int sql_set_errorlog(SQL *sql, SQL_LOG_ERROR fn);
 	int sql_set_noticelog(SQL *sql, SQL_LOG_NOTICE fn);
 
+	/* Install callbacks invoked as each query, fetch and transaction
+	 * operation on a connection starts and finishes; the structure is
+	 * copied, and tracing is disabled if tracer is NULL
+	 */
+	int sql_set_tracer(SQL *restrict sql, const SQL_TRACE *restrict tracer);
+
+	/* Obtain the plan of a query, using EXPLAIN QUERY PLAN (SQLite),
+	 * EXPLAIN FORMAT=JSON (MySQL) or EXPLAIN (FORMAT JSON) (PostgreSQL);
+	 * sql_explain_analyze() also executes the query in order to measure it,
+	 * where supported. The plan must be freed with sql_plan_free().
+	 */
+	int sql_explain(SQL *restrict sql, const char *restrict query, SQL_PLAN *restrict plan);
+	int sql_explain_analyze(SQL *restrict sql, const char *restrict query, SQL_PLAN *restrict plan);
+	void sql_plan_free(SQL_PLAN *plan);
+
+	/* Obtain the plan of each query executed on a connection which takes
+	 * at least a threshold number of nanoseconds, passing it to a callback;
+	 * the structure is copied, and disabled if autoexplain is NULL
+	 */
+	int sql_set_autoexplain(SQL *restrict sql, const SQL_AUTOEXPLAIN *restrict autoexplain);
+
+	/* Compute the fingerprint of a query, which is shared by queries that
+	 * differ only in their literal values; and control and obtain the
+	 * per-fingerprint statistics gathered across all connections, which
+	 * are disabled until a limit is set
+	 */
+	unsigned long long sql_fingerprint(const char *restrict query, char *restrict buf, size_t buflen);
+	int sql_fingerprint_set_limit(size_t limit);
+	int sql_fingerprint_reset(void);
+	size_t sql_fingerprint_top(SQL_FINGERPRINT_STATS *stats, size_t max);
+
+	/* Start or stop a background thread which delivers query and error log
+	 * records for every connection in the process, so that logging never
+	 * blocks the caller; records are dropped (and counted) if the buffer
+	 * is full. sql_logger_stop() waits for any outstanding records to be
+	 * delivered.
+	 */
+	int sql_logger_start(const SQL_LOGGER *config);
+	int sql_logger_stop(void);
+	int sql_logger_stats(SQL_LOGGER_STATS *stats);
+
 	const char *sql_sqlstate(SQL *connection);
 	const char *sql_error(SQL *connection);
 
+	/* Set or retrieve the connection flags, which apply to subsequent
+	 * queries
+	 */
+	int sql_set_flags(SQL *sql, unsigned int flags);
+	unsigned int sql_flags(SQL *sql);
+
+	/* Control the per-connection prepared statement cache, which is
+	 * disabled by default; when enabled, single data-manipulation
+	 * statements passed to sql_query() and sql_execute() are prepared on
+	 * the server and re-used (on MySQL, their results are then received
+	 * using the binary protocol)
+	 */
+	int sql_set_cache_size(SQL *sql, size_t limit);
+	int sql_cache_stats(SQL *restrict sql, SQL_CACHE_STATS *restrict stats);
+
+	/* Obtain performance statistics for a connection, or for every
+	 * connection in the process if sql is NULL, and write them in the
+	 * Prometheus text exposition format; labels, if not NULL, is a list of
+	 * additional labels (such as db="main") applied to each sample
+	 */
+	int sql_stats_get(SQL *restrict sql, SQL_STATS *restrict stats);
+	int sql_stats_prometheus(const SQL_STATS *restrict stats, const char *restrict labels, const SQL_EXPORT_SINK *restrict sink);
+
+	/* Turn the latency histograms and server wait times on (the default)
+	 * or off for every connection; operations are still counted
+	 */
+	int sql_stats_enable(int enable);
+
 	/* Escape a string */
 	size_t sql_escape(SQL *restrict sql, const unsigned char *restrict from, size_t length, char *restrict buf, size_t buflen);
 	
@@ -101,17 +504,69 @@ extern "C" {
 	int sql_executef(SQL *restrict sql, const char *restrict statement, ...);
 	int sql_vexecutef(SQL *restrict sql, const char *restrict statement, va_list ap);
 
+	/* Execute a batch of statements, or a script of semicolon-separated
+	 * statements, in as few round-trips to the server as possible
+	 */
+	int sql_execute_batch(SQL *restrict sql, const char *const *restrict statements, size_t count, unsigned long long *restrict affected);
+	int sql_execute_script(SQL *restrict sql, const char *restrict script, unsigned long long *restrict affected, size_t naffected);
+
+	/* Insert rows supplied by a callback into a table; columns is a
+	 * NULL-terminated list of column names, which are not quoted. Each
+	 * time the callback is invoked, it should populate values (one per
+	 * column, NULL for SQL NULL), which must remain valid until the next
+	 * invocation.
+	 */
+	long long sql_bulk_insert(SQL *restrict sql, const char *restrict table, const char *const *restrict columns, SQL_BULK_ROW fn, void *restrict userdata);
+
+	/* Execute a query, writing the result-set to a sink in CSV, TSV or
+	 * binary format
+	 */
+	long long sql_export(SQL *restrict sql, const char *restrict query, SQL_EXPORT_FORMAT format, const SQL_EXPORT_SINK *restrict sink);
+
+	/* Execute a query, invoking a callback for each row; the callback
+	 * returns 0 to continue, a positive value to stop, or a negative value
+	 * to abort with an error. Returns the number of rows processed, or -1
+	 * on error.
+	 */
+	long long sql_query_foreach(SQL *restrict sql, const char *restrict query, SQL_ROW_FN fn, void *restrict userdata);
+
 	/* Execute a statement which is expected to return a result-set */
 	SQL_STATEMENT *sql_query(SQL *restrict sql, const char *restrict statement);
 	SQL_STATEMENT *sql_queryf(SQL *restrict sql, const char *restrict statement, ...);
 	SQL_STATEMENT *sql_vqueryf(SQL *restrict sql, const char *restrict statement, va_list ap);
 
+	/* Execute a query whose rows are retrieved from the server as they are
+	 * read, rather than all at once; the result-set cannot be rewound, and
+	 * the connection cannot be used for anything else until it has been
+	 * destroyed
+	 */
+	SQL_STATEMENT *sql_query_stream(SQL *restrict sql, const char *restrict statement);
+
+	/* Execute a query asynchronously: sql_query_async() returns once the
+	 * query has been issued, sql_poll() returns 1 once it has completed,
+	 * and sql_result() obtains its result-set, blocking if necessary.
+	 * sql_socket() returns a descriptor which becomes readable when
+	 * sql_poll() should be invoked. The connection cannot be used for
+	 * anything else until sql_result() has been called.
+	 */
+	int sql_query_async(SQL *restrict sql, const char *restrict query);
+	int sql_poll(SQL *sql);
+	SQL_STATEMENT *sql_result(SQL *sql);
+	int sql_socket(SQL *sql);
+
 	/* Create a parameterised statement */
-	SQL_STATEMENT *sql_stmt_create(const char *statement);
+	SQL_STATEMENT *sql_stmt_create(SQL *restrict sql, const char *restrict statement);
 	
-	/* Execute a parameterised statement */
+	/* Execute a parameterised statement; a statement may be executed
+	 * repeatedly, re-using the resources allocated for its previous
+	 * results. Prepared statements returned by sql_query() can also be
+	 * re-executed in this way.
+	 */
 	int sql_stmt_execf(SQL_STATEMENT *statement, ...);
 	int sql_stmt_vexecf(SQL_STATEMENT *statement, va_list ap);
+
+	/* Discard the results of a statement so that it can be executed again */
+	int sql_stmt_reset(SQL_STATEMENT *statement);
 	
 	/* Destroy a statement or result-set */
 	int sql_stmt_destroy(SQL_STATEMENT *statement);
@@ -131,10 +586,34 @@ extern "C" {
 	long sql_stmt_long(SQL_STATEMENT *statement, unsigned int col);
 	unsigned long sql_stmt_ulong(SQL_STATEMENT *statement, unsigned int col);
 
+	/* Retrieve the native value of a column, without conversion to text
+	 * where the engine supports it
+	 */
+	int64_t sql_stmt_int64(SQL_STATEMENT *statement, unsigned int col);
+	double sql_stmt_double(SQL_STATEMENT *statement, unsigned int col);
+	int sql_stmt_bool(SQL_STATEMENT *statement, unsigned int col);
+	const unsigned char *sql_stmt_blob(SQL_STATEMENT *restrict statement, unsigned int col, size_t *restrict len);
+
+	/* Obtain the values of up to ncols columns of the current row in a
+	 * single call; returns the number of columns populated, or -1 if there
+	 * is no current row
+	 */
+	int sql_stmt_row(SQL_STATEMENT *restrict statement, SQL_CELL *restrict cells, unsigned int ncols);
+
+	/* Obtain a statement's execution counters, where the engine supports
+	 * them (currently only SQLite)
+	 */
+	int sql_stmt_scanstatus(SQL_STATEMENT *restrict statement, SQL_STMT_STATUS *restrict status);
+
+	/* Fetch rows in column-major batches */
+	int sql_stmt_fetch_batch(SQL_STATEMENT *restrict statement, size_t max_rows, SQL_BATCH *restrict batch);
+	void sql_batch_free(SQL_BATCH *batch);
+
 	/* Return the name of a column */
 	int sql_field_destroy(SQL_FIELD *field);
 	const char *sql_field_name(SQL_FIELD *field);
 	size_t sql_field_width(SQL_FIELD *field);
+	SQL_FIELD_TYPE sql_field_type(SQL_FIELD *field);
 	
 	/* Transaction handling */
 	int sql_begin(SQL *sql, SQL_TXN_MODE mode);
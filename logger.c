@@ -0,0 +1,481 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "p_libsql.h"
+
+/* Each connection's engine invokes sql_logger_query_() and
+ * sql_logger_error_() in place of the application's query and error logging
+ * callbacks. Normally these simply call the callbacks, but once
+ * sql_logger_start() has been invoked, they instead copy the log record
+ * into a fixed-size slot of a bounded multiple-producer, single-consumer
+ * ring buffer and return without blocking. A background thread drains the
+ * ring, invoking the callbacks or appending to a file.
+ *
+ * Each slot has a sequence number: a slot is free for the producer which
+ * claims position n when its sequence is n, and ready for the consumer once
+ * the producer sets it to n + 1. When the consumer has finished with it,
+ * it becomes n + capacity, freeing it for the next lap of the ring. If the
+ * ring is full, the record is dropped.
+ */
+
+#define SQL_LOGGER_DEFAULT_CAPACITY     4096
+#define SQL_LOGGER_TEXT                 448
+/* How long the consumer sleeps for when the ring is empty, in milliseconds;
+ * producers wake it early if they can
+ */
+#define SQL_LOGGER_IDLE                 100
+
+typedef enum
+{
+	SQL_LOGGER_QUERY,
+	SQL_LOGGER_ERROR
+} SQL_LOGGER_TYPE;
+
+typedef struct
+{
+	unsigned long long seq;
+	SQL_LOGGER_TYPE type;
+	SQL *sql;
+	SQL_LOG_QUERY query;
+	SQL_LOG_ERROR error;
+	struct timespec when;
+	char sqlstate[6];
+	char text[SQL_LOGGER_TEXT];
+} SQL_LOGGER_RECORD;
+
+typedef struct
+{
+	SQL_LOGGER_RECORD *slots;
+	size_t mask;
+	unsigned int sample;
+	int fd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int idle;
+	int stopping;
+	/* Positions of the next slot to be claimed and consumed */
+	unsigned long long tail;
+	unsigned long long head;
+	unsigned long long counter;
+	unsigned long long logged;
+	unsigned long long sampled;
+	unsigned long long dropped;
+} SQL_LOGGER_RING;
+
+static SQL_LOGGER_RING sql_logger_ring_;
+/* Nonzero while the ring is in use; producers which are part-way through
+ * writing a record are counted in sql_logger_users_
+ */
+static int sql_logger_running_;
+static unsigned long sql_logger_users_;
+static pthread_mutex_t sql_logger_lock_ = PTHREAD_MUTEX_INITIALIZER;
+
+static int sql_logger_query_(SQL *restrict sql, const char *query);
+static int sql_logger_error_(SQL *restrict sql, const char *sqlstate, const char *message);
+static int sql_logger_begin_(void);
+static void sql_logger_push_(SQL *restrict sql, SQL_LOGGER_TYPE type, const char *restrict sqlstate, const char *restrict text);
+static void *sql_logger_thread_(void *arg);
+static void sql_logger_deliver_(SQL_LOGGER_RECORD *record);
+
+/* Start the background logger */
+int
+sql_logger_start(const SQL_LOGGER *config)
+{
+	SQL_LOGGER_RING *ring;
+	size_t capacity, c;
+
+	ring = &sql_logger_ring_;
+	pthread_mutex_lock(&sql_logger_lock_);
+	if(__atomic_load_n(&sql_logger_running_, __ATOMIC_ACQUIRE))
+	{
+		pthread_mutex_unlock(&sql_logger_lock_);
+		errno = EBUSY;
+		return -1;
+	}
+	memset(ring, 0, sizeof(SQL_LOGGER_RING));
+	capacity = (config && config->capacity ? config->capacity : SQL_LOGGER_DEFAULT_CAPACITY);
+	for(c = 2; c < capacity; c *= 2);
+	ring->slots = (SQL_LOGGER_RECORD *) sql_calloc_(c, sizeof(SQL_LOGGER_RECORD));
+	if(!ring->slots)
+	{
+		pthread_mutex_unlock(&sql_logger_lock_);
+		return -1;
+	}
+	ring->mask = c - 1;
+	for(c = 0; c <= ring->mask; c++)
+	{
+		ring->slots[c].seq = c;
+	}
+	ring->sample = (config && config->sample ? config->sample : 1);
+	ring->fd = -1;
+	if(config && config->path)
+	{
+		ring->fd = open(config->path, O_WRONLY|O_APPEND|O_CREAT, 0666);
+		if(ring->fd == -1)
+		{
+			sql_free_(ring->slots);
+			pthread_mutex_unlock(&sql_logger_lock_);
+			return -1;
+		}
+	}
+	pthread_mutex_init(&(ring->lock), NULL);
+	pthread_cond_init(&(ring->cond), NULL);
+	if((errno = pthread_create(&(ring->thread), NULL, sql_logger_thread_, ring)))
+	{
+		pthread_cond_destroy(&(ring->cond));
+		pthread_mutex_destroy(&(ring->lock));
+		if(ring->fd != -1)
+		{
+			close(ring->fd);
+		}
+		sql_free_(ring->slots);
+		pthread_mutex_unlock(&sql_logger_lock_);
+		return -1;
+	}
+	__atomic_store_n(&sql_logger_running_, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&sql_logger_lock_);
+	return 0;
+}
+
+/* Stop the background logger once it has delivered any outstanding
+ * records; subsequent records are passed to the callbacks directly
+ */
+int
+sql_logger_stop(void)
+{
+	SQL_LOGGER_RING *ring;
+
+	ring = &sql_logger_ring_;
+	pthread_mutex_lock(&sql_logger_lock_);
+	if(!__atomic_load_n(&sql_logger_running_, __ATOMIC_ACQUIRE))
+	{
+		pthread_mutex_unlock(&sql_logger_lock_);
+		return 0;
+	}
+	__atomic_store_n(&sql_logger_running_, 0, __ATOMIC_SEQ_CST);
+	/* Wait for any producers which saw the logger running to finish */
+	while(__atomic_load_n(&sql_logger_users_, __ATOMIC_SEQ_CST))
+	{
+		sched_yield();
+	}
+	pthread_mutex_lock(&(ring->lock));
+	ring->stopping = 1;
+	pthread_cond_signal(&(ring->cond));
+	pthread_mutex_unlock(&(ring->lock));
+	pthread_join(ring->thread, NULL);
+	pthread_cond_destroy(&(ring->cond));
+	pthread_mutex_destroy(&(ring->lock));
+	if(ring->fd != -1)
+	{
+		close(ring->fd);
+	}
+	sql_free_(ring->slots);
+	ring->slots = NULL;
+	pthread_mutex_unlock(&sql_logger_lock_);
+	return 0;
+}
+
+/* Obtain the logger's counters, which are retained after it is stopped */
+int
+sql_logger_stats(SQL_LOGGER_STATS *stats)
+{
+	SQL_LOGGER_RING *ring;
+
+	ring = &sql_logger_ring_;
+	stats->logged = __atomic_load_n(&(ring->logged), __ATOMIC_RELAXED);
+	stats->sampled = __atomic_load_n(&(ring->sampled), __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&(ring->dropped), __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* Route a new connection's logging through the logger */
+int
+sql_logger_attach_(SQL *sql)
+{
+	sql->api->set_querylog(sql, sql_logger_query_);
+	sql->api->set_errorlog(sql, sql_logger_error_);
+	return 0;
+}
+
+/* Wait for any records queued by a connection to be delivered before it
+ * is freed; must be invoked by an engine when a connection is destroyed
+ */
+void
+sql_logger_detach_(SQL *sql)
+{
+	SQL_LOGGER_RING *ring;
+	unsigned long long tail;
+	struct timespec ts;
+
+	(void) sql;
+
+	if(!sql_logger_begin_())
+	{
+		return;
+	}
+	ring = &sql_logger_ring_;
+	/* The logger thread can't be stopped while we're counted as a user, so
+	 * the ring remains valid until we're done
+	 */
+	tail = __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE);
+	ts.tv_sec = 0;
+	ts.tv_nsec = 1000000;
+	while(__atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE) < tail)
+	{
+		nanosleep(&ts, NULL);
+	}
+	__atomic_sub_fetch(&sql_logger_users_, 1, __ATOMIC_SEQ_CST);
+}
+
+static int
+sql_logger_query_(SQL *restrict sql, const char *query)
+{
+	SQL_LOGGER_RING *ring;
+	unsigned long long n;
+
+	if(!sql_logger_begin_())
+	{
+		return (sql->logquery ? sql->logquery(sql, query) : 0);
+	}
+	ring = &sql_logger_ring_;
+	if(ring->fd != -1 || sql->logquery)
+	{
+		n = __atomic_fetch_add(&(ring->counter), 1, __ATOMIC_RELAXED);
+		if(n % ring->sample)
+		{
+			__atomic_add_fetch(&(ring->sampled), 1, __ATOMIC_RELAXED);
+		}
+		else
+		{
+			sql_logger_push_(sql, SQL_LOGGER_QUERY, NULL, query);
+		}
+	}
+	__atomic_sub_fetch(&sql_logger_users_, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+static int
+sql_logger_error_(SQL *restrict sql, const char *sqlstate, const char *message)
+{
+	SQL_LOGGER_RING *ring;
+
+	if(!sql_logger_begin_())
+	{
+		return (sql->logerror ? sql->logerror(sql, sqlstate, message) : 0);
+	}
+	ring = &sql_logger_ring_;
+	if(ring->fd != -1 || sql->logerror)
+	{
+		sql_logger_push_(sql, SQL_LOGGER_ERROR, sqlstate, message);
+	}
+	__atomic_sub_fetch(&sql_logger_users_, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+/* Register as a user of the ring if the logger is running, returning
+ * nonzero if so
+ */
+static int
+sql_logger_begin_(void)
+{
+	if(!__atomic_load_n(&sql_logger_running_, __ATOMIC_ACQUIRE))
+	{
+		return 0;
+	}
+	__atomic_add_fetch(&sql_logger_users_, 1, __ATOMIC_SEQ_CST);
+	if(!__atomic_load_n(&sql_logger_running_, __ATOMIC_SEQ_CST))
+	{
+		__atomic_sub_fetch(&sql_logger_users_, 1, __ATOMIC_SEQ_CST);
+		return 0;
+	}
+	return 1;
+}
+
+/* Copy a record into the ring, or drop it if the ring is full */
+static void
+sql_logger_push_(SQL *restrict sql, SQL_LOGGER_TYPE type, const char *restrict sqlstate, const char *restrict text)
+{
+	SQL_LOGGER_RING *ring;
+	SQL_LOGGER_RECORD *record;
+	unsigned long long pos, seq;
+	size_t len;
+
+	ring = &sql_logger_ring_;
+	pos = __atomic_load_n(&(ring->tail), __ATOMIC_RELAXED);
+	for(;;)
+	{
+		record = &(ring->slots[pos & ring->mask]);
+		seq = __atomic_load_n(&(record->seq), __ATOMIC_ACQUIRE);
+		if(seq == pos)
+		{
+			if(__atomic_compare_exchange_n(&(ring->tail), &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if(seq < pos)
+		{
+			/* The slot hasn't been consumed since the last lap */
+			__atomic_add_fetch(&(ring->dropped), 1, __ATOMIC_RELAXED);
+			return;
+		}
+		else
+		{
+			pos = __atomic_load_n(&(ring->tail), __ATOMIC_RELAXED);
+		}
+	}
+	record->type = type;
+	record->sql = sql;
+	record->query = sql->logquery;
+	record->error = sql->logerror;
+	clock_gettime(CLOCK_REALTIME, &(record->when));
+	record->sqlstate[0] = 0;
+	if(sqlstate)
+	{
+		strncpy(record->sqlstate, sqlstate, sizeof(record->sqlstate) - 1);
+		record->sqlstate[sizeof(record->sqlstate) - 1] = 0;
+	}
+	len = (text ? strlen(text) : 0);
+	if(len >= SQL_LOGGER_TEXT)
+	{
+		/* Truncate overlong text, marking it as such */
+		memcpy(record->text, text, SQL_LOGGER_TEXT - 4);
+		strcpy(&(record->text[SQL_LOGGER_TEXT - 4]), "...");
+	}
+	else
+	{
+		memcpy(record->text, (text ? text : ""), len + 1);
+	}
+	__atomic_store_n(&(record->seq), pos + 1, __ATOMIC_RELEASE);
+	/* Wake the logger thread if it's idle, without waiting for its lock */
+	if(__atomic_exchange_n(&(ring->idle), 0, __ATOMIC_ACQ_REL))
+	{
+		pthread_cond_signal(&(ring->cond));
+	}
+}
+
+/* The logger thread */
+static void *
+sql_logger_thread_(void *arg)
+{
+	SQL_LOGGER_RING *ring;
+	SQL_LOGGER_RECORD *record;
+	unsigned long long pos;
+	struct timespec deadline;
+	int stopping;
+
+	ring = (SQL_LOGGER_RING *) arg;
+	for(;;)
+	{
+		pos = __atomic_load_n(&(ring->head), __ATOMIC_RELAXED);
+		record = &(ring->slots[pos & ring->mask]);
+		if(__atomic_load_n(&(record->seq), __ATOMIC_ACQUIRE) == pos + 1)
+		{
+			sql_logger_deliver_(record);
+			__atomic_store_n(&(record->seq), pos + ring->mask + 1, __ATOMIC_RELEASE);
+			__atomic_store_n(&(ring->head), pos + 1, __ATOMIC_RELEASE);
+			__atomic_add_fetch(&(ring->logged), 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		pthread_mutex_lock(&(ring->lock));
+		stopping = ring->stopping;
+		if(!stopping)
+		{
+			/* Producers which find idle set will signal us; checking the
+			 * slot again catches any which published before it was set
+			 */
+			__atomic_store_n(&(ring->idle), 1, __ATOMIC_SEQ_CST);
+			if(__atomic_load_n(&(record->seq), __ATOMIC_SEQ_CST) != pos + 1)
+			{
+				clock_gettime(CLOCK_REALTIME, &deadline);
+				deadline.tv_nsec += SQL_LOGGER_IDLE * 1000000L;
+				if(deadline.tv_nsec >= 1000000000L)
+				{
+					deadline.tv_sec++;
+					deadline.tv_nsec -= 1000000000L;
+				}
+				pthread_cond_timedwait(&(ring->cond), &(ring->lock), &deadline);
+			}
+			__atomic_store_n(&(ring->idle), 0, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&(ring->lock));
+		/* Producers have all finished by the time that stopping is set, so
+		 * once the ring is empty there is nothing left to deliver
+		 */
+		if(stopping && __atomic_load_n(&(record->seq), __ATOMIC_ACQUIRE) != pos + 1)
+		{
+			break;
+		}
+	}
+	return NULL;
+}
+
+/* Pass a record to the callbacks, or write it to the log file */
+static void
+sql_logger_deliver_(SQL_LOGGER_RECORD *record)
+{
+	SQL_LOGGER_RING *ring;
+	struct tm tm;
+	char buf[SQL_LOGGER_TEXT + 64];
+	size_t len;
+	ssize_t r;
+
+	ring = &sql_logger_ring_;
+	if(ring->fd == -1)
+	{
+		if(record->type == SQL_LOGGER_QUERY && record->query)
+		{
+			record->query(record->sql, record->text);
+		}
+		else if(record->type == SQL_LOGGER_ERROR && record->error)
+		{
+			record->error(record->sql, record->sqlstate, record->text);
+		}
+		return;
+	}
+	gmtime_r(&(record->when.tv_sec), &tm);
+	len = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+	if(record->type == SQL_LOGGER_QUERY)
+	{
+		len += snprintf(&(buf[len]), sizeof(buf) - len, ".%06ldZ query: %s\n", record->when.tv_nsec / 1000, record->text);
+	}
+	else
+	{
+		len += snprintf(&(buf[len]), sizeof(buf) - len, ".%06ldZ error: %s: %s\n", record->when.tv_nsec / 1000, record->sqlstate, record->text);
+	}
+	if(len >= sizeof(buf))
+	{
+		len = sizeof(buf) - 1;
+	}
+	do
+	{
+		r = write(ring->fd, buf, len);
+	}
+	while(r == -1 && errno == EINTR);
+}
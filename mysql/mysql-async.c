@@ -0,0 +1,204 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include "p_mysql.h"
+
+#include <poll.h>
+
+/* Where the client library provides a non-blocking API, asynchronous queries
+ * are driven through it by sql_poll(); otherwise, the query is executed
+ * synchronously by sql_query_async() and its result is immediately ready.
+ */
+
+#define SQL_MYSQL_ASYNC_IDLE           0
+#define SQL_MYSQL_ASYNC_QUERY          1
+#define SQL_MYSQL_ASYNC_STORE          2
+#define SQL_MYSQL_ASYNC_DONE           3
+
+static int sql_mysql_async_step_(SQL *me);
+
+int
+sql_mysql_query_async_(SQL *restrict me, const char *restrict query)
+{
+	if(me->astate != SQL_MYSQL_ASYNC_IDLE)
+	{
+		sql_mysql_set_error_(me, "HY010", "An asynchronous query is already in progress on this connection");
+		return -1;
+	}
+	if(me->depth && me->deadlocked)
+	{
+		/* If we're already deadlocked mid-transaction, there's no point in
+		 * doing anything
+		 */
+		return -1;
+	}
+	me->deadlocked = 0;
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+#ifdef SQL_MYSQL_NONBLOCKING
+	me->aquery = strdup(query);
+	if(!me->aquery)
+	{
+		sql_mysql_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	me->aquerylen = strlen(query);
+	me->astate = SQL_MYSQL_ASYNC_QUERY;
+#else
+	if(mysql_query(&(me->mysql), query))
+	{
+		sql_mysql_copy_error_(me);
+		return -1;
+	}
+	me->astate = SQL_MYSQL_ASYNC_STORE;
+#endif
+	return (sql_mysql_async_step_(me) < 0 ? -1 : 0);
+}
+
+int
+sql_mysql_poll_(SQL *me)
+{
+	if(me->astate == SQL_MYSQL_ASYNC_IDLE)
+	{
+		sql_mysql_set_error_(me, "HY010", "No asynchronous query is in progress on this connection");
+		return -1;
+	}
+	return sql_mysql_async_step_(me);
+}
+
+/* Wait for the query to complete and return its result-set */
+SQL_STATEMENT *
+sql_mysql_result_(SQL *me)
+{
+	SQL_STATEMENT *st;
+	MYSQL_RES *res;
+	struct pollfd pfd;
+	int r;
+
+	if(me->astate == SQL_MYSQL_ASYNC_IDLE)
+	{
+		sql_mysql_set_error_(me, "HY010", "No asynchronous query is in progress on this connection");
+		return NULL;
+	}
+	while(!(r = sql_mysql_async_step_(me)))
+	{
+		/* The client library may also be waiting to finish writing the
+		 * query, so don't wait indefinitely for the socket to become
+		 * readable
+		 */
+		pfd.fd = sql_mysql_socket_(me);
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		poll(&pfd, 1, 100);
+	}
+	if(r < 0)
+	{
+		return NULL;
+	}
+	res = me->aresult;
+	me->aresult = NULL;
+	me->astate = SQL_MYSQL_ASYNC_IDLE;
+	st = sql_mysql_statement_(me, NULL);
+	if(!st)
+	{
+		if(res)
+		{
+			mysql_free_result(res);
+		}
+		sql_mysql_set_error_(me, "58000", "Memory allocation error");
+		return NULL;
+	}
+	if(st->api->set_results(st, res))
+	{
+		st->api->release(st);
+		return NULL;
+	}
+	return st;
+}
+
+int
+sql_mysql_socket_(SQL *me)
+{
+	return me->mysql.net.fd;
+}
+
+/* Advance the query as far as is possible without blocking; returns 1 once
+ * the result-set has been retrieved, 0 if the query is still executing, or
+ * -1 on error
+ */
+static int
+sql_mysql_async_step_(SQL *me)
+{
+#ifdef SQL_MYSQL_NONBLOCKING
+	enum net_async_status status;
+
+	if(me->astate == SQL_MYSQL_ASYNC_QUERY)
+	{
+		status = mysql_real_query_nonblocking(&(me->mysql), me->aquery, me->aquerylen);
+		if(status == NET_ASYNC_NOT_READY)
+		{
+			return 0;
+		}
+		free(me->aquery);
+		me->aquery = NULL;
+		if(status == NET_ASYNC_ERROR)
+		{
+			sql_mysql_copy_error_(me);
+			me->astate = SQL_MYSQL_ASYNC_IDLE;
+			return -1;
+		}
+		me->astate = SQL_MYSQL_ASYNC_STORE;
+	}
+#endif
+	if(me->astate == SQL_MYSQL_ASYNC_STORE)
+	{
+		if(mysql_field_count(&(me->mysql)))
+		{
+			if(me->flags & SQL_FLAG_STREAM)
+			{
+				/* Rows are read from the server by mysql_fetch_row() */
+				me->aresult = mysql_use_result(&(me->mysql));
+			}
+			else
+			{
+#ifdef SQL_MYSQL_NONBLOCKING
+				if(mysql_store_result_nonblocking(&(me->mysql), &(me->aresult)) == NET_ASYNC_NOT_READY)
+				{
+					return 0;
+				}
+#else
+				me->aresult = mysql_store_result(&(me->mysql));
+#endif
+			}
+			if(!me->aresult)
+			{
+				sql_mysql_copy_error_(me);
+				me->astate = SQL_MYSQL_ASYNC_IDLE;
+				return -1;
+			}
+		}
+		me->astate = SQL_MYSQL_ASYNC_DONE;
+	}
+	return 1;
+}
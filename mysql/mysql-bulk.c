@@ -0,0 +1,293 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_mysql.h"
+
+/* Upper and lower bounds on the size of each multi-row INSERT */
+#define SQL_MYSQL_BULK_MINLEN          65536
+#define SQL_MYSQL_BULK_MAXLEN          16777216
+
+static size_t sql_mysql_bulk_limit_(SQL *me);
+static int sql_mysql_bulk_flush_(SQL *restrict me, const char *restrict query, size_t len);
+
+/* Bulk-load rows using multi-row INSERT statements, each as large as the
+ * server's max_allowed_packet permits, within a single transaction
+ */
+long long
+sql_mysql_bulk_insert_(SQL *restrict me, const char *restrict table, const char *const *restrict columns, size_t ncolumns, SQL_BULK_ROW fn, void *restrict userdata)
+{
+	char *collist, *buf, *p;
+	const char **values;
+	size_t c, limit, alloc, len, prefix, needed;
+	long long count;
+	int r, txn;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	me->deadlocked = 0;
+	limit = sql_mysql_bulk_limit_(me);
+	collist = sql_bulk_columns_(columns, ncolumns);
+	values = (const char **) calloc(ncolumns, sizeof(const char *));
+	alloc = (collist ? strlen(table) + strlen(collist) + 32 : 0) + limit;
+	buf = (collist && values) ? (char *) malloc(alloc) : NULL;
+	if(!buf)
+	{
+		free(collist);
+		free(values);
+		sql_mysql_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	prefix = sprintf(buf, "INSERT INTO %s (%s) VALUES ", table, collist);
+	free(collist);
+	len = prefix;
+	txn = 0;
+	if(!me->depth)
+	{
+		if(sql_mysql_begin_(me, SQL_TXN_DEFAULT))
+		{
+			free(buf);
+			free(values);
+			return -1;
+		}
+		txn = 1;
+	}
+	count = 0;
+	for(;;)
+	{
+		r = fn(me, values, userdata);
+		if(r <= 0)
+		{
+			if(r < 0)
+			{
+				sql_mysql_set_error_(me, "HY008", "Bulk insert was aborted");
+			}
+			break;
+		}
+		/* Each value may need to be escaped in its entirety */
+		needed = 4;
+		for(c = 0; c < ncolumns; c++)
+		{
+			needed += (values[c] ? strlen(values[c]) * 2 + 2 : 4) + 2;
+		}
+		if(len > prefix && len + needed > limit)
+		{
+			if(sql_mysql_bulk_flush_(me, buf, len))
+			{
+				r = -1;
+				break;
+			}
+			len = prefix;
+		}
+		if(len + needed >= alloc)
+		{
+			/* A single row larger than the limit is sent on its own */
+			p = (char *) realloc(buf, len + needed + 1);
+			if(!p)
+			{
+				sql_mysql_set_error_(me, "58000", "Memory allocation error");
+				r = -1;
+				break;
+			}
+			buf = p;
+			alloc = len + needed + 1;
+		}
+		p = buf + len;
+		if(len > prefix)
+		{
+			*p = ',';
+			p++;
+		}
+		*p = '(';
+		p++;
+		for(c = 0; c < ncolumns; c++)
+		{
+			if(c)
+			{
+				*p = ',';
+				p++;
+			}
+			if(!values[c])
+			{
+				memcpy(p, "NULL", 4);
+				p += 4;
+				continue;
+			}
+			*p = '\'';
+			p++;
+			p += mysql_real_escape_string(&(me->mysql), p, values[c], strlen(values[c]));
+			*p = '\'';
+			p++;
+		}
+		*p = ')';
+		p++;
+		len = p - buf;
+		*p = 0;
+		count++;
+	}
+	if(r == 0 && len > prefix && sql_mysql_bulk_flush_(me, buf, len))
+	{
+		r = -1;
+	}
+	free(buf);
+	free(values);
+	if(r < 0)
+	{
+		if(txn)
+		{
+			sql_mysql_rollback_(me);
+		}
+		return -1;
+	}
+	if(txn && sql_mysql_commit_(me))
+	{
+		return -1;
+	}
+	return count;
+}
+
+/* Determine how large each INSERT statement may be */
+static size_t
+sql_mysql_bulk_limit_(SQL *me)
+{
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	size_t limit;
+
+	limit = SQL_MYSQL_BULK_MINLEN;
+	if(mysql_query(&(me->mysql), "SELECT @@max_allowed_packet"))
+	{
+		return limit;
+	}
+	res = mysql_store_result(&(me->mysql));
+	if(!res)
+	{
+		return limit;
+	}
+	row = mysql_fetch_row(res);
+	if(row && row[0])
+	{
+		/* Leave some headroom for the protocol overhead */
+		limit = strtoul(row[0], NULL, 10) / 4 * 3;
+	}
+	mysql_free_result(res);
+	if(limit < SQL_MYSQL_BULK_MINLEN)
+	{
+		limit = SQL_MYSQL_BULK_MINLEN;
+	}
+	if(limit > SQL_MYSQL_BULK_MAXLEN)
+	{
+		limit = SQL_MYSQL_BULK_MAXLEN;
+	}
+	return limit;
+}
+
+static int
+sql_mysql_bulk_flush_(SQL *restrict me, const char *restrict query, size_t len)
+{
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+	if(mysql_real_query(&(me->mysql), query, len))
+	{
+		sql_mysql_copy_error_(me);
+		return -1;
+	}
+	return 0;
+}
+
+/* Export the results of a query, reading rows from the server as they are
+ * written rather than buffering the whole result-set
+ */
+long long
+sql_mysql_export_(SQL *restrict me, const char *restrict query, SQL_EXPORT_FORMAT format, SQL_EXPORT_BUFFER *restrict buf)
+{
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	unsigned long *lengths;
+	unsigned int c, ncolumns;
+	long long count;
+	unsigned long long bytes;
+	int r;
+
+	if(format == SQL_EXPORT_BINARY)
+	{
+		sql_mysql_set_error_(me, "0A000", "Binary export is not supported by this engine");
+		return -1;
+	}
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	me->deadlocked = 0;
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+	if(mysql_query(&(me->mysql), query))
+	{
+		sql_mysql_copy_error_(me);
+		return -1;
+	}
+	res = mysql_use_result(&(me->mysql));
+	if(!res)
+	{
+		if(mysql_field_count(&(me->mysql)))
+		{
+			sql_mysql_copy_error_(me);
+			return -1;
+		}
+		/* The statement didn't return a result-set */
+		return 0;
+	}
+	ncolumns = mysql_num_fields(res);
+	count = 0;
+	bytes = 0;
+	r = 0;
+	while((row = mysql_fetch_row(res)))
+	{
+		lengths = mysql_fetch_lengths(res);
+		for(c = 0; c < ncolumns && !r; c++)
+		{
+			bytes += lengths[c];
+			r = sql_export_value_(buf, c, row[c], lengths[c]);
+		}
+		if(r || sql_export_eol_(buf))
+		{
+			/* mysql_free_result() will discard the remaining rows */
+			r = -1;
+			break;
+		}
+		count++;
+	}
+	if(!r && mysql_errno(&(me->mysql)))
+	{
+		sql_mysql_copy_error_(me);
+		r = -1;
+	}
+	mysql_free_result(res);
+	sql_stats_rows_(me, count, bytes);
+	return r ? -1 : count;
+}
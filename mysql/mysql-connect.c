@@ -31,6 +31,7 @@ sql_mysql_connect_(SQL *me, URI *uri)
 	MYSQL *res;
 	char *pw, *db;
 	unsigned long flags;
+	unsigned long long start;
 
 	info = uri_info(uri);
 	if(!info)
@@ -61,7 +62,9 @@ sql_mysql_connect_(SQL *me, URI *uri)
 		}
 	}
 	flags = 0;
+	start = sql_stats_timer_();
 	res = mysql_real_connect(&(me->mysql), info->host, info->auth, pw, db, info->port, NULL, flags);
+	sql_stats_wait_(me, start);
 	uri_info_destroy(info);
 	if(!res)
 	{
@@ -96,6 +99,7 @@ sql_mysql_set_error_(SQL *restrict me, const char *restrict sqlstate, const char
 		message = sqlstate;
 	}
 	strncpy(me->error, message, sizeof(me->error) - 1);
+	sql_stats_error_(me, me->sqlstate);
 	if(me->errorlog)
 	{
 		me->errorlog(me, me->sqlstate, me->error);
@@ -119,6 +123,31 @@ sql_mysql_copy_error_(SQL *me)
 	sql_mysql_set_error_(me, sqlstate, err);
 }
 
+void
+sql_mysql_copy_stmt_error_(SQL *restrict me, MYSQL_STMT *restrict stmt)
+{
+	int e;
+
+	e = mysql_stmt_errno(stmt);
+	if(e == 1205 || e == 1213 || e == 1478 || e == 1479)
+	{
+		me->deadlocked = 1;
+	}
+	sql_mysql_set_error_(me, mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
+}
+
+/* Check that the connection to the server is still usable */
+int
+sql_mysql_ping_(SQL *me)
+{
+	if(mysql_ping(&(me->mysql)))
+	{
+		sql_mysql_copy_error_(me);
+		return -1;
+	}
+	return 0;
+}
+
 size_t
 sql_mysql_escape_(SQL *restrict me, const unsigned char *restrict from, size_t length, char *restrict buf, size_t buflen)
 {
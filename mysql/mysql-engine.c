@@ -60,6 +60,19 @@ static SQL_API mysql_api = {
 	sql_mysql_variant_,
 	sql_mysql_set_userdata_,
 	sql_mysql_userdata_,
+	sql_mysql_set_error_,
+	sql_mysql_execute_batch_,
+	sql_mysql_execute_script_,
+	sql_mysql_bulk_insert_,
+	sql_mysql_export_,
+	sql_mysql_query_foreach_,
+	sql_mysql_ping_,
+	sql_mysql_query_async_,
+	sql_mysql_poll_,
+	sql_mysql_result_,
+	sql_mysql_socket_,
+	sql_def_cacheable_,
+	sql_mysql_affected_
 };
 
 SQL_ENGINE *
@@ -90,11 +103,21 @@ sql_engine_mysql_create_(SQL_ENGINE *me)
 
 	(void) me;
 
-	inst = (SQL *) calloc(1, sizeof(SQL));
+	sql_allocator_lock_();
+	inst = (SQL *) sql_calloc_(1, sizeof(SQL));
 	if(!inst)
 	{
 		return NULL;
 	}
+	inst->stmtslab = sql_slab_create_(sizeof(SQL_STATEMENT));
+	inst->fieldslab = sql_slab_create_(sizeof(SQL_FIELD));
+	if(!inst->stmtslab || !inst->fieldslab)
+	{
+		sql_slab_destroy_(inst->stmtslab);
+		sql_slab_destroy_(inst->fieldslab);
+		sql_free_(inst);
+		return NULL;
+	}
 	inst->api = &mysql_api;
 	inst->refcount = 1;
 	strcpy(inst->sqlstate, "0000");
@@ -102,7 +125,9 @@ sql_engine_mysql_create_(SQL_ENGINE *me)
 	res = mysql_init(&(inst->mysql));
 	if(!res)
 	{
-		free(inst);
+		sql_slab_destroy_(inst->stmtslab);
+		sql_slab_destroy_(inst->fieldslab);
+		sql_free_(inst);
 		return NULL;
 	}
 	pthread_mutex_init(&(inst->lock), NULL);
@@ -117,10 +142,21 @@ sql_mysql_free_(SQL *me)
 	{
 		return me->refcount;
 	}
+	sql_logger_detach_(me);
+	sql_stats_detach_(me);
+	sql_cache_destroy_(me->cache);
+	sql_formatter_destroy_(me->formatter);
+	sql_slab_destroy_(me->stmtslab);
+	sql_slab_destroy_(me->fieldslab);
 	pthread_mutex_destroy(&(me->lock));
+	if(me->aresult)
+	{
+		mysql_free_result(me->aresult);
+	}
+	free(me->aquery);
 	mysql_close(&(me->mysql));
 	free(me->qbuf);
-	free(me);
+	sql_free_(me);
 	return 0;
 }
 
@@ -25,7 +25,8 @@ static SQL_FIELD_API mysql_field_api = {
 	sql_field_def_addref_,
 	sql_field_mysql_free_,
 	sql_field_mysql_name_,
-	sql_field_mysql_width_
+	sql_field_mysql_width_,
+	sql_field_mysql_type_
 };
 
 /* Return a SQL_FIELD instance for a particular column (0..cols-1) */
@@ -38,7 +39,12 @@ sql_statement_mysql_field_(SQL_STATEMENT *me, unsigned int col)
 	{
 		return NULL;
 	}
-	p = (SQL_FIELD *) calloc(1, sizeof(SQL_FIELD));
+	p = (SQL_FIELD *) sql_slab_alloc_(me->sql->fieldslab);
+	if(!p)
+	{
+		return NULL;
+	}
+	p->slab = me->sql->fieldslab;
 	p->refcount = 1;
 	p->api = &mysql_field_api;
 	p->field = &(me->fields[col]);
@@ -54,7 +60,7 @@ sql_field_mysql_free_(SQL_FIELD *me)
 	{
 		return me->refcount;
 	}
-	free(me);
+	sql_slab_free_(me->slab, me);
 	return 0;
 }
 
@@ -71,3 +77,44 @@ sql_field_mysql_width_(SQL_FIELD *me)
 {
 	return me->field->max_length;
 }
+
+/* Return the type of the column */
+SQL_FIELD_TYPE
+sql_field_mysql_type_(SQL_FIELD *me)
+{
+	switch(me->field->type)
+	{
+	case MYSQL_TYPE_TINY:
+	case MYSQL_TYPE_SHORT:
+	case MYSQL_TYPE_INT24:
+	case MYSQL_TYPE_LONG:
+	case MYSQL_TYPE_LONGLONG:
+	case MYSQL_TYPE_YEAR:
+	case MYSQL_TYPE_BIT:
+		return SQL_TYPE_INTEGER;
+	case MYSQL_TYPE_FLOAT:
+	case MYSQL_TYPE_DOUBLE:
+		return SQL_TYPE_REAL;
+	case MYSQL_TYPE_DECIMAL:
+	case MYSQL_TYPE_NEWDECIMAL:
+		return SQL_TYPE_NUMERIC;
+	case MYSQL_TYPE_DATE:
+	case MYSQL_TYPE_NEWDATE:
+	case MYSQL_TYPE_DATETIME:
+	case MYSQL_TYPE_TIMESTAMP:
+		return SQL_TYPE_TIMESTAMP;
+	case MYSQL_TYPE_TINY_BLOB:
+	case MYSQL_TYPE_MEDIUM_BLOB:
+	case MYSQL_TYPE_LONG_BLOB:
+	case MYSQL_TYPE_BLOB:
+	case MYSQL_TYPE_VARCHAR:
+	case MYSQL_TYPE_VAR_STRING:
+	case MYSQL_TYPE_STRING:
+		/* Character set 63 is "binary" */
+		return (me->field->charsetnr == 63) ? SQL_TYPE_BLOB : SQL_TYPE_TEXT;
+	case MYSQL_TYPE_NULL:
+		return SQL_TYPE_UNKNOWN;
+	default:
+		return SQL_TYPE_TEXT;
+	}
+}
@@ -30,6 +30,7 @@ sql_mysql_execute_(SQL *restrict me, const char *restrict statement, void *restr
 {
 	int r;
 	MYSQL_RES *res;
+	unsigned long long start;
 
 	if(me->depth && me->deadlocked)
 	{
@@ -43,9 +44,11 @@ sql_mysql_execute_(SQL *restrict me, const char *restrict statement, void *restr
 	{
 		me->querylog(me, statement);
 	}
+	start = sql_stats_timer_();
 	r = mysql_query(&(me->mysql), statement);
 	if(r)
 	{		
+		sql_stats_wait_(me, start);
 		sql_mysql_copy_error_(me);
 		return -1;
 	}
@@ -54,22 +57,209 @@ sql_mysql_execute_(SQL *restrict me, const char *restrict statement, void *restr
 		*resultdata = NULL;
 		if(mysql_field_count(&(me->mysql)))
 		{
-			res = mysql_store_result(&(me->mysql));
+			if(me->flags & SQL_FLAG_STREAM)
+			{
+				/* Rows are read from the server by mysql_fetch_row() */
+				res = mysql_use_result(&(me->mysql));
+			}
+			else
+			{
+				res = mysql_store_result(&(me->mysql));
+			}
+			sql_stats_wait_(me, start);
 			if(!res)
 			{
 				sql_mysql_copy_error_(me);
 				return -1;
 			}
 			*resultdata = res;
+			return 0;
 		}
 	}
+	sql_stats_wait_(me, start);
 	return 0;
 }
 
+/* Return the number of rows affected by the last statement executed
+ * without a result-set
+ */
+unsigned long long
+sql_mysql_affected_(SQL *me)
+{
+	my_ulonglong n;
+
+	n = mysql_affected_rows(&(me->mysql));
+	return (n == (my_ulonglong) -1 ? 0 : (unsigned long long) n);
+}
+
+/* Execute a script as a single multi-statement query; multi-statement
+ * support is only enabled for the duration, so that it can't be exploited
+ * via any other query
+ */
+int
+sql_mysql_execute_script_(SQL *restrict me, const char *restrict script, unsigned long long *restrict affected, size_t naffected)
+{
+	MYSQL_RES *res;
+	int r, n;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	me->deadlocked = 0;
+	if(me->querylog)
+	{
+		me->querylog(me, script);
+	}
+	if(mysql_set_server_option(&(me->mysql), MYSQL_OPTION_MULTI_STATEMENTS_ON))
+	{
+		sql_mysql_copy_error_(me);
+		return -1;
+	}
+	n = 0;
+	r = mysql_query(&(me->mysql), script);
+	if(!r)
+	{
+		do
+		{
+			/* Discard the rows of any statement which returned them */
+			res = mysql_store_result(&(me->mysql));
+			if(res)
+			{
+				mysql_free_result(res);
+			}
+			else if(mysql_field_count(&(me->mysql)))
+			{
+				r = 1;
+				break;
+			}
+			if((size_t) n < naffected)
+			{
+				affected[n] = mysql_affected_rows(&(me->mysql));
+			}
+			n++;
+		}
+		while(!(r = mysql_next_result(&(me->mysql))));
+		/* -1 indicates that there are no more results */
+		r = (r > 0);
+	}
+	if(r)
+	{
+		sql_mysql_copy_error_(me);
+	}
+	mysql_set_server_option(&(me->mysql), MYSQL_OPTION_MULTI_STATEMENTS_OFF);
+	return r ? -1 : n;
+}
+
+/* Execute a batch of statements as a single multi-statement query */
+int
+sql_mysql_execute_batch_(SQL *restrict me, const char *const *restrict statements, size_t count, unsigned long long *restrict affected)
+{
+	char *script;
+	int r;
+
+	script = sql_batch_join_(statements, count);
+	if(!script)
+	{
+		sql_mysql_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	r = sql_mysql_execute_script_(me, script, affected, (affected ? count : 0));
+	free(script);
+	return (r < 0) ? -1 : 0;
+}
+
+/* Execute a query, passing each row to a callback; the rows are read from
+ * the server as they are processed if SQL_FLAG_STREAM is set, in which
+ * case the callback cannot use the connection
+ */
+long long
+sql_mysql_query_foreach_(SQL *restrict me, const char *restrict query, SQL_ROW_FN fn, void *restrict userdata)
+{
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	SQL_CELL *cells;
+	unsigned long *lengths;
+	unsigned int c, ncols;
+	long long count;
+	unsigned long long bytes;
+	int stop;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	me->deadlocked = 0;
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+	if(mysql_query(&(me->mysql), query))
+	{
+		sql_mysql_copy_error_(me);
+		return -1;
+	}
+	if(me->flags & SQL_FLAG_STREAM)
+	{
+		res = mysql_use_result(&(me->mysql));
+	}
+	else
+	{
+		res = mysql_store_result(&(me->mysql));
+	}
+	if(!res)
+	{
+		if(mysql_field_count(&(me->mysql)))
+		{
+			sql_mysql_copy_error_(me);
+			return -1;
+		}
+		return 0;
+	}
+	ncols = mysql_num_fields(res);
+	cells = (SQL_CELL *) calloc(ncols + 1, sizeof(SQL_CELL));
+	if(!cells)
+	{
+		mysql_free_result(res);
+		sql_mysql_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	count = 0;
+	stop = 0;
+	bytes = 0;
+	while(!stop && (row = mysql_fetch_row(res)))
+	{
+		lengths = mysql_fetch_lengths(res);
+		for(c = 0; c < ncols; c++)
+		{
+			cells[c].null = (row[c] == NULL);
+			cells[c].ptr = row[c];
+			cells[c].len = lengths[c];
+			bytes += lengths[c];
+		}
+		count++;
+		stop = fn(me, cells, ncols, userdata);
+	}
+	free(cells);
+	sql_stats_rows_(me, count, bytes);
+	if(stop < 0)
+	{
+		sql_mysql_set_error_(me, "HY008", "Query was aborted");
+	}
+	else if(!stop && mysql_errno(&(me->mysql)))
+	{
+		sql_mysql_copy_error_(me);
+		stop = -1;
+	}
+	mysql_free_result(res);
+	return (stop < 0) ? -1 : count;
+}
+
 int
 sql_mysql_begin_(SQL *me, SQL_TXN_MODE mode)
 {
 	const char *st;
+	unsigned long long start;
 	int r;
 	
 	if(me->depth)	
@@ -91,7 +281,9 @@ sql_mysql_begin_(SQL *me, SQL_TXN_MODE mode)
 	{
 		me->querylog(me, st);
 	}
+	start = sql_stats_timer_();
 	r = mysql_query(&(me->mysql), st);
+	sql_stats_wait_(me, start);
 	if(r)
 	{
 		sql_mysql_copy_error_(me);
@@ -105,6 +297,7 @@ int
 sql_mysql_commit_(SQL *me)
 {
 	const char *st = "COMMIT";
+	unsigned long long start;
 	int r;
 	
 	if(!me->depth)
@@ -119,7 +312,9 @@ sql_mysql_commit_(SQL *me)
 	{
 		me->querylog(me, st);
 	}
+	start = sql_stats_timer_();
 	r = mysql_query(&(me->mysql), st);
+	sql_stats_wait_(me, start);
 	if(r)
 	{
 		sql_mysql_copy_error_(me);
@@ -133,6 +328,7 @@ int
 sql_mysql_rollback_(SQL *me)	
 {
 	const char *st = "ROLLBACK";
+	unsigned long long start;
 	int r;
 	
 	if(!me->depth)
@@ -143,7 +339,9 @@ sql_mysql_rollback_(SQL *me)
 	{
 		me->querylog(me, st);
 	}
+	start = sql_stats_timer_();
 	r = mysql_query(&(me->mysql), st);
+	sql_stats_wait_(me, start);
 	if(me->deadlocked)
 	{
 		/* It doesn't matter if the rollback failed */
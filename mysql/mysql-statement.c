@@ -39,32 +39,80 @@ static SQL_STATEMENT_API mysql_statement_api = {
 	sql_statement_mysql_next_,
 	sql_statement_mysql_cur_,
 	sql_statement_mysql_rewind_,
-	sql_statement_mysql_seek_
+	sql_statement_mysql_seek_,
+	sql_statement_mysql_execute_,
+	sql_statement_mysql_reset_,
+	sql_statement_mysql_int64_,
+	sql_statement_mysql_real_,
+	sql_statement_mysql_boolean_,
+	sql_statement_def_blob_,
+	sql_statement_mysql_fetch_batch_,
+	sql_statement_mysql_row_,
+	sql_statement_def_scanstatus_
 };
 
+static int sql_statement_mysql_bind_results_(SQL_STATEMENT *me);
+static int sql_statement_mysql_fetch_(SQL_STATEMENT *me);
+static void sql_statement_mysql_free_results_(SQL_STATEMENT *me);
+static void sql_statement_mysql_free_buffers_(SQL_STATEMENT *me);
+static void sql_statement_mysql_format_(SQL_STATEMENT *me, unsigned int col);
+static void sql_statement_mysql_count_(SQL_STATEMENT *restrict me, const unsigned long *restrict lengths);
+
+/* Prepared statement result columns which are fetched in their native
+ * binary form rather than as text
+ */
+#define SQL_MYSQL_NATIVE_COL(me, col) \
+	((me)->meta && (me)->rbind[col].buffer_type != MYSQL_TYPE_STRING)
+
 /* Create a new statement or result-set */
 SQL_STATEMENT *
 sql_mysql_statement_(SQL *restrict me, const char *restrict statement)
 {
 	SQL_STATEMENT *p;
+	unsigned long long start;
+	my_bool update;
+	int r;
 
-	p = (SQL_STATEMENT *) calloc(1, sizeof(SQL_STATEMENT));
+	p = (SQL_STATEMENT *) sql_slab_alloc_(me->stmtslab);
 	if(!p)
 	{
 		return NULL;
 	}
+	p->slab = me->stmtslab;
 	p->api = &mysql_statement_api;
 	p->refcount = 1;
 	p->sql = me;
 	p->cur = (unsigned long long) -1;
 	if(statement)
 	{
-		p->statement = strdup(statement);
+		p->statement = sql_strdup_(statement);
 		if(!p->statement)
 		{
-			free(p);
+			sql_slab_free_(p->slab, p);
+			return NULL;
+		}
+		p->stmt = mysql_stmt_init(&(me->mysql));
+		if(!p->stmt)
+		{
+			sql_mysql_set_error_(me, "58000", "Memory allocation error");
+			sql_free_(p->statement);
+			sql_slab_free_(p->slab, p);
+			return NULL;
+		}
+		start = sql_stats_timer_();
+		r = mysql_stmt_prepare(p->stmt, statement, strlen(statement));
+		sql_stats_wait_(me, start);
+		if(r)
+		{
+			sql_mysql_copy_stmt_error_(me, p->stmt);
+			mysql_stmt_close(p->stmt);
+			sql_free_(p->statement);
+			sql_slab_free_(p->slab, p);
 			return NULL;
 		}
+		/* Have mysql_stmt_store_result() determine column widths */
+		update = 1;
+		mysql_stmt_attr_set(p->stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update);
 	}
 	return p;
 }
@@ -82,8 +130,16 @@ sql_statement_mysql_free_(SQL_STATEMENT *me)
 	{
 		mysql_free_result(me->result);
 	}
-	free(me->statement);
-	free(me);
+	sql_statement_mysql_free_results_(me);
+	sql_statement_mysql_free_buffers_(me);
+	if(me->stmt)
+	{
+		mysql_stmt_close(me->stmt);
+	}
+	sql_template_destroy_(me->tmpl);
+	free(me->pbind);
+	sql_free_(me->statement);
+	sql_slab_free_(me->slab, me);
 	return 0;
 }
 
@@ -113,16 +169,30 @@ sql_statement_mysql_set_results_(SQL_STATEMENT *restrict me, void *data)
 	me->affected = mysql_affected_rows(&(me->sql->mysql));
 	me->lengths = NULL;
 	me->cur = (unsigned long long) -1;
+	me->streaming = (data && (me->sql->flags & SQL_FLAG_STREAM));
 	if(data)
 	{
 		me->fields = mysql_fetch_fields(me->result);
 		me->columns = mysql_field_count(&(me->sql->mysql));
-		me->rows = mysql_num_rows(me->result);
+		/* The row count of a streamed result-set isn't known until all
+		 * of the rows have been read, so count them as they arrive
+		 */
+		me->rows = (me->streaming ? 0 : mysql_num_rows(me->result));
 		me->row = mysql_fetch_row(me->result);
 		if(me->row)
 		{
 			me->lengths = mysql_fetch_lengths(me->result);
+			sql_statement_mysql_count_(me, me->lengths);
 			me->cur = 0;
+			if(me->streaming)
+			{
+				me->rows = 1;
+			}
+		}
+		else if(me->streaming && mysql_errno(&(me->sql->mysql)))
+		{
+			sql_mysql_copy_error_(me->sql);
+			return -1;
 		}
 	}
 	else
@@ -171,6 +241,19 @@ sql_statement_mysql_eof_(SQL_STATEMENT *me)
 int
 sql_statement_mysql_next_(SQL_STATEMENT *me)
 {
+	int r;
+
+	if(me->meta)
+	{
+		r = sql_statement_mysql_fetch_(me);
+		if(r == 1)
+		{
+			me->cur++;
+			return 1;
+		}
+		me->cur = (unsigned long long) -1;
+		return r;
+	}
 	if(!me->result)
 	{
 		return 0;
@@ -180,10 +263,21 @@ sql_statement_mysql_next_(SQL_STATEMENT *me)
 	if(me->row)
 	{
 		me->lengths = mysql_fetch_lengths(me->result);
+		sql_statement_mysql_count_(me, me->lengths);
 		me->cur++;
+		if(me->streaming)
+		{
+			me->rows = me->cur + 1;
+		}
 		return 1;
 	}
 	me->cur = (unsigned long long) -1;
+	if(me->streaming && mysql_errno(&(me->sql->mysql)))
+	{
+		/* The connection failed part-way through the result-set */
+		sql_mysql_copy_error_(me->sql);
+		return -1;
+	}
 	return 0;
 }
 
@@ -201,6 +295,10 @@ sql_statement_mysql_value_(SQL_STATEMENT *restrict me, unsigned int col, char *r
 	{
 		return 0;
 	}
+	if(SQL_MYSQL_NATIVE_COL(me, col))
+	{
+		sql_statement_mysql_format_(me, col);
+	}
 	if(buf)
 	{
 		l = me->lengths[col];
@@ -222,6 +320,10 @@ sql_statement_mysql_valueptr_(SQL_STATEMENT *me, unsigned int col)
 	{
 		return NULL;
 	}
+	if(SQL_MYSQL_NATIVE_COL(me, col))
+	{
+		sql_statement_mysql_format_(me, col);
+	}
 	return (const unsigned char *) me->row[col];
 }
 
@@ -249,10 +351,146 @@ sql_statement_mysql_valuelen_(SQL_STATEMENT *me, unsigned int col)
 	{
 		return 0;
 	}
+	if(SQL_MYSQL_NATIVE_COL(me, col))
+	{
+		sql_statement_mysql_format_(me, col);
+	}
 	return me->lengths[col] + 1;
 }
 
+/* Retrieve the native value of a column in the current row */
+int64_t
+sql_statement_mysql_int64_(SQL_STATEMENT *me, unsigned int col)
+{
+	if(!me->row || col >= me->columns || !me->row[col])
+	{
+		return 0;
+	}
+	if(!SQL_MYSQL_NATIVE_COL(me, col))
+	{
+		return sql_statement_def_int64_(me, col);
+	}
+	if(me->rbind[col].buffer_type == MYSQL_TYPE_DOUBLE)
+	{
+		return (int64_t) me->rnative[col].d;
+	}
+	return (int64_t) me->rnative[col].i;
+}
+
+double
+sql_statement_mysql_real_(SQL_STATEMENT *me, unsigned int col)
+{
+	if(!me->row || col >= me->columns || !me->row[col])
+	{
+		return 0;
+	}
+	if(!SQL_MYSQL_NATIVE_COL(me, col))
+	{
+		return sql_statement_def_real_(me, col);
+	}
+	if(me->rbind[col].buffer_type == MYSQL_TYPE_DOUBLE)
+	{
+		return me->rnative[col].d;
+	}
+	if(me->rbind[col].is_unsigned)
+	{
+		return (double) me->rnative[col].u;
+	}
+	return (double) me->rnative[col].i;
+}
+
+int
+sql_statement_mysql_boolean_(SQL_STATEMENT *me, unsigned int col)
+{
+	if(!me->row || col >= me->columns || !me->row[col])
+	{
+		return 0;
+	}
+	if(!SQL_MYSQL_NATIVE_COL(me, col))
+	{
+		return sql_statement_def_boolean_(me, col);
+	}
+	if(me->rbind[col].buffer_type == MYSQL_TYPE_DOUBLE)
+	{
+		return (me->rnative[col].d != 0);
+	}
+	return (me->rnative[col].i != 0);
+}
+
 /* Return the row index of the current row */
+/* Fetch rows into a batch directly from the MYSQL_ROW arrays, or from the
+ * native values of prepared statement results
+ */
+int
+sql_statement_mysql_fetch_batch_(SQL_STATEMENT *restrict me, size_t max_rows, SQL_BATCH *restrict batch)
+{
+	unsigned int c;
+
+	while(batch->rows < max_rows && me->row)
+	{
+		for(c = 0; c < batch->ncolumns; c++)
+		{
+			if(!me->row[c])
+			{
+				sql_batch_null_(batch, c);
+				continue;
+			}
+			if(SQL_MYSQL_NATIVE_COL(me, c))
+			{
+				switch(batch->columns[c].type)
+				{
+				case SQL_TYPE_INTEGER:
+				case SQL_TYPE_BOOLEAN:
+					sql_batch_int64_(batch, c, sql_statement_mysql_int64_(me, c));
+					continue;
+				case SQL_TYPE_REAL:
+					sql_batch_real_(batch, c, sql_statement_mysql_real_(me, c));
+					continue;
+				default:
+					sql_statement_mysql_format_(me, c);
+				}
+			}
+			if(sql_batch_text_(batch, c, me->row[c], me->lengths[c]))
+			{
+				sql_mysql_set_error_(me->sql, "58000", "Memory allocation error");
+				return -1;
+			}
+		}
+		batch->rows++;
+		if(sql_statement_mysql_next_(me) < 0)
+		{
+			return -1;
+		}
+	}
+	return batch->rows;
+}
+
+int
+sql_statement_mysql_row_(SQL_STATEMENT *restrict me, SQL_CELL *restrict cells, unsigned int ncols)
+{
+	unsigned int c;
+
+	if(!me->row)
+	{
+		return -1;
+	}
+	if(ncols > me->columns)
+	{
+		ncols = me->columns;
+	}
+	for(c = 0; c < ncols; c++)
+	{
+		if(me->row[c] && SQL_MYSQL_NATIVE_COL(me, c))
+		{
+			sql_statement_mysql_format_(me, c);
+		}
+		cells[c].null = (me->row[c] == NULL);
+		cells[c].ptr = me->row[c];
+		cells[c].len = me->row[c] ? me->lengths[c] : 0;
+	}
+	return ncols;
+}
+
 unsigned long long
 sql_statement_mysql_cur_(SQL_STATEMENT *me)
 {
@@ -263,6 +501,30 @@ sql_statement_mysql_cur_(SQL_STATEMENT *me)
 int
 sql_statement_mysql_seek_(SQL_STATEMENT *me, unsigned long long row)
 {
+	if(me->meta)
+	{
+		if(row >= me->rows)
+		{
+			return -1;
+		}
+		mysql_stmt_data_seek(me->stmt, row);
+		if(sql_statement_mysql_fetch_(me) == 1)
+		{
+			me->cur = row;
+			return 0;
+		}
+		me->cur = (unsigned long long) -1;
+		return -1;
+	}
+	if(me->streaming)
+	{
+		if(me->row && row == me->cur)
+		{
+			return 0;
+		}
+		sql_mysql_set_error_(me->sql, "HY109", "Cannot seek within a streamed result-set");
+		return -1;
+	}
 	if(!me->result || row > me->rows)
 	{
 		return -1;
@@ -286,3 +548,416 @@ sql_statement_mysql_rewind_(SQL_STATEMENT *me)
 {
 	return sql_statement_mysql_seek_(me, 0);
 }
+
+/* Bind parameters to a prepared statement and execute it */
+int
+sql_statement_mysql_execute_(SQL_STATEMENT *restrict me, unsigned int nparams, const SQL_PARAM *restrict params)
+{
+	SQL *sql;
+	MYSQL_BIND *b;
+	unsigned long long start;
+	unsigned int c;
+	int r;
+
+	sql = me->sql;
+	if(!me->stmt)
+	{
+		sql_mysql_set_error_(sql, "HY010", "The statement has not been prepared");
+		return -1;
+	}
+	if(sql->depth && sql->deadlocked)
+	{
+		return -1;
+	}
+	sql->deadlocked = 0;
+	if(sql->querylog)
+	{
+		sql->querylog(sql, me->statement);
+	}
+	if(me->result)
+	{
+		mysql_free_result(me->result);
+		me->result = NULL;
+	}
+	sql_statement_mysql_free_results_(me);
+	if(nparams && !me->pbind)
+	{
+		me->pbind = (MYSQL_BIND *) calloc(nparams, sizeof(MYSQL_BIND));
+		if(!me->pbind)
+		{
+			sql_mysql_set_error_(sql, "58000", "Memory allocation error");
+			return -1;
+		}
+	}
+	for(c = 0; c < nparams; c++)
+	{
+		b = &(me->pbind[c]);
+		memset(b, 0, sizeof(MYSQL_BIND));
+		switch(params[c].type)
+		{
+		case SQL_PARAM_NULL:
+			b->buffer_type = MYSQL_TYPE_NULL;
+			break;
+		case SQL_PARAM_INT:
+			b->buffer_type = MYSQL_TYPE_LONGLONG;
+			b->buffer = (void *) &(params[c].ival);
+			break;
+		case SQL_PARAM_UINT:
+			b->buffer_type = MYSQL_TYPE_LONGLONG;
+			b->buffer = (void *) &(params[c].uval);
+			b->is_unsigned = 1;
+			break;
+		case SQL_PARAM_DOUBLE:
+			b->buffer_type = MYSQL_TYPE_DOUBLE;
+			b->buffer = (void *) &(params[c].dval);
+			break;
+		case SQL_PARAM_TEXT:
+			b->buffer_type = MYSQL_TYPE_STRING;
+			b->buffer = (void *) params[c].sval;
+			b->buffer_length = params[c].slen;
+			break;
+		}
+	}
+	start = sql_stats_timer_();
+	if((nparams && mysql_stmt_bind_param(me->stmt, me->pbind)) ||
+	   mysql_stmt_execute(me->stmt))
+	{
+		sql_stats_wait_(sql, start);
+		sql_mysql_copy_stmt_error_(sql, me->stmt);
+		return -1;
+	}
+	me->affected = mysql_stmt_affected_rows(me->stmt);
+	me->cur = (unsigned long long) -1;
+	me->meta = mysql_stmt_result_metadata(me->stmt);
+	if(!me->meta)
+	{
+		sql_stats_wait_(sql, start);
+		me->fields = NULL;
+		me->columns = 0;
+		me->rows = 0;
+		return 0;
+	}
+	r = mysql_stmt_store_result(me->stmt);
+	sql_stats_wait_(sql, start);
+	if(r)
+	{
+		sql_mysql_copy_stmt_error_(sql, me->stmt);
+		sql_statement_mysql_free_results_(me);
+		return -1;
+	}
+	me->fields = mysql_fetch_fields(me->meta);
+	me->columns = mysql_num_fields(me->meta);
+	me->rows = mysql_stmt_num_rows(me->stmt);
+	if(sql_statement_mysql_bind_results_(me))
+	{
+		sql_statement_mysql_free_results_(me);
+		return -1;
+	}
+	if(sql_statement_mysql_fetch_(me) == 1)
+	{
+		me->cur = 0;
+	}
+	return 0;
+}
+
+/* Discard any pending results so that a prepared statement can be executed
+ * again
+ */
+int
+sql_statement_mysql_reset_(SQL_STATEMENT *me)
+{
+	if(me->stmt)
+	{
+		sql_statement_mysql_free_results_(me);
+		me->columns = 0;
+		me->rows = 0;
+		me->cur = (unsigned long long) -1;
+		return 0;
+	}
+	return sql_statement_mysql_set_results_(me, NULL);
+}
+
+/* Allocate a buffer for each column of a prepared statement's results;
+ * integer and floating-point columns are fetched in native form, and
+ * everything else as text, sized according to the widest value in the
+ * result-set. Buffers from a previous execution are re-used where they
+ * are large enough.
+ */
+static int
+sql_statement_mysql_bind_results_(SQL_STATEMENT *me)
+{
+	unsigned int c;
+	size_t len;
+	char *p;
+
+	if(me->columns > me->rcolumns)
+	{
+		sql_statement_mysql_free_buffers_(me);
+		me->rbind = (MYSQL_BIND *) calloc(me->columns, sizeof(MYSQL_BIND));
+		me->rbufs = (char **) calloc(me->columns, sizeof(char *));
+		me->rowptrs = (char **) calloc(me->columns, sizeof(char *));
+		me->rlengths = (unsigned long *) calloc(me->columns, sizeof(unsigned long));
+		me->rnulls = (my_bool *) calloc(me->columns, sizeof(my_bool));
+		me->rerrors = (my_bool *) calloc(me->columns, sizeof(my_bool));
+		me->rnative = (SQL_MYSQL_NATIVE *) calloc(me->columns, sizeof(SQL_MYSQL_NATIVE));
+		me->rstale = (my_bool *) calloc(me->columns, sizeof(my_bool));
+		me->rsizes = (unsigned long *) calloc(me->columns, sizeof(unsigned long));
+		if(!me->rbind || !me->rbufs || !me->rowptrs || !me->rlengths || !me->rnulls || !me->rerrors || !me->rnative || !me->rstale || !me->rsizes)
+		{
+			sql_mysql_set_error_(me->sql, "58000", "Memory allocation error");
+			sql_statement_mysql_free_buffers_(me);
+			return -1;
+		}
+		me->rcolumns = me->columns;
+	}
+	else
+	{
+		memset(me->rbind, 0, me->columns * sizeof(MYSQL_BIND));
+		memset(me->rowptrs, 0, me->columns * sizeof(char *));
+		memset(me->rlengths, 0, me->columns * sizeof(unsigned long));
+		memset(me->rnulls, 0, me->columns * sizeof(my_bool));
+		memset(me->rerrors, 0, me->columns * sizeof(my_bool));
+		memset(me->rstale, 0, me->columns * sizeof(my_bool));
+	}
+	for(c = 0; c < me->columns; c++)
+	{
+		len = me->fields[c].max_length;
+		if(len < SQL_MYSQL_COLUMN_BUFLEN)
+		{
+			len = SQL_MYSQL_COLUMN_BUFLEN;
+		}
+		if(len > me->rsizes[c])
+		{
+			p = (char *) realloc(me->rbufs[c], len + 1);
+			if(!p)
+			{
+				sql_mysql_set_error_(me->sql, "58000", "Memory allocation error");
+				return -1;
+			}
+			me->rbufs[c] = p;
+			me->rsizes[c] = len;
+		}
+		len = me->rsizes[c];
+		me->rbind[c].length = &(me->rlengths[c]);
+		me->rbind[c].is_null = &(me->rnulls[c]);
+		me->rbind[c].error = &(me->rerrors[c]);
+		switch(me->fields[c].type)
+		{
+		case MYSQL_TYPE_TINY:
+		case MYSQL_TYPE_SHORT:
+		case MYSQL_TYPE_INT24:
+		case MYSQL_TYPE_LONG:
+		case MYSQL_TYPE_LONGLONG:
+		case MYSQL_TYPE_YEAR:
+			me->rbind[c].buffer_type = MYSQL_TYPE_LONGLONG;
+			me->rbind[c].buffer = &(me->rnative[c]);
+			me->rbind[c].buffer_length = sizeof(SQL_MYSQL_NATIVE);
+			me->rbind[c].is_unsigned = (me->fields[c].flags & UNSIGNED_FLAG) ? 1 : 0;
+			break;
+		case MYSQL_TYPE_FLOAT:
+		case MYSQL_TYPE_DOUBLE:
+			me->rbind[c].buffer_type = MYSQL_TYPE_DOUBLE;
+			me->rbind[c].buffer = &(me->rnative[c]);
+			me->rbind[c].buffer_length = sizeof(SQL_MYSQL_NATIVE);
+			break;
+		default:
+			/* Always leave room for a terminating NULL */
+			me->rbind[c].buffer_type = MYSQL_TYPE_STRING;
+			me->rbind[c].buffer = me->rbufs[c];
+			me->rbind[c].buffer_length = len;
+		}
+	}
+	if(mysql_stmt_bind_result(me->stmt, me->rbind))
+	{
+		sql_mysql_copy_stmt_error_(me->sql, me->stmt);
+		return -1;
+	}
+	return 0;
+}
+
+/* Fetch the next row of a prepared statement's results into the column
+ * buffers; returns 1 if there was a row, 0 if not or -1 if an error occurred
+ */
+static int
+sql_statement_mysql_fetch_(SQL_STATEMENT *me)
+{
+	unsigned int c;
+	int r, rebind;
+	char *p;
+
+	me->row = NULL;
+	me->lengths = NULL;
+	r = mysql_stmt_fetch(me->stmt);
+	if(r == MYSQL_NO_DATA)
+	{
+		return 0;
+	}
+	if(r == 1)
+	{
+		sql_mysql_copy_stmt_error_(me->sql, me->stmt);
+		return -1;
+	}
+	sql_statement_mysql_count_(me, me->rlengths);
+	rebind = 0;
+	for(c = 0; c < me->columns; c++)
+	{
+		if(SQL_MYSQL_NATIVE_COL(me, c))
+		{
+			/* The text form is only produced if it's asked for */
+			me->rowptrs[c] = (me->rnulls[c] ? NULL : me->rbufs[c]);
+			me->rlengths[c] = 0;
+			me->rstale[c] = 1;
+			continue;
+		}
+		if(r == MYSQL_DATA_TRUNCATED && me->rerrors[c] && !me->rnulls[c])
+		{
+			/* Grow the buffer and re-fetch the truncated column */
+			p = (char *) realloc(me->rbufs[c], me->rlengths[c] + 1);
+			if(!p)
+			{
+				sql_mysql_set_error_(me->sql, "58000", "Memory allocation error");
+				return -1;
+			}
+			me->rbufs[c] = p;
+			me->rsizes[c] = me->rlengths[c];
+			me->rbind[c].buffer = p;
+			me->rbind[c].buffer_length = me->rlengths[c];
+			if(mysql_stmt_fetch_column(me->stmt, &(me->rbind[c]), c, 0))
+			{
+				sql_mysql_copy_stmt_error_(me->sql, me->stmt);
+				return -1;
+			}
+			rebind = 1;
+		}
+		if(me->rnulls[c])
+		{
+			me->rowptrs[c] = NULL;
+			me->rlengths[c] = 0;
+		}
+		else
+		{
+			me->rbufs[c][me->rlengths[c]] = 0;
+			me->rowptrs[c] = me->rbufs[c];
+		}
+	}
+	if(rebind && mysql_stmt_bind_result(me->stmt, me->rbind))
+	{
+		sql_mysql_copy_stmt_error_(me->sql, me->stmt);
+		return -1;
+	}
+	me->row = me->rowptrs;
+	me->lengths = me->rlengths;
+	return 1;
+}
+
+/* Count a row read from a result-set in the connection's statistics */
+static void
+sql_statement_mysql_count_(SQL_STATEMENT *restrict me, const unsigned long *restrict lengths)
+{
+	unsigned long long bytes;
+	unsigned int c;
+
+	bytes = 0;
+	for(c = 0; c < me->columns; c++)
+	{
+		bytes += lengths[c];
+	}
+	sql_stats_rows_(me->sql, 1, bytes);
+}
+
+/* Discard the results of the previous execution of a prepared statement */
+static void
+sql_statement_mysql_free_results_(SQL_STATEMENT *me)
+{
+	if(me->meta)
+	{
+		mysql_stmt_free_result(me->stmt);
+		mysql_free_result(me->meta);
+		me->meta = NULL;
+		me->fields = NULL;
+		me->row = NULL;
+		me->lengths = NULL;
+	}
+}
+
+/* Free the column buffers of a prepared statement */
+static void
+sql_statement_mysql_free_buffers_(SQL_STATEMENT *me)
+{
+	unsigned int c;
+
+	if(me->rbufs)
+	{
+		for(c = 0; c < me->rcolumns; c++)
+		{
+			free(me->rbufs[c]);
+		}
+	}
+	free(me->rbufs);
+	free(me->rbind);
+	free(me->rowptrs);
+	free(me->rlengths);
+	free(me->rnulls);
+	free(me->rerrors);
+	free(me->rnative);
+	free(me->rstale);
+	free(me->rsizes);
+	me->rbufs = NULL;
+	me->rbind = NULL;
+	me->rowptrs = NULL;
+	me->rlengths = NULL;
+	me->rnulls = NULL;
+	me->rerrors = NULL;
+	me->rnative = NULL;
+	me->rstale = NULL;
+	me->rsizes = NULL;
+	me->rcolumns = 0;
+}
+
+/* Produce the text form of a natively-fetched column in the current row */
+static void
+sql_statement_mysql_format_(SQL_STATEMENT *me, unsigned int col)
+{
+	int prec, minprec, maxprec;
+	double d;
+
+	if(!me->rstale[col] || !me->rowptrs[col])
+	{
+		return;
+	}
+	me->rstale[col] = 0;
+	if(me->rbind[col].buffer_type == MYSQL_TYPE_LONGLONG)
+	{
+		if(me->rbind[col].is_unsigned)
+		{
+			me->rlengths[col] = snprintf(me->rbufs[col], SQL_MYSQL_COLUMN_BUFLEN, "%llu", me->rnative[col].u);
+		}
+		else
+		{
+			me->rlengths[col] = snprintf(me->rbufs[col], SQL_MYSQL_COLUMN_BUFLEN, "%lld", me->rnative[col].i);
+		}
+		return;
+	}
+	/* Use the shortest representation which survives a round-trip, as
+	 * the server does for the text protocol
+	 */
+	d = me->rnative[col].d;
+	if(me->fields[col].type == MYSQL_TYPE_FLOAT)
+	{
+		minprec = 6;
+		maxprec = 9;
+	}
+	else
+	{
+		minprec = 15;
+		maxprec = 17;
+	}
+	for(prec = minprec; prec <= maxprec; prec++)
+	{
+		me->rlengths[col] = snprintf(me->rbufs[col], SQL_MYSQL_COLUMN_BUFLEN, "%.*g", prec, d);
+		if(me->fields[col].type == MYSQL_TYPE_FLOAT ? ((float) strtod(me->rbufs[col], NULL) == (float) d) : (strtod(me->rbufs[col], NULL) == d))
+		{
+			break;
+		}
+	}
+}
@@ -29,6 +29,11 @@
 # include <libsql.h>
 # include <mysql.h>
 
+/* MySQL 8.0.16 and later provide a non-blocking client API */
+# if defined(MYSQL_VERSION_ID) && MYSQL_VERSION_ID >= 80016 && !defined(MARIADB_BASE_VERSION) && !defined(LIBMARIADB)
+#  define SQL_MYSQL_NONBLOCKING         1
+# endif
+
 # define SQL_STRUCT_DEFINED             1
 
 # include <libsql-engine.h>
@@ -51,8 +56,25 @@ struct sql_struct
 	SQL_LOG_QUERY querylog;
 	SQL_LOG_ERROR errorlog;
 	void *userdata;
+	int astate;
+	char *aquery;
+	unsigned long aquerylen;
+	MYSQL_RES *aresult;
 };
 
+/* Initial size of each column buffer when fetching prepared statement
+ * results
+ */
+# define SQL_MYSQL_COLUMN_BUFLEN        64
+
+/* Native values of numeric columns in prepared statement results */
+typedef union
+{
+	long long i;
+	unsigned long long u;
+	double d;
+} SQL_MYSQL_NATIVE;
+
 struct sql_statement_struct
 {
 	SQL_STATEMENT_COMMON_MEMBERS
@@ -66,6 +88,26 @@ struct sql_statement_struct
 	unsigned long long affected;
 	unsigned long long rows;
 	unsigned long long cur;
+	/* Results obtained with mysql_use_result() */
+	int streaming;
+	/* Prepared statements */
+	MYSQL_STMT *stmt;
+	MYSQL_RES *meta;
+	MYSQL_BIND *pbind;
+	MYSQL_BIND *rbind;
+	char **rbufs;
+	char **rowptrs;
+	unsigned long *rlengths;
+	my_bool *rnulls;
+	my_bool *rerrors;
+	SQL_MYSQL_NATIVE *rnative;
+	my_bool *rstale;
+	/* The column buffers are retained across executions: rcolumns is the
+	 * number of columns they have room for, and rsizes the capacity of
+	 * each of rbufs
+	 */
+	unsigned int rcolumns;
+	unsigned long *rsizes;
 };
 
 struct sql_field_struct
@@ -78,14 +120,26 @@ SQL *sql_engine_mysql_create_(SQL_ENGINE *me);
 
 void sql_mysql_set_error_(SQL *restrict me, const char *restrict sqlstate, const char *restrict message);
 void sql_mysql_copy_error_(SQL *me);
+void sql_mysql_copy_stmt_error_(SQL *restrict me, MYSQL_STMT *restrict stmt);
 
 unsigned long sql_mysql_free_(SQL *me);
 size_t sql_mysql_escape_(SQL *restrict me, const unsigned char *restrict from, size_t length, char *restrict buf, size_t buflen);
 const char *sql_mysql_sqlstate_(SQL *me);
 const char *sql_mysql_error_(SQL *me);
+int sql_mysql_ping_(SQL *me);
 int sql_mysql_connect_(SQL *restrict me, URI *restrict uri);
 int sql_mysql_execute_(SQL *restrict me, const char *restrict statement, void *restrict *restrict resultdata);
+int sql_mysql_execute_batch_(SQL *restrict me, const char *const *restrict statements, size_t count, unsigned long long *restrict affected);
+int sql_mysql_execute_script_(SQL *restrict me, const char *restrict script, unsigned long long *restrict affected, size_t naffected);
+long long sql_mysql_bulk_insert_(SQL *restrict me, const char *restrict table, const char *const *restrict columns, size_t ncolumns, SQL_BULK_ROW fn, void *restrict userdata);
+long long sql_mysql_export_(SQL *restrict me, const char *restrict query, SQL_EXPORT_FORMAT format, SQL_EXPORT_BUFFER *restrict buf);
+long long sql_mysql_query_foreach_(SQL *restrict me, const char *restrict query, SQL_ROW_FN fn, void *restrict userdata);
 SQL_STATEMENT *sql_mysql_statement_(SQL *restrict me, const char *restrict statement);
+int sql_mysql_query_async_(SQL *restrict me, const char *restrict query);
+int sql_mysql_poll_(SQL *me);
+SQL_STATEMENT *sql_mysql_result_(SQL *me);
+int sql_mysql_socket_(SQL *me);
+unsigned long long sql_mysql_affected_(SQL *me);
 
 unsigned long sql_statement_mysql_free_(SQL_STATEMENT *me);
 SQL *sql_statement_mysql_connection_(SQL_STATEMENT *me);
@@ -104,10 +158,18 @@ size_t sql_statement_mysql_valuelen_(SQL_STATEMENT *me, unsigned int col);
 unsigned long long sql_statement_mysql_cur_(SQL_STATEMENT *me);
 int sql_statement_mysql_seek_(SQL_STATEMENT *me, unsigned long long row);
 int sql_statement_mysql_rewind_(SQL_STATEMENT *me);
+int sql_statement_mysql_execute_(SQL_STATEMENT *restrict me, unsigned int nparams, const SQL_PARAM *restrict params);
+int sql_statement_mysql_reset_(SQL_STATEMENT *me);
+int64_t sql_statement_mysql_int64_(SQL_STATEMENT *me, unsigned int col);
+double sql_statement_mysql_real_(SQL_STATEMENT *me, unsigned int col);
+int sql_statement_mysql_boolean_(SQL_STATEMENT *me, unsigned int col);
+int sql_statement_mysql_fetch_batch_(SQL_STATEMENT *restrict me, size_t max_rows, SQL_BATCH *restrict batch);
+int sql_statement_mysql_row_(SQL_STATEMENT *restrict me, SQL_CELL *restrict cells, unsigned int ncols);
 
 unsigned long sql_field_mysql_free_(SQL_FIELD *me);
 const char *sql_field_mysql_name_(SQL_FIELD *me);
 size_t sql_field_mysql_width_(SQL_FIELD *me);
+SQL_FIELD_TYPE sql_field_mysql_type_(SQL_FIELD *me);
 
 int sql_mysql_begin_(SQL *me, SQL_TXN_MODE mode);
 int sql_mysql_commit_(SQL *me);
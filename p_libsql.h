@@ -20,6 +20,7 @@
 # include <stdio.h>
 # include <stdlib.h>
 # include <string.h>
+# include <strings.h>
 # include <errno.h>
 # include <stdarg.h>
 # include <pthread.h>
@@ -37,9 +38,42 @@
 # include "libsql.h"
 # include "libsql-engine.h"
 
+/* Default number of prepared statements cached by each connection; the
+ * cache is disabled unless it is requested with ?stmtcache=N or
+ * sql_set_cache_size()
+ */
+# define SQL_DEFAULT_CACHE_SIZE         0
+
+/* The state of an operation being timed and traced */
+typedef struct
+{
+	SQL_STATS_OP op;
+	const char *query;
+	unsigned long long start;
+	/* Set by sql_trace_finish_(), if the operation was timed */
+	unsigned long long end;
+	unsigned long long rows;
+	unsigned long long bytes;
+	unsigned long long fingerprint;
+	/* Nonzero if query is the literal text of a single statement */
+	int literal;
+} SQL_TRACE_STATE;
+
 SQL_ENGINE *sql_engine_(URI *uri);
 
 void sql_set_error_(const char *sqlstate, const char *msg);
-int sql_vasprintf_query_(SQL *restrict me, char *restrict *restrict ptr, const char *restrict format_string, va_list vargs);
+char *sql_format_query_(SQL *restrict sql, const char *restrict format, va_list ap);
+void sql_format_release_(SQL *restrict sql, char *restrict query);
+SQL_STATEMENT *sql_format_statement_(SQL *restrict sql, const char *restrict format);
+void sql_format_discard_(SQL *restrict sql, SQL_STATEMENT *restrict stmt);
+void sql_format_noparam_(SQL *restrict sql, const char *restrict format);
+int sql_logger_attach_(SQL *sql);
+int sql_fingerprint_enabled_(void);
+void sql_explain_auto_(SQL *restrict sql, const char *restrict query, unsigned long long nsec);
+void sql_fingerprint_record_(unsigned long long fingerprint, const char *restrict query, SQL_STATS_OP op, unsigned long long nsec, unsigned long long rows, int status);
+void sql_trace_start_(SQL *restrict sql, SQL_TRACE_STATE *restrict state, SQL_STATS_OP op, const char *restrict query);
+void sql_trace_finish_(SQL *restrict sql, SQL_TRACE_STATE *restrict state, int status, unsigned long long affected);
+void sql_trace_results_(SQL_TRACE_STATE *restrict state, SQL_STATEMENT *restrict stmt);
+void sql_trace_fetched_(SQL_STATEMENT *stmt, int status);
 
 #endif
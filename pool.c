@@ -0,0 +1,568 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+#include <time.h>
+#include <unistd.h>
+
+/* A connection pool maintains a set of connections to a single database,
+ * which are checked out by sql_pool_get() and returned by sql_pool_put().
+ *
+ * The pool's mutex is only ever held for constant-time list manipulation:
+ * connections are established, validated and closed without it. Idle
+ * connections are kept on a doubly-linked list with the most recently
+ * returned at the head, so that warm connections are re-used first and
+ * those at the tail can be reaped once they have been idle for too long.
+ * If thread affinity is enabled, a thread is preferentially given an
+ * idle connection which it used last, if there is one near the head of
+ * the list.
+ */
+
+/* Idle connections are validated before being handed out if they have
+ * been idle for longer than this (in microseconds)
+ */
+#define SQL_POOL_VALIDATE_AFTER        (5ULL * 1000000ULL)
+
+/* The number of idle connections examined for one last used by the
+ * calling thread, if thread affinity is enabled
+ */
+#define SQL_POOL_AFFINITY_SCAN         8
+
+/* The maximum number of expired connections closed at once */
+#define SQL_POOL_REAP_MAX              8
+
+/* Default idle timeout, in seconds */
+#define SQL_POOL_IDLE_TIMEOUT          300
+
+/* The clock used for the deadlines of timed waits: the monotonic clock
+ * where condition variables can use it, so that the wall clock being
+ * stepped doesn't affect them
+ */
+#if defined(_POSIX_CLOCK_SELECTION) && _POSIX_CLOCK_SELECTION >= 0
+# define SQL_POOL_WAIT_CLOCK           CLOCK_MONOTONIC
+#else
+# define SQL_POOL_WAIT_CLOCK           CLOCK_REALTIME
+#endif
+
+struct sql_pool_entry_struct
+{
+	SQL_POOL_ENTRY *prev;
+	SQL_POOL_ENTRY *next;
+	SQL_POOL *pool;
+	SQL *sql;
+	int idle;
+	unsigned long long since;
+	pthread_t owner;
+};
+
+struct sql_pool_struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int affinity;
+	char *uri;
+	size_t min;
+	size_t max;
+	/* Connections which exist or are being established */
+	size_t total;
+	size_t nidle;
+	unsigned long long idle_timeout;
+	SQL_POOL_ENTRY *head;
+	SQL_POOL_ENTRY *tail;
+	/* Entries whose connections have been closed, for re-use */
+	SQL_POOL_ENTRY *spare;
+	SQL_POOL_STATS stats;
+};
+
+static unsigned long long sql_pool_now_(void);
+static SQL_POOL_ENTRY *sql_pool_connect_(SQL_POOL *pool);
+static SQL_POOL_ENTRY *sql_pool_idle_(SQL_POOL *pool);
+static void sql_pool_unlink_(SQL_POOL *restrict pool, SQL_POOL_ENTRY *restrict entry);
+static void sql_pool_push_(SQL_POOL *restrict pool, SQL_POOL_ENTRY *restrict entry);
+static SQL *sql_pool_retire_(SQL_POOL *restrict pool, SQL_POOL_ENTRY *restrict entry);
+static size_t sql_pool_expired_(SQL_POOL *restrict pool, SQL **restrict list, size_t max);
+
+/* Create a pool of connections to the database at uri, establishing min
+ * connections immediately; no more than max connections will be open at
+ * any time
+ */
+SQL_POOL *
+sql_pool_create(const char *uri, size_t min, size_t max)
+{
+	SQL_POOL *pool;
+	SQL_POOL_ENTRY *entry;
+	pthread_condattr_t attr;
+	size_t c;
+
+	if(!max || min > max)
+	{
+		sql_set_error_("HY024", "Invalid connection pool size");
+		return NULL;
+	}
+	pool = (SQL_POOL *) calloc(1, sizeof(SQL_POOL));
+	if(!pool)
+	{
+		sql_set_error_("58000", "Memory allocation error");
+		return NULL;
+	}
+	pool->uri = strdup(uri);
+	if(!pool->uri)
+	{
+		free(pool);
+		sql_set_error_("58000", "Memory allocation error");
+		return NULL;
+	}
+	pthread_mutex_init(&(pool->lock), NULL);
+	pthread_condattr_init(&attr);
+#if defined(_POSIX_CLOCK_SELECTION) && _POSIX_CLOCK_SELECTION >= 0
+	pthread_condattr_setclock(&attr, SQL_POOL_WAIT_CLOCK);
+#endif
+	pthread_cond_init(&(pool->cond), &attr);
+	pthread_condattr_destroy(&attr);
+	pool->min = min;
+	pool->max = max;
+	pool->idle_timeout = SQL_POOL_IDLE_TIMEOUT * 1000000ULL;
+	for(c = 0; c < min; c++)
+	{
+		pool->total++;
+		entry = sql_pool_connect_(pool);
+		if(!entry)
+		{
+			sql_pool_destroy(pool);
+			return NULL;
+		}
+		sql_pool_push_(pool, entry);
+	}
+	return pool;
+}
+
+/* Close all of the connections in a pool and free its resources; fails
+ * if any connections are still checked out
+ */
+int
+sql_pool_destroy(SQL_POOL *pool)
+{
+	SQL_POOL_ENTRY *entry;
+
+	pthread_mutex_lock(&(pool->lock));
+	if(pool->total != pool->nidle)
+	{
+		pthread_mutex_unlock(&(pool->lock));
+		errno = EBUSY;
+		return -1;
+	}
+	pthread_mutex_unlock(&(pool->lock));
+	while(pool->head)
+	{
+		entry = pool->head;
+		sql_pool_unlink_(pool, entry);
+		sql_disconnect(entry->sql);
+		free(entry);
+	}
+	while(pool->spare)
+	{
+		entry = pool->spare;
+		pool->spare = entry->next;
+		free(entry);
+	}
+	pthread_cond_destroy(&(pool->cond));
+	pthread_mutex_destroy(&(pool->lock));
+	free(pool->uri);
+	free(pool);
+	return 0;
+}
+
+/* Set how long (in seconds) a connection may remain idle before it is
+ * closed, provided that the pool has more than its minimum number of
+ * connections; zero disables reaping
+ */
+int
+sql_pool_set_idle_timeout(SQL_POOL *pool, unsigned int seconds)
+{
+	pthread_mutex_lock(&(pool->lock));
+	pool->idle_timeout = seconds * 1000000ULL;
+	pthread_mutex_unlock(&(pool->lock));
+	return 0;
+}
+
+/* Enable or disable thread affinity, where a thread is preferentially
+ * given a connection which it used previously, if one is idle
+ */
+int
+sql_pool_set_affinity(SQL_POOL *pool, int enable)
+{
+	pthread_mutex_lock(&(pool->lock));
+	pool->affinity = enable;
+	pthread_mutex_unlock(&(pool->lock));
+	return 0;
+}
+
+/* Check out a connection, waiting for up to timeout milliseconds (or
+ * indefinitely if timeout is negative) for one to become available
+ */
+SQL *
+sql_pool_get(SQL_POOL *pool, int timeout)
+{
+	SQL_POOL_ENTRY *entry;
+	SQL *expired[SQL_POOL_REAP_MAX];
+	struct timespec deadline;
+	unsigned long long start, now;
+	size_t c, nexpired;
+	int r, reserved, waited;
+
+	start = sql_pool_now_();
+	if(timeout > 0)
+	{
+		clock_gettime(SQL_POOL_WAIT_CLOCK, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (timeout % 1000) * 1000000L;
+		if(deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+	entry = NULL;
+	reserved = 0;
+	waited = 0;
+	pthread_mutex_lock(&(pool->lock));
+	pool->stats.gets++;
+	for(;;)
+	{
+		entry = sql_pool_idle_(pool);
+		if(entry)
+		{
+			sql_pool_unlink_(pool, entry);
+			break;
+		}
+		if(pool->total < pool->max)
+		{
+			/* Reserve a slot and establish a new connection */
+			pool->total++;
+			reserved = 1;
+			break;
+		}
+		if(!timeout)
+		{
+			break;
+		}
+		waited = 1;
+		if(timeout < 0)
+		{
+			r = pthread_cond_wait(&(pool->cond), &(pool->lock));
+		}
+		else
+		{
+			r = pthread_cond_timedwait(&(pool->cond), &(pool->lock), &deadline);
+		}
+		if(r == ETIMEDOUT)
+		{
+			entry = sql_pool_idle_(pool);
+			if(entry)
+			{
+				sql_pool_unlink_(pool, entry);
+			}
+			break;
+		}
+	}
+	now = sql_pool_now_();
+	if(waited)
+	{
+		pool->stats.waits++;
+		pool->stats.wait_usec += now - start;
+		if(now - start > pool->stats.max_wait_usec)
+		{
+			pool->stats.max_wait_usec = now - start;
+		}
+	}
+	if(!entry && !reserved)
+	{
+		pool->stats.timeouts++;
+		pthread_mutex_unlock(&(pool->lock));
+		sql_set_error_("HYT00", "Timed out waiting for a connection from the pool");
+		return NULL;
+	}
+	nexpired = sql_pool_expired_(pool, expired, SQL_POOL_REAP_MAX);
+	pthread_mutex_unlock(&(pool->lock));
+	for(c = 0; c < nexpired; c++)
+	{
+		sql_disconnect(expired[c]);
+	}
+	if(entry && now - entry->since > SQL_POOL_VALIDATE_AFTER && entry->sql->api->ping(entry->sql))
+	{
+		/* The connection has gone away; replace it, keeping its slot */
+		pthread_mutex_lock(&(pool->lock));
+		pool->stats.failed++;
+		expired[0] = sql_pool_retire_(pool, entry);
+		pool->total++;
+		pthread_mutex_unlock(&(pool->lock));
+		sql_disconnect(expired[0]);
+		entry = NULL;
+	}
+	if(!entry)
+	{
+		entry = sql_pool_connect_(pool);
+		if(!entry)
+		{
+			return NULL;
+		}
+	}
+	entry->owner = pthread_self();
+	pthread_mutex_lock(&(pool->lock));
+	pool->stats.in_use++;
+	if(pool->stats.in_use > pool->stats.peak)
+	{
+		pool->stats.peak = pool->stats.in_use;
+	}
+	pthread_mutex_unlock(&(pool->lock));
+	return entry->sql;
+}
+
+/* Return a connection to the pool; any transaction still in progress is
+ * rolled back. Fails with EINVAL if the connection was not checked out
+ * from this pool.
+ */
+int
+sql_pool_put(SQL_POOL *pool, SQL *sql)
+{
+	SQL_POOL_ENTRY *entry;
+	SQL *expired[SQL_POOL_REAP_MAX];
+	size_t c, nexpired;
+
+	entry = sql->pooled;
+	if(!entry || entry->pool != pool)
+	{
+		sql->api->set_error(sql, "HY000", "Connection does not belong to this pool");
+		errno = EINVAL;
+		return -1;
+	}
+	sql->api->rollback(sql);
+	pthread_mutex_lock(&(pool->lock));
+	if(entry->idle)
+	{
+		pthread_mutex_unlock(&(pool->lock));
+		sql->api->set_error(sql, "HY000", "Connection has already been returned to the pool");
+		errno = EINVAL;
+		return -1;
+	}
+	pool->stats.in_use--;
+	entry->since = sql_pool_now_();
+	sql_pool_push_(pool, entry);
+	nexpired = sql_pool_expired_(pool, expired, SQL_POOL_REAP_MAX);
+	pthread_cond_signal(&(pool->cond));
+	pthread_mutex_unlock(&(pool->lock));
+	for(c = 0; c < nexpired; c++)
+	{
+		sql_disconnect(expired[c]);
+	}
+	return 0;
+}
+
+/* Obtain statistics about a pool */
+int
+sql_pool_stats(SQL_POOL *restrict pool, SQL_POOL_STATS *restrict stats)
+{
+	pthread_mutex_lock(&(pool->lock));
+	memcpy(stats, &(pool->stats), sizeof(SQL_POOL_STATS));
+	stats->size = pool->total;
+	stats->idle = pool->nidle;
+	stats->min = pool->min;
+	stats->max = pool->max;
+	pthread_mutex_unlock(&(pool->lock));
+	return 0;
+}
+
+/* Return a monotonic timestamp in microseconds */
+static unsigned long long
+sql_pool_now_(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+/* Establish a new connection for a slot which has already been reserved
+ * by incrementing pool->total; must be called without the lock held
+ */
+static SQL_POOL_ENTRY *
+sql_pool_connect_(SQL_POOL *pool)
+{
+	SQL_POOL_ENTRY *entry;
+	SQL *sql;
+
+	sql = sql_connect(pool->uri);
+	pthread_mutex_lock(&(pool->lock));
+	if(!sql)
+	{
+		pool->total--;
+		/* Another waiter may be able to establish a connection */
+		pthread_cond_signal(&(pool->cond));
+		pthread_mutex_unlock(&(pool->lock));
+		return NULL;
+	}
+	entry = pool->spare;
+	if(entry)
+	{
+		pool->spare = entry->next;
+	}
+	pthread_mutex_unlock(&(pool->lock));
+	if(!entry)
+	{
+		entry = (SQL_POOL_ENTRY *) calloc(1, sizeof(SQL_POOL_ENTRY));
+		if(!entry)
+		{
+			sql_disconnect(sql);
+			pthread_mutex_lock(&(pool->lock));
+			pool->total--;
+			pthread_cond_signal(&(pool->cond));
+			pthread_mutex_unlock(&(pool->lock));
+			sql_set_error_("58000", "Memory allocation error");
+			return NULL;
+		}
+	}
+	entry->prev = NULL;
+	entry->next = NULL;
+	entry->idle = 0;
+	entry->pool = pool;
+	entry->sql = sql;
+	entry->since = sql_pool_now_();
+	sql->pooled = entry;
+	pthread_mutex_lock(&(pool->lock));
+	pool->stats.created++;
+	pthread_mutex_unlock(&(pool->lock));
+	return entry;
+}
+
+/* Select an idle connection to hand out, if there is one */
+static SQL_POOL_ENTRY *
+sql_pool_idle_(SQL_POOL *pool)
+{
+	SQL_POOL_ENTRY *entry;
+	pthread_t self;
+	size_t c;
+
+	if(pool->affinity)
+	{
+		self = pthread_self();
+		for(entry = pool->head, c = 0; entry && c < SQL_POOL_AFFINITY_SCAN; entry = entry->next, c++)
+		{
+			if(pthread_equal(entry->owner, self))
+			{
+				return entry;
+			}
+		}
+	}
+	return pool->head;
+}
+
+/* Remove an entry from the idle list */
+static void
+sql_pool_unlink_(SQL_POOL *restrict pool, SQL_POOL_ENTRY *restrict entry)
+{
+	if(entry->prev)
+	{
+		entry->prev->next = entry->next;
+	}
+	else
+	{
+		pool->head = entry->next;
+	}
+	if(entry->next)
+	{
+		entry->next->prev = entry->prev;
+	}
+	else
+	{
+		pool->tail = entry->prev;
+	}
+	entry->prev = NULL;
+	entry->next = NULL;
+	entry->idle = 0;
+	pool->nidle--;
+}
+
+/* Add an entry to the head of the idle list */
+static void
+sql_pool_push_(SQL_POOL *restrict pool, SQL_POOL_ENTRY *restrict entry)
+{
+	entry->prev = NULL;
+	entry->next = pool->head;
+	if(pool->head)
+	{
+		pool->head->prev = entry;
+	}
+	pool->head = entry;
+	if(!pool->tail)
+	{
+		pool->tail = entry;
+	}
+	entry->idle = 1;
+	pool->nidle++;
+}
+
+/* Detach a connection which isn't on the idle list from its entry, which
+ * becomes a spare; the caller must disconnect it once the lock has been
+ * released
+ */
+static SQL *
+sql_pool_retire_(SQL_POOL *restrict pool, SQL_POOL_ENTRY *restrict entry)
+{
+	SQL *sql;
+
+	sql = entry->sql;
+	sql->pooled = NULL;
+	entry->sql = NULL;
+	entry->next = pool->spare;
+	pool->spare = entry;
+	pool->total--;
+	pool->stats.destroyed++;
+	return sql;
+}
+
+/* Detach up to max connections which have been idle for longer than the
+ * idle timeout, provided that the pool has more than its minimum number of
+ * connections
+ */
+static size_t
+sql_pool_expired_(SQL_POOL *restrict pool, SQL **restrict list, size_t max)
+{
+	SQL_POOL_ENTRY *entry;
+	unsigned long long now;
+	size_t count;
+
+	if(!pool->idle_timeout)
+	{
+		return 0;
+	}
+	now = sql_pool_now_();
+	count = 0;
+	while(count < max && pool->total > pool->min && (entry = pool->tail) && now - entry->since > pool->idle_timeout)
+	{
+		sql_pool_unlink_(pool, entry);
+		list[count] = sql_pool_retire_(pool, entry);
+		count++;
+	}
+	return count;
+}
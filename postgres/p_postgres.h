@@ -25,6 +25,9 @@
 # include <stdio.h>
 # include <stdlib.h>
 # include <string.h>
+# include <inttypes.h>
+# include <math.h>
+# include <time.h>
 # include <pthread.h>
 # include <libsql.h>
 
@@ -34,9 +37,39 @@
 
 # include <libsql-engine.h>
 
+/* The amount of result data received from the server, for statistics */
+# ifdef HAVE_PQRESULTMEMORYSIZE
+#  define SQL_PG_RESULT_BYTES(res)      PQresultMemorySize(res)
+# else
+#  define SQL_PG_RESULT_BYTES(res)      0
+# endif
+
+/* Size of the buffer used to format each non-string parameter value */
+# define SQL_PG_PARAM_BUFLEN            32
+
+/* Type OIDs of the built-in types which have native accessors */
+# define SQL_PG_BOOLOID                 16
+# define SQL_PG_BYTEAOID                17
+# define SQL_PG_INT8OID                 20
+# define SQL_PG_INT2OID                 21
+# define SQL_PG_INT4OID                 23
+# define SQL_PG_TEXTOID                 25
+# define SQL_PG_OIDOID                  26
+# define SQL_PG_FLOAT4OID               700
+# define SQL_PG_FLOAT8OID               701
+# define SQL_PG_BPCHAROID               1042
+# define SQL_PG_VARCHAROID              1043
+# define SQL_PG_DATEOID                 1082
+# define SQL_PG_TIMESTAMPOID            1114
+# define SQL_PG_TIMESTAMPTZOID          1184
+# define SQL_PG_NUMERICOID              1700
+# define SQL_PG_UUIDOID                 2950
+
 # define PQSTATUS_SUCCESS(r) \
 	(r != PGRES_BAD_RESPONSE && r != PGRES_FATAL_ERROR)
 
+typedef struct sql_pg_dealloc_struct SQL_PG_DEALLOC;
+
 struct sql_engine_struct
 {
 	SQL_ENGINE_COMMON_MEMBERS
@@ -56,8 +89,40 @@ struct sql_struct
 	SQL_LOG_ERROR errorlog;
 	SQL_LOG_NOTICE noticelog;
 	void *userdata;
+	unsigned long generation;
+	unsigned long stmtseq;
+	int async;
+	/* Statements queued in pipeline mode, which haven't been synced */
+	int pipeline;
+	int pfailed;
+	char **pqueue;
+	size_t pcount;
+	size_t palloc;
+	/* Prepared statements waiting to be deallocated; statements can be
+	 * freed by any thread, so this is only updated atomically
+	 */
+	SQL_PG_DEALLOC *deallocs;
+	/* Rows affected by the last statement executed without a result-set */
+	unsigned long long affected;
+};
+
+/* A prepared statement waiting to be deallocated by sql_pg_deallocate_() */
+struct sql_pg_dealloc_struct
+{
+	SQL_PG_DEALLOC *next;
+	unsigned long generation;
+	char name[32];
 };
 
+/* The text form of a column in a binary-format result-set */
+typedef struct
+{
+	char *buf;
+	size_t size;
+	size_t len;
+	unsigned long long row;
+} SQL_PG_TEXT;
+
 struct sql_statement_struct
 {
 	SQL_STATEMENT_COMMON_MEMBERS
@@ -70,6 +135,22 @@ struct sql_statement_struct
 	unsigned long long rows;
 	unsigned long long cur;
 	size_t *widths;
+	/* The number of columns which widths and text have room for; both are
+	 * retained across executions
+	 */
+	unsigned int colalloc;
+	char name[32];
+	unsigned long generation;
+	const char **pvalues;
+	int *plengths;
+	char *pbuf;
+	unsigned char *blob;
+	SQL_PG_TEXT *text;
+	/* Single-row mode: result holds only the current row, and offset is
+	 * the index of that row in the result-set as a whole
+	 */
+	int streaming;
+	unsigned long long offset;
 };
 
 struct sql_field_struct
@@ -83,14 +164,32 @@ SQL *sql_engine_pg_create_(SQL_ENGINE *me);
 
 void sql_pg_set_error_(SQL *restrict me, const char *restrict sqlstate, const char *restrict message);
 void sql_pg_copy_error_(SQL *restrict me, PGresult *restrict result);
+void sql_pg_reset_(SQL *me);
+void sql_pg_drain_(SQL *me);
+int sql_pg_pipeline_send_(SQL *restrict me, const char *restrict statement);
+int sql_pg_pipeline_sync_(SQL *me);
+int sql_pg_pipeline_flush_(SQL *me);
+void sql_pg_deallocate_(SQL *me);
 
 unsigned long sql_pg_free_(SQL *me);
 size_t sql_pg_escape_(SQL *restrict me, const unsigned char *restrict from, size_t length, char *restrict buf, size_t buflen);
 const char *sql_pg_sqlstate_(SQL *me);
 const char *sql_pg_error_(SQL *me);
+int sql_pg_ping_(SQL *me);
 int sql_pg_connect_(SQL *restrict me, URI *restrict uri);
 int sql_pg_execute_(SQL *restrict me, const char *restrict statement, void *restrict *restrict resultdata);
+int sql_pg_execute_batch_(SQL *restrict me, const char *const *restrict statements, size_t count, unsigned long long *restrict affected);
+int sql_pg_execute_script_(SQL *restrict me, const char *restrict script, unsigned long long *restrict affected, size_t naffected);
+long long sql_pg_bulk_insert_(SQL *restrict me, const char *restrict table, const char *const *restrict columns, size_t ncolumns, SQL_BULK_ROW fn, void *restrict userdata);
+long long sql_pg_export_(SQL *restrict me, const char *restrict query, SQL_EXPORT_FORMAT format, SQL_EXPORT_BUFFER *restrict buf);
+long long sql_pg_query_foreach_(SQL *restrict me, const char *restrict query, SQL_ROW_FN fn, void *restrict userdata);
 SQL_STATEMENT *sql_pg_statement_(SQL *restrict me, const char *restrict statement);
+int sql_pg_query_async_(SQL *restrict me, const char *restrict query);
+int sql_pg_poll_(SQL *me);
+SQL_STATEMENT *sql_pg_result_(SQL *me);
+int sql_pg_socket_(SQL *me);
+int sql_pg_cacheable_(SQL *restrict me, const char *restrict statement);
+unsigned long long sql_pg_affected_(SQL *me);
 
 unsigned long sql_statement_pg_free_(SQL_STATEMENT *me);
 SQL *sql_statement_pg_connection_(SQL_STATEMENT *me);
@@ -109,10 +208,24 @@ size_t sql_statement_pg_valuelen_(SQL_STATEMENT *me, unsigned int col);
 unsigned long long sql_statement_pg_cur_(SQL_STATEMENT *me);
 int sql_statement_pg_seek_(SQL_STATEMENT *me, unsigned long long row);
 int sql_statement_pg_rewind_(SQL_STATEMENT *me);
+int sql_statement_pg_execute_(SQL_STATEMENT *restrict me, unsigned int nparams, const SQL_PARAM *restrict params);
+int sql_statement_pg_reset_(SQL_STATEMENT *me);
+int64_t sql_statement_pg_int64_(SQL_STATEMENT *me, unsigned int col);
+double sql_statement_pg_real_(SQL_STATEMENT *me, unsigned int col);
+int sql_statement_pg_boolean_(SQL_STATEMENT *me, unsigned int col);
+const unsigned char *sql_statement_pg_blob_(SQL_STATEMENT *restrict me, unsigned int col, size_t *restrict len);
+int sql_statement_pg_fetch_batch_(SQL_STATEMENT *restrict me, size_t max_rows, SQL_BATCH *restrict batch);
+int sql_statement_pg_row_(SQL_STATEMENT *restrict me, SQL_CELL *restrict cells, unsigned int ncols);
+
+uint64_t sql_pg_be_(const unsigned char *p, size_t len);
+const char *sql_pg_binary_text_(SQL_STATEMENT *restrict me, unsigned int col, size_t *restrict len);
+void sql_pg_binary_discard_(SQL_STATEMENT *me);
+void sql_pg_binary_free_(SQL_STATEMENT *me);
 
 unsigned long sql_field_pg_free_(SQL_FIELD *me);
 const char *sql_field_pg_name_(SQL_FIELD *me);
 size_t sql_field_pg_width_(SQL_FIELD *me);
+SQL_FIELD_TYPE sql_field_pg_type_(SQL_FIELD *me);
 
 int sql_pg_begin_(SQL *me, SQL_TXN_MODE mode);
 int sql_pg_commit_(SQL *me);
@@ -0,0 +1,167 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include "p_postgres.h"
+
+/* Asynchronous queries are sent with the connection in non-blocking mode,
+ * so that sql_poll() can consume whatever input is available on the socket
+ * and report whether the complete result has arrived without waiting.
+ */
+
+/* Send a query to the server without waiting for its results */
+int
+sql_pg_query_async_(SQL *restrict me, const char *restrict query)
+{
+	int r;
+
+	if(me->async)
+	{
+		sql_pg_set_error_(me, "HY010", "An asynchronous query is already in progress on this connection");
+		return -1;
+	}
+	if(me->depth && me->deadlocked)
+	{
+		/* If we're already deadlocked mid-transaction, there's no point in
+		 * doing anything
+		 */
+		return -1;
+	}
+	if(me->deadlocked)
+	{
+		sql_pg_reset_(me);
+		me->deadlocked = 0;
+	}
+	if(sql_pg_pipeline_flush_(me))
+	{
+		return -1;
+	}
+	sql_pg_deallocate_(me);
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+	PQsetnonblocking(me->pg, 1);
+	if(me->flags & SQL_FLAG_BINARY)
+	{
+		r = PQsendQueryParams(me->pg, query, 0, NULL, NULL, NULL, NULL, 1);
+	}
+	else
+	{
+		r = PQsendQuery(me->pg, query);
+	}
+	if(!r || PQflush(me->pg) < 0)
+	{
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		PQsetnonblocking(me->pg, 0);
+		sql_pg_drain_(me);
+		return -1;
+	}
+	me->async = 1;
+	return 0;
+}
+
+/* Finish sending the query if necessary, read any available input, and
+ * determine whether PQgetResult() would block
+ */
+int
+sql_pg_poll_(SQL *me)
+{
+	int r;
+
+	if(!me->async)
+	{
+		sql_pg_set_error_(me, "HY010", "No asynchronous query is in progress on this connection");
+		return -1;
+	}
+	r = PQflush(me->pg);
+	if(r > 0)
+	{
+		return 0;
+	}
+	if(r < 0 || !PQconsumeInput(me->pg))
+	{
+		sql_pg_set_error_(me, "08006", PQerrorMessage(me->pg));
+		return -1;
+	}
+	return (PQisBusy(me->pg) ? 0 : 1);
+}
+
+/* Collect the results of the query, blocking if they haven't all arrived;
+ * as with PQexec(), if the query contained several statements, the result
+ * of the last is returned
+ */
+SQL_STATEMENT *
+sql_pg_result_(SQL *me)
+{
+	SQL_STATEMENT *st;
+	PGresult *res, *next;
+	ExecStatusType status;
+
+	if(!me->async)
+	{
+		sql_pg_set_error_(me, "HY010", "No asynchronous query is in progress on this connection");
+		return NULL;
+	}
+	me->async = 0;
+	PQsetnonblocking(me->pg, 0);
+	res = NULL;
+	while((next = PQgetResult(me->pg)))
+	{
+		PQclear(res);
+		res = next;
+	}
+	if(!res)
+	{
+		sql_pg_set_error_(me, "08006", PQerrorMessage(me->pg));
+		return NULL;
+	}
+	status = PQresultStatus(res);
+	if(!PQSTATUS_SUCCESS(status))
+	{
+		sql_pg_copy_error_(me, res);
+		PQclear(res);
+		return NULL;
+	}
+	if(status != PGRES_TUPLES_OK)
+	{
+		PQclear(res);
+		res = NULL;
+	}
+	st = sql_pg_statement_(me, NULL);
+	if(!st)
+	{
+		PQclear(res);
+		return NULL;
+	}
+	if(st->api->set_results(st, res))
+	{
+		st->api->release(st);
+		return NULL;
+	}
+	return st;
+}
+
+int
+sql_pg_socket_(SQL *me)
+{
+	return PQsocket(me->pg);
+}
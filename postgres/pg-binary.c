@@ -0,0 +1,484 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_postgres.h"
+
+/* Decoding of binary-format results (SQL_FLAG_BINARY)
+ *
+ * The native accessors read binary values directly; this module produces
+ * the same text that the server would have sent in text-format mode for
+ * callers using sql_stmt_value() and friends. Values are rendered on
+ * demand into a per-column buffer, so that columns which are only read
+ * natively are never formatted.
+ *
+ * Timestamps with time zone are rendered in UTC, rather than the session
+ * time zone. Values of types without a decoder are rendered in the same
+ * hexadecimal form used for bytea.
+ */
+
+/* Seconds between 1970-01-01 and the PostgreSQL epoch of 2000-01-01 */
+#define SQL_PG_EPOCH_OFFSET             946684800LL
+
+/* Other type OIDs whose binary form is identical to their text form */
+#define SQL_PG_CHAROID                  18
+#define SQL_PG_NAMEOID                  19
+#define SQL_PG_JSONOID                  114
+#define SQL_PG_XMLOID                   142
+#define SQL_PG_UNKNOWNOID               705
+#define SQL_PG_JSONBOID                 3802
+
+static char *sql_pg_binary_reserve_(SQL_PG_TEXT *text, size_t len);
+static int sql_pg_binary_hex_(SQL_PG_TEXT *restrict text, const unsigned char *restrict p, size_t len);
+static int sql_pg_binary_real_(SQL_PG_TEXT *text, double d, int single);
+static int sql_pg_binary_timestamp_(SQL_PG_TEXT *text, int64_t usec, int tz);
+static int sql_pg_binary_date_(SQL_PG_TEXT *text, int32_t days);
+static int sql_pg_binary_uuid_(SQL_PG_TEXT *restrict text, const unsigned char *restrict p, size_t len);
+static int sql_pg_binary_numeric_(SQL_PG_TEXT *restrict text, const unsigned char *restrict p, size_t len);
+
+/* Decode a big-endian (network byte order) integer of up to 8 bytes */
+uint64_t
+sql_pg_be_(const unsigned char *p, size_t len)
+{
+	uint64_t v;
+	size_t c;
+
+	v = 0;
+	for(c = 0; c < len && c < 8; c++)
+	{
+		v = (v << 8) | p[c];
+	}
+	return v;
+}
+
+/* Return the text form of a column in the current row of a binary-format
+ * result-set, or NULL if the value is NULL or an error occurred. The
+ * returned buffer remains valid until the result-set is replaced or the
+ * column is rendered for a different row.
+ */
+const char *
+sql_pg_binary_text_(SQL_STATEMENT *restrict me, unsigned int col, size_t *restrict len)
+{
+	SQL_PG_TEXT *text;
+	const unsigned char *p;
+	size_t l;
+	int r;
+
+	if(len)
+	{
+		*len = 0;
+	}
+	if(me->cur >= me->rows || col >= me->columns || PQgetisnull(me->result, me->cur, col))
+	{
+		return NULL;
+	}
+	if(!me->text)
+	{
+		me->text = (SQL_PG_TEXT *) calloc(me->colalloc, sizeof(SQL_PG_TEXT));
+		if(!me->text)
+		{
+			sql_pg_set_error_(me->sql, "58000", "Memory allocation error");
+			return NULL;
+		}
+	}
+	text = &(me->text[col]);
+	if(text->buf && text->row == me->cur)
+	{
+		if(len)
+		{
+			*len = text->len;
+		}
+		return text->buf;
+	}
+	p = (const unsigned char *) PQgetvalue(me->result, me->cur, col);
+	l = PQgetlength(me->result, me->cur, col);
+	switch(PQftype(me->result, col))
+	{
+	case SQL_PG_TEXTOID:
+	case SQL_PG_VARCHAROID:
+	case SQL_PG_BPCHAROID:
+	case SQL_PG_CHAROID:
+	case SQL_PG_NAMEOID:
+	case SQL_PG_JSONOID:
+	case SQL_PG_XMLOID:
+	case SQL_PG_UNKNOWNOID:
+		/* libpq always NUL-terminates values, even binary ones */
+		if(len)
+		{
+			*len = l;
+		}
+		return (const char *) p;
+	case SQL_PG_JSONBOID:
+		/* A version byte followed by the JSON text */
+		if(l && p[0] == 1)
+		{
+			if(len)
+			{
+				*len = l - 1;
+			}
+			return (const char *) (p + 1);
+		}
+		r = sql_pg_binary_hex_(text, p, l);
+		break;
+	case SQL_PG_BOOLOID:
+		r = -1;
+		if(sql_pg_binary_reserve_(text, 1))
+		{
+			strcpy(text->buf, (l && p[0]) ? "t" : "f");
+			text->len = 1;
+			r = 0;
+		}
+		break;
+	case SQL_PG_INT2OID:
+	case SQL_PG_INT4OID:
+	case SQL_PG_INT8OID:
+		r = -1;
+		if(sql_pg_binary_reserve_(text, 24))
+		{
+			text->len = snprintf(text->buf, 24, "%" PRId64, sql_statement_pg_int64_(me, col));
+			r = 0;
+		}
+		break;
+	case SQL_PG_OIDOID:
+		r = -1;
+		if(sql_pg_binary_reserve_(text, 24))
+		{
+			text->len = snprintf(text->buf, 24, "%lu", (unsigned long) sql_pg_be_(p, l));
+			r = 0;
+		}
+		break;
+	case SQL_PG_FLOAT4OID:
+	case SQL_PG_FLOAT8OID:
+		r = sql_pg_binary_real_(text, sql_statement_pg_real_(me, col), PQftype(me->result, col) == SQL_PG_FLOAT4OID);
+		break;
+	case SQL_PG_TIMESTAMPOID:
+	case SQL_PG_TIMESTAMPTZOID:
+		r = sql_pg_binary_timestamp_(text, (int64_t) sql_pg_be_(p, l), PQftype(me->result, col) == SQL_PG_TIMESTAMPTZOID);
+		break;
+	case SQL_PG_DATEOID:
+		r = sql_pg_binary_date_(text, (int32_t) sql_pg_be_(p, l));
+		break;
+	case SQL_PG_UUIDOID:
+		r = sql_pg_binary_uuid_(text, p, l);
+		break;
+	case SQL_PG_NUMERICOID:
+		r = sql_pg_binary_numeric_(text, p, l);
+		break;
+	default:
+		/* bytea, and anything we can't decode */
+		r = sql_pg_binary_hex_(text, p, l);
+	}
+	if(r)
+	{
+		sql_pg_set_error_(me->sql, "58000", "Memory allocation error");
+		return NULL;
+	}
+	text->row = me->cur;
+	if(len)
+	{
+		*len = text->len;
+	}
+	return text->buf;
+}
+
+/* Invalidate the text forms held in the buffers, which are retained for
+ * re-use by the next row or result-set
+ */
+void
+sql_pg_binary_discard_(SQL_STATEMENT *me)
+{
+	unsigned int c;
+
+	if(!me->text)
+	{
+		return;
+	}
+	for(c = 0; c < me->colalloc; c++)
+	{
+		me->text[c].row = (unsigned long long) -1;
+	}
+}
+
+/* Free the text buffers associated with a result-set */
+void
+sql_pg_binary_free_(SQL_STATEMENT *me)
+{
+	unsigned int c;
+
+	if(!me->text)
+	{
+		return;
+	}
+	for(c = 0; c < me->colalloc; c++)
+	{
+		free(me->text[c].buf);
+	}
+	free(me->text);
+	me->text = NULL;
+}
+
+/* Ensure that a text buffer can hold len bytes plus a terminating NUL */
+static char *
+sql_pg_binary_reserve_(SQL_PG_TEXT *text, size_t len)
+{
+	char *p;
+
+	if(len + 1 > text->size)
+	{
+		p = (char *) realloc(text->buf, len + 1);
+		if(!p)
+		{
+			return NULL;
+		}
+		text->buf = p;
+		text->size = len + 1;
+	}
+	text->buf[0] = 0;
+	text->len = 0;
+	return text->buf;
+}
+
+/* Render a value in bytea hex format */
+static int
+sql_pg_binary_hex_(SQL_PG_TEXT *restrict text, const unsigned char *restrict p, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *s;
+	size_t c;
+
+	s = sql_pg_binary_reserve_(text, 2 + len * 2);
+	if(!s)
+	{
+		return -1;
+	}
+	*s++ = '\\';
+	*s++ = 'x';
+	for(c = 0; c < len; c++)
+	{
+		*s++ = hex[p[c] >> 4];
+		*s++ = hex[p[c] & 15];
+	}
+	*s = 0;
+	text->len = 2 + len * 2;
+	return 0;
+}
+
+/* Render a floating-point value using the shortest representation which
+ * survives a round-trip, as the server does
+ */
+static int
+sql_pg_binary_real_(SQL_PG_TEXT *text, double d, int single)
+{
+	int prec, maxprec;
+
+	if(!sql_pg_binary_reserve_(text, 32))
+	{
+		return -1;
+	}
+	if(isnan(d))
+	{
+		text->len = sprintf(text->buf, "NaN");
+		return 0;
+	}
+	if(isinf(d))
+	{
+		text->len = sprintf(text->buf, (d < 0) ? "-Infinity" : "Infinity");
+		return 0;
+	}
+	prec = (single ? 6 : 15);
+	maxprec = (single ? 9 : 17);
+	for(; prec <= maxprec; prec++)
+	{
+		text->len = snprintf(text->buf, 32, "%.*g", prec, d);
+		if(single ? ((float) strtod(text->buf, NULL) == (float) d) : (strtod(text->buf, NULL) == d))
+		{
+			break;
+		}
+	}
+	return 0;
+}
+
+/* Render a timestamp, which is a count of microseconds since 2000-01-01 */
+static int
+sql_pg_binary_timestamp_(SQL_PG_TEXT *text, int64_t usec, int tz)
+{
+	struct tm tm;
+	time_t t;
+	int64_t secs, frac;
+	size_t l;
+
+	if(!sql_pg_binary_reserve_(text, 48))
+	{
+		return -1;
+	}
+	if(usec == INT64_MAX || usec == INT64_MIN)
+	{
+		text->len = sprintf(text->buf, (usec < 0) ? "-infinity" : "infinity");
+		return 0;
+	}
+	secs = usec / 1000000;
+	frac = usec % 1000000;
+	if(frac < 0)
+	{
+		frac += 1000000;
+		secs--;
+	}
+	t = (time_t) (secs + SQL_PG_EPOCH_OFFSET);
+	gmtime_r(&t, &tm);
+	l = strftime(text->buf, 48, "%Y-%m-%d %H:%M:%S", &tm);
+	if(frac)
+	{
+		l += sprintf(&(text->buf[l]), ".%06d", (int) frac);
+		while(text->buf[l - 1] == '0')
+		{
+			l--;
+		}
+		text->buf[l] = 0;
+	}
+	if(tz)
+	{
+		strcpy(&(text->buf[l]), "+00");
+		l += 3;
+	}
+	text->len = l;
+	return 0;
+}
+
+/* Render a date, which is a count of days since 2000-01-01 */
+static int
+sql_pg_binary_date_(SQL_PG_TEXT *text, int32_t days)
+{
+	struct tm tm;
+	time_t t;
+
+	if(!sql_pg_binary_reserve_(text, 32))
+	{
+		return -1;
+	}
+	if(days == INT32_MAX || days == INT32_MIN)
+	{
+		text->len = sprintf(text->buf, (days < 0) ? "-infinity" : "infinity");
+		return 0;
+	}
+	t = (time_t) (((int64_t) days * 86400) + SQL_PG_EPOCH_OFFSET);
+	gmtime_r(&t, &tm);
+	text->len = strftime(text->buf, 32, "%Y-%m-%d", &tm);
+	return 0;
+}
+
+/* Render a UUID in its canonical form */
+static int
+sql_pg_binary_uuid_(SQL_PG_TEXT *restrict text, const unsigned char *restrict p, size_t len)
+{
+	if(len != 16)
+	{
+		return sql_pg_binary_hex_(text, p, len);
+	}
+	if(!sql_pg_binary_reserve_(text, 36))
+	{
+		return -1;
+	}
+	text->len = sprintf(text->buf, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+		p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7],
+		p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15]);
+	return 0;
+}
+
+/* Render a numeric value, which is transmitted as a sequence of base-10000
+ * digits: int16 ndigits, int16 weight (of the first digit), uint16 sign,
+ * int16 display scale, followed by the digits themselves
+ */
+static int
+sql_pg_binary_numeric_(SQL_PG_TEXT *restrict text, const unsigned char *restrict p, size_t len)
+{
+	int ndigits, weight, sign, dscale, c, d, digit;
+	char *s;
+
+	if(len < 8)
+	{
+		return sql_pg_binary_hex_(text, p, len);
+	}
+	ndigits = (int16_t) sql_pg_be_(p, 2);
+	weight = (int16_t) sql_pg_be_(p + 2, 2);
+	sign = (int) sql_pg_be_(p + 4, 2);
+	dscale = (int16_t) sql_pg_be_(p + 6, 2);
+	if(ndigits < 0 || dscale < 0 || len < 8 + (size_t) ndigits * 2)
+	{
+		return sql_pg_binary_hex_(text, p, len);
+	}
+	p += 8;
+	switch(sign)
+	{
+	case 0xc000:
+		s = "NaN";
+		break;
+	case 0xd000:
+		s = "Infinity";
+		break;
+	case 0xf000:
+		s = "-Infinity";
+		break;
+	default:
+		s = NULL;
+	}
+	if(s)
+	{
+		if(!sql_pg_binary_reserve_(text, strlen(s)))
+		{
+			return -1;
+		}
+		strcpy(text->buf, s);
+		text->len = strlen(s);
+		return 0;
+	}
+	s = sql_pg_binary_reserve_(text, 2 + (weight > 0 ? (weight + 1) * 4 : 4) + 1 + dscale + 4);
+	if(!s)
+	{
+		return -1;
+	}
+	if(sign == 0x4000)
+	{
+		*s++ = '-';
+	}
+	/* Integer part */
+	if(weight < 0)
+	{
+		*s++ = '0';
+	}
+	for(c = 0; c <= weight; c++)
+	{
+		digit = (c < ndigits) ? (int) sql_pg_be_(p + c * 2, 2) : 0;
+		s += sprintf(s, (c ? "%04d" : "%d"), digit);
+	}
+	/* Fractional part, truncated to the display scale */
+	if(dscale)
+	{
+		*s++ = '.';
+		for(d = 0, c = weight + 1; d < dscale; c++, d += 4)
+		{
+			digit = (c >= 0 && c < ndigits) ? (int) sql_pg_be_(p + c * 2, 2) : 0;
+			sprintf(s, "%04d", digit);
+			s += (dscale - d < 4) ? dscale - d : 4;
+		}
+		*s = 0;
+	}
+	text->len = s - text->buf;
+	return 0;
+}
@@ -0,0 +1,329 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_postgres.h"
+
+/* Rows are accumulated into a buffer of (at least) this size before being
+ * sent to the server
+ */
+#define SQL_PG_COPY_BUFLEN             65536
+
+static int sql_pg_copy_row_(char *restrict *restrict buf, size_t *restrict len, size_t *restrict alloc, const char *restrict *restrict values, size_t ncolumns);
+
+/* Bulk-load rows using COPY ... FROM STDIN, which avoids a round-trip to
+ * the server for each row; the whole load succeeds or fails as one
+ * statement
+ */
+long long
+sql_pg_bulk_insert_(SQL *restrict me, const char *restrict table, const char *const *restrict columns, size_t ncolumns, SQL_BULK_ROW fn, void *restrict userdata)
+{
+	PGresult *res;
+	char *collist, *query, *buf;
+	const char **values;
+	const char *errmsg;
+	size_t len, alloc;
+	long long count;
+	int r, failed;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	if(me->deadlocked)
+	{
+		sql_pg_reset_(me);
+		me->deadlocked = 0;
+	}
+	if(sql_pg_pipeline_flush_(me))
+	{
+		return -1;
+	}
+	collist = sql_bulk_columns_(columns, ncolumns);
+	values = (const char **) calloc(ncolumns, sizeof(const char *));
+	query = (collist && values) ? (char *) malloc(strlen(table) + strlen(collist) + 32) : NULL;
+	if(!query)
+	{
+		free(collist);
+		free(values);
+		sql_pg_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	sprintf(query, "COPY %s (%s) FROM STDIN", table, collist);
+	free(collist);
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+	res = PQexec(me->pg, query);
+	free(query);
+	if(!res)
+	{
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		free(values);
+		return -1;
+	}
+	if(PQresultStatus(res) != PGRES_COPY_IN)
+	{
+		sql_pg_copy_error_(me, res);
+		PQclear(res);
+		free(values);
+		return -1;
+	}
+	PQclear(res);
+	buf = NULL;
+	len = 0;
+	alloc = 0;
+	count = 0;
+	failed = 0;
+	errmsg = NULL;
+	for(;;)
+	{
+		r = fn(me, values, userdata);
+		if(r <= 0)
+		{
+			if(r < 0)
+			{
+				sql_pg_set_error_(me, "HY008", "Bulk insert was aborted");
+				errmsg = "Bulk insert was aborted";
+				failed = 1;
+			}
+			break;
+		}
+		if(sql_pg_copy_row_(&buf, &len, &alloc, values, ncolumns))
+		{
+			sql_pg_set_error_(me, "58000", "Memory allocation error");
+			errmsg = "Memory allocation error";
+			failed = 1;
+			break;
+		}
+		count++;
+		if(len >= SQL_PG_COPY_BUFLEN)
+		{
+			if(PQputCopyData(me->pg, buf, len) != 1)
+			{
+				sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+				failed = 1;
+				break;
+			}
+			len = 0;
+		}
+	}
+	if(!failed && len && PQputCopyData(me->pg, buf, len) != 1)
+	{
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		failed = 1;
+	}
+	free(buf);
+	free(values);
+	/* Supplying an error message causes the server to abandon the COPY */
+	PQputCopyEnd(me->pg, (failed ? (errmsg ? errmsg : "Bulk insert failed") : NULL));
+	while((res = PQgetResult(me->pg)))
+	{
+		if(!failed && !PQSTATUS_SUCCESS(PQresultStatus(res)))
+		{
+			sql_pg_copy_error_(me, res);
+			failed = 1;
+		}
+		PQclear(res);
+	}
+	return failed ? -1 : count;
+}
+
+/* Append a row to the buffer in COPY's text format */
+static int
+sql_pg_copy_row_(char *restrict *restrict buf, size_t *restrict len, size_t *restrict alloc, const char *restrict *restrict values, size_t ncolumns)
+{
+	const char *s;
+	char *p;
+	size_t c, needed;
+
+	/* Worst case: every character is escaped, plus delimiters */
+	needed = *len + 1;
+	for(c = 0; c < ncolumns; c++)
+	{
+		needed += (values[c] ? strlen(values[c]) * 2 : 2) + 1;
+	}
+	if(needed > *alloc)
+	{
+		needed = ((needed / SQL_PG_COPY_BUFLEN) + 1) * SQL_PG_COPY_BUFLEN;
+		p = (char *) realloc(*buf, needed);
+		if(!p)
+		{
+			return -1;
+		}
+		*buf = p;
+		*alloc = needed;
+	}
+	p = *buf + *len;
+	for(c = 0; c < ncolumns; c++)
+	{
+		if(c)
+		{
+			*p = '\t';
+			p++;
+		}
+		if(!values[c])
+		{
+			*p = '\\';
+			p++;
+			*p = 'N';
+			p++;
+			continue;
+		}
+		for(s = values[c]; *s; s++)
+		{
+			switch(*s)
+			{
+			case '\\':
+				*p = '\\';
+				p++;
+				*p = '\\';
+				break;
+			case '\t':
+				*p = '\\';
+				p++;
+				*p = 't';
+				break;
+			case '\n':
+				*p = '\\';
+				p++;
+				*p = 'n';
+				break;
+			case '\r':
+				*p = '\\';
+				p++;
+				*p = 'r';
+				break;
+			default:
+				*p = *s;
+			}
+			p++;
+		}
+	}
+	*p = '\n';
+	p++;
+	*len = p - *buf;
+	return 0;
+}
+
+/* Export the results of a query using COPY ... TO STDOUT, passing the data
+ * to the sink exactly as the server sends it
+ */
+long long
+sql_pg_export_(SQL *restrict me, const char *restrict query, SQL_EXPORT_FORMAT format, SQL_EXPORT_BUFFER *restrict buf)
+{
+	PGresult *res;
+	const char *opts;
+	char *copy, *data;
+	long long count;
+	unsigned long long bytes;
+	int len, failed;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	if(me->deadlocked)
+	{
+		sql_pg_reset_(me);
+		me->deadlocked = 0;
+	}
+	if(sql_pg_pipeline_flush_(me))
+	{
+		return -1;
+	}
+	switch(format)
+	{
+	case SQL_EXPORT_CSV:
+		opts = " WITH (FORMAT csv)";
+		break;
+	case SQL_EXPORT_BINARY:
+		opts = " WITH (FORMAT binary)";
+		break;
+	default:
+		opts = "";
+	}
+	copy = (char *) malloc(strlen(query) + strlen(opts) + 32);
+	if(!copy)
+	{
+		sql_pg_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	sprintf(copy, "COPY (%s) TO STDOUT%s", query, opts);
+	if(me->querylog)
+	{
+		me->querylog(me, copy);
+	}
+	res = PQexec(me->pg, copy);
+	free(copy);
+	if(!res)
+	{
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		return -1;
+	}
+	if(PQresultStatus(res) != PGRES_COPY_OUT)
+	{
+		sql_pg_copy_error_(me, res);
+		PQclear(res);
+		return -1;
+	}
+	PQclear(res);
+	failed = 0;
+	bytes = 0;
+	while((len = PQgetCopyData(me->pg, &data, 0)) > 0)
+	{
+		bytes += len;
+		/* If the sink fails, the remaining data must still be read from
+		 * the connection
+		 */
+		if(!failed && sql_export_data_(buf, data, len))
+		{
+			failed = 1;
+		}
+		PQfreemem(data);
+	}
+	if(len == -2)
+	{
+		if(!failed)
+		{
+			sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		}
+		failed = 1;
+	}
+	count = 0;
+	while((res = PQgetResult(me->pg)))
+	{
+		if(!failed && !PQSTATUS_SUCCESS(PQresultStatus(res)))
+		{
+			sql_pg_copy_error_(me, res);
+			failed = 1;
+		}
+		else if(!failed)
+		{
+			count = atoll(PQcmdTuples(res));
+		}
+		PQclear(res);
+	}
+	sql_stats_rows_(me, count, bytes);
+	return failed ? -1 : count;
+}
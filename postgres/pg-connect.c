@@ -35,6 +35,7 @@ sql_pg_connect_(SQL *me, URI *uri)
 	ConnStatusType status;
 	char *pw, *db;
 	unsigned long flags;
+	unsigned long long start;
 
 	info = uri_info(uri);
 	if(!info)
@@ -65,7 +66,9 @@ sql_pg_connect_(SQL *me, URI *uri)
 		}
 	}
 	flags = 0;	
+	start = sql_stats_timer_();
 	me->pg = PQsetdbLogin(info->host, NULL, NULL, NULL, db, info->auth, pw);
+	sql_stats_wait_(me, start);
 	uri_info_destroy(info);
 	if(!me->pg)
 	{
@@ -107,6 +110,7 @@ sql_pg_set_error_(SQL *restrict me, const char *restrict sqlstate, const char *r
 		message = sqlstate;
 	}
 	strncpy(me->error, message, sizeof(me->error) - 1);
+	sql_stats_error_(me, me->sqlstate);
 	if(me->errorlog)
 	{
 		me->errorlog(me, me->sqlstate, me->error);
@@ -125,10 +129,39 @@ sql_pg_copy_error_(SQL *restrict me, PGresult *restrict result)
 	if(!strcmp(sqlstate, "40001") || !strcmp(sqlstate, "40P01"))
 	{
 		me->deadlocked = 1;
-		PQreset(me->pg);
+		sql_pg_reset_(me);
 	}
 }
 
+/* Reset the connection to the server; any statements prepared on the
+ * connection will need to be prepared again
+ */
+void
+sql_pg_reset_(SQL *me)
+{
+	PQreset(me->pg);
+	me->generation++;
+}
+
+/* Check that the connection to the server is still usable, attempting to
+ * re-establish it if not
+ */
+int
+sql_pg_ping_(SQL *me)
+{
+	if(PQstatus(me->pg) == CONNECTION_OK)
+	{
+		return 0;
+	}
+	sql_pg_reset_(me);
+	if(PQstatus(me->pg) == CONNECTION_OK)
+	{
+		return 0;
+	}
+	sql_pg_set_error_(me, "08006", PQerrorMessage(me->pg));
+	return -1;
+}
+
 size_t
 sql_pg_escape_(SQL *restrict me, const unsigned char *restrict from, size_t length, char *restrict buf, size_t buflen)
 {
@@ -60,7 +60,20 @@ static SQL_API pg_api = {
 	sql_pg_lang_,
 	sql_pg_variant_,
 	sql_pg_set_userdata_,
-	sql_pg_userdata_
+	sql_pg_userdata_,
+	sql_pg_set_error_,
+	sql_pg_execute_batch_,
+	sql_pg_execute_script_,
+	sql_pg_bulk_insert_,
+	sql_pg_export_,
+	sql_pg_query_foreach_,
+	sql_pg_ping_,
+	sql_pg_query_async_,
+	sql_pg_poll_,
+	sql_pg_result_,
+	sql_pg_socket_,
+	sql_pg_cacheable_,
+	sql_pg_affected_
 };
 
 SQL_ENGINE *
@@ -90,11 +103,21 @@ sql_engine_pg_create_(SQL_ENGINE *me)
 
 	(void) me;
 
-	inst = (SQL *) calloc(1, sizeof(SQL));
+	sql_allocator_lock_();
+	inst = (SQL *) sql_calloc_(1, sizeof(SQL));
 	if(!inst)
 	{
 		return NULL;
 	}
+	inst->stmtslab = sql_slab_create_(sizeof(SQL_STATEMENT));
+	inst->fieldslab = sql_slab_create_(sizeof(SQL_FIELD));
+	if(!inst->stmtslab || !inst->fieldslab)
+	{
+		sql_slab_destroy_(inst->stmtslab);
+		sql_slab_destroy_(inst->fieldslab);
+		sql_free_(inst);
+		return NULL;
+	}
 	inst->api = &pg_api;
 	inst->refcount = 1;
 	strcpy(inst->sqlstate, "00000");
@@ -106,18 +129,39 @@ sql_engine_pg_create_(SQL_ENGINE *me)
 unsigned long
 sql_pg_free_(SQL *me)
 {
+	SQL_PG_DEALLOC *d;
+	size_t c;
+
 	me->refcount--;
 	if(me->refcount)
 	{
 		return me->refcount;
 	}
+	sql_logger_detach_(me);
+	sql_stats_detach_(me);
+	sql_cache_destroy_(me->cache);
+	sql_formatter_destroy_(me->formatter);
+	sql_slab_destroy_(me->stmtslab);
+	sql_slab_destroy_(me->fieldslab);
 	pthread_mutex_destroy(&(me->lock));
 	if(me->pg)
 	{
 		PQfinish(me->pg);
 	}
+	for(c = 0; c < me->pcount; c++)
+	{
+		free(me->pqueue[c]);
+	}
+	free(me->pqueue);
+	/* Prepared statements are released along with the connection */
+	while(me->deallocs)
+	{
+		d = me->deallocs;
+		me->deallocs = d->next;
+		free(d);
+	}
 	free(me->qbuf);
-	free(me);
+	sql_free_(me);
 	return 0;
 }
 
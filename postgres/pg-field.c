@@ -26,7 +26,8 @@ static SQL_FIELD_API pg_field_api = {
 	sql_field_def_addref_,
 	sql_field_pg_free_,
 	sql_field_pg_name_,
-	sql_field_pg_width_
+	sql_field_pg_width_,
+	sql_field_pg_type_
 };
 
 /* Return a SQL_FIELD instance for a particular column (0..cols-1) */
@@ -39,7 +40,12 @@ sql_statement_pg_field_(SQL_STATEMENT *me, unsigned int col)
 	{
 		return NULL;
 	}
-	p = (SQL_FIELD *) calloc(1, sizeof(SQL_FIELD));
+	p = (SQL_FIELD *) sql_slab_alloc_(me->sql->fieldslab);
+	if(!p)
+	{
+		return NULL;
+	}
+	p->slab = me->sql->fieldslab;
 	p->refcount = 1;
 	p->api = &pg_field_api;
 	p->st = me;
@@ -56,7 +62,7 @@ sql_field_pg_free_(SQL_FIELD *me)
 	{
 		return me->refcount;
 	}
-	free(me);
+	sql_slab_free_(me->slab, me);
 	return 0;
 }
 
@@ -76,7 +82,7 @@ sql_field_pg_width_(SQL_FIELD *me)
 
 	if(!me->st->widths)
 	{
-		me->st->widths = (size_t *) calloc(me->st->columns, sizeof(size_t));
+		me->st->widths = (size_t *) calloc(me->st->colalloc, sizeof(size_t));
 		if(!me->st->widths)
 		{
 			return 0;
@@ -95,3 +101,37 @@ sql_field_pg_width_(SQL_FIELD *me)
 	}
 	return me->st->widths[me->col];
 }
+
+/* Return the type of the column, based upon its type OID */
+SQL_FIELD_TYPE
+sql_field_pg_type_(SQL_FIELD *me)
+{
+	switch(PQftype(me->st->result, me->col))
+	{
+	case SQL_PG_INT2OID:
+	case SQL_PG_INT4OID:
+	case SQL_PG_INT8OID:
+	case SQL_PG_OIDOID:
+		return SQL_TYPE_INTEGER;
+	case SQL_PG_FLOAT4OID:
+	case SQL_PG_FLOAT8OID:
+		return SQL_TYPE_REAL;
+	case SQL_PG_NUMERICOID:
+		return SQL_TYPE_NUMERIC;
+	case SQL_PG_BOOLOID:
+		return SQL_TYPE_BOOLEAN;
+	case SQL_PG_TEXTOID:
+	case SQL_PG_VARCHAROID:
+	case SQL_PG_BPCHAROID:
+		return SQL_TYPE_TEXT;
+	case SQL_PG_BYTEAOID:
+		return SQL_TYPE_BLOB;
+	case SQL_PG_DATEOID:
+	case SQL_PG_TIMESTAMPOID:
+	case SQL_PG_TIMESTAMPTZOID:
+		return SQL_TYPE_TIMESTAMP;
+	case SQL_PG_UUIDOID:
+		return SQL_TYPE_UUID;
+	}
+	return SQL_TYPE_UNKNOWN;
+}
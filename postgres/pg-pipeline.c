@@ -0,0 +1,190 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include "p_postgres.h"
+
+/* When SQL_FLAG_PIPELINE is set, sql_perform() transactions are executed
+ * using libpq's pipeline mode: START TRANSACTION, each statement executed
+ * by sql_execute() and COMMIT are queued, and the results are only read
+ * once the COMMIT has been sent, so that the whole transaction costs a
+ * single round-trip. Because results aren't read until then, an error in
+ * a queued statement is reported by sql_commit() rather than sql_execute().
+ *
+ * Anything else which needs a response from the server part-way through
+ * the transaction (such as a query returning a result-set) flushes the
+ * queue first, reporting any error in the queued statements.
+ */
+
+/* Queue a statement; the connection is placed into pipeline mode if it
+ * isn't already
+ */
+int
+sql_pg_pipeline_send_(SQL *restrict me, const char *restrict statement)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+	char **p;
+	size_t n;
+
+	if(me->pcount == me->palloc)
+	{
+		n = (me->palloc ? me->palloc * 2 : 8);
+		p = (char **) realloc(me->pqueue, n * sizeof(char *));
+		if(!p)
+		{
+			sql_pg_set_error_(me, "58000", "Memory allocation error");
+			return -1;
+		}
+		me->pqueue = p;
+		me->palloc = n;
+	}
+	me->pqueue[me->pcount] = strdup(statement);
+	if(!me->pqueue[me->pcount])
+	{
+		sql_pg_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	if(PQpipelineStatus(me->pg) == PQ_PIPELINE_OFF && !PQenterPipelineMode(me->pg))
+	{
+		free(me->pqueue[me->pcount]);
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		return -1;
+	}
+	/* Only the extended query protocol is permitted in pipeline mode */
+	if(!PQsendQueryParams(me->pg, statement, 0, NULL, NULL, NULL, NULL, 0))
+	{
+		free(me->pqueue[me->pcount]);
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		return -1;
+	}
+	me->pcount++;
+	return 0;
+#else
+	sql_pg_set_error_(me, "0A000", "Pipeline mode is not supported by this version of libpq");
+	return -1;
+#endif
+}
+
+/* Send a sync message and read the results of every queued statement,
+ * leaving pipeline mode. If any statement failed, the error is reported
+ * along with the text of the statement responsible.
+ */
+int
+sql_pg_pipeline_sync_(SQL *me)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+	PGresult *res, *err;
+	ExecStatusType status;
+	const char *sqlstate;
+	char buf[sizeof(me->error)];
+	size_t c, failed;
+	int synced;
+
+	if(!me->pcount)
+	{
+		return 0;
+	}
+	err = NULL;
+	failed = 0;
+	synced = 0;
+	if(PQpipelineSync(me->pg))
+	{
+		/* Each statement produces one or more results followed by NULL,
+		 * and the sync produces PGRES_PIPELINE_SYNC; if the connection
+		 * fails, there will be nothing but NULLs
+		 */
+		c = 0;
+		while(c <= me->pcount)
+		{
+			res = PQgetResult(me->pg);
+			if(!res)
+			{
+				c++;
+				continue;
+			}
+			status = PQresultStatus(res);
+			if(status == PGRES_PIPELINE_SYNC)
+			{
+				PQclear(res);
+				synced = 1;
+				break;
+			}
+			if(status == PGRES_FATAL_ERROR && !err)
+			{
+				err = res;
+				failed = c;
+				continue;
+			}
+			PQclear(res);
+		}
+	}
+	PQexitPipelineMode(me->pg);
+	if(err)
+	{
+		sqlstate = PQresultErrorField(err, PG_DIAG_SQLSTATE);
+		if(!sqlstate)
+		{
+			sqlstate = "08006";
+		}
+		snprintf(buf, sizeof(buf), "%sSTATEMENT:  %s", PQresultErrorMessage(err), (failed < me->pcount ? me->pqueue[failed] : ""));
+		sql_pg_set_error_(me, sqlstate, buf);
+		PQclear(err);
+		if(!strcmp(sqlstate, "40001") || !strcmp(sqlstate, "40P01"))
+		{
+			me->deadlocked = 1;
+			sql_pg_reset_(me);
+		}
+	}
+	else if(!synced)
+	{
+		sql_pg_set_error_(me, "08006", PQerrorMessage(me->pg));
+	}
+	for(c = 0; c < me->pcount; c++)
+	{
+		free(me->pqueue[c]);
+	}
+	me->pcount = 0;
+	if(err || !synced)
+	{
+		if(me->pipeline)
+		{
+			me->pfailed = 1;
+		}
+		return -1;
+	}
+	return 0;
+#else
+	return 0;
+#endif
+}
+
+/* Ensure that there are no queued statements before sending anything
+ * else to the server
+ */
+int
+sql_pg_pipeline_flush_(SQL *me)
+{
+	if(!me->pcount)
+	{
+		return 0;
+	}
+	return sql_pg_pipeline_sync_(me);
+}
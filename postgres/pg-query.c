@@ -25,12 +25,16 @@
 
 #include "p_postgres.h"
 
+static int sql_pg_execute_stream_(SQL *restrict me, const char *restrict statement, void *restrict *restrict resultdata);
+
 int
 sql_pg_execute_(SQL *restrict me, const char *restrict statement, void *restrict *restrict resultdata)
 {
 	PGresult *res;
 	ExecStatusType status;
+	unsigned long long start;
 
+	me->affected = 0;
 	if(me->depth && me->deadlocked)
 	{
 		/* If we're already deadlocked mid-transaction, there's no point in
@@ -40,14 +44,42 @@ sql_pg_execute_(SQL *restrict me, const char *restrict statement, void *restrict
 	}
 	if(me->deadlocked)
 	{
-		PQreset(me->pg);
+		sql_pg_reset_(me);
 		me->deadlocked = 0;
 	}
 	if(me->querylog)
 	{
 		me->querylog(me, statement);
 	}
-	res = PQexec(me->pg, statement);
+	if(me->pipeline)
+	{
+		if(!resultdata)
+		{
+			return sql_pg_pipeline_send_(me, statement);
+		}
+		if(sql_pg_pipeline_flush_(me))
+		{
+			return -1;
+		}
+	}
+	sql_pg_deallocate_(me);
+	if(resultdata && (me->flags & SQL_FLAG_STREAM))
+	{
+		return sql_pg_execute_stream_(me, statement, resultdata);
+	}
+	start = sql_stats_timer_();
+	if(resultdata && (me->flags & SQL_FLAG_BINARY))
+	{
+		/* The extended query protocol is needed to request binary results,
+		 * although it only permits a single statement
+		 */
+		res = PQexecParams(me->pg, statement, 0, NULL, NULL, NULL, NULL, 1);
+	}
+	else
+	{
+		res = PQexec(me->pg, statement);
+	}
+	sql_stats_wait_(me, start);
 	status = PQresultStatus(res);
 	if(!PQSTATUS_SUCCESS(status))
 	{
@@ -68,17 +100,374 @@ sql_pg_execute_(SQL *restrict me, const char *restrict statement, void *restrict
 	}
 	else
 	{
+		/* Statements queued in pipeline mode report nothing here */
+		me->affected = strtoull(PQcmdTuples(res), NULL, 10);
 		PQclear(res);
 	}
 	return 0;
 }
 
+/* Return the number of rows affected by the last statement executed
+ * without a result-set
+ */
+unsigned long long
+sql_pg_affected_(SQL *me)
+{
+	return me->affected;
+}
+
+/* Send a query in single-row mode, returning the first row (or the whole,
+ * empty, result-set) in resultdata; the remaining rows are retrieved by
+ * sql_statement_pg_next_()
+ */
+static int
+sql_pg_execute_stream_(SQL *restrict me, const char *restrict statement, void *restrict *restrict resultdata)
+{
+	PGresult *res;
+	ExecStatusType status;
+	unsigned long long start;
+	int r;
+
+	start = sql_stats_timer_();
+	if(me->flags & SQL_FLAG_BINARY)
+	{
+		r = PQsendQueryParams(me->pg, statement, 0, NULL, NULL, NULL, NULL, 1);
+	}
+	else
+	{
+		r = PQsendQuery(me->pg, statement);
+	}
+	if(!r)
+	{
+		sql_stats_wait_(me, start);
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		return -1;
+	}
+	PQsetSingleRowMode(me->pg);
+	res = PQgetResult(me->pg);
+	sql_stats_wait_(me, start);
+	status = PQresultStatus(res);
+	if(!PQSTATUS_SUCCESS(status))
+	{
+		sql_pg_copy_error_(me, res);
+		PQclear(res);
+		sql_pg_drain_(me);
+		return -1;
+	}
+	if(status != PGRES_SINGLE_TUPLE)
+	{
+		/* The query has already completed */
+		sql_pg_drain_(me);
+	}
+	*resultdata = NULL;
+	if(status == PGRES_SINGLE_TUPLE || status == PGRES_TUPLES_OK)
+	{
+		*resultdata = res;
+	}
+	else
+	{
+		PQclear(res);
+	}
+	return 0;
+}
+
+/* Discard any results still pending on the connection */
+void
+sql_pg_drain_(SQL *me)
+{
+	PGresult *res;
+
+	while((res = PQgetResult(me->pg)))
+	{
+		PQclear(res);
+	}
+}
+
+/* Execute a script as a single simple query, which the server runs in an
+ * implicit transaction unless the script contains explicit transaction
+ * control statements
+ */
+int
+sql_pg_execute_script_(SQL *restrict me, const char *restrict script, unsigned long long *restrict affected, size_t naffected)
+{
+	PGresult *res;
+	ExecStatusType status;
+	int n, failed;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	if(me->deadlocked)
+	{
+		sql_pg_reset_(me);
+		me->deadlocked = 0;
+	}
+	if(sql_pg_pipeline_flush_(me))
+	{
+		return -1;
+	}
+	if(me->querylog)
+	{
+		me->querylog(me, script);
+	}
+	if(!PQsendQuery(me->pg, script))
+	{
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		return -1;
+	}
+	n = 0;
+	failed = 0;
+	/* There is one result for each statement, up to the first failure */
+	while((res = PQgetResult(me->pg)))
+	{
+		status = PQresultStatus(res);
+		if(!PQSTATUS_SUCCESS(status))
+		{
+			if(!failed)
+			{
+				sql_pg_copy_error_(me, res);
+			}
+			failed = 1;
+		}
+		else
+		{
+			if((size_t) n < naffected)
+			{
+				affected[n] = atoll(PQcmdTuples(res));
+			}
+			n++;
+		}
+		PQclear(res);
+	}
+	return failed ? -1 : n;
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+/* Execute a batch of statements using pipeline mode: all of the statements
+ * are sent before any results are read, and the server runs them in an
+ * implicit transaction which ends at the pipeline's synchronisation point
+ */
+int
+sql_pg_execute_batch_(SQL *restrict me, const char *const *restrict statements, size_t count, unsigned long long *restrict affected)
+{
+	PGresult *res;
+	ExecStatusType status;
+	size_t c, sent;
+	int failed;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	if(me->deadlocked)
+	{
+		sql_pg_reset_(me);
+		me->deadlocked = 0;
+	}
+	if(sql_pg_pipeline_flush_(me))
+	{
+		return -1;
+	}
+	if(!PQenterPipelineMode(me->pg))
+	{
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		return -1;
+	}
+	failed = 0;
+	for(sent = 0; sent < count; sent++)
+	{
+		if(me->querylog)
+		{
+			me->querylog(me, statements[sent]);
+		}
+		if(!PQsendQueryParams(me->pg, statements[sent], 0, NULL, NULL, NULL, NULL, 0))
+		{
+			sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+			failed = 1;
+			break;
+		}
+	}
+	PQpipelineSync(me->pg);
+	for(c = 0; c < sent; c++)
+	{
+		res = PQgetResult(me->pg);
+		if(!res)
+		{
+			/* The connection was lost or reset */
+			if(!failed)
+			{
+				sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+			}
+			failed = 1;
+			break;
+		}
+		status = PQresultStatus(res);
+		if(status == PGRES_PIPELINE_ABORTED)
+		{
+			/* Skipped because an earlier statement failed */
+		}
+		else if(!PQSTATUS_SUCCESS(status))
+		{
+			if(!failed)
+			{
+				sql_pg_copy_error_(me, res);
+			}
+			failed = 1;
+		}
+		else if(affected)
+		{
+			affected[c] = atoll(PQcmdTuples(res));
+		}
+		PQclear(res);
+		/* Each statement's results are terminated by a NULL result */
+		while((res = PQgetResult(me->pg)))
+		{
+			PQclear(res);
+		}
+	}
+	/* Consume the result marking the synchronisation point */
+	while((res = PQgetResult(me->pg)))
+	{
+		status = PQresultStatus(res);
+		PQclear(res);
+		if(status == PGRES_PIPELINE_SYNC)
+		{
+			break;
+		}
+	}
+	PQexitPipelineMode(me->pg);
+	return failed ? -1 : 0;
+}
+#else /*LIBPQ_HAS_PIPELINING*/
+/* Without pipeline mode, execute a batch as a single multi-statement
+ * simple query
+ */
+int
+sql_pg_execute_batch_(SQL *restrict me, const char *const *restrict statements, size_t count, unsigned long long *restrict affected)
+{
+	char *script;
+	int r;
+
+	script = sql_batch_join_(statements, count);
+	if(!script)
+	{
+		sql_pg_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	r = sql_pg_execute_script_(me, script, affected, (affected ? count : 0));
+	free(script);
+	return (r < 0) ? -1 : 0;
+}
+#endif /*LIBPQ_HAS_PIPELINING*/
+
+/* Execute a query, passing each row to a callback; if SQL_FLAG_STREAM is
+ * set, rows are retrieved from the server one at a time, in which case
+ * the callback cannot use the connection
+ */
+long long
+sql_pg_query_foreach_(SQL *restrict me, const char *restrict query, SQL_ROW_FN fn, void *restrict userdata)
+{
+	PGresult *res;
+	ExecStatusType status;
+	SQL_CELL *cells;
+	int c, ncols, row, nrows, stop, failed;
+	long long count;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	if(me->deadlocked)
+	{
+		sql_pg_reset_(me);
+		me->deadlocked = 0;
+	}
+	if(sql_pg_pipeline_flush_(me))
+	{
+		return -1;
+	}
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+	if(!PQsendQueryParams(me->pg, query, 0, NULL, NULL, NULL, NULL, 0))
+	{
+		sql_pg_set_error_(me, "08000", PQerrorMessage(me->pg));
+		return -1;
+	}
+	if(me->flags & SQL_FLAG_STREAM)
+	{
+		PQsetSingleRowMode(me->pg);
+	}
+	cells = NULL;
+	count = 0;
+	stop = 0;
+	failed = 0;
+	/* Once the callback has stopped, or an error has occurred, any
+	 * remaining results are read and discarded
+	 */
+	while((res = PQgetResult(me->pg)))
+	{
+		status = PQresultStatus(res);
+		if(stop || failed)
+		{
+			PQclear(res);
+			continue;
+		}
+		if(status != PGRES_TUPLES_OK && status != PGRES_SINGLE_TUPLE)
+		{
+			if(!PQSTATUS_SUCCESS(status))
+			{
+				sql_pg_copy_error_(me, res);
+				failed = 1;
+			}
+			PQclear(res);
+			continue;
+		}
+		ncols = PQnfields(res);
+		if(!cells)
+		{
+			cells = (SQL_CELL *) calloc(ncols + 1, sizeof(SQL_CELL));
+			if(!cells)
+			{
+				sql_pg_set_error_(me, "58000", "Memory allocation error");
+				failed = 1;
+				PQclear(res);
+				continue;
+			}
+		}
+		nrows = PQntuples(res);
+		sql_stats_rows_(me, nrows, SQL_PG_RESULT_BYTES(res));
+		for(row = 0; row < nrows && !stop; row++)
+		{
+			for(c = 0; c < ncols; c++)
+			{
+				cells[c].null = PQgetisnull(res, row, c);
+				cells[c].ptr = cells[c].null ? NULL : PQgetvalue(res, row, c);
+				cells[c].len = PQgetlength(res, row, c);
+			}
+			count++;
+			stop = fn(me, cells, ncols, userdata);
+		}
+		PQclear(res);
+	}
+	free(cells);
+	if(stop < 0)
+	{
+		sql_pg_set_error_(me, "HY008", "Query was aborted");
+		return -1;
+	}
+	return failed ? -1 : count;
+}
+
 int
 sql_pg_begin_(SQL *me, SQL_TXN_MODE mode)
 {
 	const char *st;
 	PGresult *res;
 	ExecStatusType status;
+	unsigned long long start;
 	
 	if(me->depth)	
 	{
@@ -88,7 +477,7 @@ sql_pg_begin_(SQL *me, SQL_TXN_MODE mode)
 	}
 	if(me->deadlocked)
 	{
-		PQreset(me->pg);
+		sql_pg_reset_(me);
 		me->deadlocked = 0;
 	}
 	switch(mode)
@@ -104,7 +493,23 @@ sql_pg_begin_(SQL *me, SQL_TXN_MODE mode)
 	{
 		me->querylog(me, st);
 	}
+#ifdef LIBPQ_HAS_PIPELINING
+	if(me->flags & SQL_FLAG_PIPELINE)
+	{
+		/* Queue the start of the transaction along with its statements */
+		if(sql_pg_pipeline_send_(me, st))
+		{
+			return -1;
+		}
+		me->pipeline = 1;
+		me->pfailed = 0;
+		me->depth++;
+		return 0;
+	}
+#endif
+	start = sql_stats_timer_();
 	res = PQexec(me->pg, st);
+	sql_stats_wait_(me, start);
 	status = PQresultStatus(res);
 	if(!PQSTATUS_SUCCESS(status))
 	{
@@ -122,6 +527,7 @@ sql_pg_commit_(SQL *me)
 	const char *st = "COMMIT";
 	PGresult *res;
 	ExecStatusType status;
+	unsigned long long start;
 	
 	if(!me->depth)
 	{
@@ -135,7 +541,36 @@ sql_pg_commit_(SQL *me)
 	{
 		me->querylog(me, st);
 	}
+	if(me->pipeline)
+	{
+		/* Queue the COMMIT and sync: the whole transaction is sent to the
+		 * server in one go
+		 */
+		me->pipeline = 0;
+		if(me->pfailed || sql_pg_pipeline_send_(me, st) || sql_pg_pipeline_sync_(me))
+		{
+			sql_pg_pipeline_flush_(me);
+			if(me->deadlocked)
+			{
+				return -1;
+			}
+			/* The transaction was aborted by the failed statement, but
+			 * the server is still waiting for it to be rolled back
+			 */
+			if(me->querylog)
+			{
+				me->querylog(me, "ROLLBACK");
+			}
+			PQclear(PQexec(me->pg, "ROLLBACK"));
+			me->depth--;
+			return -1;
+		}
+		me->depth--;
+		return 0;
+	}
+	start = sql_stats_timer_();
 	res = PQexec(me->pg, st);
+	sql_stats_wait_(me, start);
 	status = PQresultStatus(res);
 	if(!PQSTATUS_SUCCESS(status))
 	{
@@ -153,16 +588,25 @@ sql_pg_rollback_(SQL *me)
 	const char *st = "ROLLBACK";
 	PGresult *res;
 	ExecStatusType status;
+	unsigned long long start;
 	
 	if(!me->depth)
 	{
 		return 0;
 	}
+	if(me->pipeline)
+	{
+		/* Errors in any queued statements are moot */
+		me->pipeline = 0;
+		sql_pg_pipeline_flush_(me);
+	}
 	if(me->querylog)
 	{
 		me->querylog(me, st);
 	}
+	start = sql_stats_timer_();
 	res = PQexec(me->pg, st);
+	sql_stats_wait_(me, start);
 	status = PQresultStatus(res);
 	if(!PQSTATUS_SUCCESS(status))
 	{
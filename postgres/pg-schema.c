@@ -71,6 +71,10 @@ sql_pg_schema_create_table_(SQL *me)
 	{
 		me->querylog(me, st);
 	}
+	if(sql_pg_pipeline_flush_(me))
+	{
+		return -1;
+	}
 	res = PQexec(me->pg, st);
 	status = PQresultStatus(res);
 	if(!PQSTATUS_SUCCESS(status))
@@ -121,6 +125,10 @@ sql_pg_schema_set_version_(SQL *me, const char *identifier, int version)
 	{
 		me->querylog(me, me->qbuf);
 	}
+	if(sql_pg_pipeline_flush_(me))
+	{
+		return -1;
+	}
 	res = PQexec(me->pg, me->qbuf);
 	status = PQresultStatus(res);
 	if(!PQSTATUS_SUCCESS(status))
@@ -151,6 +159,10 @@ sql_pg_schema_select_version_(SQL *me, const char *identifier, size_t idlen, int
 	{
 		me->querylog(me, me->qbuf);
 	}
+	if(sql_pg_pipeline_flush_(me))
+	{
+		return -1;
+	}
 	res = PQexec(me->pg, me->qbuf);
 	status = PQresultStatus(res);
 	if(!PQSTATUS_SUCCESS(status))
@@ -40,29 +40,64 @@ static SQL_STATEMENT_API pg_statement_api = {
 	sql_statement_pg_next_,
 	sql_statement_pg_cur_,
 	sql_statement_pg_rewind_,
-	sql_statement_pg_seek_
+	sql_statement_pg_seek_,
+	sql_statement_pg_execute_,
+	sql_statement_pg_reset_,
+	sql_statement_pg_int64_,
+	sql_statement_pg_real_,
+	sql_statement_pg_boolean_,
+	sql_statement_pg_blob_,
+	sql_statement_pg_fetch_batch_,
+	sql_statement_pg_row_,
+	sql_statement_def_scanstatus_
 };
 
+static int sql_statement_pg_prepare_(SQL_STATEMENT *me);
+static void sql_statement_pg_stream_finish_(SQL_STATEMENT *me);
+static int sql_statement_pg_stream_next_(SQL_STATEMENT *me);
+
+/* Determine whether the statement cache may prepare a statement. Inside a
+ * transaction, a failed Parse would abort the transaction, and with it the
+ * direct execution which the cache falls back to, so only statements
+ * which have already been prepared can be used.
+ */
+int
+sql_pg_cacheable_(SQL *restrict me, const char *restrict statement)
+{
+	(void) statement;
+
+	return !me->depth && PQtransactionStatus(me->pg) == PQTRANS_IDLE;
+}
+
 /* Create a new statement or result-set */
 SQL_STATEMENT *
 sql_pg_statement_(SQL *restrict me, const char *restrict statement)
 {
 	SQL_STATEMENT *p;
 
-	p = (SQL_STATEMENT *) calloc(1, sizeof(SQL_STATEMENT));
+	p = (SQL_STATEMENT *) sql_slab_alloc_(me->stmtslab);
 	if(!p)
 	{
 		return NULL;
 	}
+	p->slab = me->stmtslab;
 	p->api = &pg_statement_api;
 	p->refcount = 1;
 	p->sql = me;
 	if(statement)
 	{
-		p->statement = strdup(statement);
+		p->statement = sql_strdup_(statement);
 		if(!p->statement)
 		{
-			free(p);
+			sql_slab_free_(p->slab, p);
+			return NULL;
+		}
+		me->stmtseq++;
+		snprintf(p->name, sizeof(p->name), "libsql_%lu", me->stmtseq);
+		if(sql_statement_pg_prepare_(p))
+		{
+			sql_free_(p->statement);
+			sql_slab_free_(p->slab, p);
 			return NULL;
 		}
 	}
@@ -73,21 +108,102 @@ sql_pg_statement_(SQL *restrict me, const char *restrict statement)
 unsigned long
 sql_statement_pg_free_(SQL_STATEMENT *me)
 {
+	SQL_PG_DEALLOC *d;
+
 	me->refcount--;
 	if(me->refcount)
 	{
 		return me->refcount;
 	}
+	sql_statement_pg_stream_finish_(me);
 	if(me->result)
 	{
 		PQclear(me->result);
 	}
+	if(me->name[0] && me->generation)
+	{
+		/* The statement may be freed by a thread other than the one using
+		 * the connection, or while a result-set is being streamed or a
+		 * pipeline is queued, so the server-side prepared statement is
+		 * released later by sql_pg_deallocate_()
+		 */
+		d = (SQL_PG_DEALLOC *) malloc(sizeof(SQL_PG_DEALLOC));
+		if(d)
+		{
+			d->generation = me->generation;
+			strcpy(d->name, me->name);
+			d->next = __atomic_load_n(&(me->sql->deallocs), __ATOMIC_RELAXED);
+			while(!__atomic_compare_exchange_n(&(me->sql->deallocs), &(d->next), d, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			{
+			}
+		}
+	}
+	sql_template_destroy_(me->tmpl);
+	free(me->pvalues);
+	free(me->plengths);
+	free(me->pbuf);
 	free(me->widths);
-	free(me->statement);
-	free(me);
+	sql_pg_binary_free_(me);
+	if(me->blob)
+	{
+		PQfreemem(me->blob);
+	}
+	sql_free_(me->statement);
+	sql_slab_free_(me->slab, me);
 	return 0;
 }
 
+/* Deallocate the server-side prepared statements of statements which have
+ * been freed; invoked by the thread using the connection before it sends
+ * a command, and does nothing if another command is still in progress
+ */
+void
+sql_pg_deallocate_(SQL *me)
+{
+	SQL_PG_DEALLOC *d, *next;
+	PGTransactionStatusType status;
+	char buf[1024];
+	size_t len;
+
+	if(!__atomic_load_n(&(me->deallocs), __ATOMIC_RELAXED) || !me->pg || me->async)
+	{
+		return;
+	}
+	status = PQtransactionStatus(me->pg);
+	if(status != PQTRANS_IDLE && status != PQTRANS_INTRANS)
+	{
+		return;
+	}
+#ifdef LIBPQ_HAS_PIPELINING
+	if(PQpipelineStatus(me->pg) != PQ_PIPELINE_OFF)
+	{
+		return;
+	}
+#endif
+	/* Statements prepared before the connection was last reset no longer
+	 * exist on the server
+	 */
+	len = 0;
+	for(d = __atomic_exchange_n(&(me->deallocs), NULL, __ATOMIC_ACQUIRE); d; d = next)
+	{
+		next = d->next;
+		if(d->generation == me->generation)
+		{
+			if(len + sizeof(d->name) + 16 > sizeof(buf))
+			{
+				PQclear(PQexec(me->pg, buf));
+				len = 0;
+			}
+			len += snprintf(&(buf[len]), sizeof(buf) - len, "DEALLOCATE \"%s\";", d->name);
+		}
+		free(d);
+	}
+	if(len)
+	{
+		PQclear(PQexec(me->pg, buf));
+	}
+}
+
 /* Return the connection associated with this statement */
 SQL *
 sql_statement_pg_connection_(SQL_STATEMENT *me)
@@ -106,18 +222,27 @@ sql_statement_pg_statement_(SQL_STATEMENT *me)
 int
 sql_statement_pg_set_results_(SQL_STATEMENT *restrict me, void *data)
 {
+	sql_statement_pg_stream_finish_(me);
 	if(me->result)
 	{
 		PQclear(me->result);
 	}
 	me->result = (PGresult *) data;
 	me->lengths = NULL;
+	me->offset = 0;
+	me->streaming = (data && PQresultStatus(me->result) == PGRES_SINGLE_TUPLE);
+	if(me->blob)
+	{
+		PQfreemem(me->blob);
+		me->blob = NULL;
+	}
 	me->cur = 0;
 	if(data)
 	{
 		me->affected = atoll(PQcmdTuples(me->result));
 		me->columns = PQnfields(me->result);
 		me->rows = PQntuples(me->result);
+		sql_stats_rows_(me->sql, me->rows, SQL_PG_RESULT_BYTES(me->result));
 	}
 	else
 	{
@@ -125,6 +250,149 @@ sql_statement_pg_set_results_(SQL_STATEMENT *restrict me, void *data)
 		me->columns = 0;
 		me->rows = 0;
 	}
+	/* Keep the per-column buffers if they're large enough for the new
+	 * result-set, but discard their contents
+	 */
+	if(me->columns > me->colalloc)
+	{
+		sql_pg_binary_free_(me);
+		free(me->widths);
+		me->widths = NULL;
+		me->colalloc = me->columns;
+	}
+	else
+	{
+		sql_pg_binary_discard_(me);
+		if(me->widths)
+		{
+			memset(me->widths, 0, me->colalloc * sizeof(size_t));
+		}
+	}
+	return 0;
+}
+
+/* Bind parameters to a prepared statement and execute it */
+int
+sql_statement_pg_execute_(SQL_STATEMENT *restrict me, unsigned int nparams, const SQL_PARAM *restrict params)
+{
+	SQL *sql;
+	PGresult *res;
+	ExecStatusType status;
+	unsigned long long start;
+	unsigned int c;
+	char *p;
+
+	sql = me->sql;
+	if(!me->name[0])
+	{
+		sql_pg_set_error_(sql, "HY010", "The statement has not been prepared");
+		return -1;
+	}
+	if(sql->depth && sql->deadlocked)
+	{
+		return -1;
+	}
+	if(sql->deadlocked)
+	{
+		sql_pg_reset_(sql);
+		sql->deadlocked = 0;
+	}
+	if(sql_pg_pipeline_flush_(sql))
+	{
+		return -1;
+	}
+	sql_pg_deallocate_(sql);
+	if(me->generation != sql->generation && sql_statement_pg_prepare_(me))
+	{
+		return -1;
+	}
+	if(nparams && !me->pvalues)
+	{
+		me->pvalues = (const char **) calloc(nparams, sizeof(const char *));
+		me->plengths = (int *) calloc(nparams, sizeof(int));
+		me->pbuf = (char *) calloc(nparams, SQL_PG_PARAM_BUFLEN);
+		if(!me->pvalues || !me->plengths || !me->pbuf)
+		{
+			sql_pg_set_error_(sql, "58000", "Memory allocation error");
+			return -1;
+		}
+	}
+	/* All parameters are passed to the server in text form */
+	for(c = 0; c < nparams; c++)
+	{
+		p = &(me->pbuf[c * SQL_PG_PARAM_BUFLEN]);
+		switch(params[c].type)
+		{
+		case SQL_PARAM_NULL:
+			me->pvalues[c] = NULL;
+			me->plengths[c] = 0;
+			continue;
+		case SQL_PARAM_INT:
+			snprintf(p, SQL_PG_PARAM_BUFLEN, "%lld", params[c].ival);
+			break;
+		case SQL_PARAM_UINT:
+			snprintf(p, SQL_PG_PARAM_BUFLEN, "%llu", params[c].uval);
+			break;
+		case SQL_PARAM_DOUBLE:
+			snprintf(p, SQL_PG_PARAM_BUFLEN, "%.17g", params[c].dval);
+			break;
+		case SQL_PARAM_TEXT:
+			me->pvalues[c] = params[c].sval;
+			me->plengths[c] = params[c].slen;
+			continue;
+		}
+		me->pvalues[c] = p;
+		me->plengths[c] = strlen(p);
+	}
+	if(sql->querylog)
+	{
+		sql->querylog(sql, me->statement);
+	}
+	start = sql_stats_timer_();
+	res = PQexecPrepared(sql->pg, me->name, nparams, me->pvalues, me->plengths, NULL, (sql->flags & SQL_FLAG_BINARY) ? 1 : 0);
+	sql_stats_wait_(sql, start);
+	status = PQresultStatus(res);
+	if(!PQSTATUS_SUCCESS(status))
+	{
+		sql_pg_copy_error_(sql, res);
+		PQclear(res);
+		return -1;
+	}
+	if(status != PGRES_TUPLES_OK)
+	{
+		sql_statement_pg_set_results_(me, NULL);
+		me->affected = atoll(PQcmdTuples(res));
+		PQclear(res);
+		return 0;
+	}
+	return sql_statement_pg_set_results_(me, res);
+}
+
+/* Prepare the statement on the server */
+static int
+sql_statement_pg_prepare_(SQL_STATEMENT *me)
+{
+	PGresult *res;
+	ExecStatusType status;
+	unsigned long long start;
+
+	if(sql_pg_pipeline_flush_(me->sql))
+	{
+		return -1;
+	}
+	sql_pg_deallocate_(me->sql);
+	start = sql_stats_timer_();
+	res = PQprepare(me->sql->pg, me->name, me->statement, 0, NULL);
+	sql_stats_wait_(me->sql, start);
+	status = PQresultStatus(res);
+	if(!PQSTATUS_SUCCESS(status))
+	{
+		sql_pg_copy_error_(me->sql, res);
+		PQclear(res);
+		return -1;
+	}
+	PQclear(res);
+	me->generation = me->sql->generation;
 	return 0;
 }
 
@@ -139,7 +407,8 @@ sql_statement_pg_columns_(SQL_STATEMENT *me)
 unsigned long long
 sql_statement_pg_rows_(SQL_STATEMENT *me)
 {
-	return me->rows;
+	/* While streaming, this is the number of rows retrieved so far */
+	return me->offset + me->rows;
 }
 
 /* Return the number of rows affected by the query */
@@ -164,6 +433,10 @@ sql_statement_pg_eof_(SQL_STATEMENT *me)
 int
 sql_statement_pg_next_(SQL_STATEMENT *me)
 {
+	if(me->streaming)
+	{
+		return sql_statement_pg_stream_next_(me);
+	}
 	if(!me->result)
 	{
 		return 0;
@@ -191,14 +464,21 @@ sql_statement_pg_value_(SQL_STATEMENT *restrict me, unsigned int col, char *rest
 	{
 		return 0;
 	}
-	l = PQgetlength(me->result, me->cur, col);
+	if(PQfformat(me->result, col) == 1)
+	{
+		value = (char *) sql_pg_binary_text_(me, col, &l);
+	}
+	else
+	{
+		value = PQgetvalue(me->result, me->cur, col);
+		l = PQgetlength(me->result, me->cur, col);
+	}
 	if(buf)
 	{
 		if(l >= buflen)
 		{
 			l = buflen - 1;
 		}
-		value = PQgetvalue(me->result, me->cur, col);
 		if(!value)
 		{
 			return 0;
@@ -213,6 +493,10 @@ sql_statement_pg_value_(SQL_STATEMENT *restrict me, unsigned int col, char *rest
 const unsigned char *
 sql_statement_pg_valueptr_(SQL_STATEMENT *me, unsigned int col)
 {
+	if(PQfformat(me->result, col) == 1)
+	{
+		return (const unsigned char *) sql_pg_binary_text_(me, col, NULL);
+	}
 	return (const unsigned char *) PQgetvalue(me->result, me->cur, col);	
 }
 
@@ -228,20 +512,278 @@ sql_statement_pg_null_(SQL_STATEMENT *me, unsigned int col)
 size_t
 sql_statement_pg_valuelen_(SQL_STATEMENT *me, unsigned int col)
 {
+	size_t l;
+
+	if(PQfformat(me->result, col) == 1)
+	{
+		sql_pg_binary_text_(me, col, &l);
+		return l;
+	}
 	return PQgetlength(me->result, me->cur, col);
 }
 
+/* Retrieve the native value of a column in the current row; values in
+ * binary-format results are decoded directly, while text-format results
+ * are parsed
+ */
+int64_t
+sql_statement_pg_int64_(SQL_STATEMENT *me, unsigned int col)
+{
+	const unsigned char *p;
+	int len;
+
+	if(me->cur >= me->rows || col >= me->columns || PQgetisnull(me->result, me->cur, col))
+	{
+		return 0;
+	}
+	if(PQfformat(me->result, col) != 1)
+	{
+		return sql_statement_def_int64_(me, col);
+	}
+	p = (const unsigned char *) PQgetvalue(me->result, me->cur, col);
+	len = PQgetlength(me->result, me->cur, col);
+	switch(PQftype(me->result, col))
+	{
+	case SQL_PG_INT2OID:
+		return (int16_t) sql_pg_be_(p, len);
+	case SQL_PG_INT4OID:
+		return (int32_t) sql_pg_be_(p, len);
+	case SQL_PG_OIDOID:
+		return (uint32_t) sql_pg_be_(p, len);
+	case SQL_PG_INT8OID:
+		return (int64_t) sql_pg_be_(p, len);
+	case SQL_PG_BOOLOID:
+		return (len && p[0]) ? 1 : 0;
+	case SQL_PG_FLOAT4OID:
+	case SQL_PG_FLOAT8OID:
+		return (int64_t) sql_statement_pg_real_(me, col);
+	}
+	/* Parse the text form of anything else, such as numeric */
+	return sql_statement_def_int64_(me, col);
+}
+
+double
+sql_statement_pg_real_(SQL_STATEMENT *me, unsigned int col)
+{
+	const unsigned char *p;
+	uint64_t v;
+	uint32_t v32;
+	float f;
+	double d;
+	int len;
+
+	if(me->cur >= me->rows || col >= me->columns || PQgetisnull(me->result, me->cur, col))
+	{
+		return 0;
+	}
+	if(PQfformat(me->result, col) != 1)
+	{
+		return sql_statement_def_real_(me, col);
+	}
+	p = (const unsigned char *) PQgetvalue(me->result, me->cur, col);
+	len = PQgetlength(me->result, me->cur, col);
+	switch(PQftype(me->result, col))
+	{
+	case SQL_PG_FLOAT4OID:
+		v32 = (uint32_t) sql_pg_be_(p, len);
+		memcpy(&f, &v32, sizeof(f));
+		return f;
+	case SQL_PG_FLOAT8OID:
+		v = sql_pg_be_(p, len);
+		memcpy(&d, &v, sizeof(d));
+		return d;
+	case SQL_PG_INT2OID:
+	case SQL_PG_INT4OID:
+	case SQL_PG_OIDOID:
+	case SQL_PG_INT8OID:
+	case SQL_PG_BOOLOID:
+		return (double) sql_statement_pg_int64_(me, col);
+	}
+	return sql_statement_def_real_(me, col);
+}
+
+int
+sql_statement_pg_boolean_(SQL_STATEMENT *me, unsigned int col)
+{
+	if(me->cur >= me->rows || col >= me->columns || PQgetisnull(me->result, me->cur, col))
+	{
+		return 0;
+	}
+	if(PQfformat(me->result, col) != 1)
+	{
+		return sql_statement_def_boolean_(me, col);
+	}
+	switch(PQftype(me->result, col))
+	{
+	case SQL_PG_BOOLOID:
+	case SQL_PG_INT2OID:
+	case SQL_PG_INT4OID:
+	case SQL_PG_INT8OID:
+	case SQL_PG_OIDOID:
+		return (sql_statement_pg_int64_(me, col) != 0);
+	case SQL_PG_FLOAT4OID:
+	case SQL_PG_FLOAT8OID:
+		return (sql_statement_pg_real_(me, col) != 0);
+	}
+	return sql_statement_def_boolean_(me, col);
+}
+
+/* Retrieve the contents of a column as a binary blob; bytea values in
+ * text-format results are unescaped into a buffer which remains valid
+ * until the next call
+ */
+const unsigned char *
+sql_statement_pg_blob_(SQL_STATEMENT *restrict me, unsigned int col, size_t *restrict len)
+{
+	const unsigned char *p;
+	size_t l;
+
+	if(len)
+	{
+		*len = 0;
+	}
+	if(me->cur >= me->rows || col >= me->columns || PQgetisnull(me->result, me->cur, col))
+	{
+		return NULL;
+	}
+	p = (const unsigned char *) PQgetvalue(me->result, me->cur, col);
+	l = PQgetlength(me->result, me->cur, col);
+	if(PQfformat(me->result, col) != 1 && PQftype(me->result, col) == SQL_PG_BYTEAOID)
+	{
+		if(me->blob)
+		{
+			PQfreemem(me->blob);
+		}
+		me->blob = PQunescapeBytea(p, &l);
+		if(!me->blob)
+		{
+			sql_pg_set_error_(me->sql, "58000", "Memory allocation error");
+			return NULL;
+		}
+		p = me->blob;
+	}
+	if(len)
+	{
+		*len = l;
+	}
+	return p;
+}
+
 /* Return the row index of the current row */
+/* Fetch rows into a batch directly from the PGresult; binary-format
+ * numeric values are decoded without being converted to text
+ */
+int
+sql_statement_pg_fetch_batch_(SQL_STATEMENT *restrict me, size_t max_rows, SQL_BATCH *restrict batch)
+{
+	const char *p;
+	size_t len;
+	unsigned int c;
+
+	while(batch->rows < max_rows && me->cur < me->rows)
+	{
+		for(c = 0; c < batch->ncolumns; c++)
+		{
+			if(PQgetisnull(me->result, me->cur, c))
+			{
+				sql_batch_null_(batch, c);
+				continue;
+			}
+			if(batch->columns[c].type == SQL_TYPE_BLOB)
+			{
+				p = (const char *) sql_statement_pg_blob_(me, c, &len);
+			}
+			else if(PQfformat(me->result, c) != 1)
+			{
+				p = PQgetvalue(me->result, me->cur, c);
+				len = PQgetlength(me->result, me->cur, c);
+			}
+			else
+			{
+				switch(batch->columns[c].type)
+				{
+				case SQL_TYPE_INTEGER:
+					sql_batch_int64_(batch, c, sql_statement_pg_int64_(me, c));
+					continue;
+				case SQL_TYPE_BOOLEAN:
+					sql_batch_int64_(batch, c, sql_statement_pg_boolean_(me, c));
+					continue;
+				case SQL_TYPE_REAL:
+					sql_batch_real_(batch, c, sql_statement_pg_real_(me, c));
+					continue;
+				default:
+					p = sql_pg_binary_text_(me, c, &len);
+				}
+			}
+			if(!p || sql_batch_text_(batch, c, p, len))
+			{
+				sql_pg_set_error_(me->sql, "58000", "Memory allocation error");
+				return -1;
+			}
+		}
+		batch->rows++;
+		if(sql_statement_pg_next_(me) < 0)
+		{
+			return -1;
+		}
+	}
+	return batch->rows;
+}
+
+int
+sql_statement_pg_row_(SQL_STATEMENT *restrict me, SQL_CELL *restrict cells, unsigned int ncols)
+{
+	unsigned int c;
+
+	if(!me->result || me->cur >= me->rows)
+	{
+		return -1;
+	}
+	if(ncols > me->columns)
+	{
+		ncols = me->columns;
+	}
+	for(c = 0; c < ncols; c++)
+	{
+		cells[c].null = PQgetisnull(me->result, me->cur, c);
+		if(cells[c].null)
+		{
+			cells[c].ptr = NULL;
+			cells[c].len = 0;
+		}
+		else if(PQfformat(me->result, c) == 1)
+		{
+			cells[c].ptr = sql_pg_binary_text_(me, c, &(cells[c].len));
+		}
+		else
+		{
+			cells[c].ptr = PQgetvalue(me->result, me->cur, c);
+			cells[c].len = PQgetlength(me->result, me->cur, c);
+		}
+	}
+	return ncols;
+}
+
 unsigned long long
 sql_statement_pg_cur_(SQL_STATEMENT *me)
 {
-	return me->cur;
+	return me->offset + me->cur;
 }
 
 /* Seek to a particular row in the result-set */
 int
 sql_statement_pg_seek_(SQL_STATEMENT *me, unsigned long long row)
 {
+	if(me->offset)
+	{
+		/* Rows which have been streamed past are gone */
+		if(me->result && row == me->offset + me->cur)
+		{
+			return 0;
+		}
+		sql_pg_set_error_(me->sql, "HY109", "Cannot seek within a streamed result-set");
+		return -1;
+	}
 	if(!me->result || row >= me->rows)
 	{
 		return -1;
@@ -256,3 +798,65 @@ sql_statement_pg_rewind_(SQL_STATEMENT *me)
 {	
 	return sql_statement_pg_seek_(me, 0);
 }
+
+/* Discard the results so that a prepared statement can be executed again */
+int
+sql_statement_pg_reset_(SQL_STATEMENT *me)
+{
+	return sql_statement_pg_set_results_(me, NULL);
+}
+
+/* Replace the current row of a streamed result-set with the next one;
+ * returns 1 if there was a row, 0 if not or -1 if an error occurred
+ */
+static int
+sql_statement_pg_stream_next_(SQL_STATEMENT *me)
+{
+	PGresult *res;
+	ExecStatusType status;
+
+	sql_pg_binary_discard_(me);
+	PQclear(me->result);
+	me->result = NULL;
+	me->offset += me->rows;
+	me->cur = 0;
+	me->rows = 0;
+	/* Rows are counted, but individual fetches are not timed */
+	res = PQgetResult(me->sql->pg);
+	status = PQresultStatus(res);
+	if(status == PGRES_SINGLE_TUPLE)
+	{
+		me->result = res;
+		me->rows = 1;
+		sql_stats_rows_(me->sql, 1, SQL_PG_RESULT_BYTES(res));
+		return 1;
+	}
+	/* Either the final, empty, result or an error */
+	me->streaming = 0;
+	if(res && !PQSTATUS_SUCCESS(status))
+	{
+		sql_pg_copy_error_(me->sql, res);
+		PQclear(res);
+		sql_pg_drain_(me->sql);
+		return -1;
+	}
+	me->result = res;
+	sql_pg_drain_(me->sql);
+	return 0;
+}
+
+/* Abandon a streamed result-set which hasn't been read to the end, so that
+ * the connection can be used again. The remaining rows are read and
+ * discarded rather than cancelling the query, which would abort any
+ * transaction in progress.
+ */
+static void
+sql_statement_pg_stream_finish_(SQL_STATEMENT *me)
+{
+	if(!me->streaming)
+	{
+		return;
+	}
+	me->streaming = 0;
+	sql_pg_drain_(me->sql);
+}
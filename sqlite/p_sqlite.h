@@ -25,6 +25,7 @@
 # include <stdio.h>
 # include <stdlib.h>
 # include <string.h>
+# include <limits.h>
 # include <pthread.h>
 # include <libsql.h>
 # include "sqlite3.h"
@@ -51,8 +52,36 @@ struct sql_struct
 	SQL_LOG_QUERY querylog;
 	SQL_LOG_ERROR errorlog;
 	void *userdata;
+	/* Asynchronous queries are executed by a worker thread, which writes
+	 * to apipe when each has completed
+	 */
+	int hasworker;
+	pthread_t worker;
+	pthread_mutex_t amutex;
+	pthread_cond_t acond;
+	int apipe[2];
+	int astate;
+	int aquit;
+	char *aquery;
+	SQL_STATEMENT *aresult;
+	int afailed;
+	/* Rows affected by the last statement executed without a result-set */
+	unsigned long long affected;
 };
 
+/* A value in a buffered result-set (see sqlite-buffer.c) */
+typedef struct
+{
+	int type;
+	size_t offset;
+	size_t len;
+	union
+	{
+		sqlite3_int64 ival;
+		double dval;
+	} native;
+} SQL_SQLITE_CELL;
+
 struct sql_statement_struct
 {
 	SQL_STATEMENT_COMMON_MEMBERS
@@ -63,7 +92,20 @@ struct sql_statement_struct
 	unsigned long long rows;
 	int affected;
 	int columns;
+	/* Fields are created on demand, and the array is retained (and grown
+	 * as needed) across executions
+	 */
 	SQL_FIELD **fields;
+	int nfields;
+	/* The row store of a buffered result-set */
+	int buffered;
+	SQL_SQLITE_CELL *cells;
+	size_t cellalloc;
+	char *data;
+	size_t datalen;
+	size_t dataalloc;
+	size_t *widths;
+	int widthalloc;
 };
 
 struct sql_field_struct
@@ -82,13 +124,30 @@ void sql_sqlite_set_error_(SQL *restrict me, const char *restrict sqlstate, cons
 void sql_sqlite_set_errcode_(SQL *me, int errcode);
 void sql_sqlite_copy_error_(SQL *me);
 
+int sql_sqlite_buffer_load_(SQL_STATEMENT *me);
+const SQL_SQLITE_CELL *sql_sqlite_buffer_cell_(SQL_STATEMENT *me, unsigned int col);
+const char *sql_sqlite_buffer_text_(SQL_STATEMENT *restrict me, const SQL_SQLITE_CELL *restrict cell);
+void sql_sqlite_buffer_free_(SQL_STATEMENT *me);
+
 unsigned long sql_sqlite_free_(SQL *me);
 size_t sql_sqlite_escape_(SQL *restrict me, const unsigned char *restrict from, size_t length, char *restrict buf, size_t buflen);
 const char *sql_sqlite_sqlstate_(SQL *me);
 const char *sql_sqlite_error_(SQL *me);
+int sql_sqlite_ping_(SQL *me);
 int sql_sqlite_connect_(SQL *restrict me, URI *restrict uri);
 int sql_sqlite_execute_(SQL *restrict me, const char *restrict statement, void *restrict *restrict resultdata);
+int sql_sqlite_execute_batch_(SQL *restrict me, const char *const *restrict statements, size_t count, unsigned long long *restrict affected);
+int sql_sqlite_execute_script_(SQL *restrict me, const char *restrict script, unsigned long long *restrict affected, size_t naffected);
+long long sql_sqlite_bulk_insert_(SQL *restrict me, const char *restrict table, const char *const *restrict columns, size_t ncolumns, SQL_BULK_ROW fn, void *restrict userdata);
+long long sql_sqlite_export_(SQL *restrict me, const char *restrict query, SQL_EXPORT_FORMAT format, SQL_EXPORT_BUFFER *restrict buf);
+long long sql_sqlite_query_foreach_(SQL *restrict me, const char *restrict query, SQL_ROW_FN fn, void *restrict userdata);
 SQL_STATEMENT *sql_sqlite_statement_(SQL *restrict me, const char *restrict statement);
+int sql_sqlite_query_async_(SQL *restrict me, const char *restrict query);
+int sql_sqlite_poll_(SQL *me);
+SQL_STATEMENT *sql_sqlite_result_(SQL *me);
+int sql_sqlite_socket_(SQL *me);
+unsigned long long sql_sqlite_affected_(SQL *me);
+void sql_sqlite_async_stop_(SQL *me);
 
 unsigned long sql_statement_sqlite_free_(SQL_STATEMENT *me);
 SQL *sql_statement_sqlite_connection_(SQL_STATEMENT *me);
@@ -107,10 +166,20 @@ size_t sql_statement_sqlite_valuelen_(SQL_STATEMENT *me, unsigned int col);
 unsigned long long sql_statement_sqlite_cur_(SQL_STATEMENT *me);
 int sql_statement_sqlite_seek_(SQL_STATEMENT *me, unsigned long long row);
 int sql_statement_sqlite_rewind_(SQL_STATEMENT *me);
+int sql_statement_sqlite_execute_(SQL_STATEMENT *restrict me, unsigned int nparams, const SQL_PARAM *restrict params);
+int sql_statement_sqlite_reset_(SQL_STATEMENT *me);
+int64_t sql_statement_sqlite_int64_(SQL_STATEMENT *me, unsigned int col);
+double sql_statement_sqlite_real_(SQL_STATEMENT *me, unsigned int col);
+int sql_statement_sqlite_boolean_(SQL_STATEMENT *me, unsigned int col);
+const unsigned char *sql_statement_sqlite_blob_(SQL_STATEMENT *restrict me, unsigned int col, size_t *restrict len);
+int sql_statement_sqlite_fetch_batch_(SQL_STATEMENT *restrict me, size_t max_rows, SQL_BATCH *restrict batch);
+int sql_statement_sqlite_row_(SQL_STATEMENT *restrict me, SQL_CELL *restrict cells, unsigned int ncols);
+int sql_statement_sqlite_scanstatus_(SQL_STATEMENT *restrict me, SQL_STMT_STATUS *restrict status);
 
 unsigned long sql_field_sqlite_free_(SQL_FIELD *me);
 const char *sql_field_sqlite_name_(SQL_FIELD *me);
 size_t sql_field_sqlite_width_(SQL_FIELD *me);
+SQL_FIELD_TYPE sql_field_sqlite_type_(SQL_FIELD *me);
 
 int sql_sqlite_begin_(SQL *me, SQL_TXN_MODE mode);
 int sql_sqlite_commit_(SQL *me);
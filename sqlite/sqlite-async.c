@@ -0,0 +1,265 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include "p_sqlite.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/* SQLite has no network protocol to wait upon, so asynchronous queries are
+ * executed (as far as their first row) by a worker thread belonging to the
+ * connection, which writes a byte to a pipe when each query has completed.
+ * The read end of the pipe is the descriptor returned by sql_socket(), and
+ * remains readable until the result has been collected.
+ *
+ * The statement which receives the result is created, and if the query
+ * fails, destroyed, by the thread which owns the connection, because the
+ * connection's slabs aren't thread-safe.
+ */
+
+#define SQL_SQLITE_ASYNC_IDLE          0
+#define SQL_SQLITE_ASYNC_PENDING       1
+#define SQL_SQLITE_ASYNC_DONE          2
+
+static int sql_sqlite_async_start_(SQL *me);
+static void *sql_sqlite_async_worker_(void *arg);
+static int sql_sqlite_async_run_(SQL *restrict me, SQL_STATEMENT *restrict st, const char *restrict query);
+
+/* Hand a query to the worker thread */
+int
+sql_sqlite_query_async_(SQL *restrict me, const char *restrict query)
+{
+	SQL_STATEMENT *st;
+	char *p;
+
+	if(!me->hasworker && sql_sqlite_async_start_(me))
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&(me->amutex));
+	if(me->astate != SQL_SQLITE_ASYNC_IDLE)
+	{
+		pthread_mutex_unlock(&(me->amutex));
+		sql_sqlite_set_error_(me, "HY010", "An asynchronous query is already in progress on this connection");
+		return -1;
+	}
+	pthread_mutex_unlock(&(me->amutex));
+	p = strdup(query);
+	st = sql_sqlite_statement_(me, NULL);
+	if(!p || !st)
+	{
+		free(p);
+		if(st)
+		{
+			st->api->release(st);
+		}
+		sql_sqlite_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	pthread_mutex_lock(&(me->amutex));
+	me->aquery = p;
+	me->aresult = st;
+	me->afailed = 0;
+	me->astate = SQL_SQLITE_ASYNC_PENDING;
+	pthread_cond_signal(&(me->acond));
+	pthread_mutex_unlock(&(me->amutex));
+	return 0;
+}
+
+/* Determine whether the worker has finished executing the query */
+int
+sql_sqlite_poll_(SQL *me)
+{
+	int r;
+
+	if(!me->hasworker)
+	{
+		sql_sqlite_set_error_(me, "HY010", "No asynchronous query is in progress on this connection");
+		return -1;
+	}
+	pthread_mutex_lock(&(me->amutex));
+	r = me->astate;
+	pthread_mutex_unlock(&(me->amutex));
+	switch(r)
+	{
+	case SQL_SQLITE_ASYNC_PENDING:
+		return 0;
+	case SQL_SQLITE_ASYNC_DONE:
+		return 1;
+	}
+	sql_sqlite_set_error_(me, "HY010", "No asynchronous query is in progress on this connection");
+	return -1;
+}
+
+/* Wait for the worker to signal completion and collect the result */
+SQL_STATEMENT *
+sql_sqlite_result_(SQL *me)
+{
+	SQL_STATEMENT *st;
+	ssize_t r;
+	char c;
+
+	if(sql_sqlite_poll_(me) < 0)
+	{
+		return NULL;
+	}
+	do
+	{
+		r = read(me->apipe[0], &c, 1);
+	}
+	while(r < 0 && errno == EINTR);
+	pthread_mutex_lock(&(me->amutex));
+	st = me->aresult;
+	me->aresult = NULL;
+	if(me->afailed)
+	{
+		st->api->release(st);
+		st = NULL;
+	}
+	me->astate = SQL_SQLITE_ASYNC_IDLE;
+	pthread_mutex_unlock(&(me->amutex));
+	return st;
+}
+
+/* Return the read end of the completion pipe, starting the worker if it
+ * isn't already running so that the descriptor can be registered with an
+ * event loop before the first query is issued
+ */
+int
+sql_sqlite_socket_(SQL *me)
+{
+	if(!me->hasworker && sql_sqlite_async_start_(me))
+	{
+		return -1;
+	}
+	return me->apipe[0];
+}
+
+/* Stop the worker thread, if any, waiting for it to finish any query which
+ * it is executing; invoked when the connection is freed
+ */
+void
+sql_sqlite_async_stop_(SQL *me)
+{
+	if(!me->hasworker)
+	{
+		return;
+	}
+	pthread_mutex_lock(&(me->amutex));
+	me->aquit = 1;
+	pthread_cond_signal(&(me->acond));
+	pthread_mutex_unlock(&(me->amutex));
+	pthread_join(me->worker, NULL);
+	if(me->aresult)
+	{
+		me->aresult->api->release(me->aresult);
+		me->aresult = NULL;
+	}
+	free(me->aquery);
+	me->aquery = NULL;
+	close(me->apipe[0]);
+	close(me->apipe[1]);
+	pthread_cond_destroy(&(me->acond));
+	pthread_mutex_destroy(&(me->amutex));
+	me->hasworker = 0;
+}
+
+static int
+sql_sqlite_async_start_(SQL *me)
+{
+	if(pipe(me->apipe))
+	{
+		sql_sqlite_set_error_(me, "58000", "Failed to create asynchronous query notification pipe");
+		return -1;
+	}
+	fcntl(me->apipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(me->apipe[1], F_SETFD, FD_CLOEXEC);
+	pthread_mutex_init(&(me->amutex), NULL);
+	pthread_cond_init(&(me->acond), NULL);
+	me->aquit = 0;
+	if(pthread_create(&(me->worker), NULL, sql_sqlite_async_worker_, (void *) me))
+	{
+		pthread_cond_destroy(&(me->acond));
+		pthread_mutex_destroy(&(me->amutex));
+		close(me->apipe[0]);
+		close(me->apipe[1]);
+		sql_sqlite_set_error_(me, "58000", "Failed to create asynchronous query worker thread");
+		return -1;
+	}
+	me->hasworker = 1;
+	return 0;
+}
+
+static void *
+sql_sqlite_async_worker_(void *arg)
+{
+	SQL *me;
+	SQL_STATEMENT *st;
+	char *query;
+	int r;
+
+	me = (SQL *) arg;
+	pthread_mutex_lock(&(me->amutex));
+	for(;;)
+	{
+		while(!me->aquit && !me->aquery)
+		{
+			pthread_cond_wait(&(me->acond), &(me->amutex));
+		}
+		if(me->aquit)
+		{
+			break;
+		}
+		query = me->aquery;
+		st = me->aresult;
+		pthread_mutex_unlock(&(me->amutex));
+		r = sql_sqlite_async_run_(me, st, query);
+		pthread_mutex_lock(&(me->amutex));
+		free(query);
+		me->aquery = NULL;
+		me->afailed = r;
+		me->astate = SQL_SQLITE_ASYNC_DONE;
+		if(write(me->apipe[1], "", 1) < 0)
+		{
+			/* sql_result() will block indefinitely, but there's nothing
+			 * useful which can be done about it
+			 */
+		}
+	}
+	pthread_mutex_unlock(&(me->amutex));
+	return NULL;
+}
+
+/* Execute a query as sql_query() would, bypassing the statement cache */
+static int
+sql_sqlite_async_run_(SQL *restrict me, SQL_STATEMENT *restrict st, const char *restrict query)
+{
+	void *data;
+
+	data = NULL;
+	if(sql_sqlite_execute_(me, query, &data) || st->api->set_results(st, data))
+	{
+		return -1;
+	}
+	return 0;
+}
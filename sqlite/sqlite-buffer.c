@@ -0,0 +1,225 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_sqlite.h"
+
+/* A SQLite statement is a forward-only cursor. If SQL_FLAG_BUFFERED is
+ * set, the rows of a result-set are read in their entirety when it is
+ * executed and copied into a row store: a cell array, indexed by
+ * row * columns + column, holding the storage class and native value of
+ * each value, and a single arena holding the text (or blob) form of every
+ * non-NULL value, which each cell refers to by offset. Once the rows have
+ * been copied, the statement is reset, so that it doesn't keep a read
+ * transaction open. Buffered result-sets can be rewound and seeked, and
+ * the exact row count and column widths are known.
+ *
+ * The row store is retained when the statement is executed again.
+ */
+
+static int sql_sqlite_buffer_row_(SQL_STATEMENT *me);
+
+/* Read the remainder of the result-set into the row store; the first row
+ * must already have been stepped to, unless the result-set is empty
+ */
+int
+sql_sqlite_buffer_load_(SQL_STATEMENT *me)
+{
+	size_t *widths;
+	unsigned long long start;
+	int r;
+
+	me->buffered = 1;
+	me->datalen = 0;
+	me->rows = 0;
+	if(me->columns > me->widthalloc)
+	{
+		widths = (size_t *) sql_realloc_(me->widths, me->columns * sizeof(size_t));
+		if(!widths)
+		{
+			sql_sqlite_set_error_(me->sql, "58000", "Memory allocation error");
+			return -1;
+		}
+		me->widths = widths;
+		me->widthalloc = me->columns;
+	}
+	if(me->columns)
+	{
+		memset(me->widths, 0, me->columns * sizeof(size_t));
+	}
+	/* The first row has already been counted by set_results */
+	start = sql_stats_timer_();
+	r = (me->eof ? SQLITE_DONE : SQLITE_ROW);
+	while(r == SQLITE_ROW)
+	{
+		if(sql_sqlite_buffer_row_(me))
+		{
+			sql_stats_wait_(me->sql, start);
+			sql_sqlite_set_error_(me->sql, "58000", "Memory allocation error");
+			return -1;
+		}
+		r = sqlite3_step(me->stmt);
+	}
+	sql_stats_wait_(me->sql, start);
+	if(me->rows > 1)
+	{
+		sql_stats_rows_(me->sql, me->rows - 1, 0);
+	}
+	if(r != SQLITE_DONE)
+	{
+		sql_sqlite_set_errcode_(me->sql, r);
+		return -1;
+	}
+	sqlite3_reset(me->stmt);
+	me->cur = 0;
+	me->eof = (me->rows == 0);
+	return 0;
+}
+
+/* Return the cell for a column in the current row, or NULL if there isn't
+ * a current row
+ */
+const SQL_SQLITE_CELL *
+sql_sqlite_buffer_cell_(SQL_STATEMENT *me, unsigned int col)
+{
+	if(me->eof || me->cur >= me->rows || col >= (unsigned int) me->columns)
+	{
+		return NULL;
+	}
+	return &(me->cells[me->cur * me->columns + col]);
+}
+
+/* Return the text form of a cell, which is NUL-terminated, or NULL if
+ * the value is NULL
+ */
+const char *
+sql_sqlite_buffer_text_(SQL_STATEMENT *restrict me, const SQL_SQLITE_CELL *restrict cell)
+{
+	if(!cell || cell->type == SQLITE_NULL)
+	{
+		return NULL;
+	}
+	return &(me->data[cell->offset]);
+}
+
+/* Free the row store of a statement */
+void
+sql_sqlite_buffer_free_(SQL_STATEMENT *me)
+{
+	sql_free_(me->cells);
+	sql_free_(me->data);
+	sql_free_(me->widths);
+	me->cells = NULL;
+	me->data = NULL;
+	me->widths = NULL;
+	me->cellalloc = 0;
+	me->dataalloc = 0;
+	me->datalen = 0;
+	me->widthalloc = 0;
+	me->buffered = 0;
+}
+
+/* Append the current row to the row store */
+static int
+sql_sqlite_buffer_row_(SQL_STATEMENT *me)
+{
+	SQL_SQLITE_CELL *cells, *cell;
+	const void *p;
+	size_t needed, alloc;
+	char *data;
+	int c;
+
+	needed = (me->rows + 1) * me->columns;
+	if(needed > me->cellalloc)
+	{
+		alloc = (me->cellalloc ? me->cellalloc * 2 : 64);
+		while(alloc < needed)
+		{
+			alloc *= 2;
+		}
+		cells = (SQL_SQLITE_CELL *) sql_realloc_(me->cells, alloc * sizeof(SQL_SQLITE_CELL));
+		if(!cells)
+		{
+			return -1;
+		}
+		me->cells = cells;
+		me->cellalloc = alloc;
+	}
+	cell = &(me->cells[me->rows * me->columns]);
+	for(c = 0; c < me->columns; c++, cell++)
+	{
+		/* The storage class and native value must be obtained before the
+		 * text form, as the conversion can change them
+		 */
+		cell->type = sqlite3_column_type(me->stmt, c);
+		cell->offset = 0;
+		cell->len = 0;
+		switch(cell->type)
+		{
+		case SQLITE_NULL:
+			continue;
+		case SQLITE_INTEGER:
+			cell->native.ival = sqlite3_column_int64(me->stmt, c);
+			p = sqlite3_column_text(me->stmt, c);
+			break;
+		case SQLITE_FLOAT:
+			cell->native.dval = sqlite3_column_double(me->stmt, c);
+			p = sqlite3_column_text(me->stmt, c);
+			break;
+		case SQLITE_BLOB:
+			p = sqlite3_column_blob(me->stmt, c);
+			break;
+		default:
+			p = sqlite3_column_text(me->stmt, c);
+		}
+		cell->len = sqlite3_column_bytes(me->stmt, c);
+		needed = me->datalen + cell->len + 1;
+		if(needed > me->dataalloc)
+		{
+			alloc = (me->dataalloc ? me->dataalloc * 2 : 1024);
+			while(alloc < needed)
+			{
+				alloc *= 2;
+			}
+			data = (char *) sql_realloc_(me->data, alloc);
+			if(!data)
+			{
+				return -1;
+			}
+			me->data = data;
+			me->dataalloc = alloc;
+		}
+		cell->offset = me->datalen;
+		if(cell->len)
+		{
+			memcpy(&(me->data[me->datalen]), p, cell->len);
+		}
+		me->data[me->datalen + cell->len] = 0;
+		me->datalen += cell->len + 1;
+		if(cell->len > me->widths[c])
+		{
+			me->widths[c] = cell->len;
+		}
+	}
+	me->rows++;
+	return 0;
+}
@@ -0,0 +1,198 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_sqlite.h"
+
+/* There is no bulk-load interface in SQLite, but a single prepared INSERT
+ * executed repeatedly within one transaction is nearly as fast
+ */
+long long
+sql_sqlite_bulk_insert_(SQL *restrict me, const char *restrict table, const char *const *restrict columns, size_t ncolumns, SQL_BULK_ROW fn, void *restrict userdata)
+{
+	sqlite3_stmt *stmt;
+	char *collist, *query, *p;
+	const char **values;
+	long long count;
+	size_t c;
+	int r, txn;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	me->deadlocked = 0;
+	collist = sql_bulk_columns_(columns, ncolumns);
+	values = (const char **) calloc(ncolumns, sizeof(const char *));
+	query = (collist && values) ? (char *) malloc(strlen(table) + strlen(collist) + (ncolumns * 3) + 32) : NULL;
+	if(!query)
+	{
+		free(collist);
+		free(values);
+		sql_sqlite_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	p = query + sprintf(query, "INSERT INTO %s (%s) VALUES (", table, collist);
+	for(c = 0; c < ncolumns; c++)
+	{
+		p += sprintf(p, (c ? ", ?" : "?"));
+	}
+	strcpy(p, ")");
+	free(collist);
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+	r = sqlite3_prepare_v2(me->sqlite, query, -1, &stmt, NULL);
+	free(query);
+	if(r != SQLITE_OK)
+	{
+		sql_sqlite_copy_error_(me);
+		free(values);
+		return -1;
+	}
+	/* If a transaction is already in progress, it's up to the caller to
+	 * commit or roll it back
+	 */
+	txn = 0;
+	if(!me->depth)
+	{
+		if(sql_sqlite_begin_(me, SQL_TXN_DEFAULT))
+		{
+			sqlite3_finalize(stmt);
+			free(values);
+			return -1;
+		}
+		txn = 1;
+	}
+	count = 0;
+	for(;;)
+	{
+		r = fn(me, values, userdata);
+		if(r <= 0)
+		{
+			if(r < 0)
+			{
+				sql_sqlite_set_error_(me, "HY008", "Bulk insert was aborted");
+			}
+			break;
+		}
+		for(c = 0; c < ncolumns; c++)
+		{
+			if(values[c])
+			{
+				sqlite3_bind_text(stmt, c + 1, values[c], -1, SQLITE_STATIC);
+			}
+			else
+			{
+				sqlite3_bind_null(stmt, c + 1);
+			}
+		}
+		if(sqlite3_step(stmt) != SQLITE_DONE)
+		{
+			sql_sqlite_copy_error_(me);
+			r = -1;
+			break;
+		}
+		sqlite3_reset(stmt);
+		count++;
+	}
+	sqlite3_finalize(stmt);
+	free(values);
+	if(r < 0)
+	{
+		if(txn)
+		{
+			sql_sqlite_rollback_(me);
+		}
+		return -1;
+	}
+	if(txn && sql_sqlite_commit_(me))
+	{
+		return -1;
+	}
+	return count;
+}
+
+/* Export the results of a query by stepping through them directly */
+long long
+sql_sqlite_export_(SQL *restrict me, const char *restrict query, SQL_EXPORT_FORMAT format, SQL_EXPORT_BUFFER *restrict buf)
+{
+	sqlite3_stmt *stmt;
+	long long count;
+	int r, c, ncolumns;
+
+	if(format == SQL_EXPORT_BINARY)
+	{
+		sql_sqlite_set_error_(me, "0A000", "Binary export is not supported by this engine");
+		return -1;
+	}
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	me->deadlocked = 0;
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+	if(sqlite3_prepare_v2(me->sqlite, query, -1, &stmt, NULL) != SQLITE_OK)
+	{
+		sql_sqlite_copy_error_(me);
+		return -1;
+	}
+	ncolumns = sqlite3_column_count(stmt);
+	count = 0;
+	while((r = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		for(c = 0; c < ncolumns; c++)
+		{
+			if(sqlite3_column_type(stmt, c) == SQLITE_NULL)
+			{
+				r = sql_export_value_(buf, c, NULL, 0);
+			}
+			else
+			{
+				r = sql_export_value_(buf, c, (const char *) sqlite3_column_text(stmt, c), sqlite3_column_bytes(stmt, c));
+			}
+			if(r)
+			{
+				break;
+			}
+		}
+		if(r || sql_export_eol_(buf))
+		{
+			sqlite3_finalize(stmt);
+			return -1;
+		}
+		count++;
+	}
+	sql_stats_rows_(me, count, 0);
+	if(r != SQLITE_DONE)
+	{
+		sql_sqlite_copy_error_(me);
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_finalize(stmt);
+	return count;
+}
@@ -34,6 +34,7 @@ int
 sql_sqlite_connect_(SQL *me, URI *uri)
 {
 	URI_INFO *info;
+	unsigned long long start;
 	int r;
 
 	info = uri_info(uri);
@@ -47,7 +48,9 @@ sql_sqlite_connect_(SQL *me, URI *uri)
 		sql_sqlite_set_error_(me, "X000", "No database path provided in connection URI");
 		return -1;
 	}
+	start = sql_stats_timer_();
 	r = sqlite3_open_v2(info->path, &(me->sqlite), SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, NULL);
+	sql_stats_wait_(me, start);
 	uri_info_destroy(info);
 	if(r != SQLITE_OK)
 	{
@@ -85,6 +88,7 @@ sql_sqlite_set_error_(SQL *restrict me, const char *restrict sqlstate, const cha
 		message = sqlstate;
 	}
 	strncpy(me->error, message, sizeof(me->error) - 1);
+	sql_stats_error_(me, me->sqlstate);
 	if(me->errorlog)
 	{
 		me->errorlog(me, me->sqlstate, me->error);
@@ -106,6 +110,15 @@ sql_sqlite_set_errcode_(SQL *me, int errcode)
 	sql_sqlite_set_error_(me, sqlstate, sqlite3_errstr(errcode));
 }
 
+/* There is no server connection to lose */
+int
+sql_sqlite_ping_(SQL *me)
+{
+	(void) me;
+
+	return 0;
+}
+
 size_t
 sql_sqlite_escape_(SQL *restrict me, const unsigned char *restrict from, size_t length, char *restrict buf, size_t buflen)
 {
@@ -26,8 +26,33 @@
 #include "p_sqlite.h"
 
 static void engine_alloc(void);
+static void sqlite_config_alloc(void);
+static void *sqlite_mem_malloc(int size);
+static void sqlite_mem_free(void *ptr);
+static void *sqlite_mem_realloc(void *ptr, int size);
+static int sqlite_mem_size(void *ptr);
+static int sqlite_mem_roundup(int size);
+static int sqlite_mem_init(void *data);
+static void sqlite_mem_shutdown(void *data);
 
 static pthread_once_t engine_control = PTHREAD_ONCE_INIT;
+static pthread_once_t config_control = PTHREAD_ONCE_INIT;
+
+/* SQLite needs to be able to determine the size of an allocation, which
+ * is stored in a header preceding it
+ */
+#define SQLITE_MEM_HEADER              16
+
+static const sqlite3_mem_methods sqlite_mem_methods = {
+	sqlite_mem_malloc,
+	sqlite_mem_free,
+	sqlite_mem_realloc,
+	sqlite_mem_size,
+	sqlite_mem_roundup,
+	sqlite_mem_init,
+	sqlite_mem_shutdown,
+	NULL
+};
 
 static SQL_ENGINE *engine;
 
@@ -65,6 +90,19 @@ static SQL_API sqlite_api = {
 	sql_sqlite_variant_,
 	sql_sqlite_set_userdata_,
 	sql_sqlite_userdata_,
+	sql_sqlite_set_error_,
+	sql_sqlite_execute_batch_,
+	sql_sqlite_execute_script_,
+	sql_sqlite_bulk_insert_,
+	sql_sqlite_export_,
+	sql_sqlite_query_foreach_,
+	sql_sqlite_ping_,
+	sql_sqlite_query_async_,
+	sql_sqlite_poll_,
+	sql_sqlite_result_,
+	sql_sqlite_socket_,
+	sql_def_cacheable_,
+	sql_sqlite_affected_
 };
 
 SQL_ENGINE *
@@ -94,11 +132,24 @@ sql_engine_sqlite_create_(SQL_ENGINE *me)
 
 	(void) me;
 
-	inst = (SQL *) calloc(1, sizeof(SQL));
+	if(sql_allocator_lock_())
+	{
+		pthread_once(&config_control, sqlite_config_alloc);
+	}
+	inst = (SQL *) sql_calloc_(1, sizeof(SQL));
 	if(!inst)
 	{
 		return NULL;
 	}
+	inst->stmtslab = sql_slab_create_(sizeof(SQL_STATEMENT));
+	inst->fieldslab = sql_slab_create_(sizeof(SQL_FIELD));
+	if(!inst->stmtslab || !inst->fieldslab)
+	{
+		sql_slab_destroy_(inst->stmtslab);
+		sql_slab_destroy_(inst->fieldslab);
+		sql_free_(inst);
+		return NULL;
+	}
 	inst->api = &sqlite_api;
 	inst->refcount = 1;
 	strcpy(inst->sqlstate, "0000");
@@ -115,6 +166,13 @@ sql_sqlite_free_(SQL *me)
 	{
 		return me->refcount;
 	}
+	sql_sqlite_async_stop_(me);
+	sql_logger_detach_(me);
+	sql_stats_detach_(me);
+	sql_cache_destroy_(me->cache);
+	sql_formatter_destroy_(me->formatter);
+	sql_slab_destroy_(me->stmtslab);
+	sql_slab_destroy_(me->fieldslab);
 	pthread_mutex_destroy(&(me->lock));
 	if(me->sqlite)
 	{
@@ -122,7 +180,7 @@ sql_sqlite_free_(SQL *me)
 		me->sqlite = NULL;
 	}
 	free(me->qbuf);
-	free(me);
+	sql_free_(me);
 	return 0;
 }
 
@@ -139,3 +197,87 @@ sql_sqlite_userdata_(SQL *me)
 	return me->userdata;
 }
 
+/* Configure SQLite to use the allocator passed to sql_set_allocator(); this
+ * has no effect if SQLite has already been initialised, in which case it
+ * continues to use its own
+ */
+static void
+sqlite_config_alloc(void)
+{
+	sqlite3_config(SQLITE_CONFIG_MALLOC, &sqlite_mem_methods);
+}
+
+static void *
+sqlite_mem_malloc(int size)
+{
+	char *p;
+
+	if(size <= 0)
+	{
+		return NULL;
+	}
+	p = (char *) sql_malloc_(SQLITE_MEM_HEADER + size);
+	if(!p)
+	{
+		return NULL;
+	}
+	*((size_t *) (void *) p) = size;
+	return p + SQLITE_MEM_HEADER;
+}
+
+static void
+sqlite_mem_free(void *ptr)
+{
+	if(ptr)
+	{
+		sql_free_((char *) ptr - SQLITE_MEM_HEADER);
+	}
+}
+
+static void *
+sqlite_mem_realloc(void *ptr, int size)
+{
+	char *p;
+
+	if(!ptr)
+	{
+		return sqlite_mem_malloc(size);
+	}
+	p = (char *) sql_realloc_((char *) ptr - SQLITE_MEM_HEADER, SQLITE_MEM_HEADER + size);
+	if(!p)
+	{
+		return NULL;
+	}
+	*((size_t *) (void *) p) = size;
+	return p + SQLITE_MEM_HEADER;
+}
+
+static int
+sqlite_mem_size(void *ptr)
+{
+	if(!ptr)
+	{
+		return 0;
+	}
+	return (int) *((size_t *) (void *) ((char *) ptr - SQLITE_MEM_HEADER));
+}
+
+static int
+sqlite_mem_roundup(int size)
+{
+	return (size + 7) & ~7;
+}
+
+static int
+sqlite_mem_init(void *data)
+{
+	(void) data;
+
+	return SQLITE_OK;
+}
+
+static void
+sqlite_mem_shutdown(void *data)
+{
+	(void) data;
+}
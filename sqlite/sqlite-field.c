@@ -30,7 +30,8 @@ SQL_FIELD_API sql_sqlite_field_api_ = {
 	sql_field_def_addref_,
 	sql_field_sqlite_free_,
 	sql_field_sqlite_name_,
-	sql_field_sqlite_width_
+	sql_field_sqlite_width_,
+	sql_field_sqlite_type_
 };
 
 /* Free a SQL_FIELD structure */
@@ -42,7 +43,7 @@ sql_field_sqlite_free_(SQL_FIELD *me)
 	{
 		return me->refcount;
 	}
-	free(me);
+	sql_slab_free_(me->slab, me);
 	return 0;
 }
 
@@ -53,9 +54,87 @@ sql_field_sqlite_name_(SQL_FIELD *me)
 	return sqlite3_column_name(me->stmt->stmt, me->index);
 }
 
-/* Return the maximum width (i.e., number of characters) for this column */
+/* Return the maximum width (i.e., number of characters) for this column,
+ * which is only known if the result-set is buffered
+ */
 size_t
 sql_field_sqlite_width_(SQL_FIELD *me)
 {
+	if(me->stmt && me->stmt->buffered)
+	{
+		return me->stmt->widths[me->index];
+	}
 	return 1;
 }
+
+/* Return the type of the column, based upon its declared type where there
+ * is one (following SQLite's column affinity rules, with the addition of
+ * booleans and date/time types), or the storage class of the value in the
+ * current row otherwise
+ */
+SQL_FIELD_TYPE
+sql_field_sqlite_type_(SQL_FIELD *me)
+{
+	const SQL_SQLITE_CELL *cell;
+	const char *decl;
+	int type;
+
+	if(!me->stmt || !me->stmt->stmt)
+	{
+		return SQL_TYPE_UNKNOWN;
+	}
+	decl = sqlite3_column_decltype(me->stmt->stmt, me->index);
+	if(decl && *decl)
+	{
+		if(!sqlite3_strlike("%BOOL%", decl, 0))
+		{
+			return SQL_TYPE_BOOLEAN;
+		}
+		if(!sqlite3_strlike("%DATE%", decl, 0) || !sqlite3_strlike("%TIME%", decl, 0))
+		{
+			return SQL_TYPE_TIMESTAMP;
+		}
+		if(!sqlite3_strlike("%INT%", decl, 0))
+		{
+			return SQL_TYPE_INTEGER;
+		}
+		if(!sqlite3_strlike("%CHAR%", decl, 0) || !sqlite3_strlike("%CLOB%", decl, 0) || !sqlite3_strlike("%TEXT%", decl, 0))
+		{
+			return SQL_TYPE_TEXT;
+		}
+		if(!sqlite3_strlike("%BLOB%", decl, 0))
+		{
+			return SQL_TYPE_BLOB;
+		}
+		if(!sqlite3_strlike("%REAL%", decl, 0) || !sqlite3_strlike("%FLOA%", decl, 0) || !sqlite3_strlike("%DOUB%", decl, 0))
+		{
+			return SQL_TYPE_REAL;
+		}
+		return SQL_TYPE_NUMERIC;
+	}
+	if(me->stmt->eof)
+	{
+		return SQL_TYPE_UNKNOWN;
+	}
+	if(me->stmt->buffered)
+	{
+		cell = sql_sqlite_buffer_cell_(me->stmt, me->index);
+		type = (cell ? cell->type : SQLITE_NULL);
+	}
+	else
+	{
+		type = sqlite3_column_type(me->stmt->stmt, me->index);
+	}
+	switch(type)
+	{
+	case SQLITE_INTEGER:
+		return SQL_TYPE_INTEGER;
+	case SQLITE_FLOAT:
+		return SQL_TYPE_REAL;
+	case SQLITE_TEXT:
+		return SQL_TYPE_TEXT;
+	case SQLITE_BLOB:
+		return SQL_TYPE_BLOB;
+	}
+	return SQL_TYPE_UNKNOWN;
+}
@@ -28,9 +28,11 @@
 int
 sql_sqlite_execute_(SQL *restrict me, const char *restrict statement, void *restrict *restrict resultdata)
 {
-	int r;
+	int r, total;
 	sqlite3_stmt *stmt;
+	unsigned long long start;
 
+	me->affected = 0;
 	if(me->depth && me->deadlocked)
 	{
 		/* If we're already deadlocked mid-transaction, there's no point in
@@ -44,32 +46,192 @@ sql_sqlite_execute_(SQL *restrict me, const char *restrict statement, void *rest
 		me->querylog(me, statement);
 	}
 	stmt = NULL;
+	start = sql_stats_timer_();
 	r = sqlite3_prepare_v2(me->sqlite, statement, strlen(statement), &stmt, NULL);
 	if(r != SQLITE_OK)
 	{		
+		sql_stats_wait_(me, start);
 		sql_sqlite_copy_error_(me);
 		return -1;
 	}	
 	if(resultdata)
 	{
+		sql_stats_wait_(me, start);
 		*resultdata = stmt;
 	}
 	else
 	{
+		total = sqlite3_total_changes(me->sqlite);
 		r = sqlite3_step(stmt);
 		sqlite3_finalize(stmt);
+		sql_stats_wait_(me, start);
 		if(r != SQLITE_DONE && r != SQLITE_ROW)
 		{
 			return -1;
 		}
+		/* sqlite3_changes() isn't reset by statements which aren't
+		 * INSERT, UPDATE or DELETE
+		 */
+		if(sqlite3_total_changes(me->sqlite) != total)
+		{
+			me->affected = sqlite3_changes(me->sqlite);
+		}
 	}
 	return 0;
 }
 
+/* Return the number of rows affected by the last statement executed
+ * without a result-set
+ */
+unsigned long long
+sql_sqlite_affected_(SQL *me)
+{
+	return me->affected;
+}
+
+/* Execute each of the statements in a script in turn */
+int
+sql_sqlite_execute_script_(SQL *restrict me, const char *restrict script, unsigned long long *restrict affected, size_t naffected)
+{
+	int r, total, n;
+	sqlite3_stmt *stmt;
+	const char *tail;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	me->deadlocked = 0;
+	n = 0;
+	while(*script)
+	{
+		stmt = NULL;
+		r = sqlite3_prepare_v2(me->sqlite, script, -1, &stmt, &tail);
+		if(r != SQLITE_OK)
+		{
+			sql_sqlite_copy_error_(me);
+			return -1;
+		}
+		script = tail;
+		if(!stmt)
+		{
+			/* Whitespace or a comment */
+			continue;
+		}
+		if(me->querylog)
+		{
+			me->querylog(me, sqlite3_sql(stmt));
+		}
+		total = sqlite3_total_changes(me->sqlite);
+		do
+		{
+			r = sqlite3_step(stmt);
+		}
+		while(r == SQLITE_ROW);
+		if(r != SQLITE_DONE)
+		{
+			sql_sqlite_copy_error_(me);
+			sqlite3_finalize(stmt);
+			return -1;
+		}
+		sqlite3_finalize(stmt);
+		if((size_t) n < naffected)
+		{
+			/* sqlite3_changes() isn't reset by statements which aren't
+			 * INSERT, UPDATE or DELETE
+			 */
+			affected[n] = (sqlite3_total_changes(me->sqlite) != total) ? sqlite3_changes(me->sqlite) : 0;
+		}
+		n++;
+	}
+	return n;
+}
+
+/* Execute a batch of statements; there are no round-trips to save, so this
+ * is the same as executing each as a script
+ */
+int
+sql_sqlite_execute_batch_(SQL *restrict me, const char *const *restrict statements, size_t count, unsigned long long *restrict affected)
+{
+	size_t c;
+
+	for(c = 0; c < count; c++)
+	{
+		if(sql_sqlite_execute_script_(me, statements[c], (affected ? &(affected[c]) : NULL), (affected ? 1 : 0)) < 0)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Execute a query, stepping through its rows and passing each to a
+ * callback
+ */
+long long
+sql_sqlite_query_foreach_(SQL *restrict me, const char *restrict query, SQL_ROW_FN fn, void *restrict userdata)
+{
+	sqlite3_stmt *stmt;
+	SQL_CELL *cells;
+	long long count;
+	int r, c, ncols, stop;
+
+	if(me->depth && me->deadlocked)
+	{
+		return -1;
+	}
+	me->deadlocked = 0;
+	if(me->querylog)
+	{
+		me->querylog(me, query);
+	}
+	if(sqlite3_prepare_v2(me->sqlite, query, -1, &stmt, NULL) != SQLITE_OK)
+	{
+		sql_sqlite_copy_error_(me);
+		return -1;
+	}
+	ncols = sqlite3_column_count(stmt);
+	cells = (SQL_CELL *) calloc(ncols + 1, sizeof(SQL_CELL));
+	if(!cells)
+	{
+		sqlite3_finalize(stmt);
+		sql_sqlite_set_error_(me, "58000", "Memory allocation error");
+		return -1;
+	}
+	count = 0;
+	stop = 0;
+	while(!stop && (r = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		for(c = 0; c < ncols; c++)
+		{
+			cells[c].null = (sqlite3_column_type(stmt, c) == SQLITE_NULL);
+			cells[c].ptr = cells[c].null ? NULL : (const char *) sqlite3_column_text(stmt, c);
+			cells[c].len = cells[c].null ? 0 : sqlite3_column_bytes(stmt, c);
+		}
+		count++;
+		stop = fn(me, cells, ncols, userdata);
+	}
+	free(cells);
+	sql_stats_rows_(me, count, 0);
+	if(stop < 0)
+	{
+		sql_sqlite_set_error_(me, "HY008", "Query was aborted");
+	}
+	else if(!stop && r != SQLITE_DONE)
+	{
+		sql_sqlite_copy_error_(me);
+		stop = -1;
+	}
+	sqlite3_finalize(stmt);
+	return (stop < 0) ? -1 : count;
+}
+
 int
 sql_sqlite_begin_(SQL *me, SQL_TXN_MODE mode)
 {
 	const char *st;
+	unsigned long long start;
+	int r;
 	
 	(void) mode;
 
@@ -84,7 +246,10 @@ sql_sqlite_begin_(SQL *me, SQL_TXN_MODE mode)
 	{
 		me->querylog(me, st);
 	}
-	if(sqlite3_exec(me->sqlite, st, NULL, NULL, NULL) != SQLITE_OK)
+	start = sql_stats_timer_();
+	r = sqlite3_exec(me->sqlite, st, NULL, NULL, NULL);
+	sql_stats_wait_(me, start);
+	if(r != SQLITE_OK)
 	{
 		sql_sqlite_copy_error_(me);
 		return -1;
@@ -97,6 +262,8 @@ int
 sql_sqlite_commit_(SQL *me)
 {
 	const char *st = "COMMIT";
+	unsigned long long start;
+	int r;
 	
 	if(!me->depth)
 	{
@@ -110,7 +277,10 @@ sql_sqlite_commit_(SQL *me)
 	{
 		me->querylog(me, st);
 	}
-	if(sqlite3_exec(me->sqlite, st, NULL, NULL, NULL) != SQLITE_OK)
+	start = sql_stats_timer_();
+	r = sqlite3_exec(me->sqlite, st, NULL, NULL, NULL);
+	sql_stats_wait_(me, start);
+	if(r != SQLITE_OK)
 	{
 		sql_sqlite_copy_error_(me);
 		return -1;
@@ -123,6 +293,8 @@ int
 sql_sqlite_rollback_(SQL *me)	
 {
 	const char *st = "ROLLBACK";
+	unsigned long long start;
+	int r;
 	
 	if(!me->depth)
 	{
@@ -132,7 +304,10 @@ sql_sqlite_rollback_(SQL *me)
 	{
 		me->querylog(me, st);
 	}
-	if(sqlite3_exec(me->sqlite, st, NULL, NULL, NULL) != SQLITE_OK)
+	start = sql_stats_timer_();
+	r = sqlite3_exec(me->sqlite, st, NULL, NULL, NULL);
+	sql_stats_wait_(me, start);
+	if(r != SQLITE_OK)
 	{
 		sql_sqlite_copy_error_(me);
 		if(me->deadlocked)
@@ -44,29 +44,47 @@ static SQL_STATEMENT_API sqlite_statement_api = {
 	sql_statement_sqlite_next_,
 	sql_statement_sqlite_cur_,
 	sql_statement_sqlite_rewind_,
-	sql_statement_sqlite_seek_
+	sql_statement_sqlite_seek_,
+	sql_statement_sqlite_execute_,
+	sql_statement_sqlite_reset_,
+	sql_statement_sqlite_int64_,
+	sql_statement_sqlite_real_,
+	sql_statement_sqlite_boolean_,
+	sql_statement_sqlite_blob_,
+	sql_statement_sqlite_fetch_batch_,
+	sql_statement_sqlite_row_,
+	sql_statement_sqlite_scanstatus_
 };
 
+static void sql_statement_sqlite_release_fields_(SQL_STATEMENT *me);
+
 /* Create a new statement or result-set */
 SQL_STATEMENT *
 sql_sqlite_statement_(SQL *restrict me, const char *restrict statement)
 {
 	SQL_STATEMENT *p;
+	unsigned long long start;
+	int r;
 
-	p = (SQL_STATEMENT *) calloc(1, sizeof(SQL_STATEMENT));
+	p = (SQL_STATEMENT *) sql_slab_alloc_(me->stmtslab);
 	if(!p)
 	{
 		return NULL;
 	}
+	p->slab = me->stmtslab;
 	p->api = &sqlite_statement_api;
 	p->refcount = 1;
 	p->sql = me;
 	p->cur = (unsigned long long) -1;
 	if(statement)
 	{
-		if(sqlite3_prepare_v2(me->sqlite, statement, strlen(statement), &(p->stmt), NULL) != SQLITE_OK)
+		start = sql_stats_timer_();
+		r = sqlite3_prepare_v2(me->sqlite, statement, strlen(statement), &(p->stmt), NULL);
+		sql_stats_wait_(me, start);
+		if(r != SQLITE_OK)
 		{
-			free(p);
+			sql_sqlite_copy_error_(me);
+			sql_slab_free_(p->slab, p);
 			return NULL;
 		}
 	}
@@ -77,8 +95,6 @@ sql_sqlite_statement_(SQL *restrict me, const char *restrict statement)
 unsigned long
 sql_statement_sqlite_free_(SQL_STATEMENT *me)
 {
-	size_t c;
-
 	me->refcount--;
 	if(me->refcount)
 	{
@@ -88,19 +104,11 @@ sql_statement_sqlite_free_(SQL_STATEMENT *me)
 	{
 		sqlite3_finalize(me->stmt);
 	}
-	if(me->fields)
-	{
-		for(c = 0; me->fields[c]; c++)
-		{
-			if(me->fields[c])
-			{
-				me->fields[c]->stmt = NULL;
-				me->fields[c]->api->release(me->fields[c]);
-			}
-		}
-		free(me->fields);
-	}
-	free(me);
+	sql_statement_sqlite_release_fields_(me);
+	sql_free_(me->fields);
+	sql_sqlite_buffer_free_(me);
+	sql_template_destroy_(me->tmpl);
+	sql_slab_free_(me->slab, me);
 	return 0;
 }
 
@@ -122,27 +130,26 @@ sql_statement_sqlite_statement_(SQL_STATEMENT *me)
 int
 sql_statement_sqlite_set_results_(SQL_STATEMENT *restrict me, void *data)
 {
-	int r, i;
-	size_t c;
+	SQL_FIELD **fields;
+	unsigned long long start;
+	int r;
 
 	if(me->stmt && me->stmt != (sqlite3_stmt *) data)
 	{
 		sqlite3_finalize(me->stmt);
+		sql_statement_sqlite_release_fields_(me);
 	}
-	if(me->fields)
+	else if(data && sqlite3_column_count((sqlite3_stmt *) data) != me->columns)
 	{
-		for(c = 0; me->fields[c]; c++)
-		{
-			me->fields[c]->stmt = NULL;
-			me->fields[c]->api->release(me->fields[c]);
-		}
-		me->fields = NULL;
+		sql_statement_sqlite_release_fields_(me);
 	}
+	/* When a statement is re-executed, its fields remain valid */
 	me->stmt = (sqlite3_stmt *) data;
 	me->cur = (unsigned long long) -1;
 	me->eof = 0;
 	me->rows = 0;
 	me->affected = 0;
+	me->buffered = 0;
 	if(me->stmt)
 	{
 		me->columns = sqlite3_column_count(me->stmt);
@@ -151,26 +158,22 @@ sql_statement_sqlite_set_results_(SQL_STATEMENT *restrict me, void *data)
 			/* XXX can this happen? */
 			return -1;
 		}
-		me->fields = (SQL_FIELD **) calloc(me->columns + 1, sizeof(SQL_FIELD *));
-		if(!me->fields)
+		if(me->columns > me->nfields)
 		{
-			/* XXX memory allocation failure */
-			return -1;
-		}
-		for(i = 0; i < me->columns; i++)
-		{
-			me->fields[i] = (SQL_FIELD *) calloc(1, sizeof(SQL_FIELD));
-			if(!me->fields[i])
+			fields = (SQL_FIELD **) sql_realloc_(me->fields, me->columns * sizeof(SQL_FIELD *));
+			if(!fields)
 			{
-				/* XXX memory allocation failure */
+				sql_sqlite_set_error_(me->sql, "58000", "Memory allocation error");
+				me->columns = 0;
 				return -1;
 			}
-			me->fields[i]->api = &sql_sqlite_field_api_;
-			me->fields[i]->refcount = 1;
-			me->fields[i]->index = i;
-			me->fields[i]->stmt = me;
+			memset(&(fields[me->nfields]), 0, (me->columns - me->nfields) * sizeof(SQL_FIELD *));
+			me->fields = fields;
+			me->nfields = me->columns;
 		}
+		start = sql_stats_timer_();
 		r = sqlite3_step(me->stmt);
+		sql_stats_wait_(me->sql, start);
 		if(r == SQLITE_DONE)
 		{
 			me->affected = sqlite3_changes(me->sql->sqlite);
@@ -184,7 +187,13 @@ sql_statement_sqlite_set_results_(SQL_STATEMENT *restrict me, void *data)
 		else
 		{
 			me->affected = sqlite3_changes(me->sql->sqlite);
-			me->rows++;
+			me->cur = 0;
+			me->rows = 1;
+			sql_stats_rows_(me->sql, 1, 0);
+		}
+		if(me->columns && (me->sql->flags & SQL_FLAG_BUFFERED) && !(me->sql->flags & SQL_FLAG_STREAM))
+		{
+			return sql_sqlite_buffer_load_(me);
 		}
 	}
 	else
@@ -195,6 +204,72 @@ sql_statement_sqlite_set_results_(SQL_STATEMENT *restrict me, void *data)
 	return 0;
 }
 
+/* Bind parameters to a prepared statement and execute it */
+int
+sql_statement_sqlite_execute_(SQL_STATEMENT *restrict me, unsigned int nparams, const SQL_PARAM *restrict params)
+{
+	SQL *sql;
+	unsigned int c;
+	char nbuf[32];
+	int r;
+
+	sql = me->sql;
+	if(!me->stmt)
+	{
+		sql_sqlite_set_error_(sql, "HY010", "The statement has not been prepared");
+		return -1;
+	}
+	if(sql->depth && sql->deadlocked)
+	{
+		return -1;
+	}
+	sql->deadlocked = 0;
+	if(sql->querylog)
+	{
+		sql->querylog(sql, sqlite3_sql(me->stmt));
+	}
+	sqlite3_reset(me->stmt);
+	sqlite3_clear_bindings(me->stmt);
+	for(c = 0; c < nparams; c++)
+	{
+		switch(params[c].type)
+		{
+		case SQL_PARAM_NULL:
+			r = sqlite3_bind_null(me->stmt, c + 1);
+			break;
+		case SQL_PARAM_INT:
+			r = sqlite3_bind_int64(me->stmt, c + 1, params[c].ival);
+			break;
+		case SQL_PARAM_UINT:
+			if(params[c].uval > (unsigned long long) LLONG_MAX)
+			{
+				/* SQLite has no unsigned 64-bit storage class */
+				snprintf(nbuf, sizeof(nbuf), "%llu", params[c].uval);
+				r = sqlite3_bind_text(me->stmt, c + 1, nbuf, -1, SQLITE_TRANSIENT);
+			}
+			else
+			{
+				r = sqlite3_bind_int64(me->stmt, c + 1, (sqlite3_int64) params[c].uval);
+			}
+			break;
+		case SQL_PARAM_DOUBLE:
+			r = sqlite3_bind_double(me->stmt, c + 1, params[c].dval);
+			break;
+		case SQL_PARAM_TEXT:
+			r = sqlite3_bind_text(me->stmt, c + 1, params[c].sval, params[c].slen, SQLITE_TRANSIENT);
+			break;
+		default:
+			r = SQLITE_MISUSE;
+		}
+		if(r != SQLITE_OK)
+		{
+			sql_sqlite_copy_error_(sql);
+			return -1;
+		}
+	}
+	return sql_statement_sqlite_set_results_(me, me->stmt);
+}
+
 /* Return the number of columns in the result-set */
 unsigned int
 sql_statement_sqlite_columns_(SQL_STATEMENT *me)
@@ -229,10 +304,23 @@ sql_statement_sqlite_next_(SQL_STATEMENT *me)
 {
 	int r;
 
-	if(!me->stmt)
+	/* Stepping a statement which has finished would execute it again */
+	if(!me->stmt || me->eof)
 	{
 		return 0;
 	}
+	if(me->buffered)
+	{
+		me->cur++;
+		if(me->cur >= me->rows)
+		{
+			me->cur = me->rows;
+			me->eof = 1;
+			return 0;
+		}
+		return 1;
+	}
+	/* Rows are counted, but individual steps are not timed */
 	r = sqlite3_step(me->stmt);
 	if(r == SQLITE_DONE)
 	{
@@ -242,10 +330,8 @@ sql_statement_sqlite_next_(SQL_STATEMENT *me)
 	if(r == SQLITE_ROW)
 	{
 		me->cur++;
-		if(me->cur >= me->rows)
-		{
-			me->rows = me->cur + 1;
-		}
+		me->rows = me->cur + 1;
+		sql_stats_rows_(me->sql, 1, 0);
 		return 1;
 	}
 	sql_sqlite_set_errcode_(me->sql, r);
@@ -256,9 +342,11 @@ sql_statement_sqlite_next_(SQL_STATEMENT *me)
 size_t
 sql_statement_sqlite_value_(SQL_STATEMENT *restrict me, unsigned int col, char *restrict buf, size_t buflen)
 {
+	const SQL_SQLITE_CELL *cell;
 	const unsigned char *t;
+	size_t len;
 
-	if(buf)
+	if(buf && buflen)
 	{
 		*buf = 0;
 	}
@@ -266,18 +354,33 @@ sql_statement_sqlite_value_(SQL_STATEMENT *restrict me, unsigned int col, char *
 	{
 		return 0;
 	}
-	t = sqlite3_column_text(me->stmt, col);
-	if(!t)
+	if(me->buffered)
 	{
-		return 1;
+		cell = sql_sqlite_buffer_cell_(me, col);
+		t = (const unsigned char *) sql_sqlite_buffer_text_(me, cell);
+		if(!t)
+		{
+			return 1;
+		}
+		len = cell->len;
+	}
+	else
+	{
+		t = sqlite3_column_text(me->stmt, col);
+		if(!t)
+		{
+			return 1;
+		}
+		/* SQLite already knows the length of the value */
+		len = sqlite3_column_bytes(me->stmt, col);
 	}
-	if(buf)
+	if(buf && buflen)
 	{
 		/* buflen includes the NULL terminator */
-		strncpy(buf, (const char *) t, buflen);
-		buf[buflen - 1] = 0;
+		memcpy(buf, t, (len < buflen ? len : buflen - 1));
+		buf[(len < buflen ? len : buflen - 1)] = 0;
 	}
-	return strlen((const char *) t) + 1;
+	return len + 1;
 }
 
 /* Retrieve a pointer to the first byte in a field, or NULL if the value is NULL */
@@ -288,6 +391,10 @@ sql_statement_sqlite_valueptr_(SQL_STATEMENT *me, unsigned int col)
 	{
 		return NULL;
 	}
+	if(me->buffered)
+	{
+		return (const unsigned char *) sql_sqlite_buffer_text_(me, sql_sqlite_buffer_cell_(me, col));
+	}
 	return sqlite3_column_text(me->stmt, col);
 }
 
@@ -296,10 +403,17 @@ sql_statement_sqlite_valueptr_(SQL_STATEMENT *me, unsigned int col)
 int
 sql_statement_sqlite_null_(SQL_STATEMENT *me, unsigned int col)
 {
+	const SQL_SQLITE_CELL *cell;
+
 	if(me->eof)
 	{
 		return 1;
 	}
+	if(me->buffered)
+	{
+		cell = sql_sqlite_buffer_cell_(me, col);
+		return (!cell || cell->type == SQLITE_NULL);
+	}
 	if(sqlite3_column_type(me->stmt, col) == SQLITE_NULL)
 	{
 		return 1;
@@ -311,13 +425,274 @@ sql_statement_sqlite_null_(SQL_STATEMENT *me, unsigned int col)
 size_t
 sql_statement_sqlite_valuelen_(SQL_STATEMENT *me, unsigned int col)
 {
+	const SQL_SQLITE_CELL *cell;
+
 	if(me->eof)
 	{
 		return 0;
 	}
+	if(me->buffered)
+	{
+		cell = sql_sqlite_buffer_cell_(me, col);
+		return (cell ? cell->len + 1 : 0);
+	}
 	return sqlite3_column_bytes(me->stmt, col) + 1;
 }
 
+/* Retrieve the native value of a column in the current row */
+int64_t
+sql_statement_sqlite_int64_(SQL_STATEMENT *me, unsigned int col)
+{
+	const SQL_SQLITE_CELL *cell;
+
+	if(me->eof)
+	{
+		return 0;
+	}
+	if(me->buffered)
+	{
+		cell = sql_sqlite_buffer_cell_(me, col);
+		if(!cell)
+		{
+			return 0;
+		}
+		switch(cell->type)
+		{
+		case SQLITE_NULL:
+			return 0;
+		case SQLITE_INTEGER:
+			return (int64_t) cell->native.ival;
+		case SQLITE_FLOAT:
+			return (int64_t) cell->native.dval;
+		}
+		return sql_statement_def_int64_(me, col);
+	}
+	return (int64_t) sqlite3_column_int64(me->stmt, col);
+}
+
+double
+sql_statement_sqlite_real_(SQL_STATEMENT *me, unsigned int col)
+{
+	const SQL_SQLITE_CELL *cell;
+
+	if(me->eof)
+	{
+		return 0;
+	}
+	if(me->buffered)
+	{
+		cell = sql_sqlite_buffer_cell_(me, col);
+		if(!cell)
+		{
+			return 0;
+		}
+		switch(cell->type)
+		{
+		case SQLITE_NULL:
+			return 0;
+		case SQLITE_INTEGER:
+			return (double) cell->native.ival;
+		case SQLITE_FLOAT:
+			return cell->native.dval;
+		}
+		return sql_statement_def_real_(me, col);
+	}
+	return sqlite3_column_double(me->stmt, col);
+}
+
+int
+sql_statement_sqlite_boolean_(SQL_STATEMENT *me, unsigned int col)
+{
+	const SQL_SQLITE_CELL *cell;
+
+	if(me->eof)
+	{
+		return 0;
+	}
+	if(me->buffered)
+	{
+		cell = sql_sqlite_buffer_cell_(me, col);
+		if(!cell)
+		{
+			return 0;
+		}
+		switch(cell->type)
+		{
+		case SQLITE_NULL:
+			return 0;
+		case SQLITE_INTEGER:
+			return (cell->native.ival != 0);
+		case SQLITE_FLOAT:
+			return (cell->native.dval != 0);
+		}
+		return sql_statement_def_boolean_(me, col);
+	}
+	switch(sqlite3_column_type(me->stmt, col))
+	{
+	case SQLITE_NULL:
+		return 0;
+	case SQLITE_INTEGER:
+		return (sqlite3_column_int64(me->stmt, col) != 0);
+	case SQLITE_FLOAT:
+		return (sqlite3_column_double(me->stmt, col) != 0);
+	}
+	/* Booleans stored as text, such as 'true' or 't' */
+	return sql_statement_def_boolean_(me, col);
+}
+
+const unsigned char *
+sql_statement_sqlite_blob_(SQL_STATEMENT *restrict me, unsigned int col, size_t *restrict len)
+{
+	const SQL_SQLITE_CELL *cell;
+	const unsigned char *p;
+
+	if(me->eof)
+	{
+		if(len)
+		{
+			*len = 0;
+		}
+		return NULL;
+	}
+	if(me->buffered)
+	{
+		cell = sql_sqlite_buffer_cell_(me, col);
+		p = (const unsigned char *) sql_sqlite_buffer_text_(me, cell);
+		if(len)
+		{
+			*len = (p ? cell->len : 0);
+		}
+		return p;
+	}
+	/* sqlite3_column_bytes() must be called after sqlite3_column_blob() */
+	p = (const unsigned char *) sqlite3_column_blob(me->stmt, col);
+	if(len)
+	{
+		*len = sqlite3_column_bytes(me->stmt, col);
+	}
+	return p;
+}
+
+/* Fetch rows into a batch, using the native values of columns */
+int
+sql_statement_sqlite_fetch_batch_(SQL_STATEMENT *restrict me, size_t max_rows, SQL_BATCH *restrict batch)
+{
+	const unsigned char *p;
+	unsigned int c;
+	size_t len;
+
+	while(batch->rows < max_rows && !me->eof)
+	{
+		for(c = 0; c < batch->ncolumns; c++)
+		{
+			if(sql_statement_sqlite_null_(me, c))
+			{
+				sql_batch_null_(batch, c);
+				continue;
+			}
+			switch(batch->columns[c].type)
+			{
+			case SQL_TYPE_INTEGER:
+				sql_batch_int64_(batch, c, sql_statement_sqlite_int64_(me, c));
+				break;
+			case SQL_TYPE_BOOLEAN:
+				sql_batch_int64_(batch, c, (sql_statement_sqlite_int64_(me, c) != 0));
+				break;
+			case SQL_TYPE_REAL:
+				sql_batch_real_(batch, c, sql_statement_sqlite_real_(me, c));
+				break;
+			case SQL_TYPE_BLOB:
+				p = sql_statement_sqlite_blob_(me, c, &len);
+				if(sql_batch_text_(batch, c, (const char *) p, len))
+				{
+					sql_sqlite_set_error_(me->sql, "58000", "Memory allocation error");
+					return -1;
+				}
+				break;
+			default:
+				p = sql_statement_sqlite_valueptr_(me, c);
+				len = sql_statement_sqlite_valuelen_(me, c) - 1;
+				if(sql_batch_text_(batch, c, (const char *) p, len))
+				{
+					sql_sqlite_set_error_(me->sql, "58000", "Memory allocation error");
+					return -1;
+				}
+			}
+		}
+		batch->rows++;
+		if(sql_statement_sqlite_next_(me) < 0)
+		{
+			return -1;
+		}
+	}
+	return batch->rows;
+}
+
+int
+sql_statement_sqlite_row_(SQL_STATEMENT *restrict me, SQL_CELL *restrict cells, unsigned int ncols)
+{
+	unsigned int c;
+
+	if(me->eof)
+	{
+		return -1;
+	}
+	if(ncols > (unsigned int) me->columns)
+	{
+		ncols = me->columns;
+	}
+	for(c = 0; c < ncols; c++)
+	{
+		cells[c].null = sql_statement_sqlite_null_(me, c);
+		cells[c].ptr = cells[c].null ? NULL : (const char *) sql_statement_sqlite_valueptr_(me, c);
+		cells[c].len = cells[c].null ? 0 : sql_statement_sqlite_valuelen_(me, c) - 1;
+	}
+	return ncols;
+}
+
+/* Obtain the statement's counters; per-loop counters are only available
+ * if SQLite was built with SQLITE_ENABLE_STMT_SCANSTATUS, as the bundled
+ * copy is
+ */
+int
+sql_statement_sqlite_scanstatus_(SQL_STATEMENT *restrict me, SQL_STMT_STATUS *restrict status)
+{
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+	SQL_SCAN_STATUS *scan;
+	sqlite3_int64 n;
+	int c;
+#endif
+
+	memset(status, 0, sizeof(SQL_STMT_STATUS));
+	if(!me->stmt)
+	{
+		sql_sqlite_set_error_(me->sql, "HY010", "The statement has not been prepared");
+		return -1;
+	}
+	status->fullscan_steps = sqlite3_stmt_status(me->stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+	status->sorts = sqlite3_stmt_status(me->stmt, SQLITE_STMTSTATUS_SORT, 0);
+	status->autoindexes = sqlite3_stmt_status(me->stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0);
+	status->vm_steps = sqlite3_stmt_status(me->stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+	for(c = 0; c < SQL_STMT_SCANS; c++)
+	{
+		scan = &(status->scans[c]);
+		if(sqlite3_stmt_scanstatus(me->stmt, c, SQLITE_SCANSTAT_NLOOP, &n))
+		{
+			break;
+		}
+		scan->loops = n;
+		sqlite3_stmt_scanstatus(me->stmt, c, SQLITE_SCANSTAT_NVISIT, &n);
+		scan->visits = n;
+		sqlite3_stmt_scanstatus(me->stmt, c, SQLITE_SCANSTAT_EST, &(scan->estimate));
+		sqlite3_stmt_scanstatus(me->stmt, c, SQLITE_SCANSTAT_NAME, &(scan->name));
+		sqlite3_stmt_scanstatus(me->stmt, c, SQLITE_SCANSTAT_EXPLAIN, &(scan->explain));
+		status->nscans++;
+	}
+#endif
+	return 0;
+}
+
 /* Return the row index of the current row */
 unsigned long long
 sql_statement_sqlite_cur_(SQL_STATEMENT *me)
@@ -329,9 +704,22 @@ sql_statement_sqlite_cur_(SQL_STATEMENT *me)
 int
 sql_statement_sqlite_seek_(SQL_STATEMENT *me, unsigned long long row)
 {
-	(void) row;
-
-	sql_sqlite_set_error_(me->sql, "X0001", "cannot seek a SQLite cursor");
+	if(me->buffered)
+	{
+		if(row >= me->rows)
+		{
+			return -1;
+		}
+		me->cur = row;
+		me->eof = 0;
+		return 0;
+	}
+	/* An unbuffered result-set can only "seek" to where it already is */
+	if(!me->eof && me->stmt && row == me->cur)
+	{
+		return 0;
+	}
+	sql_sqlite_set_error_(me->sql, "X0001", "cannot seek a SQLite cursor unless the result-set is buffered");
 	return -1;
 }
 
@@ -339,22 +727,81 @@ sql_statement_sqlite_seek_(SQL_STATEMENT *me, unsigned long long row)
 int
 sql_statement_sqlite_rewind_(SQL_STATEMENT *me)
 {
-	sql_sqlite_set_error_(me->sql, "X0001", "cannot rewind a SQLite cursor");
+	if(me->buffered)
+	{
+		me->cur = 0;
+		me->eof = (me->rows == 0);
+		return 0;
+	}
+	if(!me->eof && me->stmt && !me->cur)
+	{
+		return 0;
+	}
+	sql_sqlite_set_error_(me->sql, "X0001", "cannot rewind a SQLite cursor unless the result-set is buffered");
 	return -1;
 }
 
+/* Reset a prepared statement so that it can be executed again, releasing
+ * any locks held by an incomplete result-set
+ */
+int
+sql_statement_sqlite_reset_(SQL_STATEMENT *me)
+{
+	if(me->stmt)
+	{
+		sqlite3_reset(me->stmt);
+	}
+	me->eof = 1;
+	me->cur = (unsigned long long) -1;
+	me->rows = 0;
+	me->buffered = 0;
+	return 0;
+}
+
 /* Return a SQL_FIELD instance for a particular column (0..cols-1) */
 SQL_FIELD *
 sql_statement_sqlite_field_(SQL_STATEMENT *me, unsigned int col)
 {
-	if(!me->stmt)
+	SQL_FIELD *p;
+
+	if(!me->stmt || col >= (unsigned int) me->columns)
 	{
 		return NULL;
 	}
-	if(col >= (unsigned int) me->columns || !me->fields[col])
+	if(!me->fields[col])
 	{
-		return NULL;
+		p = (SQL_FIELD *) sql_slab_alloc_(me->sql->fieldslab);
+		if(!p)
+		{
+			sql_sqlite_set_error_(me->sql, "58000", "Memory allocation error");
+			return NULL;
+		}
+		p->slab = me->sql->fieldslab;
+		p->api = &sql_sqlite_field_api_;
+		p->refcount = 1;
+		p->index = col;
+		p->stmt = me;
+		me->fields[col] = p;
 	}
 	me->fields[col]->api->addref(me->fields[col]);
 	return me->fields[col];
 }
+
+/* Detach the statement's fields, which remain valid (but no longer refer
+ * to it) until they have been released by anything which retained them
+ */
+static void
+sql_statement_sqlite_release_fields_(SQL_STATEMENT *me)
+{
+	int c;
+
+	for(c = 0; c < me->nfields; c++)
+	{
+		if(me->fields[c])
+		{
+			me->fields[c]->stmt = NULL;
+			me->fields[c]->api->release(me->fields[c]);
+			me->fields[c] = NULL;
+		}
+	}
+}
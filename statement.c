@@ -25,32 +25,255 @@
 
 #include "p_libsql.h"
 
+/* The error reported by an automatically-parameterised statement, kept
+ * while the query is retried as text
+ */
+typedef struct
+{
+	int failed;
+	char sqlstate[6];
+	char message[512];
+} SQL_AUTOPARAM_ERROR;
+
+static int sql_execute_(SQL *restrict sql, const char *restrict statement, unsigned long long *restrict affected);
+static int sql_vexecutef_(SQL *restrict sql, const char *restrict format, unsigned long long *restrict affected, va_list ap);
+static SQL_STATEMENT *sql_query_(SQL *restrict sql, const char *restrict statement);
+static SQL_STATEMENT *sql_vqueryf_(SQL *restrict sql, const char *restrict format, va_list ap);
+static int sql_stmt_vexecf_(SQL_STATEMENT *stmt, va_list ap);
+static int sql_pipelined_(SQL *sql);
+static int sql_autoparam_(SQL *sql);
+static void sql_autoparam_failed_(SQL *restrict sql, SQL_STATEMENT *restrict stmt, SQL_AUTOPARAM_ERROR *restrict err);
+static void sql_autoparam_retried_(SQL *restrict sql, const char *restrict format, const SQL_AUTOPARAM_ERROR *restrict err, int status);
 
 /* Execute a statement not expected to return a result-set */
 int
 sql_execute(SQL *restrict sql, const char *restrict statement)
 {
+	SQL_TRACE_STATE state;
+	unsigned long long affected;
+	int r;
+
+	affected = 0;
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, statement);
+	state.literal = 1;
+	r = sql_execute_(sql, statement, &affected);
+	sql_trace_finish_(sql, &state, r, affected);
+	return r;
+}
+
+static int
+sql_execute_(SQL *restrict sql, const char *restrict statement, unsigned long long *restrict affected)
+{
+	SQL_STATEMENT *stmt;
 	int r;
 
+	/* Statements in a pipelined PostgreSQL transaction are queued rather
+	 * than prepared, so they bypass the statement cache
+	 */
+	if(sql->cache && !sql_pipelined_(sql))
+	{
+		stmt = sql_cache_statement_(sql, statement);
+		if(stmt)
+		{
+			r = stmt->api->execute(stmt, 0, NULL);
+			if(r)
+			{
+				sql_cache_discard_(sql, stmt);
+			}
+			else
+			{
+				*affected = stmt->api->affected(stmt);
+			}
+			sql_stmt_destroy(stmt);
+			return r;
+		}
+	}
 	r = sql->api->execute(sql, statement, NULL);
+	if(!r)
+	{
+		*affected = sql->api->affected(sql);
+	}
+	return r;
+}
 
+/* Execute a batch of statements which are not expected to return
+ * result-sets; if affected is not NULL, it receives the number of rows
+ * affected by each statement. Whether the batch is executed atomically
+ * depends upon the engine: wrap it in a transaction if that matters.
+ */
+int
+sql_execute_batch(SQL *restrict sql, const char *const *restrict statements, size_t count, unsigned long long *restrict affected)
+{
+	SQL_TRACE_STATE state;
+	unsigned long long total;
+	size_t c;
+	int r;
+
+	if(affected)
+	{
+		memset(affected, 0, sizeof(unsigned long long) * count);
+	}
+	if(!count)
+	{
+		return 0;
+	}
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, NULL);
+	r = sql->api->execute_batch(sql, statements, count, affected);
+	total = 0;
+	for(c = 0; affected && c < count; c++)
+	{
+		total += affected[c];
+	}
+	sql_trace_finish_(sql, &state, r, total);
+	return r;
+}
+
+/* Execute a script consisting of any number of semicolon-separated
+ * statements; returns the number of statements executed, or -1 if an
+ * error occurred. The first naffected per-statement affected row counts
+ * are stored in affected.
+ */
+int
+sql_execute_script(SQL *restrict sql, const char *restrict script, unsigned long long *restrict affected, size_t naffected)
+{
+	SQL_TRACE_STATE state;
+	unsigned long long total;
+	size_t c;
+	int r;
+
+	if(affected)
+	{
+		memset(affected, 0, sizeof(unsigned long long) * naffected);
+	}
+	else
+	{
+		naffected = 0;
+	}
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, script);
+	r = sql->api->execute_script(sql, script, affected, naffected);
+	total = 0;
+	for(c = 0; c < naffected; c++)
+	{
+		total += affected[c];
+	}
+	sql_trace_finish_(sql, &state, (r < 0 ? -1 : 0), total);
 	return r;
 }
 
+/* Execute a query, passing each row of the result-set to a callback; the
+ * engine iterates the rows itself, without a statement being created
+ */
+long long
+sql_query_foreach(SQL *restrict sql, const char *restrict query, SQL_ROW_FN fn, void *restrict userdata)
+{
+	SQL_TRACE_STATE state;
+	long long r;
+
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, query);
+	state.literal = 1;
+	r = sql->api->query_foreach(sql, query, fn, userdata);
+	sql_trace_finish_(sql, &state, (r < 0 ? -1 : 0), 0);
+	return r;
+}
+
+/* Join a batch of statements into a single script, for engines which
+ * execute batches that way
+ */
+char *
+sql_batch_join_(const char *const *statements, size_t count)
+{
+	size_t c, len, total;
+	char *buf, *p;
+
+	total = 1;
+	for(c = 0; c < count; c++)
+	{
+		total += strlen(statements[c]) + 3;
+	}
+	buf = (char *) malloc(total);
+	if(!buf)
+	{
+		return NULL;
+	}
+	p = buf;
+	for(c = 0; c < count; c++)
+	{
+		/* Drop any trailing terminator, which would otherwise result in an
+		 * empty statement
+		 */
+		len = strlen(statements[c]);
+		while(len && (isspace((unsigned char) statements[c][len - 1]) || statements[c][len - 1] == ';'))
+		{
+			len--;
+		}
+		memcpy(p, statements[c], len);
+		p += len;
+		/* The newline terminates any trailing comment */
+		if(c + 1 < count)
+		{
+			memcpy(p, "\n;\n", 3);
+			p += 3;
+		}
+	}
+	*p = 0;
+	return buf;
+}
+
 /* Execute a statement, interpolating parameters */
 int
 sql_vexecutef(SQL *restrict sql, const char *restrict format, va_list ap)
 {
+	SQL_TRACE_STATE state;
+	unsigned long long affected;
+	int r;
+
+	affected = 0;
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, format);
+	r = sql_vexecutef_(sql, format, &affected, ap);
+	sql_trace_finish_(sql, &state, r, affected);
+	return r;
+}
+
+static int
+sql_vexecutef_(SQL *restrict sql, const char *restrict format, unsigned long long *restrict affected, va_list ap)
+{
+	SQL_AUTOPARAM_ERROR err;
+	SQL_STATEMENT *stmt;
+	va_list args;
 	char *qs;
 	int r;
 	
-	r = sql_vasprintf_query_(sql, &qs, format, ap);
-	if(r == -1)
+	err.failed = 0;
+	if(sql_autoparam_(sql))
+	{
+		stmt = sql_format_statement_(sql, format);
+		if(stmt)
+		{
+			va_copy(args, ap);
+			sql_template_bind_(stmt->tmpl, args);
+			va_end(args);
+			r = stmt->api->execute(stmt, stmt->tmpl->nparams, stmt->tmpl->params);
+			if(!r)
+			{
+				*affected = stmt->api->affected(stmt);
+				sql_stmt_destroy(stmt);
+				return 0;
+			}
+			sql_autoparam_failed_(sql, stmt, &err);
+		}
+	}
+	qs = sql_format_query_(sql, format, ap);
+	if(!qs)
 	{
 		return -1;
 	}
 	r = sql->api->execute(sql, qs, NULL);
-	free(qs);
+	sql_format_release_(sql, qs);
+	if(!r)
+	{
+		*affected = sql->api->affected(sql);
+	}
+	sql_autoparam_retried_(sql, format, &err, r);
 	return r;
 }
 
@@ -69,11 +292,42 @@ sql_executef(SQL *restrict sql, const char *restrict format, ...)
 /* Execute a statement which is expected to return a result-set */
 SQL_STATEMENT *
 sql_query(SQL *restrict sql, const char *restrict statement)
+{
+	SQL_TRACE_STATE state;
+	SQL_STATEMENT *rs;
+
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, statement);
+	state.literal = 1;
+	rs = sql_query_(sql, statement);
+	sql_trace_finish_(sql, &state, (rs ? 0 : -1), (rs ? rs->api->affected(rs) : 0));
+	if(rs)
+	{
+		sql_trace_results_(&state, rs);
+	}
+	return rs;
+}
+
+static SQL_STATEMENT *
+sql_query_(SQL *restrict sql, const char *restrict statement)
 {
 	SQL_STATEMENT *rs;
 	void *data;
 	int r;
 
+	if(sql->cache && !(sql->flags & SQL_FLAG_STREAM))
+	{
+		rs = sql_cache_statement_(sql, statement);
+		if(rs)
+		{
+			if(rs->api->execute(rs, 0, NULL))
+			{
+				sql_cache_discard_(sql, rs);
+				sql_stmt_destroy(rs);
+				return NULL;
+			}
+			return rs;
+		}
+	}
 	data = NULL;
 	rs = sql->api->statement(sql, NULL);
 	if(!rs)
@@ -86,7 +340,27 @@ sql_query(SQL *restrict sql, const char *restrict statement)
 		rs->api->release(rs);
 		return NULL;
 	}
-	rs->api->set_results(rs, data);
+	if(rs->api->set_results(rs, data))
+	{
+		rs->api->release(rs);
+		return NULL;
+	}
+	return rs;
+}
+
+/* Execute a statement returning a result-set whose rows are retrieved
+ * incrementally
+ */
+SQL_STATEMENT *
+sql_query_stream(SQL *restrict sql, const char *restrict statement)
+{
+	SQL_STATEMENT *rs;
+	unsigned int flags;
+
+	flags = sql->flags;
+	sql->flags |= SQL_FLAG_STREAM;
+	rs = sql_query(sql, statement);
+	sql->flags = flags;
 	return rs;
 }
 
@@ -94,31 +368,69 @@ sql_query(SQL *restrict sql, const char *restrict statement)
 SQL_STATEMENT *
 sql_vqueryf(SQL *restrict sql, const char *restrict format, va_list ap)
 {
+	SQL_TRACE_STATE state;
+	SQL_STATEMENT *rs;
+
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, format);
+	rs = sql_vqueryf_(sql, format, ap);
+	sql_trace_finish_(sql, &state, (rs ? 0 : -1), (rs ? rs->api->affected(rs) : 0));
+	if(rs)
+	{
+		sql_trace_results_(&state, rs);
+	}
+	return rs;
+}
+
+static SQL_STATEMENT *
+sql_vqueryf_(SQL *restrict sql, const char *restrict format, va_list ap)
+{
+	SQL_AUTOPARAM_ERROR err;
 	char *qs;
 	int r;	
 	SQL_STATEMENT *rs;
 	void *data;
+	va_list args;
 
+	err.failed = 0;
+	if(sql_autoparam_(sql))
+	{
+		rs = sql_format_statement_(sql, format);
+		if(rs)
+		{
+			va_copy(args, ap);
+			sql_template_bind_(rs->tmpl, args);
+			va_end(args);
+			if(!rs->api->execute(rs, rs->tmpl->nparams, rs->tmpl->params))
+			{
+				return rs;
+			}
+			sql_autoparam_failed_(sql, rs, &err);
+		}
+	}
 	data = NULL;
 	rs = sql->api->statement(sql, NULL);
 	if(!rs)
 	{
 		return NULL;
 	}
-	r = sql_vasprintf_query_(sql, &qs, format, ap);
-	if(r == -1)
+	qs = sql_format_query_(sql, format, ap);
+	if(!qs)
 	{
 		rs->api->release(rs);
 		return NULL;
 	}
 	r = sql->api->execute(sql, qs, &data);
-	free(qs);
+	sql_format_release_(sql, qs);
+	if(!r && rs->api->set_results(rs, data))
+	{
+		r = -1;
+	}
+	sql_autoparam_retried_(sql, format, &err, r);
 	if(r)
 	{
 		rs->api->release(rs);
 		return NULL;
 	}
-	rs->api->set_results(rs, data);
 	return rs;
 }
 
@@ -137,15 +449,46 @@ sql_queryf(SQL *restrict sql, const char *restrict format, ...)
 int
 sql_stmt_destroy(SQL_STATEMENT *stmt)
 {
+	sql_trace_fetched_(stmt, 0);
+	if(stmt->cached && stmt->refcount == 2)
+	{
+		/* Discard the results so that the cached statement is ready for
+		 * re-use, unless something other than the cache (such as an
+		 * Arrow stream) still holds a reference to it
+		 */
+		stmt->api->reset(stmt);
+	}
 	return stmt->api->release(stmt);
 }
 
+/* Discard the results of a statement, retaining it so that it can be
+ * executed again
+ */
+int
+sql_stmt_reset(SQL_STATEMENT *stmt)
+{
+	sql_trace_fetched_(stmt, 0);
+	return stmt->api->reset(stmt);
+}
+
 int
 sql_stmt_rewind(SQL_STATEMENT *stmt)
 {
 	return stmt->api->rewind(stmt);
 }
 
+int
+sql_stmt_seek(SQL_STATEMENT *stmt, unsigned long long row)
+{
+	return stmt->api->seek(stmt, row);
+}
+
+unsigned long long
+sql_stmt_cur(SQL_STATEMENT *stmt)
+{
+	return stmt->api->cur(stmt);
+}
+
 unsigned int
 sql_stmt_columns(SQL_STATEMENT *stmt)
 {
@@ -173,7 +516,18 @@ sql_stmt_eof(SQL_STATEMENT *stmt)
 int
 sql_stmt_next(SQL_STATEMENT *stmt)
 {
-	return stmt->api->next(stmt);
+	int r;
+
+	r = stmt->api->next(stmt);
+	if(r > 0)
+	{
+		stmt->fetched++;
+	}
+	else
+	{
+		sql_trace_fetched_(stmt, (r < 0 ? -1 : 0));
+	}
+	return r;
 }
 
 int
@@ -182,6 +536,18 @@ sql_stmt_null(SQL_STATEMENT *stmt, unsigned int col)
 	return stmt->api->null(stmt, col);
 }
 
+int
+sql_stmt_row(SQL_STATEMENT *restrict stmt, SQL_CELL *restrict cells, unsigned int ncols)
+{
+	return stmt->api->row(stmt, cells, ncols);
+}
+
+int
+sql_stmt_scanstatus(SQL_STATEMENT *restrict stmt, SQL_STMT_STATUS *restrict status)
+{
+	return stmt->api->scanstatus(stmt, status);
+}
+
 size_t
 sql_stmt_value(SQL_STATEMENT *restrict stmt, unsigned int col, char *restrict buf, size_t buflen)
 {
@@ -197,21 +563,23 @@ sql_stmt_str(SQL_STATEMENT *stmt, unsigned int col)
 long
 sql_stmt_long(SQL_STATEMENT *stmt, unsigned int col)
 {
-	const char *s;
-
-	s = (const char *) stmt->api->valueptr(stmt, col);
-	if(!s)
-	{
-		return 0;
-	}
-	return strtol(s, NULL, 10);
+	return (long) stmt->api->int64(stmt, col);
 }
 
 unsigned long
 sql_stmt_ulong(SQL_STATEMENT *stmt, unsigned int col)
 {
 	const char *s;
+	int64_t v;
 
+	/* Use the typed accessor where the value fits; values beyond the
+	 * range of int64_t are clamped by it, so parse those from the text
+	 */
+	v = stmt->api->int64(stmt, col);
+	if(v >= 0 && v < INT64_MAX && (uint64_t) v <= (unsigned long) -1)
+	{
+		return (unsigned long) v;
+	}
 	s = (const char *) stmt->api->valueptr(stmt, col);
 	if(!s)
 	{
@@ -220,6 +588,63 @@ sql_stmt_ulong(SQL_STATEMENT *stmt, unsigned int col)
 	return strtoul(s, NULL, 10);
 }
 
+int64_t
+sql_stmt_int64(SQL_STATEMENT *stmt, unsigned int col)
+{
+	return stmt->api->int64(stmt, col);
+}
+
+double
+sql_stmt_double(SQL_STATEMENT *stmt, unsigned int col)
+{
+	return stmt->api->real(stmt, col);
+}
+
+int
+sql_stmt_bool(SQL_STATEMENT *stmt, unsigned int col)
+{
+	return stmt->api->boolean(stmt, col);
+}
+
+const unsigned char *
+sql_stmt_blob(SQL_STATEMENT *restrict stmt, unsigned int col, size_t *restrict len)
+{
+	return stmt->api->blob(stmt, col, len);
+}
+
+/* Create a parameterised statement from a format string, preparing it
+ * on the server (or within the engine) once so that it can be executed
+ * repeatedly with sql_stmt_execf()
+ */
+SQL_STATEMENT *
+sql_stmt_create(SQL *restrict sql, const char *restrict statement)
+{
+	SQL_TEMPLATE *tmpl;
+	SQL_STATEMENT *stmt;
+
+	tmpl = sql_template_create_(sql, statement);
+	if(!tmpl)
+	{
+		if(errno == ENOTSUP)
+		{
+			sql->api->set_error(sql, "0A000", "The statement contains conversions which cannot be used as parameters");
+		}
+		else
+		{
+			sql->api->set_error(sql, "58000", "Memory allocation error");
+		}
+		return NULL;
+	}
+	stmt = sql->api->statement(sql, tmpl->native);
+	if(!stmt)
+	{
+		sql_template_destroy_(tmpl);
+		return NULL;
+	}
+	stmt->tmpl = tmpl;
+	return stmt;
+}
+
 int
 sql_stmt_execf(SQL_STATEMENT *statement, ...)
 {
@@ -229,51 +654,84 @@ sql_stmt_execf(SQL_STATEMENT *statement, ...)
 	va_start(ap, statement);
 	r = sql_stmt_vexecf(statement, ap);
 	va_end(ap);
-	return 0;
+	return r;
 }
 
+/* Bind a new set of parameters to a statement created by sql_stmt_create()
+ * and execute it
+ */
 int
 sql_stmt_vexecf(SQL_STATEMENT *stmt, va_list ap)
 {
-	const char *format;
-	char *qs;
+	SQL_TRACE_STATE state;
 	SQL *sql;
 	int r;
-	void *data;
-	
+
 	sql = stmt->api->connection(stmt);
-	format = stmt->api->statement(stmt);
-	stmt->api->set_results(stmt, NULL);	
-	r = sql_vasprintf_query_(sql, &qs, format, ap);
-	if(r == -1)
+	sql_trace_fetched_(stmt, 0);
+	sql_trace_start_(sql, &state, SQL_STATS_QUERY, stmt->api->statement(stmt));
+	state.fingerprint = stmt->fingerprint;
+	r = sql_stmt_vexecf_(stmt, ap);
+	sql_trace_finish_(sql, &state, r, (r ? 0 : stmt->api->affected(stmt)));
+	if(r)
 	{
-		return -1;
+		stmt->fingerprint = state.fingerprint;
 	}
-	r = sql->api->execute(sql, qs, &data);
-	free(qs);
-	if(r)
+	else
 	{
-		return -1;
+		sql_trace_results_(&state, stmt);
 	}
-	return stmt->api->set_results(stmt, data);
+	return r;
+}
+
+static int
+sql_stmt_vexecf_(SQL_STATEMENT *stmt, va_list ap)
+{
+	if(!stmt->tmpl)
+	{
+		/* A prepared statement without parameters, such as one obtained
+		 * from the statement cache by sql_query(), is simply re-executed
+		 */
+		return stmt->api->execute(stmt, 0, NULL);
+	}
+	sql_template_bind_(stmt->tmpl, ap);
+	return stmt->api->execute(stmt, stmt->tmpl->nparams, stmt->tmpl->params);
 }
 
 int
 sql_begin(SQL *sql, SQL_TXN_MODE mode)
 {
-	return sql->api->begin(sql, mode);
+	SQL_TRACE_STATE state;
+	int r;
+
+	sql_trace_start_(sql, &state, SQL_STATS_BEGIN, NULL);
+	r = sql->api->begin(sql, mode);
+	sql_trace_finish_(sql, &state, r, 0);
+	return r;
 }
 
 int
 sql_commit(SQL *sql)
 {
-	return sql->api->commit(sql);
+	SQL_TRACE_STATE state;
+	int r;
+
+	sql_trace_start_(sql, &state, SQL_STATS_COMMIT, NULL);
+	r = sql->api->commit(sql);
+	sql_trace_finish_(sql, &state, r, 0);
+	return r;
 }
 
 int
 sql_rollback(SQL *sql)
 {
-	return sql->api->rollback(sql);
+	SQL_TRACE_STATE state;
+	int r;
+
+	sql_trace_start_(sql, &state, SQL_STATS_ROLLBACK, NULL);
+	r = sql->api->rollback(sql);
+	sql_trace_finish_(sql, &state, r, 0);
+	return r;
 }
 
 /* Repeatedly execute a callback function in the context of a transaction. If
@@ -361,6 +819,7 @@ sql_perform(SQL *restrict sql, SQL_PERFORM_TXN fn, void *restrict userdata, int
 			}
 		}
 		/* Try again */
+		sql_stats_retry_(sql, sql->api->deadlocked(sql));
 		sql_rollback(sql);
 	}
 	/* Retry count exceeded */
@@ -372,3 +831,63 @@ sql_deadlocked(SQL *sql)
 {
 	return sql->api->deadlocked(sql);
 }
+
+/* Determine whether sql_execute() queues statements in a pipelined
+ * transaction, in which case prepared statements aren't used
+ */
+static int
+sql_pipelined_(SQL *sql)
+{
+	return ((sql->flags & SQL_FLAG_PIPELINE) && sql->api->variant(sql) == SQL_VARIANT_POSTGRES);
+}
+
+/* Determine whether sql_queryf() and sql_executef() should execute format
+ * strings as prepared statements
+ */
+static int
+sql_autoparam_(SQL *sql)
+{
+	if(!(sql->flags & SQL_FLAG_AUTOPARAM) || (sql->flags & SQL_FLAG_STREAM))
+	{
+		return 0;
+	}
+	return !sql_pipelined_(sql);
+}
+
+/* An automatically-parameterised statement failed to execute: discard it,
+ * keeping its error, so that the query can be retried as text
+ */
+static void
+sql_autoparam_failed_(SQL *restrict sql, SQL_STATEMENT *restrict stmt, SQL_AUTOPARAM_ERROR *restrict err)
+{
+	err->failed = 1;
+	strncpy(err->sqlstate, sql->api->sqlstate(sql), sizeof(err->sqlstate) - 1);
+	err->sqlstate[sizeof(err->sqlstate) - 1] = 0;
+	strncpy(err->message, sql->api->error(sql), sizeof(err->message) - 1);
+	err->message[sizeof(err->message) - 1] = 0;
+	sql_format_discard_(sql, stmt);
+	sql_stmt_destroy(stmt);
+}
+
+/* A query has been retried as text after its parameterised form failed:
+ * if it succeeded, the format string is thereafter always formatted as
+ * text; if not, the original error is reported unless the retry failed
+ * in the same way (it won't have if, for example, the first failure
+ * aborted a PostgreSQL transaction)
+ */
+static void
+sql_autoparam_retried_(SQL *restrict sql, const char *restrict format, const SQL_AUTOPARAM_ERROR *restrict err, int status)
+{
+	if(!err->failed)
+	{
+		return;
+	}
+	if(!status)
+	{
+		sql_format_noparam_(sql, format);
+	}
+	else if(strcmp(err->sqlstate, sql->api->sqlstate(sql)))
+	{
+		sql->api->set_error(sql, err->sqlstate, err->message);
+	}
+}
@@ -0,0 +1,539 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+#include <time.h>
+#include <unistd.h>
+
+/* Each connection embeds a block of statistics counters, which are updated
+ * by the core and by the engines as operations complete. A connection is
+ * only used by one thread at a time, so the counters are updated with
+ * plain (relaxed atomic) loads and stores rather than read-modify-write
+ * operations, which allows another thread to take a snapshot without
+ * tearing, although it need not be consistent between counters.
+ *
+ * The process-wide statistics are built on demand by adding together the
+ * blocks of every live connection and the totals of the connections which
+ * have since been closed, which are folded in by sql_stats_detach_().
+ *
+ * Latency histograms, and the time spent waiting for the server, can be
+ * turned off with sql_stats_enable(), in which case operations are still
+ * counted but not timed (unless a tracer or fingerprinting needs it).
+ */
+
+#define SQL_STATS_ADD(counter, n)      __atomic_store_n(&(counter), __atomic_load_n(&(counter), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED)
+#define SQL_STATS_LOAD(counter)        __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+typedef struct
+{
+	char *buf;
+	size_t len;
+	size_t alloc;
+	int failed;
+} SQL_STATS_OUTPUT;
+
+static const char *const sql_stats_opnames_[SQL_STATS_OPS] = {
+	"connect", "query", "fetch", "begin", "commit", "rollback"
+};
+
+static pthread_mutex_t sql_stats_lock_ = PTHREAD_MUTEX_INITIALIZER;
+/* Live connections */
+static SQL_STATS_BLOCK *sql_stats_first_;
+/* Connections which have been closed, or could not be created */
+static SQL_STATS sql_stats_retired_;
+static int sql_stats_enabled_ = 1;
+
+static void sql_stats_count_error_(SQL_STATS_BLOCK *block, unsigned long long key);
+static void sql_stats_copy_(SQL_STATS_BLOCK *restrict block, SQL_STATS *restrict stats);
+static void sql_stats_merge_(SQL_STATS *restrict dest, const SQL_STATS *restrict src);
+static void sql_stats_printf_(SQL_STATS_OUTPUT *restrict out, const char *restrict format, ...);
+static int sql_stats_write_(const SQL_EXPORT_SINK *restrict sink, const char *restrict data, size_t len);
+
+/* Obtain a snapshot of the statistics of a connection, or of the whole
+ * process if sql is NULL
+ */
+int
+sql_stats_get(SQL *restrict sql, SQL_STATS *restrict stats)
+{
+	SQL_STATS_BLOCK *block;
+	SQL_STATS live;
+
+	if(sql)
+	{
+		sql_stats_copy_(&(sql->stats), stats);
+		return 0;
+	}
+	pthread_mutex_lock(&sql_stats_lock_);
+	memcpy(stats, &sql_stats_retired_, sizeof(SQL_STATS));
+	for(block = sql_stats_first_; block; block = block->next)
+	{
+		sql_stats_copy_(block, &live);
+		sql_stats_merge_(stats, &live);
+	}
+	pthread_mutex_unlock(&sql_stats_lock_);
+	return 0;
+}
+
+/* Turn the timing of operations on or off for every connection; when it
+ * is off, operations are counted but latency histograms and server wait
+ * times are not recorded
+ */
+int
+sql_stats_enable(int enable)
+{
+	__atomic_store_n(&sql_stats_enabled_, (enable ? 1 : 0), __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* Write a snapshot of statistics in the Prometheus text format */
+int
+sql_stats_prometheus(const SQL_STATS *restrict stats, const char *restrict labels, const SQL_EXPORT_SINK *restrict sink)
+{
+	SQL_STATS_OUTPUT out;
+	const char *sep;
+	unsigned long long total, nsec, other;
+	unsigned int op, c;
+	int r;
+
+	if(!labels)
+	{
+		labels = "";
+	}
+	sep = (*labels ? "," : "");
+	memset(&out, 0, sizeof(out));
+	sql_stats_printf_(&out, "# HELP libsql_operation_duration_seconds Time taken by library operations\n"
+		"# TYPE libsql_operation_duration_seconds histogram\n");
+	nsec = 0;
+	for(op = 0; op < SQL_STATS_OPS; op++)
+	{
+		total = 0;
+		for(c = 0; c < SQL_STATS_BUCKETS; c++)
+		{
+			total += stats->ops[op].buckets[c];
+			if(c + 1 < SQL_STATS_BUCKETS)
+			{
+				sql_stats_printf_(&out, "libsql_operation_duration_seconds_bucket{%s%sop=\"%s\",le=\"%g\"} %llu\n", labels, sep, sql_stats_opnames_[op], (1 << c) / 1000000.0, total);
+			}
+			else
+			{
+				sql_stats_printf_(&out, "libsql_operation_duration_seconds_bucket{%s%sop=\"%s\",le=\"+Inf\"} %llu\n", labels, sep, sql_stats_opnames_[op], total);
+			}
+		}
+		sql_stats_printf_(&out, "libsql_operation_duration_seconds_sum{%s%sop=\"%s\"} %.9f\n", labels, sep, sql_stats_opnames_[op], stats->ops[op].nsec / 1000000000.0);
+		sql_stats_printf_(&out, "libsql_operation_duration_seconds_count{%s%sop=\"%s\"} %llu\n", labels, sep, sql_stats_opnames_[op], stats->ops[op].count);
+		nsec += stats->ops[op].nsec;
+	}
+	/* Waits can occur outside of the timed operations, such as when a
+	 * schema migration is performed, so the difference is clamped
+	 */
+	nsec = (nsec > stats->wait_nsec ? nsec - stats->wait_nsec : 0);
+	sql_stats_printf_(&out, "# HELP libsql_server_wait_seconds_total Time spent waiting for the database server\n"
+		"# TYPE libsql_server_wait_seconds_total counter\n"
+		"libsql_server_wait_seconds_total{%s} %.9f\n", labels, stats->wait_nsec / 1000000000.0);
+	sql_stats_printf_(&out, "# HELP libsql_library_seconds_total Time spent in operations other than waiting for the server\n"
+		"# TYPE libsql_library_seconds_total counter\n"
+		"libsql_library_seconds_total{%s} %.9f\n", labels, nsec / 1000000000.0);
+	sql_stats_printf_(&out, "# HELP libsql_rows_total Rows received\n"
+		"# TYPE libsql_rows_total counter\n"
+		"libsql_rows_total{%s} %llu\n", labels, stats->rows);
+	sql_stats_printf_(&out, "# HELP libsql_received_bytes_total Result data received from the server\n"
+		"# TYPE libsql_received_bytes_total counter\n"
+		"libsql_received_bytes_total{%s} %llu\n", labels, stats->bytes);
+	sql_stats_printf_(&out, "# HELP libsql_transaction_retries_total Transactions retried by sql_perform()\n"
+		"# TYPE libsql_transaction_retries_total counter\n"
+		"libsql_transaction_retries_total{%s} %llu\n", labels, stats->retries);
+	sql_stats_printf_(&out, "# HELP libsql_deadlocks_total Transactions retried by sql_perform() following a deadlock\n"
+		"# TYPE libsql_deadlocks_total counter\n"
+		"libsql_deadlocks_total{%s} %llu\n", labels, stats->deadlocks);
+	sql_stats_printf_(&out, "# HELP libsql_errors_total Errors by SQLSTATE\n"
+		"# TYPE libsql_errors_total counter\n");
+	total = 0;
+	for(c = 0; c < SQL_STATS_SQLSTATES && stats->sqlstates[c].sqlstate[0]; c++)
+	{
+		sql_stats_printf_(&out, "libsql_errors_total{%s%ssqlstate=\"%s\"} %llu\n", labels, sep, stats->sqlstates[c].sqlstate, stats->sqlstates[c].count);
+		total += stats->sqlstates[c].count;
+	}
+	other = (stats->errors > total ? stats->errors - total : 0);
+	if(other)
+	{
+		sql_stats_printf_(&out, "libsql_errors_total{%s%ssqlstate=\"other\"} %llu\n", labels, sep, other);
+	}
+	if(out.failed)
+	{
+		sql_free_(out.buf);
+		errno = ENOMEM;
+		return -1;
+	}
+	r = sql_stats_write_(sink, out.buf, out.len);
+	sql_free_(out.buf);
+	return r;
+}
+
+/* Return a monotonic timestamp in nanoseconds */
+unsigned long long
+sql_stats_now_(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/* Return a timestamp marking the start of an operation or wait, or zero
+ * if timing is turned off
+ */
+unsigned long long
+sql_stats_timer_(void)
+{
+	if(!__atomic_load_n(&sql_stats_enabled_, __ATOMIC_RELAXED))
+	{
+		return 0;
+	}
+	return sql_stats_now_();
+}
+
+/* Register a newly-created connection, so that its statistics are included
+ * in those of the process
+ */
+void
+sql_stats_attach_(SQL *sql)
+{
+	pthread_mutex_lock(&sql_stats_lock_);
+	sql->stats.prev = NULL;
+	sql->stats.next = sql_stats_first_;
+	if(sql_stats_first_)
+	{
+		sql_stats_first_->prev = &(sql->stats);
+	}
+	sql_stats_first_ = &(sql->stats);
+	sql->stats.attached = 1;
+	pthread_mutex_unlock(&sql_stats_lock_);
+}
+
+/* Fold the statistics of a connection which is being freed into the
+ * process-wide totals; invoked by an engine when a connection is freed
+ */
+void
+sql_stats_detach_(SQL *sql)
+{
+	SQL_STATS stats;
+
+	if(!sql->stats.attached)
+	{
+		return;
+	}
+	sql_stats_copy_(&(sql->stats), &stats);
+	pthread_mutex_lock(&sql_stats_lock_);
+	if(sql->stats.prev)
+	{
+		sql->stats.prev->next = sql->stats.next;
+	}
+	else
+	{
+		sql_stats_first_ = sql->stats.next;
+	}
+	if(sql->stats.next)
+	{
+		sql->stats.next->prev = sql->stats.prev;
+	}
+	sql->stats.attached = 0;
+	sql_stats_merge_(&sql_stats_retired_, &stats);
+	pthread_mutex_unlock(&sql_stats_lock_);
+}
+
+/* Record the completion of an operation which began at start, returning
+ * its duration; if start is zero, the operation was not timed and is only
+ * counted. sql is NULL if there is no connection, such as when one could
+ * not be created.
+ */
+unsigned long long
+sql_stats_op_(SQL *sql, SQL_STATS_OP op, unsigned long long start)
+{
+	SQL_STATS_HISTOGRAM *hist;
+	unsigned long long nsec, usec;
+	unsigned int bucket;
+	int timed;
+
+	nsec = (start ? sql_stats_now_() - start : 0);
+	timed = (start && __atomic_load_n(&sql_stats_enabled_, __ATOMIC_RELAXED));
+	usec = nsec / 1000;
+	for(bucket = 0; usec && bucket + 1 < SQL_STATS_BUCKETS; bucket++)
+	{
+		usec >>= 1;
+	}
+	if(!sql)
+	{
+		pthread_mutex_lock(&sql_stats_lock_);
+		hist = &(sql_stats_retired_.ops[op]);
+		hist->count++;
+		if(timed)
+		{
+			hist->nsec += nsec;
+			hist->buckets[bucket]++;
+		}
+		pthread_mutex_unlock(&sql_stats_lock_);
+		return nsec;
+	}
+	hist = &(sql->stats.ops[op]);
+	SQL_STATS_ADD(hist->count, 1);
+	if(timed)
+	{
+		SQL_STATS_ADD(hist->nsec, nsec);
+		SQL_STATS_ADD(hist->buckets[bucket], 1);
+	}
+	return nsec;
+}
+
+/* Record time spent waiting for the server since start, as returned by
+ * sql_stats_timer_()
+ */
+void
+sql_stats_wait_(SQL *sql, unsigned long long start)
+{
+	if(start)
+	{
+		SQL_STATS_ADD(sql->stats.wait_nsec, sql_stats_now_() - start);
+	}
+}
+
+/* Record the receipt of rows and result data from the server */
+void
+sql_stats_rows_(SQL *sql, unsigned long long rows, unsigned long long bytes)
+{
+	SQL_STATS_ADD(sql->stats.rows, rows);
+	if(bytes)
+	{
+		SQL_STATS_ADD(sql->stats.bytes, bytes);
+	}
+}
+
+/* Record an error; invoked by the engines whenever the error state of a
+ * connection is set
+ */
+void
+sql_stats_error_(SQL *restrict sql, const char *restrict sqlstate)
+{
+	char buf[sizeof(unsigned long long)];
+	unsigned long long key;
+
+	memset(buf, 0, sizeof(buf));
+	strncpy(buf, sqlstate, 5);
+	memcpy(&key, buf, sizeof(key));
+	sql_stats_count_error_(&(sql->stats), key);
+}
+
+/* Record a sql_perform() retry */
+void
+sql_stats_retry_(SQL *sql, int deadlocked)
+{
+	SQL_STATS_ADD(sql->stats.retries, 1);
+	if(deadlocked)
+	{
+		SQL_STATS_ADD(sql->stats.deadlocks, 1);
+	}
+}
+
+/* Count an error against its slot in the table, claiming a free slot if
+ * the code hasn't been seen before; a key of zero (an empty SQLSTATE) is
+ * only counted in the total
+ */
+static void
+sql_stats_count_error_(SQL_STATS_BLOCK *block, unsigned long long key)
+{
+	unsigned long long current;
+	unsigned int c, start, slot;
+
+	SQL_STATS_ADD(block->errors, 1);
+	if(!key)
+	{
+		return;
+	}
+	start = (unsigned int) ((key * 11400714819323198485ULL) >> 32);
+	for(c = 0; c < SQL_STATS_SQLSTATES; c++)
+	{
+		slot = (start + c) % SQL_STATS_SQLSTATES;
+		current = SQL_STATS_LOAD(block->errkeys[slot]);
+		if(!current)
+		{
+			/* Set the count before the key, so that a snapshot never sees
+			 * the key with a stale count
+			 */
+			__atomic_store_n(&(block->errcounts[slot]), 1, __ATOMIC_RELAXED);
+			__atomic_store_n(&(block->errkeys[slot]), key, __ATOMIC_RELEASE);
+			return;
+		}
+		if(current == key)
+		{
+			SQL_STATS_ADD(block->errcounts[slot], 1);
+			return;
+		}
+	}
+}
+
+static void
+sql_stats_copy_(SQL_STATS_BLOCK *restrict block, SQL_STATS *restrict stats)
+{
+	char buf[sizeof(unsigned long long)];
+	unsigned long long key;
+	unsigned int op, c, n;
+
+	memset(stats, 0, sizeof(SQL_STATS));
+	for(op = 0; op < SQL_STATS_OPS; op++)
+	{
+		stats->ops[op].count = SQL_STATS_LOAD(block->ops[op].count);
+		stats->ops[op].nsec = SQL_STATS_LOAD(block->ops[op].nsec);
+		for(c = 0; c < SQL_STATS_BUCKETS; c++)
+		{
+			stats->ops[op].buckets[c] = SQL_STATS_LOAD(block->ops[op].buckets[c]);
+		}
+	}
+	stats->wait_nsec = SQL_STATS_LOAD(block->wait_nsec);
+	stats->rows = SQL_STATS_LOAD(block->rows);
+	stats->bytes = SQL_STATS_LOAD(block->bytes);
+	stats->errors = SQL_STATS_LOAD(block->errors);
+	stats->retries = SQL_STATS_LOAD(block->retries);
+	stats->deadlocks = SQL_STATS_LOAD(block->deadlocks);
+	n = 0;
+	for(c = 0; c < SQL_STATS_SQLSTATES; c++)
+	{
+		key = __atomic_load_n(&(block->errkeys[c]), __ATOMIC_ACQUIRE);
+		if(!key)
+		{
+			continue;
+		}
+		memcpy(buf, &key, sizeof(buf));
+		memcpy(stats->sqlstates[n].sqlstate, buf, 5);
+		stats->sqlstates[n].count = SQL_STATS_LOAD(block->errcounts[c]);
+		n++;
+	}
+}
+
+/* Add the statistics in src to those in dest */
+static void
+sql_stats_merge_(SQL_STATS *restrict dest, const SQL_STATS *restrict src)
+{
+	unsigned int op, c, n;
+
+	for(op = 0; op < SQL_STATS_OPS; op++)
+	{
+		dest->ops[op].count += src->ops[op].count;
+		dest->ops[op].nsec += src->ops[op].nsec;
+		for(c = 0; c < SQL_STATS_BUCKETS; c++)
+		{
+			dest->ops[op].buckets[c] += src->ops[op].buckets[c];
+		}
+	}
+	dest->wait_nsec += src->wait_nsec;
+	dest->rows += src->rows;
+	dest->bytes += src->bytes;
+	dest->errors += src->errors;
+	dest->retries += src->retries;
+	dest->deadlocks += src->deadlocks;
+	/* Codes which don't fit are counted only in the total */
+	for(c = 0; c < SQL_STATS_SQLSTATES && src->sqlstates[c].sqlstate[0]; c++)
+	{
+		for(n = 0; n < SQL_STATS_SQLSTATES && dest->sqlstates[n].sqlstate[0]; n++)
+		{
+			if(!strcmp(dest->sqlstates[n].sqlstate, src->sqlstates[c].sqlstate))
+			{
+				break;
+			}
+		}
+		if(n == SQL_STATS_SQLSTATES)
+		{
+			continue;
+		}
+		if(!dest->sqlstates[n].sqlstate[0])
+		{
+			strcpy(dest->sqlstates[n].sqlstate, src->sqlstates[c].sqlstate);
+		}
+		dest->sqlstates[n].count += src->sqlstates[c].count;
+	}
+}
+
+/* Append formatted text to the output buffer */
+static void
+sql_stats_printf_(SQL_STATS_OUTPUT *restrict out, const char *restrict format, ...)
+{
+	va_list ap;
+	char *p;
+	size_t needed;
+	int n;
+
+	if(out->failed)
+	{
+		return;
+	}
+	for(;;)
+	{
+		va_start(ap, format);
+		n = vsnprintf(out->buf ? &(out->buf[out->len]) : NULL, out->alloc - out->len, format, ap);
+		va_end(ap);
+		if(n < 0)
+		{
+			out->failed = 1;
+			return;
+		}
+		if((size_t) n < out->alloc - out->len)
+		{
+			out->len += n;
+			return;
+		}
+		needed = ((out->len + n + 1) / 4096 + 1) * 4096;
+		p = (char *) sql_realloc_(out->buf, needed);
+		if(!p)
+		{
+			out->failed = 1;
+			return;
+		}
+		out->buf = p;
+		out->alloc = needed;
+	}
+}
+
+static int
+sql_stats_write_(const SQL_EXPORT_SINK *restrict sink, const char *restrict data, size_t len)
+{
+	ssize_t n;
+
+	if(sink->write)
+	{
+		return (sink->write(sink->userdata, data, len) ? -1 : 0);
+	}
+	while(len)
+	{
+		n = write(sink->fd, data, len);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
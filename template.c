@@ -0,0 +1,458 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+/* Statement templates are printf-style format strings, as accepted by
+ * sql_queryf() and sql_executef(), which are compiled into a statement
+ * using the engine's native placeholder syntax so that they can be
+ * prepared once and executed many times with different parameters.
+ *
+ * The following conversions are turned into bound parameters:
+ *
+ *   %d %i %u    integers, with optional h, l, ll, z or t modifiers
+ *   %f %e %g    floating-point values, with an optional L modifier
+ *   %Q          a string, which will be NULL if the argument is NULL
+ *   '%q'        a string, only when it forms the whole of a quoted literal
+ *
+ * %% is a literal percent sign. Any other conversion (including %s, which
+ * interpolates raw SQL text), any flags, width or precision, or any
+ * conversion within a quoted string or identifier, a comment or (for
+ * PostgreSQL) a dollar-quoted string, cannot be expressed as a bound
+ * parameter and causes compilation to fail.
+ */
+
+static const char *sql_template_quoted_(SQL_VARIANT variant, const char *restrict format, const char *restrict p);
+static int sql_template_literal_(SQL_TEMPLATE *restrict tmpl, size_t *restrict len, size_t *restrict alloc, const char *restrict start, const char *restrict end);
+static int sql_template_append_(SQL_TEMPLATE *restrict tmpl, size_t *restrict len, size_t *restrict alloc, const char *restrict str, size_t slen);
+static int sql_template_arg_(SQL_TEMPLATE *tmpl, SQL_ARG_TYPE type);
+
+/* Compile a format string into a template; returns NULL with errno set to
+ * ENOTSUP if the format string cannot be expressed using bound parameters
+ */
+SQL_TEMPLATE *
+sql_template_create_(SQL *restrict sql, const char *restrict format)
+{
+	SQL_TEMPLATE *tmpl;
+	SQL_VARIANT variant;
+	SQL_ARG_TYPE type;
+	const char *p, *s;
+	size_t len, alloc;
+	char pbuf[16];
+	int modifier, r;
+
+	variant = sql->api->variant(sql);
+	tmpl = (SQL_TEMPLATE *) sql_calloc_(1, sizeof(SQL_TEMPLATE));
+	if(!tmpl)
+	{
+		return NULL;
+	}
+	len = 0;
+	alloc = 0;
+	for(p = format; *p; p++)
+	{
+		if(!strncmp(p, "'%q'", 4) && p[4] != '\'')
+		{
+			/* %q can only become a parameter if it is the entire contents
+			 * of a quoted string literal, in which case the quotes are
+			 * consumed along with it
+			 */
+			p += 3;
+			type = SQL_ARG_STRING;
+		}
+		else if((s = sql_template_quoted_(variant, format, p)))
+		{
+			r = sql_template_literal_(tmpl, &len, &alloc, p, s);
+			if(r > 0)
+			{
+				errno = ENOTSUP;
+				sql_template_destroy_(tmpl);
+				return NULL;
+			}
+			if(r)
+			{
+				break;
+			}
+			p = s - 1;
+			continue;
+		}
+		else if(*p != '%')
+		{
+			s = p + 1 + strcspn(p + 1, "%'\"`-/$");
+			if(sql_template_append_(tmpl, &len, &alloc, p, s - p))
+			{
+				break;
+			}
+			p = s - 1;
+			continue;
+		}
+		else if(p[1] == '%')
+		{
+			p++;
+			if(sql_template_append_(tmpl, &len, &alloc, p, 1))
+			{
+				break;
+			}
+			continue;
+		}
+		else
+		{
+			p++;
+			modifier = 0;
+			switch(*p)
+			{
+			case 'h':
+			case 'z':
+			case 't':
+			case 'L':
+				modifier = *p;
+				p++;
+				break;
+			case 'l':
+				modifier = 'l';
+				p++;
+				if(*p == 'l')
+				{
+					modifier = 'q';
+					p++;
+				}
+				break;
+			}
+			switch(*p)
+			{
+			case 'd':
+			case 'i':
+			case 'u':
+				switch(modifier)
+				{
+				case 0:
+					type = (*p == 'u' ? SQL_ARG_UINT : SQL_ARG_INT);
+					break;
+				case 'h':
+					type = (*p == 'u' ? SQL_ARG_USHORT : SQL_ARG_SHORT);
+					break;
+				case 'l':
+					type = (*p == 'u' ? SQL_ARG_ULONG : SQL_ARG_LONG);
+					break;
+				case 'q':
+					type = (*p == 'u' ? SQL_ARG_ULLONG : SQL_ARG_LLONG);
+					break;
+				case 'z':
+					type = SQL_ARG_SIZE;
+					break;
+				case 't':
+					type = SQL_ARG_PTRDIFF;
+					break;
+				default:
+					errno = ENOTSUP;
+					sql_template_destroy_(tmpl);
+					return NULL;
+				}
+				break;
+			case 'f':
+			case 'e':
+			case 'g':
+			case 'E':
+			case 'G':
+				if(modifier && modifier != 'l' && modifier != 'L')
+				{
+					errno = ENOTSUP;
+					sql_template_destroy_(tmpl);
+					return NULL;
+				}
+				type = (modifier == 'L' ? SQL_ARG_LDOUBLE : SQL_ARG_DOUBLE);
+				break;
+			case 'Q':
+				if(modifier)
+				{
+					errno = ENOTSUP;
+					sql_template_destroy_(tmpl);
+					return NULL;
+				}
+				type = SQL_ARG_STRING;
+				break;
+			default:
+				/* Including %q other than as the whole of a literal */
+				errno = ENOTSUP;
+				sql_template_destroy_(tmpl);
+				return NULL;
+			}
+		}
+		if(sql_template_arg_(tmpl, type))
+		{
+			break;
+		}
+		if(variant == SQL_VARIANT_POSTGRES)
+		{
+			snprintf(pbuf, sizeof(pbuf), "$%u", tmpl->nparams);
+		}
+		else
+		{
+			strcpy(pbuf, "?");
+		}
+		if(sql_template_append_(tmpl, &len, &alloc, pbuf, strlen(pbuf)))
+		{
+			break;
+		}
+	}
+	if(*p || sql_template_append_(tmpl, &len, &alloc, "", 0))
+	{
+		sql_template_destroy_(tmpl);
+		return NULL;
+	}
+	if(tmpl->nparams)
+	{
+		tmpl->params = (SQL_PARAM *) sql_calloc_(tmpl->nparams, sizeof(SQL_PARAM));
+		if(!tmpl->params)
+		{
+			sql_template_destroy_(tmpl);
+			return NULL;
+		}
+	}
+	return tmpl;
+}
+
+/* Free the resources used by a template */
+void
+sql_template_destroy_(SQL_TEMPLATE *tmpl)
+{
+	if(!tmpl)
+	{
+		return;
+	}
+	sql_free_(tmpl->native);
+	sql_free_(tmpl->args);
+	sql_free_(tmpl->params);
+	sql_free_(tmpl);
+}
+
+/* Populate tmpl->params from a list of arguments matching the original
+ * format string
+ */
+int
+sql_template_bind_(SQL_TEMPLATE *tmpl, va_list ap)
+{
+	SQL_PARAM *param;
+	unsigned int c;
+
+	for(c = 0; c < tmpl->nparams; c++)
+	{
+		param = &(tmpl->params[c]);
+		switch(tmpl->args[c])
+		{
+		case SQL_ARG_INT:
+			param->type = SQL_PARAM_INT;
+			param->ival = va_arg(ap, int);
+			break;
+		case SQL_ARG_UINT:
+			param->type = SQL_PARAM_UINT;
+			param->uval = va_arg(ap, unsigned int);
+			break;
+		case SQL_ARG_SHORT:
+			param->type = SQL_PARAM_INT;
+			param->ival = (short) va_arg(ap, int);
+			break;
+		case SQL_ARG_USHORT:
+			param->type = SQL_PARAM_UINT;
+			param->uval = (unsigned short) va_arg(ap, int);
+			break;
+		case SQL_ARG_LONG:
+			param->type = SQL_PARAM_INT;
+			param->ival = va_arg(ap, long);
+			break;
+		case SQL_ARG_ULONG:
+			param->type = SQL_PARAM_UINT;
+			param->uval = va_arg(ap, unsigned long);
+			break;
+		case SQL_ARG_LLONG:
+			param->type = SQL_PARAM_INT;
+			param->ival = va_arg(ap, long long);
+			break;
+		case SQL_ARG_ULLONG:
+			param->type = SQL_PARAM_UINT;
+			param->uval = va_arg(ap, unsigned long long);
+			break;
+		case SQL_ARG_SIZE:
+			param->type = SQL_PARAM_UINT;
+			param->uval = va_arg(ap, size_t);
+			break;
+		case SQL_ARG_PTRDIFF:
+			param->type = SQL_PARAM_INT;
+			param->ival = va_arg(ap, ptrdiff_t);
+			break;
+		case SQL_ARG_DOUBLE:
+			param->type = SQL_PARAM_DOUBLE;
+			param->dval = va_arg(ap, double);
+			break;
+		case SQL_ARG_LDOUBLE:
+			param->type = SQL_PARAM_DOUBLE;
+			param->dval = (double) va_arg(ap, long double);
+			break;
+		case SQL_ARG_STRING:
+			param->sval = va_arg(ap, const char *);
+			if(param->sval)
+			{
+				param->type = SQL_PARAM_TEXT;
+				param->slen = strlen(param->sval);
+			}
+			else
+			{
+				param->type = SQL_PARAM_NULL;
+				param->slen = 0;
+			}
+			break;
+		}
+	}
+	return 0;
+}
+
+/* If p is the start of a quoted string or identifier, a comment or (for
+ * PostgreSQL) a dollar-quoted string, return a pointer to the character
+ * following its end; otherwise, return NULL
+ */
+static const char *
+sql_template_quoted_(SQL_VARIANT variant, const char *restrict format, const char *restrict p)
+{
+	const char *tag;
+	size_t taglen;
+	char quote;
+
+	switch(*p)
+	{
+	case '\'':
+	case '"':
+	case '`':
+		/* Doubled quotes are handled as two adjacent literals */
+		quote = *p;
+		for(p++; *p && *p != quote; p++)
+		{
+			if(*p == '\\' && quote != '`' && variant == SQL_VARIANT_MYSQL && p[1])
+			{
+				p++;
+			}
+		}
+		return (*p ? p + 1 : p);
+	case '-':
+		if(p[1] != '-')
+		{
+			return NULL;
+		}
+		return p + strcspn(p, "\n");
+	case '/':
+		if(p[1] != '*')
+		{
+			return NULL;
+		}
+		tag = strstr(p + 2, "*/");
+		return (tag ? tag + 2 : strchr(p, 0));
+	case '$':
+		if(variant != SQL_VARIANT_POSTGRES ||
+		   (p > format && (isalnum((unsigned char) p[-1]) || p[-1] == '_')))
+		{
+			return NULL;
+		}
+		tag = p;
+		for(p++; isalpha((unsigned char) *p) || *p == '_'; p++)
+		{
+		}
+		if(*p != '$')
+		{
+			return NULL;
+		}
+		taglen = p - tag + 1;
+		for(p++; *p && strncmp(p, tag, taglen); p++)
+		{
+		}
+		return (*p ? p + taglen : p);
+	}
+	return NULL;
+}
+
+/* Append the text of a literal or comment, in which %% is the only
+ * conversion permitted; returns 1 if it contains any other
+ */
+static int
+sql_template_literal_(SQL_TEMPLATE *restrict tmpl, size_t *restrict len, size_t *restrict alloc, const char *restrict start, const char *restrict end)
+{
+	const char *p;
+
+	for(p = start; p < end; p++)
+	{
+		if(*p != '%')
+		{
+			continue;
+		}
+		if(p + 1 >= end || p[1] != '%')
+		{
+			return 1;
+		}
+		/* Append up to and including the first %, skipping the second */
+		if(sql_template_append_(tmpl, len, alloc, start, p + 1 - start))
+		{
+			return -1;
+		}
+		p++;
+		start = p + 1;
+	}
+	return sql_template_append_(tmpl, len, alloc, start, end - start);
+}
+
+static int
+sql_template_append_(SQL_TEMPLATE *restrict tmpl, size_t *restrict len, size_t *restrict alloc, const char *restrict str, size_t slen)
+{
+	char *p;
+	size_t needed;
+
+	needed = *len + slen + 1;
+	if(needed > *alloc)
+	{
+		needed = ((needed / 128) + 1) * 128;
+		p = (char *) sql_realloc_(tmpl->native, needed);
+		if(!p)
+		{
+			return -1;
+		}
+		tmpl->native = p;
+		*alloc = needed;
+	}
+	memcpy(&(tmpl->native[*len]), str, slen);
+	*len += slen;
+	tmpl->native[*len] = 0;
+	return 0;
+}
+
+static int
+sql_template_arg_(SQL_TEMPLATE *tmpl, SQL_ARG_TYPE type)
+{
+	SQL_ARG_TYPE *p;
+
+	p = (SQL_ARG_TYPE *) sql_realloc_(tmpl->args, sizeof(SQL_ARG_TYPE) * (tmpl->nparams + 1));
+	if(!p)
+	{
+		return -1;
+	}
+	tmpl->args = p;
+	tmpl->args[tmpl->nparams] = type;
+	tmpl->nparams++;
+	return 0;
+}
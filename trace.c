@@ -0,0 +1,191 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC.
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libsql.h"
+
+/* Query and transaction operations are bracketed by sql_trace_start_() and
+ * sql_trace_finish_(), which record their timing in the connection's
+ * statistics and invoke any tracing callbacks. The rows and bytes received
+ * during an operation are taken from the differences in the connection's
+ * counters, which the engines maintain.
+ *
+ * Fetching the rows of a result-set with sql_stmt_next() is reported once,
+ * by sql_trace_fetched_(), when the last row has been fetched or the
+ * result-set is discarded, rather than for every row.
+ */
+
+/* Install or remove tracing callbacks */
+int
+sql_set_tracer(SQL *restrict sql, const SQL_TRACE *restrict tracer)
+{
+	if(tracer)
+	{
+		memcpy(&(sql->tracer), tracer, sizeof(SQL_TRACE));
+	}
+	else
+	{
+		memset(&(sql->tracer), 0, sizeof(SQL_TRACE));
+	}
+	return 0;
+}
+
+/* Begin an operation */
+void
+sql_trace_start_(SQL *restrict sql, SQL_TRACE_STATE *restrict state, SQL_STATS_OP op, const char *restrict query)
+{
+	SQL_TRACE_EVENT event;
+
+	state->op = op;
+	state->query = query;
+	state->rows = __atomic_load_n(&(sql->stats.rows), __ATOMIC_RELAXED);
+	state->bytes = __atomic_load_n(&(sql->stats.bytes), __ATOMIC_RELAXED);
+	state->fingerprint = 0;
+	state->literal = 0;
+	/* Tracing, fingerprinting and auto-explain need the duration of the
+	 * operation even if the statistics don't
+	 */
+	if(sql->tracer.start || sql->tracer.finish || sql->autoexplain.fn || sql_fingerprint_enabled_())
+	{
+		state->start = sql_stats_now_();
+	}
+	else
+	{
+		state->start = sql_stats_timer_();
+	}
+	if(sql->tracer.start)
+	{
+		memset(&event, 0, sizeof(event));
+		event.op = op;
+		event.query = query;
+		event.start = state->start;
+		sql->tracer.start(sql, &event, sql->tracer.userdata);
+		/* Don't include the time taken by the callback */
+		state->start = sql_stats_now_();
+	}
+}
+
+/* Complete an operation; status is zero if it succeeded, in which case
+ * affected is the number of rows it affected, if known. The caller sets
+ * state->literal if the query can be explained as it stands. If it has
+ * set state->fingerprint (from a statement which has been executed
+ * before), it is used in place of fingerprinting the query afresh; either
+ * way, it is available to the caller afterwards.
+ */
+void
+sql_trace_finish_(SQL *restrict sql, SQL_TRACE_STATE *restrict state, int status, unsigned long long affected)
+{
+	SQL_TRACE_EVENT event;
+	unsigned long long nsec, rows;
+
+	nsec = sql_stats_op_(sql, state->op, state->start);
+	state->end = (state->start ? state->start + nsec : 0);
+	rows = __atomic_load_n(&(sql->stats.rows), __ATOMIC_RELAXED) - state->rows;
+	if(sql_fingerprint_enabled_())
+	{
+		if(!state->fingerprint && state->op == SQL_STATS_QUERY && state->query)
+		{
+			state->fingerprint = sql_fingerprint(state->query, NULL, 0);
+		}
+		if(state->fingerprint)
+		{
+			sql_fingerprint_record_(state->fingerprint, state->query, state->op, nsec, rows, status);
+		}
+	}
+	if(sql->autoexplain.fn && state->literal && !status)
+	{
+		sql_explain_auto_(sql, state->query, nsec);
+	}
+	if(!sql->tracer.finish || nsec < sql->tracer.threshold)
+	{
+		return;
+	}
+	memset(&event, 0, sizeof(event));
+	event.op = state->op;
+	event.query = state->query;
+	event.start = state->start;
+	event.nsec = nsec;
+	event.rows = rows;
+	event.bytes = __atomic_load_n(&(sql->stats.bytes), __ATOMIC_RELAXED) - state->bytes;
+	event.status = status;
+	if(status)
+	{
+		event.sqlstate = sql->api->sqlstate(sql);
+	}
+	else
+	{
+		event.affected = affected;
+	}
+	sql->tracer.finish(sql, &event, sql->tracer.userdata);
+}
+
+/* Begin tracking the fetching of rows from a result-set which has just
+ * been produced by a traced query
+ */
+void
+sql_trace_results_(SQL_TRACE_STATE *restrict state, SQL_STATEMENT *restrict stmt)
+{
+	stmt->fingerprint = state->fingerprint;
+	stmt->fetching = !stmt->api->eof(stmt);
+	stmt->fetched = stmt->fetching;
+	stmt->fetch_start = state->end;
+}
+
+/* Report the fetching of rows from a result-set, if it hasn't been
+ * already; the duration runs from the end of the query until now, and so
+ * includes the time spent by the application processing the rows
+ */
+void
+sql_trace_fetched_(SQL_STATEMENT *stmt, int status)
+{
+	SQL_TRACE_EVENT event;
+	SQL *sql;
+	unsigned long long nsec;
+
+	if(!stmt->fetching)
+	{
+		return;
+	}
+	stmt->fetching = 0;
+	sql = stmt->api->connection(stmt);
+	nsec = sql_stats_op_(sql, SQL_STATS_FETCH, stmt->fetch_start);
+	if(stmt->fingerprint && sql_fingerprint_enabled_())
+	{
+		sql_fingerprint_record_(stmt->fingerprint, stmt->api->statement(stmt), SQL_STATS_FETCH, nsec, stmt->fetched, status);
+	}
+	if(!sql->tracer.finish || nsec < sql->tracer.threshold)
+	{
+		return;
+	}
+	memset(&event, 0, sizeof(event));
+	event.op = SQL_STATS_FETCH;
+	event.query = stmt->api->statement(stmt);
+	event.start = stmt->fetch_start;
+	event.nsec = nsec;
+	event.rows = stmt->fetched;
+	event.status = status;
+	if(status)
+	{
+		event.sqlstate = sql->api->sqlstate(sql);
+	}
+	sql->tracer.finish(sql, &event, sql->tracer.userdata);
+}